@@ -2,6 +2,73 @@
 
 namespace ovum::vm::jit {
 
+std::optional<size_t> GetOilCommandArgumentCount(std::string_view command_name) {
+  if (command_name == "LoadLocal" || command_name == "SetLocal" || command_name == "LoadStatic" ||
+      command_name == "SetStatic" || command_name == "GetField" || command_name == "SetField") {
+    // 1 arg commands (size_t)
+    return 1;
+  } else if (command_name == "PushInt" || command_name == "PushFloat" || command_name == "PushBool" ||
+             command_name == "PushChar" || command_name == "PushByte" || command_name == "Rotate") {
+    // 1 arg (int64_t, double, bool, char, byte)
+    return 1;
+  } else if (command_name == "PushString") {
+    // 1 arg (string)
+    return 1;
+  } else if (command_name == "Call" || command_name == "CallVirtual" || command_name == "CallConstructor" ||
+             command_name == "GetVTable" || command_name == "SetVTable" || command_name == "SafeCall" ||
+             command_name == "IsType" || command_name == "SizeOf") {
+    // 1 arg (void*)
+    return 1;
+  } else if (command_name == "PushNull" || command_name == "Pop" || command_name == "Dup" || command_name == "Swap" ||
+             command_name == "IntAdd" || command_name == "IntSubtract" || command_name == "IntMultiply" ||
+             command_name == "IntDivide" || command_name == "IntModulo" || command_name == "IntNegate" ||
+             command_name == "IntIncrement" || command_name == "IntDecrement" || command_name == "FloatAdd" ||
+             command_name == "FloatSubtract" || command_name == "FloatMultiply" || command_name == "FloatDivide" ||
+             command_name == "FloatNegate" || command_name == "FloatSqrt" || command_name == "ByteAdd" ||
+             command_name == "ByteSubtract" || command_name == "ByteMultiply" || command_name == "ByteDivide" ||
+             command_name == "ByteModulo" || command_name == "ByteNegate" || command_name == "ByteIncrement" ||
+             command_name == "ByteDecrement" || command_name == "IntEqual" || command_name == "IntNotEqual" ||
+             command_name == "IntLessThan" || command_name == "IntLessEqual" || command_name == "IntGreaterThan" ||
+             command_name == "IntGreaterEqual" || command_name == "FloatEqual" || command_name == "FloatNotEqual" ||
+             command_name == "FloatLessThan" || command_name == "FloatLessEqual" ||
+             command_name == "FloatGreaterThan" || command_name == "FloatGreaterEqual" || command_name == "ByteEqual" ||
+             command_name == "ByteNotEqual" || command_name == "ByteLessThan" || command_name == "ByteLessEqual" ||
+             command_name == "ByteGreaterThan" || command_name == "ByteGreaterEqual" || command_name == "BoolAnd" ||
+             command_name == "BoolOr" || command_name == "BoolNot" || command_name == "BoolXor" ||
+             command_name == "IntAnd" || command_name == "IntOr" || command_name == "IntXor" ||
+             command_name == "IntNot" || command_name == "IntLeftShift" || command_name == "IntRightShift" ||
+             command_name == "ByteAnd" || command_name == "ByteOr" || command_name == "ByteXor" ||
+             command_name == "ByteNot" || command_name == "ByteLeftShift" || command_name == "ByteRightShift" ||
+             command_name == "StringConcat" || command_name == "StringLength" || command_name == "StringSubstring" ||
+             command_name == "StringCompare" || command_name == "StringToInt" || command_name == "StringToFloat" ||
+             command_name == "IntToString" || command_name == "FloatToString" || command_name == "IntToFloat" ||
+             command_name == "FloatToInt" || command_name == "ByteToInt" || command_name == "CharToByte" ||
+             command_name == "ByteToChar" || command_name == "BoolToByte" || command_name == "CallIndirect" ||
+             command_name == "Return" || command_name == "Break" || command_name == "Continue" ||
+             command_name == "Unwrap" || command_name == "NullCoalesce" || command_name == "IsNull" ||
+             command_name == "Print" || command_name == "PrintLine" || command_name == "ReadLine" ||
+             command_name == "ReadChar" || command_name == "ReadInt" || command_name == "ReadFloat" ||
+             command_name == "UnixTime" || command_name == "UnixTimeMs" || command_name == "UnixTimeNs" ||
+             command_name == "NanoTime" || command_name == "FormatDateTime" || command_name == "ParseDateTime" ||
+             command_name == "FileExists" || command_name == "DirectoryExists" || command_name == "CreateDir" ||
+             command_name == "DeleteFileByName" || command_name == "DeleteDir" || command_name == "MoveFileByName" ||
+             command_name == "CopyFileByName" || command_name == "ListDir" || command_name == "GetCurrentDir" ||
+             command_name == "ChangeDir" || command_name == "SleepMs" || command_name == "SleepNs" ||
+             command_name == "Exit" || command_name == "GetProcessId" || command_name == "GetEnvironmentVar" ||
+             command_name == "SetEnvironmentVar" || command_name == "Random" || command_name == "RandomRange" ||
+             command_name == "RandomFloat" || command_name == "RandomFloatRange" || command_name == "SeedRandom" ||
+             command_name == "GetMemoryUsage" || command_name == "GetPeakMemoryUsage" ||
+             command_name == "ForceGarbageCollection" || command_name == "GetProcessorCount" ||
+             command_name == "GetOsName" || command_name == "GetOsVersion" || command_name == "GetArchitecture" ||
+             command_name == "GetUsername" || command_name == "GetHomeDir" || command_name == "TypeOf" ||
+             command_name == "Interop") {
+    // 0 arg commands
+    return 0;
+  }
+
+  return std::nullopt;
+}
+
 std::expected<std::string, std::runtime_error> ExtractArgument(std::vector<TokenPtr>& oil_body, size_t& pos) {
   if (!oil_body[pos]->GetStringType().contains("LITERAL")) {
     std::string what = "ExtractArgument: Argument not found! Found: ";
@@ -18,7 +85,7 @@ std::expected<std::string, std::runtime_error> ExtractArgument(std::vector<Token
 
 std::expected<PackedOilCommand, std::runtime_error> ExtractOilCommand(std::vector<TokenPtr>& oil_body, size_t& pos) {
   PackedOilCommand result;
-  while (oil_body[pos]->GetStringType() != "IDENT" && oil_body.size() > pos) {
+  while (oil_body.size() > pos && oil_body[pos]->GetStringType() != "IDENT") {
     ++pos;
   }
 
@@ -29,107 +96,21 @@ std::expected<PackedOilCommand, std::runtime_error> ExtractOilCommand(std::vecto
   result.command_name = oil_body[pos]->GetLexeme();
   ++pos;
 
-  if (result.command_name == "LoadLocal" || result.command_name == "SetLocal" || result.command_name == "LoadStatic" ||
-      result.command_name == "SetStatic" || result.command_name == "GetField" || result.command_name == "SetField") {
-    // 1 arg commands (size_t)
-    auto arg1 = ExtractArgument(oil_body, pos);
-    if (!arg1) {
-      return std::unexpected(arg1.error());
-    }
-    result.arguments.push_back(arg1.value());
-
-  } else if (result.command_name == "PushInt" || result.command_name == "PushFloat" ||
-             result.command_name == "PushBool" || result.command_name == "PushChar" ||
-             result.command_name == "PushByte" || result.command_name == "Rotate") {
-    // 1 arg (int64_t, double, bool, char, byte)
-    auto arg1 = ExtractArgument(oil_body, pos);
-    if (!arg1) {
-      return std::unexpected(arg1.error());
-    }
-    result.arguments.push_back(arg1.value());
+  auto argument_count = GetOilCommandArgumentCount(result.command_name);
+  if (!argument_count) {
+    return std::unexpected(std::runtime_error("Unknown command: " + result.command_name));
+  }
 
-  } else if (result.command_name == "PushString") {
-    // 1 arg (string)
-    auto arg1 = ExtractArgument(oil_body, pos);
-    if (!arg1) {
-      return std::unexpected(arg1.error());
+  for (size_t i = 0; i < argument_count.value(); ++i) {
+    if (oil_body.size() <= pos) {
+      return std::unexpected(std::runtime_error("ExtractOilCommand: EOF before argument of " + result.command_name));
     }
-    result.arguments.push_back(arg1.value());
 
-  } else if (result.command_name == "Call" || result.command_name == "CallVirtual" ||
-             result.command_name == "CallConstructor" || result.command_name == "GetVTable" ||
-             result.command_name == "SetVTable" || result.command_name == "SafeCall" ||
-             result.command_name == "IsType" || result.command_name == "SizeOf") {
-    // 1 arg (void*)
-    auto arg1 = ExtractArgument(oil_body, pos);
-    if (!arg1) {
-      return std::unexpected(arg1.error());
+    auto argument = ExtractArgument(oil_body, pos);
+    if (!argument) {
+      return std::unexpected(argument.error());
     }
-    result.arguments.push_back(arg1.value());
-
-  } else if (result.command_name == "PushNull" || result.command_name == "Pop" || result.command_name == "Dup" ||
-             result.command_name == "Swap" || result.command_name == "IntAdd" || result.command_name == "IntSubtract" ||
-             result.command_name == "IntMultiply" || result.command_name == "IntDivide" ||
-             result.command_name == "IntModulo" || result.command_name == "IntNegate" ||
-             result.command_name == "IntIncrement" || result.command_name == "IntDecrement" ||
-             result.command_name == "FloatAdd" || result.command_name == "FloatSubtract" ||
-             result.command_name == "FloatMultiply" || result.command_name == "FloatDivide" ||
-             result.command_name == "FloatNegate" || result.command_name == "FloatSqrt" ||
-             result.command_name == "ByteAdd" || result.command_name == "ByteSubtract" ||
-             result.command_name == "ByteMultiply" || result.command_name == "ByteDivide" ||
-             result.command_name == "ByteModulo" || result.command_name == "ByteNegate" ||
-             result.command_name == "ByteIncrement" || result.command_name == "ByteDecrement" ||
-             result.command_name == "IntEqual" || result.command_name == "IntNotEqual" ||
-             result.command_name == "IntLessThan" || result.command_name == "IntLessEqual" ||
-             result.command_name == "IntGreaterThan" || result.command_name == "IntGreaterEqual" ||
-             result.command_name == "FloatEqual" || result.command_name == "FloatNotEqual" ||
-             result.command_name == "FloatLessThan" || result.command_name == "FloatLessEqual" ||
-             result.command_name == "FloatGreaterThan" || result.command_name == "FloatGreaterEqual" ||
-             result.command_name == "ByteEqual" || result.command_name == "ByteNotEqual" ||
-             result.command_name == "ByteLessThan" || result.command_name == "ByteLessEqual" ||
-             result.command_name == "ByteGreaterThan" || result.command_name == "ByteGreaterEqual" ||
-             result.command_name == "BoolAnd" || result.command_name == "BoolOr" || result.command_name == "BoolNot" ||
-             result.command_name == "BoolXor" || result.command_name == "IntAnd" || result.command_name == "IntOr" ||
-             result.command_name == "IntXor" || result.command_name == "IntNot" ||
-             result.command_name == "IntLeftShift" || result.command_name == "IntRightShift" ||
-             result.command_name == "ByteAnd" || result.command_name == "ByteOr" || result.command_name == "ByteXor" ||
-             result.command_name == "ByteNot" || result.command_name == "ByteLeftShift" ||
-             result.command_name == "ByteRightShift" || result.command_name == "StringConcat" ||
-             result.command_name == "StringLength" || result.command_name == "StringSubstring" ||
-             result.command_name == "StringCompare" || result.command_name == "StringToInt" ||
-             result.command_name == "StringToFloat" || result.command_name == "IntToString" ||
-             result.command_name == "FloatToString" || result.command_name == "IntToFloat" ||
-             result.command_name == "FloatToInt" || result.command_name == "ByteToInt" ||
-             result.command_name == "CharToByte" || result.command_name == "ByteToChar" ||
-             result.command_name == "BoolToByte" || result.command_name == "CallIndirect" ||
-             result.command_name == "Return" || result.command_name == "Break" || result.command_name == "Continue" ||
-             result.command_name == "Unwrap" || result.command_name == "NullCoalesce" ||
-             result.command_name == "IsNull" || result.command_name == "Print" || result.command_name == "PrintLine" ||
-             result.command_name == "ReadLine" || result.command_name == "ReadChar" ||
-             result.command_name == "ReadInt" || result.command_name == "ReadFloat" ||
-             result.command_name == "UnixTime" || result.command_name == "UnixTimeMs" ||
-             result.command_name == "UnixTimeNs" || result.command_name == "NanoTime" ||
-             result.command_name == "FormatDateTime" || result.command_name == "ParseDateTime" ||
-             result.command_name == "FileExists" || result.command_name == "DirectoryExists" ||
-             result.command_name == "CreateDir" || result.command_name == "DeleteFileByName" ||
-             result.command_name == "DeleteDir" || result.command_name == "MoveFileByName" ||
-             result.command_name == "CopyFileByName" || result.command_name == "ListDir" ||
-             result.command_name == "GetCurrentDir" || result.command_name == "ChangeDir" ||
-             result.command_name == "SleepMs" || result.command_name == "SleepNs" || result.command_name == "Exit" ||
-             result.command_name == "GetProcessId" || result.command_name == "GetEnvironmentVar" ||
-             result.command_name == "SetEnvironmentVar" || result.command_name == "Random" ||
-             result.command_name == "RandomRange" || result.command_name == "RandomFloat" ||
-             result.command_name == "RandomFloatRange" || result.command_name == "SeedRandom" ||
-             result.command_name == "GetMemoryUsage" || result.command_name == "GetPeakMemoryUsage" ||
-             result.command_name == "ForceGarbageCollection" || result.command_name == "GetProcessorCount" ||
-             result.command_name == "GetOsName" || result.command_name == "GetOsVersion" ||
-             result.command_name == "GetArchitecture" || result.command_name == "GetUsername" ||
-             result.command_name == "GetHomeDir" || result.command_name == "TypeOf" ||
-             result.command_name == "Interop") {
-    // 0 arg commands
-
-  } else {
-    return std::unexpected(std::runtime_error("Unknown command: " + result.command_name));
+    result.arguments.push_back(argument.value());
   }
 
   return result;
@@ -151,10 +132,15 @@ std::expected<std::vector<PackedOilCommand>, std::runtime_error> PackOilCommands
 
   while (pos < oil_body.size()) {
     auto res = ExtractOilCommand(oil_body, pos);
-    if (!res && res.error().what() != std::string("EOF before any command")) {
+    if (!res) {
+      // Tokens after the last command are skipped
+      if (pos >= oil_body.size() && res.error().what() == std::string("ExtractOilCommand: EOF before any command")) {
+        break;
+      }
       return std::unexpected(res.error());
     }
     packed_commands.push_back(res.value());
+    packed_commands.back().source_index = packed_commands.size() - 1;
   }
 
   return packed_commands;
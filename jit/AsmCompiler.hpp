@@ -2,8 +2,10 @@
 #define JIT_ASMCOMPILER_HPP
 
 #include <expected>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <tokens/Token.hpp>
@@ -14,8 +16,13 @@ namespace ovum::vm::jit {
 struct PackedOilCommand {
   std::string command_name;
   std::vector<std::string> arguments;
+  // Position in the packed body of the function the command was read from, 0 for commands made by optimisers
+  size_t source_index = 0;
 };
 
+// Number of arguments following the command in OIL, std::nullopt for unknown commands
+std::optional<size_t> GetOilCommandArgumentCount(std::string_view command_name);
+
 std::expected<std::vector<PackedOilCommand>, std::runtime_error> PackOilCommands(std::vector<TokenPtr>& oil_body);
 
 } // namespace ovum::vm::jit
@@ -36,6 +36,10 @@ enum class AsmCommand : uint16_t {
   XOR,
   NOT,
   TEST,
+  POPCNT, // Count set bits (POPCNT)
+  LZCNT,  // Count leading zero bits (ABM/LZCNT)
+  TZCNT,  // Count trailing zero bits (BMI1)
+  BSR,    // Bit scan reverse, ZF=1 and undefined destination for zero source
 
   SHL = 0x400,
   SHR,
@@ -44,6 +48,9 @@ enum class AsmCommand : uint16_t {
   ROR,
   RCL,
   RCR,
+  SHLX, // BMI2 shifts: dst, src, count in any register, flags are not changed
+  SARX,
+  SHRX,
 
   JMP = 0x500,
   CALL,
@@ -86,6 +93,8 @@ enum class AsmCommand : uint16_t {
   MULSD,         // Multiply Scalar Double-Precision Floating-Point
   DIVSD,         // Divide Scalar Double-Precision Floating-Point
   SQRTSD,        // Square Root Scalar Double-Precision Floating-Point
+  MINSD,         // Return Minimum Scalar Double-Precision Floating-Point
+  MAXSD,         // Return Maximum Scalar Double-Precision Floating-Point
   COMISD,        // Compare Scalar Ordered Double-Precision Floating-Point
   UCOMISD,       // Unordered Compare Scalar Double-Precision Floating-Point
   CVTSI2SD,      // Convert Dword Integer to Scalar Double-Precision FP
@@ -104,6 +113,21 @@ enum class AsmCommand : uint16_t {
   ORPD,   // Bitwise Logical OR of Packed Double-Precision Floating-Point
   XORPD,  // Bitwise Logical XOR of Packed Double-Precision Floating-Point
 
+  // SSE4.1 Instructions
+  ROUNDSD, // Round Scalar Double-Precision Floating-Point, imm8 selects rounding mode
+
+  // AVX (VEX.128) three-operand forms: dst, src1, src2, upper half of dst is taken from src1
+  VADDSD,
+  VSUBSD,
+  VMULSD,
+  VDIVSD,
+  VMINSD,
+  VMAXSD,
+  VSQRTSD,
+  VANDPD,
+  VXORPD,
+  VROUNDSD, // dst, src1, src2, imm8
+
   // Stack operations
   PUSH = 0x700,
   POP,
@@ -444,6 +468,12 @@ constexpr MemoryAddress indexed_addr(Register base, Register index, uint8_t scal
   return create_memory_addr(base, index, scale, disp);
 }
 
+// RIP-relative operand of an absolute target, the displacement is fixed up when the code is placed.
+// Only valid in instructions without an immediate after the operand.
+inline MemoryAddress rip_addr(const void* target) noexcept {
+  return create_memory_addr(std::nullopt, std::nullopt, 1, reinterpret_cast<int64_t>(target));
+}
+
 class AssemblyInstructionBuilder {
 private:
   AssemblyInstruction instr;
@@ -0,0 +1,133 @@
+#include "CopyAndPatchCompiler.hpp"
+
+#include <cstring>
+#include <string>
+
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/oil-to-asm-realisation/AsmToBytes.hpp>
+#include <jit/oil-to-asm-realisation/DeoptExits.hpp>
+
+namespace ovum::vm::jit {
+
+// Immediate used while encoding a template, its bytes mark the hole
+static const int64_t kHoleSentinel = 0x0BADC0DE0BADC0DE;
+
+MachineCodeTemplate CopyAndPatchCompiler::s_prologue_template;
+MachineCodeTemplate CopyAndPatchCompiler::s_epilogue_template;
+std::unordered_map<std::string_view, MachineCodeTemplate> CopyAndPatchCompiler::s_command_templates;
+
+void CopyAndPatchCompiler::InitializeTemplates() {
+  // Templates of a previous initialization may be encoded for other target features
+  s_command_templates.clear();
+
+  auto prologue = EncodeTemplate("prologue", OilCommandAsmCompiler::GetPrologue());
+  auto epilogue = EncodeTemplate("epilogue", OilCommandAsmCompiler::GetEpilogue());
+  if (!prologue || !epilogue) {
+    // Without frame templates baseline tier is unavailable, all functions go to the optimizing tier
+    return;
+  }
+
+  s_prologue_template = std::move(prologue.value());
+  s_epilogue_template = std::move(epilogue.value());
+
+  for (const auto& [command_name, instructions] : OilCommandAsmCompiler::GetAllCommandAssemblers()) {
+    // Trapping commands are left to the optimizing tier, which turns their faults into deoptimization exits
+    if (IsTrappingCommand(std::string(command_name))) {
+      continue;
+    }
+
+    // Commands which cannot be encoded standalone are left to the optimizing tier
+    auto command_template = EncodeTemplate(command_name, instructions);
+    if (command_template) {
+      s_command_templates.emplace(command_name, std::move(command_template.value()));
+    }
+  }
+}
+
+std::expected<MachineCodeTemplate, std::runtime_error> CopyAndPatchCompiler::EncodeTemplate(
+    std::string_view command_name, const std::vector<AssemblyInstruction>& instructions) {
+  MachineCodeTemplate result;
+  AsmToBytes asmtobytes;
+
+  // Argument placers are encoded one by one to know where each immediate lands
+  const size_t argument_count = GetOilCommandArgumentCount(command_name).value_or(0);
+  const std::vector<std::string> sentinel_args(argument_count, std::to_string(kHoleSentinel));
+  auto arg_placer = CreateArgumentPlacer("", sentinel_args);
+  if (!arg_placer) {
+    return std::unexpected(arg_placer.error());
+  }
+
+  for (size_t i = 0; i < arg_placer->size(); ++i) {
+    auto placer_code = asmtobytes.Convert({arg_placer->at(i)});
+    if (!placer_code) {
+      return std::unexpected(placer_code.error());
+    }
+
+    if (placer_code->size() < sizeof(int64_t) ||
+        std::memcmp(placer_code->data() + placer_code->size() - sizeof(int64_t), &kHoleSentinel, sizeof(int64_t)) !=
+            0) {
+      return std::unexpected(std::runtime_error("EncodeTemplate: immediate is not 8 bytes wide for " +
+                                                std::string(command_name)));
+    }
+
+    result.code.insert(result.code.end(), placer_code->begin(), placer_code->end());
+    result.holes.push_back({result.code.size() - sizeof(int64_t), i});
+  }
+
+  auto body_code = asmtobytes.Convert(instructions);
+  if (!body_code) {
+    return std::unexpected(body_code.error());
+  }
+
+  result.code.insert(result.code.end(), body_code->begin(), body_code->end());
+  return result;
+}
+
+void CopyAndPatchCompiler::AppendTemplate(const MachineCodeTemplate& machine_code_template,
+                                          const std::vector<int64_t>& arguments,
+                                          code_vector& output) {
+  const size_t base = output.size();
+  output.insert(output.end(), machine_code_template.code.begin(), machine_code_template.code.end());
+
+  for (const auto& hole : machine_code_template.holes) {
+    std::memcpy(output.data() + base + hole.offset, &arguments[hole.argument_index], sizeof(int64_t));
+  }
+}
+
+std::expected<code_vector, std::runtime_error> CopyAndPatchCompiler::Compile(
+    const std::vector<PackedOilCommand>& packed_oil_body) {
+  if (s_command_templates.empty()) {
+    return std::unexpected(std::runtime_error("CopyAndPatchCompiler: templates are not initialized"));
+  }
+
+  code_vector result;
+  AppendTemplate(s_prologue_template, {}, result);
+
+  std::vector<int64_t> arguments;
+  for (const auto& poc : packed_oil_body) {
+    const auto it = s_command_templates.find(poc.command_name);
+    if (it == s_command_templates.end()) {
+      return std::unexpected(std::runtime_error("CopyAndPatchCompiler: no template for command " + poc.command_name));
+    }
+
+    if (poc.arguments.size() != it->second.holes.size()) {
+      return std::unexpected(std::runtime_error("CopyAndPatchCompiler: wrong argument count for " + poc.command_name));
+    }
+
+    arguments.clear();
+    for (const auto& argument : poc.arguments) {
+      auto value = ParseImmediateArgument(poc.command_name, argument);
+      if (!value) {
+        return std::unexpected(value.error());
+      }
+      arguments.push_back(value.value());
+    }
+
+    AppendTemplate(it->second, arguments, result);
+  }
+
+  AppendTemplate(s_epilogue_template, {}, result);
+  return result;
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,65 @@
+#ifndef JIT_COPYANDPATCHCOMPILER_HPP
+#define JIT_COPYANDPATCHCOMPILER_HPP
+
+#include <cstdint>
+#include <expected>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+#include <jit/machine-code-runner/ExecutableMemory.hpp>
+#include "AsmData.hpp"
+
+namespace ovum::vm::jit {
+
+// Place in a template where an 8-byte immediate argument of the command is patched in
+struct TemplateHole {
+  size_t offset;
+  size_t argument_index;
+};
+
+// Machine code of a single OIL command, encoded once on startup
+struct MachineCodeTemplate {
+  code_vector code;
+  std::vector<TemplateHole> holes;
+};
+
+// Baseline compiler: copies pre-encoded command templates and patches immediates into them,
+// without running the assembler per function
+class CopyAndPatchCompiler {
+public:
+  CopyAndPatchCompiler() = delete;
+  CopyAndPatchCompiler(const CopyAndPatchCompiler&) = delete;
+  CopyAndPatchCompiler(CopyAndPatchCompiler&&) = delete;
+  ~CopyAndPatchCompiler() = delete;
+  CopyAndPatchCompiler& operator=(const CopyAndPatchCompiler&) = delete;
+  CopyAndPatchCompiler& operator=(CopyAndPatchCompiler&&) = delete;
+
+  // Encodes templates for all registered command assemblers, must be called after them
+  static void InitializeTemplates();
+
+  [[nodiscard]] static std::expected<code_vector, std::runtime_error> Compile(
+      const std::vector<PackedOilCommand>& packed_oil_body);
+
+  [[nodiscard]] static bool HasTemplateForCommand(std::string_view command_name) noexcept {
+    return s_command_templates.contains(command_name);
+  }
+
+private:
+  static std::expected<MachineCodeTemplate, std::runtime_error> EncodeTemplate(
+      std::string_view command_name, const std::vector<AssemblyInstruction>& instructions);
+
+  static void AppendTemplate(const MachineCodeTemplate& machine_code_template,
+                             const std::vector<int64_t>& arguments,
+                             code_vector& output);
+
+  static MachineCodeTemplate s_prologue_template;
+  static MachineCodeTemplate s_epilogue_template;
+  static std::unordered_map<std::string_view, MachineCodeTemplate> s_command_templates;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_COPYANDPATCHCOMPILER_HPP
@@ -0,0 +1,94 @@
+#include "CpuFeatures.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace ovum::vm::jit {
+
+// EAX, EBX, ECX, EDX of the given CPUID leaf, zeros if the leaf is not supported
+static std::array<uint32_t, 4> QueryCpuid(uint32_t leaf, uint32_t subleaf = 0) {
+  std::array<uint32_t, 4> registers = {0, 0, 0, 0};
+#ifdef _MSC_VER
+  std::array<int, 4> info = {0, 0, 0, 0};
+  __cpuid(info.data(), static_cast<int>(leaf & 0x80000000U));
+  if (static_cast<uint32_t>(info[0]) >= leaf) {
+    __cpuidex(info.data(), static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (size_t i = 0; i < info.size(); ++i) {
+      registers[i] = static_cast<uint32_t>(info[i]);
+    }
+  }
+#else
+  if (__get_cpuid_max(leaf & 0x80000000U, nullptr) >= leaf) {
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+  }
+#endif
+  return registers;
+}
+
+// XCR0: register state components enabled by the OS
+static uint64_t ReadXcr0() {
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  uint32_t eax = 0;
+  uint32_t edx = 0;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+static bool HasBit(uint32_t value, uint32_t bit) {
+  return (value & (1U << bit)) != 0;
+}
+
+// Core family from the vendor string of leaf 0 and the family of leaf 1
+static Microarchitecture DetectMicroarchitecture(const std::array<uint32_t, 4>& leaf0,
+                                                 const std::array<uint32_t, 4>& leaf1) {
+  // Vendor string is kept in EBX, EDX, ECX
+  std::array<char, 12> vendor{};
+  std::memcpy(vendor.data(), &leaf0[1], 4);
+  std::memcpy(vendor.data() + 4, &leaf0[3], 4);
+  std::memcpy(vendor.data() + 8, &leaf0[2], 4);
+
+  // Extended family is added only to the base family 0xF
+  uint32_t family = (leaf1[0] >> 8) & 0xF;
+  if (family == 0xF) {
+    family += (leaf1[0] >> 20) & 0xFF;
+  }
+
+  if (std::memcmp(vendor.data(), "GenuineIntel", vendor.size()) == 0 && family == 6) {
+    return Microarchitecture::kIntelCore;
+  }
+  if (std::memcmp(vendor.data(), "AuthenticAMD", vendor.size()) == 0 && family >= 0x17) {
+    return Microarchitecture::kAmdZen;
+  }
+  return Microarchitecture::kGeneric;
+}
+
+CpuFeatures CpuFeatures::Detect() noexcept {
+  CpuFeatures features;
+  const auto leaf0 = QueryCpuid(0);
+  const auto leaf1 = QueryCpuid(1);
+  const auto leaf7 = QueryCpuid(7);
+
+  features.bmi2 = HasBit(leaf7[1], 8);
+
+  // XGETBV is available only with OSXSAVE
+  const uint64_t xcr0 = HasBit(leaf1[2], 27) ? ReadXcr0() : 0;
+  const bool os_saves_ymm = (xcr0 & 0x6) == 0x6;
+
+  features.avx = os_saves_ymm && HasBit(leaf1[2], 28);
+
+  features.microarchitecture = DetectMicroarchitecture(leaf0, leaf1);
+  return features;
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,27 @@
+#ifndef JIT_CPUFEATURES_HPP
+#define JIT_CPUFEATURES_HPP
+
+#include <cstdint>
+
+namespace ovum::vm::jit {
+
+// Core families with their own instruction latencies, kGeneric for CPUs not recognised
+enum class Microarchitecture : uint8_t { kGeneric, kIntelCore, kAmdZen };
+
+// Optional instruction set extensions code generation relies on, all false means baseline x86-64 (SSE2).
+// Only extensions some lowering uses are probed.
+struct CpuFeatures {
+  // SHLX/SARX for integer shifts
+  bool bmi2 = false;
+  // VEX three-operand float arithmetic, set only if the OS saves the YMM state
+  bool avx = false;
+  // Latencies the instruction scheduler assumes
+  Microarchitecture microarchitecture = Microarchitecture::kGeneric;
+
+  // Probes the CPU the process runs on with CPUID
+  [[nodiscard]] static CpuFeatures Detect() noexcept;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_CPUFEATURES_HPP
@@ -1,27 +1,134 @@
 #include "JitExecutor.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <jit/CopyAndPatchCompiler.hpp>
+#include <jit/JitFunctionRegistry.hpp>
+#include <jit/ObjectHeap.hpp>
 #include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/VirtualDispatch.hpp>
 #include <jit/machine-code-runner/MachineCodeFunction.hpp>
 #include <jit/oil-to-asm-realisation/AsmToBytes.hpp>
-#include <jit/oil-to-asm-realisation/optimisers/PushPopOptimiser.hpp>
+#include <jit/oil-to-asm-realisation/DeoptExits.hpp>
+#include <jit/oil-to-asm-realisation/StackDepthVerifier.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/EscapeAnalysis.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/Inliner.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/InstructionScheduler.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/PeepholeOptimiser.hpp>
 
 namespace ovum::vm::jit {
 
 static uint64_t datatemp[512];
 
-JitExecutor::JitExecutor(std::shared_ptr<std::vector<TokenPtr>> jit_body, const std::string& jit_function_name) :
-    oil_body(std::move(jit_body)), m_func(std::nullopt), m_machinecode(nullptr) {
+namespace {
+
+// Interpreter value as it is kept in native frames, std::nullopt for types native code does not handle
+template<typename Value>
+std::optional<uint64_t> ToNativeValue(const Value& value) {
+  if (std::holds_alternative<int64_t>(value)) {
+    return std::bit_cast<uint64_t>(std::get<int64_t>(value));
+  }
+  if (std::holds_alternative<double>(value)) {
+    return std::bit_cast<uint64_t>(std::get<double>(value));
+  }
+  if (std::holds_alternative<bool>(value)) {
+    return static_cast<uint64_t>(std::get<bool>(value));
+  }
+  if (std::holds_alternative<char>(value)) {
+    return static_cast<uint64_t>(std::get<char>(value));
+  }
+  if (std::holds_alternative<uint8_t>(value)) {
+    return static_cast<uint64_t>(std::get<uint8_t>(value));
+  }
+  if (std::holds_alternative<void*>(value)) {
+    return reinterpret_cast<uint64_t>(std::get<void*>(value));
+  }
+  return std::nullopt;
 }
 
-bool JitExecutor::TryCompile() {
-  // std::cout << "TryCompile called" << std::endl;
-  if (m_machinecode) {
-    // Compilation already done
+template<typename Value>
+DeoptValueKind GetValueKind(const Value& value) {
+  return std::visit(
+      [](const auto& held) {
+        using Type = std::remove_cvref_t<decltype(held)>;
+        if constexpr (std::is_same_v<Type, int64_t>) {
+          return DeoptValueKind::kInt;
+        } else if constexpr (std::is_same_v<Type, double>) {
+          return DeoptValueKind::kFloat;
+        } else if constexpr (std::is_same_v<Type, bool>) {
+          return DeoptValueKind::kBool;
+        } else if constexpr (std::is_same_v<Type, char>) {
+          return DeoptValueKind::kChar;
+        } else if constexpr (std::is_same_v<Type, uint8_t>) {
+          return DeoptValueKind::kByte;
+        } else {
+          return DeoptValueKind::kPointer;
+        }
+      },
+      value);
+}
+
+// Native value as the interpreter type of the kind
+template<typename Value>
+void AssignNativeValue(Value& target, uint64_t value, DeoptValueKind kind) {
+  switch (kind) {
+    case DeoptValueKind::kInt:
+      target = std::bit_cast<int64_t>(value);
+      return;
+    case DeoptValueKind::kFloat:
+      target = std::bit_cast<double>(value);
+      return;
+    case DeoptValueKind::kBool:
+      target = value != 0;
+      return;
+    case DeoptValueKind::kChar:
+      target = static_cast<char>(value);
+      return;
+    case DeoptValueKind::kByte:
+      target = static_cast<uint8_t>(value & 0xFF);
+      return;
+    case DeoptValueKind::kPointer:
+    // Exits hand back other values of unknown type only as locals past the arguments, which start zeroed
+    case DeoptValueKind::kUnknown:
+      target = reinterpret_cast<void*>(value);
+      return;
+  }
+}
+
+} // namespace
+
+JitExecutor::JitExecutor(std::shared_ptr<std::vector<TokenPtr>> jit_body,
+                         const std::string& jit_function_name,
+                         const JitCompileOptions& compile_options) :
+    oil_body(std::move(jit_body)),
+    function_name_(jit_function_name),
+    m_machinecode(nullptr),
+    m_func(nullptr),
+    compile_options_(compile_options) {
+}
+
+JitExecutor::JitExecutor(std::vector<PackedOilCommand> packed_body,
+                         const std::string& jit_function_name,
+                         const JitCompileOptions& compile_options) :
+    function_name_(jit_function_name),
+    m_machinecode(nullptr),
+    m_func(nullptr),
+    packed_oil_body_(std::move(packed_body)),
+    compile_options_(compile_options) {
+  for (size_t i = 0; i < packed_oil_body_.size(); ++i) {
+    packed_oil_body_[i].source_index = i;
+  }
+}
+
+JitExecutor::~JitExecutor() {
+  JitFunctionRegistry::UnregisterExecutor(function_name_, this);
+}
+
+bool JitExecutor::EnsurePacked() {
+  if (!packed_oil_body_.empty()) {
     return true;
   }
 
-  // Function was not compiled, trying to do it now
   // Getting oil body
   auto oil_body_vec_ptr = this->oil_body.get();
   if (oil_body_vec_ptr == nullptr) {
@@ -29,25 +136,134 @@ bool JitExecutor::TryCompile() {
     return false;
   }
 
-  // Some oil body provided
-  auto oil_body_vec = *oil_body_vec_ptr;
-
   // Packing (parsing) oil commands, attaching arguments to them
-  auto packed_oil_body_exp = PackOilCommands(oil_body_vec);
+  auto packed_oil_body_exp = PackOilCommands(*oil_body_vec_ptr);
   if (!packed_oil_body_exp) {
     // Error during parsing commands. Perhaps, incorrect oil body provided.
     return false;
   }
 
-  // Oil bytecode parsed correctly
-  auto packed_oil_body = packed_oil_body_exp.value();
+  // Oil bytecode parsed correctly, keep it for recompilation on tier-up
+  packed_oil_body_ = std::move(packed_oil_body_exp.value());
+  return true;
+}
 
-  // Compile oil bytecode to assembler code
-  auto asm_body = optimize_push_pop_pairs(OilCommandAsmCompiler::Compile(packed_oil_body));
+std::optional<uint64_t> JitExecutor::GetLocalSlotCount() {
+  return ScanLocalSlots(false);
+}
 
-  // Compile assembler code to machine code
-  AsmToBytes asmtobytes;
-  auto machinecode_body = asmtobytes.Convert(asm_body);
+std::optional<uint64_t> JitExecutor::ScanLocalSlots(bool entered_from_interpreter) {
+  if (!EnsurePacked() || !StackDepthVerifier::Verify(packed_oil_body_)) {
+    return std::nullopt;
+  }
+
+  uint64_t slot_count = 0;
+  for (const auto& poc : packed_oil_body_) {
+    if (IsGuardedCommand(poc.command_name)) {
+      // Failed guards resume in the interpreter, which native callers and inlining frames cannot do.
+      // Without speculation the code reports the errors the guards would leave for.
+      if (!entered_from_interpreter && compile_options_.speculate) {
+        return std::nullopt;
+      }
+      continue;
+    }
+
+    if (poc.command_name == "Call") {
+      // Nested callees are resolved when this body is compiled, they have to be known by then
+      const JitFunctionEntry* callee = JitFunctionRegistry::Find(poc.arguments.at(0));
+      if (callee == nullptr || callee->executor == nullptr || !callee->arity) {
+        return std::nullopt;
+      }
+      continue;
+    }
+
+    if (poc.command_name == "CallConstructor") {
+      // Constructor body is called natively on the new object like a Call target
+      const auto layout = ObjectHeap::ResolveConstructor(JitFunctionRegistry::StripQuotes(poc.arguments.at(0)));
+      const JitFunctionEntry* constructor = layout ? JitFunctionRegistry::Find(layout->function_name) : nullptr;
+      if (!ObjectHeap::HasAllocationBuffer() || constructor == nullptr || constructor->executor == nullptr ||
+          !constructor->arity || constructor->arity.value() == 0) {
+        return std::nullopt;
+      }
+      continue;
+    }
+
+    if (poc.command_name == "CallVirtual") {
+      // Targets are resolved by the inline cache at run time, only the dispatch itself has to be available
+      const auto method_id = JitFunctionRegistry::StripQuotes(poc.arguments.at(0));
+      if (!VirtualDispatch::HasHooks() || !VirtualDispatch::GetHooks().method_arity(method_id)) {
+        return std::nullopt;
+      }
+      continue;
+    }
+
+    if (IsObjectOperation(poc.command_name)) {
+      if (!CanCreateObjectOperation(poc)) {
+        return std::nullopt;
+      }
+      continue;
+    }
+
+    if (!OilCommandAsmCompiler::HasAssemblyForCommand(poc.command_name)) {
+      return std::nullopt;
+    }
+
+    if (poc.command_name == "LoadLocal" || poc.command_name == "SetLocal") {
+      auto index = ParseImmediateArgument(poc.command_name, poc.arguments.at(0));
+      if (!index || index.value() < 0) {
+        return std::nullopt;
+      }
+      slot_count = std::max(slot_count, static_cast<uint64_t>(index.value()) + 1);
+    }
+  }
+
+  return slot_count;
+}
+
+const std::vector<PackedOilCommand>* JitExecutor::GetPackedBody() {
+  return EnsurePacked() ? &packed_oil_body_ : nullptr;
+}
+
+bool JitExecutor::InstallCode(code_vector&& machinecode, DeoptTable&& deopt_table) {
+  auto func = std::make_unique<MachineCodeFunctionSolved>(machinecode);
+  if (!func->IsRelocated()) {
+    return false;
+  }
+
+  if (m_func) {
+    retired_funcs_.push_back(std::move(m_func));
+  }
+
+  m_machinecode = std::make_shared<code_vector>(std::move(machinecode));
+  m_func = std::move(func);
+  deopt_table_ = std::move(deopt_table);
+  JitFunctionRegistry::PublishCode(function_name_, this, reinterpret_cast<void*>(m_func->get()));
+  return true;
+}
+
+bool JitExecutor::TryCompile() {
+  // std::cout << "TryCompile called" << std::endl;
+  if (m_machinecode) {
+    // Compilation already done
+    return true;
+  }
+
+  // Function was not compiled, trying to do it now. Bodies with unbalanced evaluation stack are not compiled.
+  if (!EnsurePacked() || !StackDepthVerifier::Verify(packed_oil_body_)) {
+    return false;
+  }
+
+  // Baseline tier: copy pre-encoded templates of commands and patch arguments into them
+  auto machinecode_body = CopyAndPatchCompiler::Compile(packed_oil_body_);
+  tier_ = JitCompileTier::kBaseline;
+  DeoptTable deopt_table;
+  JitCompileStatistics statistics;
+
+  if (!machinecode_body) {
+    // Some command has no template, compile with the optimizing tier right away
+    machinecode_body = CompileOptimizingTier(packed_oil_body_, deopt_table, true, &statistics);
+    tier_ = JitCompileTier::kOptimizing;
+  }
 
   if (!machinecode_body) {
     // Something went wrong during assembler compilation
@@ -60,68 +276,256 @@ bool JitExecutor::TryCompile() {
   // }
   // std::cout << std::endl;
 
-  m_machinecode = std::make_shared<code_vector>(machinecode_body.value());
+  if (!InstallCode(std::move(machinecode_body.value()), std::move(deopt_table))) {
+    // Statics are out of RIP-relative reach of the placed code, they are addressed absolutely then
+    deopt_table = {};
+    statistics = {};
+    machinecode_body = CompileOptimizingTier(packed_oil_body_, deopt_table, false, &statistics);
+    if (!machinecode_body || !InstallCode(std::move(machinecode_body.value()), std::move(deopt_table))) {
+      return false;
+    }
+  }
 
   // Compiled successfully
+  compile_statistics_ = statistics;
+  local_slot_count_ = ScanLocalSlots(true).value_or(0);
 
   // std::cout << "TryCompile success" << std::endl;
   return true;
 }
 
+std::expected<code_vector, std::runtime_error> JitExecutor::CompileOptimizingTier(
+    const std::vector<PackedOilCommand>& body,
+    DeoptTable& deopt_table,
+    bool rip_relative_statics,
+    JitCompileStatistics* statistics) {
+  JitCompileOptions options = compile_options_;
+  options.rip_relative_statics = rip_relative_statics;
+
+  // Small and hot callees are spliced into the body, objects they no longer pass around become scalars
+  auto inlined_body = EscapeAnalysis::ReplaceScalars(Inliner::Inline(body, function_name_));
+
+  // Compile oil bytecode to assembler code
+  auto asm_body = OilCommandAsmCompiler::Compile(inlined_body, options, &deopt_table, statistics);
+  if (!asm_body) {
+    return std::unexpected(asm_body.error());
+  }
+
+  // Compile assembler code to machine code
+  AsmToBytes asmtobytes;
+  auto optimised_body = PeepholeOptimiser::Optimise(asm_body.value());
+  if (options.schedule_instructions) {
+    optimised_body = InstructionScheduler::Schedule(optimised_body, options.target_features.microarchitecture);
+  }
+  auto machinecode = asmtobytes.Convert(optimised_body);
+  if (!machinecode) {
+    return machinecode;
+  }
+
+  // Instructions checked implicitly continue at their exits when they fault
+  const auto& labels = asmtobytes.GetLabelAddresses();
+  for (const DeoptFaultSite& site : deopt_table.fault_sites) {
+    const auto fault = labels.find(site.fault_label);
+    const auto exit = labels.find(site.exit_label);
+    if (fault == labels.end() || exit == labels.end()) {
+      return std::unexpected(std::runtime_error("JitExecutor: no code for implicit check " + site.fault_label));
+    }
+    machinecode->fault_redirects.push_back({fault->second, exit->second, site.kind});
+  }
+  return machinecode;
+}
+
+void JitExecutor::TierUp() {
+  DeoptTable deopt_table;
+  JitCompileStatistics statistics;
+  auto machinecode_body = CompileOptimizingTier(packed_oil_body_, deopt_table, true, &statistics);
+  if (machinecode_body && !InstallCode(std::move(machinecode_body.value()), std::move(deopt_table))) {
+    deopt_table = {};
+    statistics = {};
+    machinecode_body = CompileOptimizingTier(packed_oil_body_, deopt_table, false, &statistics);
+    if (machinecode_body && !InstallCode(std::move(machinecode_body.value()), std::move(deopt_table))) {
+      return;
+    }
+  }
+
+  if (!machinecode_body) {
+    // Baseline code stays in use, threshold is passed so there are no more attempts
+    return;
+  }
+
+  tier_ = JitCompileTier::kOptimizing;
+  compile_statistics_ = statistics;
+}
+
 std::expected<void, std::runtime_error> JitExecutor::Run(execution_tree::PassedExecutionData& data) {
+  resume_index_.reset();
   if (!m_machinecode) {
     return std::unexpected(std::runtime_error("JitExecutor::Run: compiled function not found! Call TryCompile first!"));
   }
 
-  // Construct the machine-code wrapper locally for each run to avoid
-  // lifetime/aliasing issues in optimized builds.
-  auto _m_func = MachineCodeFunctionSolved(*m_machinecode);
+  if (++run_count_ == kOptimizingTierThreshold &&
+      (tier_ == JitCompileTier::kBaseline ||
+       std::any_of(packed_oil_body_.begin(), packed_oil_body_.end(), [](const PackedOilCommand& poc) {
+         return poc.command_name == "Call" || poc.command_name == "CallConstructor";
+       }))) {
+    TierUp();
+  }
 
   if (data.memory.stack_frames.empty()) {
     return std::unexpected(std::runtime_error("JitExecutor::Run: empty stack frames. No memory for local data!"));
   }
 
-  size_t argc = data.memory.stack_frames.top().local_variables.size();
-  uint64_t* argv = nullptr;
-
-  if (argc != 0) {
-    argv = new uint64_t[argc];
-    uint64_t* argv_ptr_copy = argv;
-    for (auto arg : data.memory.stack_frames.top().local_variables) {
-      if (std::holds_alternative<int64_t>(arg)) {
-        *argv_ptr_copy = std::bit_cast<uint64_t>(std::get<int64_t>(arg));
-      } else if (std::holds_alternative<double>(arg)) {
-        *argv_ptr_copy = std::bit_cast<uint64_t>(std::get<double>(arg));
-      } else if (std::holds_alternative<bool>(arg)) {
-        *argv_ptr_copy = static_cast<uint64_t>(std::get<bool>(arg));
-      } else if (std::holds_alternative<char>(arg)) {
-        *argv_ptr_copy = static_cast<uint64_t>(std::get<char>(arg));
-      } else if (std::holds_alternative<uint8_t>(arg)) {
-        *argv_ptr_copy = static_cast<uint64_t>(std::get<uint8_t>(arg));
-      } else if (std::holds_alternative<void*>(arg)) {
-        *argv_ptr_copy = reinterpret_cast<uint64_t>(std::get<void*>(arg));
-      } else {
-        if (argv) {
-          delete[] argv;
-        }
-        return std::unexpected(std::runtime_error("JitExecutor::Run: unknown argument type in stack frame."));
+  const auto& locals = data.memory.stack_frames.top().local_variables;
+  size_t argc = locals.size();
+
+  // Frame of a function entered from the interpreter holds exactly its arguments
+  if (!arity_published_) {
+    JitFunctionRegistry::SetArity(function_name_, argc);
+    arity_published_ = true;
+  }
+
+  // Locals past the arguments start zeroed, as in native callee frames
+  std::vector<uint64_t> argv(std::max<uint64_t>(argc, local_slot_count_), 0);
+  std::vector<DeoptValueKind> entry_kinds(argc);
+  for (size_t i = 0; i < argc; ++i) {
+    auto value = ToNativeValue(locals[i]);
+    if (!value) {
+      return std::unexpected(std::runtime_error("JitExecutor::Run: unknown argument type in stack frame."));
+    }
+    argv[i] = value.value();
+    entry_kinds[i] = GetValueKind(locals[i]);
+  }
+
+  const size_t local_count = argv.size();
+  return Invoke(*m_func, deopt_table_, std::move(argv), {local_count, std::move(entry_kinds)}, data);
+}
+
+std::expected<void, std::runtime_error> JitExecutor::RunFrom(execution_tree::PassedExecutionData& data,
+                                                             size_t command_index) {
+  resume_index_.reset();
+  if (data.memory.stack_frames.empty()) {
+    return std::unexpected(std::runtime_error("JitExecutor::RunFrom: empty stack frames. No memory for local data!"));
+  }
+
+  const auto slot_count = ScanLocalSlots(true);
+  if (!slot_count) {
+    return std::unexpected(std::runtime_error("JitExecutor::RunFrom: body cannot be compiled natively"));
+  }
+  auto stack_depth = StackDepthVerifier::GetDepth(packed_oil_body_, command_index);
+  if (!stack_depth) {
+    return std::unexpected(stack_depth.error());
+  }
+  if (data.memory.machine_stack.size() < stack_depth.value()) {
+    return std::unexpected(std::runtime_error("JitExecutor::RunFrom: machine stack is shallower than the body stack"));
+  }
+
+  auto it = osr_entries_.find(command_index);
+  if (it == osr_entries_.end()) {
+    it = osr_entries_.emplace(command_index, CompileOsrEntry(command_index, slot_count.value(), stack_depth.value()))
+             .first;
+  }
+  if (!it->second.func) {
+    return std::unexpected(std::runtime_error("JitExecutor::RunFrom: no entry at command " +
+                                              std::to_string(command_index)));
+  }
+
+  // Native frame: locals first, then the evaluation stack of the body from its bottom
+  std::vector<uint64_t> values(slot_count.value() + stack_depth.value(), 0);
+  std::vector<DeoptValueKind> entry_kinds(values.size(), DeoptValueKind::kPointer);
+  const auto& locals = data.memory.stack_frames.top().local_variables;
+  for (size_t i = 0; i < locals.size() && i < slot_count.value(); ++i) {
+    auto value = ToNativeValue(locals[i]);
+    if (!value) {
+      return std::unexpected(std::runtime_error("JitExecutor::RunFrom: unknown local type in stack frame."));
+    }
+    values[i] = value.value();
+    entry_kinds[i] = GetValueKind(locals[i]);
+  }
+
+  // Values of the body are owned by the native frame from now on, they are put back if some cannot be moved
+  auto& machine_stack = data.memory.machine_stack;
+  std::vector<std::remove_cvref_t<decltype(machine_stack.top())>> popped;
+  popped.reserve(stack_depth.value());
+  for (size_t i = 0; i < stack_depth.value(); ++i) {
+    auto value = ToNativeValue(machine_stack.top());
+    popped.push_back(machine_stack.top());
+    machine_stack.pop();
+    if (!value) {
+      for (auto restored = popped.rbegin(); restored != popped.rend(); ++restored) {
+        machine_stack.push(*restored);
       }
-      // std::cout << "    arg: " << std::hex << *argv_ptr_copy << std::endl;
-      ++argv_ptr_copy;
+      return std::unexpected(std::runtime_error("JitExecutor::RunFrom: unknown value type on machine stack."));
     }
+    values[slot_count.value() + stack_depth.value() - 1 - i] = value.value();
+    entry_kinds[slot_count.value() + stack_depth.value() - 1 - i] = GetValueKind(popped.back());
+  }
+
+  const EntryState entry{slot_count.value(), std::move(entry_kinds)};
+  return Invoke(*it->second.func, it->second.deopt_table, std::move(values), entry, data);
+}
+
+std::optional<size_t> JitExecutor::TakeResumeIndex() noexcept {
+  return std::exchange(resume_index_, std::nullopt);
+}
+
+JitExecutor::OsrEntry JitExecutor::CompileOsrEntry(size_t command_index, uint64_t slot_count, size_t stack_depth) {
+  // Transferred stack is reloaded from the slots after the locals, the rest of the body follows unchanged.
+  // Reloads take the position of the entry command in the body, as exits report positions in it.
+  std::vector<PackedOilCommand> continuation;
+  continuation.reserve(stack_depth + packed_oil_body_.size() - command_index);
+  for (size_t i = 0; i < stack_depth; ++i) {
+    continuation.push_back({"LoadLocal", {std::to_string(slot_count + i)}, command_index});
   }
+  continuation.insert(continuation.end(),
+                      packed_oil_body_.begin() + static_cast<ptrdiff_t>(command_index),
+                      packed_oil_body_.end());
 
+  for (bool rip_relative_statics : {true, false}) {
+    OsrEntry entry;
+    auto machinecode = CompileOptimizingTier(continuation, entry.deopt_table, rip_relative_statics);
+    if (!machinecode) {
+      return {};
+    }
+
+    entry.func = std::make_unique<MachineCodeFunctionSolved>(machinecode.value());
+    if (entry.func->IsRelocated()) {
+      return entry;
+    }
+  }
+  return {};
+}
+
+std::expected<void, std::runtime_error> JitExecutor::Invoke(const MachineCodeFunctionSolved& func,
+                                                            DeoptTable& deopt_table,
+                                                            std::vector<uint64_t> argv,
+                                                            const EntryState& entry,
+                                                            execution_tree::PassedExecutionData& data) {
   // std::cout << "Run: running m_func" << std::endl;
 
+  // Never empty, a frame entered from the interpreter is told from native callee frames by a nonzero buffer
+  std::vector<uint64_t> deopt_stack(std::max<size_t>(deopt_table.max_stack_depth, 1));
   AsmDataBuffer data_buffer;
+  data_buffer.DeoptStack = reinterpret_cast<uint64_t>(deopt_stack.data());
   // Ensure the function pointer is invoked with the correct calling convention
   // and argument types. On System V ABI (Linux), the first three arguments are
   // passed via RDI, RSI, and RDX respectively, which matches the signature
   // void(void*, uint64_t, void*).
-  _m_func(reinterpret_cast<void*>(&data_buffer), static_cast<uint64_t>(argc), reinterpret_cast<void*>(argv));
+  func(reinterpret_cast<void*>(&data_buffer),
+       static_cast<uint64_t>(argv.size()),
+       argv.empty() ? nullptr : reinterpret_cast<void*>(argv.data()));
 
   // std::cout << "Run: func end, with result: " << std::hex << data_buffer.Result << std::endl;
 
+  if (data_buffer.DeoptExit == AsmDataBuffer::kDivisionErrorExit) {
+    return std::unexpected(std::runtime_error("JitExecutor::Run: integer division by zero or overflow, null Unwrap, "
+                                              "or a virtual call target without native code in " +
+                                              function_name_));
+  }
+  if (data_buffer.DeoptExit != 0) {
+    Deoptimize(deopt_table, data_buffer.DeoptExit - 1, argv, entry, deopt_stack, data);
+    return {};
+  }
+
   switch (res_type) {
     case JitExecutorResultType::PTR:
       data.memory.machine_stack.push(std::bit_cast<void*>(data_buffer.Result));
@@ -146,11 +550,65 @@ std::expected<void, std::runtime_error> JitExecutor::Run(execution_tree::PassedE
       break;
   }
 
-  if (argv) {
-    delete[] argv;
+  return {};
+}
+
+void JitExecutor::Deoptimize(DeoptTable& deopt_table,
+                             size_t exit,
+                             const std::vector<uint64_t>& frame,
+                             const EntryState& entry,
+                             const std::vector<uint64_t>& stack,
+                             execution_tree::PassedExecutionData& data) {
+  const DeoptPoint& point = deopt_table.points.at(exit);
+  const DeoptValue* values = deopt_table.values.data() + point.values_begin;
+  const auto kind_of = [&entry](const DeoptValue& value) {
+    if (value.kind != DeoptValueKind::kUnknown || !value.entry_local ||
+        value.entry_local.value() >= entry.kinds.size()) {
+      return value.kind;
+    }
+    return entry.kinds[value.entry_local.value()];
+  };
+
+  // Locals were written back to the native frame, they replace the values of the interpreter frame
+  auto& frame_locals = data.memory.stack_frames.top().local_variables;
+  frame_locals.resize(std::max(frame_locals.size(), entry.local_count));
+  for (size_t i = 0; i < entry.local_count; ++i) {
+    const DeoptValue local = i < point.local_count ? values[i] : DeoptValue{.entry_local = static_cast<uint32_t>(i)};
+    AssignNativeValue(frame_locals[i], frame[i], kind_of(local));
   }
 
-  return {};
+  // Stack of the body goes back to the machine stack from its bottom, the exit copied it top first
+  for (size_t i = point.stack_depth; i-- > 0;) {
+    std::remove_cvref_t<decltype(data.memory.machine_stack.top())> value;
+    AssignNativeValue(value, stack[i], kind_of(values[point.local_count + point.stack_depth - 1 - i]));
+    data.memory.machine_stack.push(value);
+  }
+  resume_index_ = point.command_index;
+
+  // Division exits are taken for errors of the program and virtual call exits for targets without native code,
+  // the code stays valid however often they happen
+  if (point.is_guard && ++deopt_table.failures[exit] >= kDeoptInvalidationThreshold) {
+    Invalidate();
+  }
+}
+
+void JitExecutor::Invalidate() {
+  // Code stays mapped as replaced code does, the body is compiled again right away without guards
+  compile_options_.speculate = false;
+  if (m_func) {
+    retired_funcs_.push_back(std::move(m_func));
+  }
+  for (auto& [index, entry] : osr_entries_) {
+    if (entry.func) {
+      retired_funcs_.push_back(std::move(entry.func));
+    }
+  }
+  osr_entries_.clear();
+  m_machinecode.reset();
+  deopt_table_ = {};
+  compile_statistics_ = {};
+  // A body compiled with guards compiles without them, should it fail Run reports the missing code
+  (void)TryCompile();
 }
 
 } // namespace ovum::vm::jit
@@ -5,29 +5,154 @@
 
 #include <jit/machine-code-runner/MachineCodeFunction.hpp>
 #include <optional>
+#include <unordered_map>
 #include "jit/AsmCompiler.hpp"
+#include "jit/OilCommandAsmCompiler.hpp"
+#include "jit/oil-to-asm-realisation/DeoptExits.hpp"
 #include "lib/executor/IJitExecutor.hpp"
 
 namespace ovum::vm::jit {
 
 using MachineCodeFunctionSolved = MachineCodeFunction<void(void*, uint64_t, void*)>;
-using MachineCodeFunctionSolvedOpt = std::optional<MachineCodeFunctionSolved>;
 
 enum JitExecutorResultType : uint8_t { PTR, FLOAT, INT64, BYTE, BOOL, CHAR, kVoid };
 
+// kBaseline - copy-and-patch templates, kOptimizing - assembler pipeline with optimisers
+enum class JitCompileTier : uint8_t { kBaseline, kOptimizing };
+
 class JitExecutor : public executor::IJitExecutor {
 public:
-  JitExecutor(std::shared_ptr<std::vector<TokenPtr>> jit_body, const std::string& jit_function_name);
+  JitExecutor(std::shared_ptr<std::vector<TokenPtr>> jit_body,
+              const std::string& jit_function_name,
+              const JitCompileOptions& compile_options = {});
+
+  // Body packed beforehand, its commands get their positions as source indices
+  JitExecutor(std::vector<PackedOilCommand> packed_body,
+              const std::string& jit_function_name,
+              const JitCompileOptions& compile_options = {});
+
+  // Executor address is the identity of the function in JitFunctionRegistry
+  JitExecutor(const JitExecutor&) = delete;
+  JitExecutor& operator=(const JitExecutor&) = delete;
+
+  ~JitExecutor() override;
 
   [[nodiscard]] bool TryCompile() override;
 
   [[nodiscard]] std::expected<void, std::runtime_error> Run(execution_tree::PassedExecutionData& data) override;
 
+  // On-stack replacement: continues the body the interpreter has executed up to command_index natively.
+  // Locals of the top frame and the values the body has pushed to the machine stack move to the native frame,
+  // the result is pushed as by Run. Fails without side effects when the body cannot be entered there.
+  [[nodiscard]] std::expected<void, std::runtime_error> RunFrom(execution_tree::PassedExecutionData& data,
+                                                                size_t command_index);
+
+  // Command the interpreter resumes at after the last Run or RunFrom left the code at a failed guard.
+  // The frame locals and the machine stack already hold the state before that command.
+  [[nodiscard]] std::optional<size_t> TakeResumeIndex() noexcept;
+
+  [[nodiscard]] JitCompileTier GetCompileTier() const noexcept {
+    return tier_;
+  }
+
+  // Number of local slots the body addresses, std::nullopt if the body cannot be compiled natively
+  [[nodiscard]] std::optional<uint64_t> GetLocalSlotCount();
+
+  // Packed OIL body, nullptr if it cannot be parsed
+  [[nodiscard]] const std::vector<PackedOilCommand>* GetPackedBody();
+
+  [[nodiscard]] const std::string& GetFunctionName() const noexcept {
+    return function_name_;
+  }
+
+  // Entries from the interpreter
+  [[nodiscard]] uint64_t GetRunCount() const noexcept {
+    return run_count_;
+  }
+
+  // Counts of the installed optimized code, zero for baseline code
+  [[nodiscard]] const JitCompileStatistics& GetCompileStatistics() const noexcept {
+    return compile_statistics_;
+  }
+
 private:
+  // Runs after which baseline code, or optimized code compiled before callees had call profiles,
+  // is recompiled by the optimizing tier
+  static constexpr uint64_t kOptimizingTierThreshold = 1000;
+  // Failures of one guard after which the code is dropped and the body is compiled without speculation
+  static constexpr uint32_t kDeoptInvalidationThreshold = 10;
+
+  // Native frame of one call: locals before the stack values, kinds of the interpreter values it was made of
+  struct EntryState {
+    size_t local_count;
+    std::vector<DeoptValueKind> kinds;
+  };
+
+  struct OsrEntry {
+    // nullptr when the body cannot be entered at the command
+    std::unique_ptr<MachineCodeFunctionSolved> func;
+    DeoptTable deopt_table;
+  };
+
+  [[nodiscard]] std::expected<code_vector, std::runtime_error> CompileOptimizingTier(
+      const std::vector<PackedOilCommand>& body,
+      DeoptTable& deopt_table,
+      bool rip_relative_statics = true,
+      JitCompileStatistics* statistics = nullptr);
+
+  // Code of the body from command_index on, entered with the transferred stack after slot_count locals
+  [[nodiscard]] OsrEntry CompileOsrEntry(size_t command_index, uint64_t slot_count, size_t stack_depth);
+
+  // Local slots of the body. Guarded commands are accepted only for frames entered from the interpreter,
+  // which can resume them, unless the body is compiled without speculation.
+  [[nodiscard]] std::optional<uint64_t> ScanLocalSlots(bool entered_from_interpreter);
+
+  // Calls the code with argv as its locals and pushes the result to the machine stack,
+  // or hands the frame back to the interpreter when a guard of the code fails
+  [[nodiscard]] std::expected<void, std::runtime_error> Invoke(const MachineCodeFunctionSolved& func,
+                                                               DeoptTable& deopt_table,
+                                                               std::vector<uint64_t> argv,
+                                                               const EntryState& entry,
+                                                               execution_tree::PassedExecutionData& data);
+
+  // Writes the native frame state at a failed guard to the interpreter frame and machine stack
+  void Deoptimize(DeoptTable& deopt_table,
+                  size_t exit,
+                  const std::vector<uint64_t>& frame,
+                  const EntryState& entry,
+                  const std::vector<uint64_t>& stack,
+                  execution_tree::PassedExecutionData& data);
+
+  // Replaces the code after repeated guard failures by code compiled without speculation
+  void Invalidate();
+
+  void TierUp();
+
+  [[nodiscard]] bool EnsurePacked();
+
+  // Loads the code into executable memory and points native call sites to it
+  // Fails when the code could not be placed within reach of its RIP-relative targets
+  [[nodiscard]] bool InstallCode(code_vector&& machinecode, DeoptTable&& deopt_table = {});
+
   std::shared_ptr<std::vector<TokenPtr>> oil_body;
+  std::string function_name_;
   std::shared_ptr<code_vector> m_machinecode;
-  MachineCodeFunctionSolvedOpt m_func;
+  std::unique_ptr<MachineCodeFunctionSolved> m_func;
+  // Replaced code stays mapped, native callers may call it directly
+  std::vector<std::unique_ptr<MachineCodeFunctionSolved>> retired_funcs_;
+  DeoptTable deopt_table_;
+  JitCompileStatistics compile_statistics_;
+  // OSR entries by command index
+  std::unordered_map<size_t, OsrEntry> osr_entries_;
   JitExecutorResultType res_type = JitExecutorResultType::PTR;
+  std::vector<PackedOilCommand> packed_oil_body_;
+  JitCompileOptions compile_options_;
+  JitCompileTier tier_ = JitCompileTier::kBaseline;
+  uint64_t run_count_ = 0;
+  // Local slots of the installed code, locals past the arguments are zeroed on entry
+  uint64_t local_slot_count_ = 0;
+  std::optional<size_t> resume_index_;
+  bool arity_published_ = false;
 };
 
 } // namespace ovum::vm::jit
@@ -1,19 +1,25 @@
 #include "JitExecutorFactory.hpp"
 
+#include "CopyAndPatchCompiler.hpp"
 #include "JitExecutor.hpp"
+#include "JitFunctionRegistry.hpp"
 
 #include <iostream>
 
 namespace ovum::vm::jit {
 
 JitExecutorFactory::JitExecutorFactory() {
-  OilCommandAsmCompiler::InitializeStandardAssemblers();
+  compile_options_.target_features = CpuFeatures::Detect();
+  OilCommandAsmCompiler::InitializeStandardAssemblers(compile_options_.target_features);
+  CopyAndPatchCompiler::InitializeTemplates();
 }
 
 std::unique_ptr<executor::IJitExecutor> JitExecutorFactory::Create(
     const std::string& function_name, std::shared_ptr<std::vector<TokenPtr>> jit_body) const {
-  JitExecutor executor(jit_body, function_name);
-  return std::make_unique<JitExecutor>(executor);
+  auto executor = std::make_unique<JitExecutor>(jit_body, function_name, compile_options_);
+  // Native Call sites find the callee by name
+  JitFunctionRegistry::RegisterExecutor(function_name, executor.get());
+  return executor;
 }
 
 } // namespace ovum::vm::jit
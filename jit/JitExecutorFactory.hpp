@@ -16,6 +16,10 @@ public:
   JitExecutorFactory();
   [[nodiscard]] std::unique_ptr<executor::IJitExecutor> Create(const std::string&,
                                                                std::shared_ptr<std::vector<TokenPtr>>) const override;
+
+private:
+  // Target features are probed once, all executors generate code for them
+  JitCompileOptions compile_options_;
 };
 
 } // namespace ovum::vm::jit
@@ -0,0 +1,146 @@
+#include "JitFunctionRegistry.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <jit/JitExecutor.hpp>
+#include <jit/oil-to-asm-realisation/AsmToBytes.hpp>
+
+namespace ovum::vm::jit {
+
+std::mutex JitFunctionRegistry::s_mutex;
+std::unordered_map<std::string, std::unique_ptr<JitFunctionEntry>> JitFunctionRegistry::s_entries;
+std::unique_ptr<MachineCodeFunction<void()>> JitFunctionRegistry::s_resolver_stub;
+
+// Registers holding JIT function arguments (data buffer, argc, argv) when the stub is entered
+#ifdef _WIN32
+static const std::vector<Register> kJitArgumentRegisters = {Register::RCX, Register::RDX, Register::R8};
+static const Register kResolverArgumentRegister = Register::RCX;
+#else
+static const std::vector<Register> kJitArgumentRegisters = {Register::RDI, Register::RSI, Register::RDX};
+static const Register kResolverArgumentRegister = Register::RDI;
+#endif
+
+void JitFunctionRegistry::RegisterExecutor(const std::string& function_name, JitExecutor* executor) {
+  void* resolver_stub = GetResolverStub();
+
+  std::lock_guard lock(s_mutex);
+  auto& entry = s_entries[function_name];
+  if (!entry) {
+    entry = std::make_unique<JitFunctionEntry>();
+  }
+
+  entry->executor = executor;
+  entry->call_target.store(resolver_stub, std::memory_order_release);
+}
+
+void JitFunctionRegistry::UnregisterExecutor(const std::string& function_name, const JitExecutor* executor) {
+  void* resolver_stub = GetResolverStub();
+
+  std::lock_guard lock(s_mutex);
+  const auto it = s_entries.find(function_name);
+  if (it == s_entries.end() || it->second->executor != executor) {
+    return;
+  }
+
+  it->second->executor = nullptr;
+  it->second->call_target.store(resolver_stub, std::memory_order_release);
+}
+
+std::string_view JitFunctionRegistry::StripQuotes(std::string_view id) noexcept {
+  if (id.size() >= 2 && id.front() == '"' && id.back() == '"') {
+    return id.substr(1, id.size() - 2);
+  }
+  return id;
+}
+
+JitFunctionEntry* JitFunctionRegistry::Find(std::string_view function_name) {
+  std::lock_guard lock(s_mutex);
+  const auto it = s_entries.find(std::string(StripQuotes(function_name)));
+  return it != s_entries.end() ? it->second.get() : nullptr;
+}
+
+void JitFunctionRegistry::SetArity(std::string_view function_name, uint64_t arity) {
+  std::lock_guard lock(s_mutex);
+  auto& entry = s_entries[std::string(function_name)];
+  if (!entry) {
+    entry = std::make_unique<JitFunctionEntry>();
+  }
+
+  if (!entry->arity) {
+    entry->arity = arity;
+  }
+}
+
+void JitFunctionRegistry::PublishCode(std::string_view function_name, const JitExecutor* executor, void* entry_point) {
+  std::lock_guard lock(s_mutex);
+  const auto it = s_entries.find(std::string(function_name));
+  if (it == s_entries.end() || it->second->executor != executor) {
+    return;
+  }
+
+  it->second->call_target.store(entry_point, std::memory_order_release);
+}
+
+void* JitFunctionRegistry::GetResolverStub() {
+  std::lock_guard lock(s_mutex);
+  if (s_resolver_stub) {
+    return reinterpret_cast<void*>(s_resolver_stub->get());
+  }
+
+  std::vector<AssemblyInstruction> stub = {
+      // Frame pointer keeps the unaligned RSP of the call site
+      {AsmCommand::PUSH, {Register::RBP}},
+      {AsmCommand::MOV, {Register::RBP, Register::RSP}},
+  };
+  for (const Register reg : kJitArgumentRegisters) {
+    stub.push_back({AsmCommand::PUSH, {reg}});
+  }
+
+  const auto saved_size = static_cast<int64_t>(kJitArgumentRegisters.size() * sizeof(uint64_t));
+  stub.push_back({AsmCommand::AND, {Register::RSP, make_imm_arg(-16)}});
+#ifdef _WIN32
+  stub.push_back({AsmCommand::SUB, {Register::RSP, make_imm_arg(ShadowSpaceSizeBytes)}});
+#endif
+  stub.push_back({AsmCommand::MOV, {kResolverArgumentRegister, Register::RAX}});
+  stub.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(reinterpret_cast<int64_t>(&ResolveCall))}});
+  stub.push_back({AsmCommand::CALL, {Register::RAX}});
+
+  // RAX holds the compiled entry point, arguments are restored and the call continues there
+  stub.push_back({AsmCommand::MOV, {Register::RSP, Register::RBP}});
+  stub.push_back({AsmCommand::SUB, {Register::RSP, make_imm_arg(saved_size)}});
+  for (auto it = kJitArgumentRegisters.rbegin(); it != kJitArgumentRegisters.rend(); ++it) {
+    stub.push_back({AsmCommand::POP, {*it}});
+  }
+  stub.push_back({AsmCommand::POP, {Register::RBP}});
+  stub.push_back({AsmCommand::JMP, {Register::RAX}});
+
+  AsmToBytes asmtobytes;
+  auto code = asmtobytes.Convert(stub);
+  if (!code) {
+    std::cerr << "JitFunctionRegistry: cannot encode resolver stub: " << code.error().what() << std::endl;
+    std::abort();
+  }
+
+  s_resolver_stub = std::make_unique<MachineCodeFunction<void()>>(code.value());
+  return reinterpret_cast<void*>(s_resolver_stub->get());
+}
+
+void* JitFunctionRegistry::ResolveCall(JitFunctionEntry* entry) {
+  // Call sites are emitted only for compilable callees, a failure here leaves no way back to the interpreter
+  if (entry->executor == nullptr || !entry->executor->TryCompile()) {
+    std::cerr << "JitFunctionRegistry: native callee cannot be compiled" << std::endl;
+    std::abort();
+  }
+
+  void* target = entry->call_target.load(std::memory_order_acquire);
+  if (target == reinterpret_cast<void*>(s_resolver_stub->get())) {
+    std::cerr << "JitFunctionRegistry: compiled callee is not published" << std::endl;
+    std::abort();
+  }
+
+  return target;
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,71 @@
+#ifndef JIT_JITFUNCTIONREGISTRY_HPP
+#define JIT_JITFUNCTIONREGISTRY_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <jit/machine-code-runner/MachineCodeFunction.hpp>
+
+namespace ovum::vm::jit {
+
+class JitExecutor;
+
+// Native call target of one OIL function, entries are never removed so call sites may keep their addresses
+struct JitFunctionEntry {
+  // Address called by native call sites, the resolver stub until the function is compiled.
+  // Must stay the first member, call sites pass the cell address as the entry address.
+  std::atomic<void*> call_target = nullptr;
+  JitExecutor* executor = nullptr;
+  // Number of arguments taken from the caller evaluation stack
+  std::optional<uint64_t> arity;
+  // Calls made by native call sites, incremented without synchronization and used as a profile only
+  std::atomic<uint64_t> call_count = 0;
+};
+
+class JitFunctionRegistry {
+public:
+  JitFunctionRegistry() = delete;
+  JitFunctionRegistry(const JitFunctionRegistry&) = delete;
+  JitFunctionRegistry(JitFunctionRegistry&&) = delete;
+  ~JitFunctionRegistry() = delete;
+  JitFunctionRegistry& operator=(const JitFunctionRegistry&) = delete;
+  JitFunctionRegistry& operator=(JitFunctionRegistry&&) = delete;
+
+  static void RegisterExecutor(const std::string& function_name, JitExecutor* executor);
+
+  // Detaches the executor, its call sites go back to the resolver stub
+  static void UnregisterExecutor(const std::string& function_name, const JitExecutor* executor);
+
+  // Ids of Call and related commands may come as quoted string literals
+  [[nodiscard]] static std::string_view StripQuotes(std::string_view id) noexcept;
+
+  // Accepts the function id as written in OIL, quoted or not
+  [[nodiscard]] static JitFunctionEntry* Find(std::string_view function_name);
+
+  // Arity is supplied by the VM or learned from the first interpreted entry, the first value is kept
+  static void SetArity(std::string_view function_name, uint64_t arity);
+
+  // Makes call sites of the function jump straight to the entry point
+  static void PublishCode(std::string_view function_name, const JitExecutor* executor, void* entry_point);
+
+  // Stub called with the entry address in RAX and JIT function arguments in ABI registers,
+  // it compiles the callee, patches the entry and jumps to the compiled code
+  [[nodiscard]] static void* GetResolverStub();
+
+private:
+  static void* ResolveCall(JitFunctionEntry* entry);
+
+  static std::mutex s_mutex;
+  static std::unordered_map<std::string, std::unique_ptr<JitFunctionEntry>> s_entries;
+  static std::unique_ptr<MachineCodeFunction<void()>> s_resolver_stub;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_JITFUNCTIONREGISTRY_HPP
@@ -0,0 +1,34 @@
+#include "ObjectHeap.hpp"
+
+#include <utility>
+
+namespace ovum::vm::jit {
+
+ObjectHeapHooks ObjectHeap::s_hooks;
+
+void ObjectHeap::SetHooks(ObjectHeapHooks hooks) {
+  s_hooks = std::move(hooks);
+}
+
+std::optional<FieldLayout> ObjectHeap::ResolveField(uint64_t field_index) {
+  if (!s_hooks.resolve_field) {
+    return std::nullopt;
+  }
+  return s_hooks.resolve_field(field_index);
+}
+
+std::optional<ConstructorLayout> ObjectHeap::ResolveConstructor(std::string_view constructor_id) {
+  if (!s_hooks.resolve_constructor) {
+    return std::nullopt;
+  }
+  return s_hooks.resolve_constructor(constructor_id);
+}
+
+uint64_t* ObjectHeap::ResolveStatic(uint64_t slot) {
+  if (!s_hooks.resolve_static) {
+    return nullptr;
+  }
+  return s_hooks.resolve_static(slot);
+}
+
+} // namespace ovum::vm::jit
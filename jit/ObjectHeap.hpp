@@ -0,0 +1,92 @@
+#ifndef JIT_OBJECTHEAP_HPP
+#define JIT_OBJECTHEAP_HPP
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace ovum::vm::jit {
+
+struct FieldLayout {
+  // Offset of the field value from the object pointer
+  int64_t offset = 0;
+  // Stores of references go through the write barrier
+  bool is_reference = false;
+};
+
+// Allocation buffer of the thread running jitted code, objects are bumped from top to end
+struct AllocationBuffer {
+  uintptr_t top = 0;
+  uintptr_t end = 0;
+};
+
+struct ConstructorLayout {
+  // Constructor body registered in JitFunctionRegistry, the new object is its first argument
+  std::string function_name;
+  uint64_t object_size = 0;
+  // Initial header word and vtable of the object, the vtable is not written when null
+  uint64_t header = 0;
+  const void* vtable = nullptr;
+};
+
+// Heap knowledge supplied by the VM, field commands are not compiled until it is set
+struct ObjectHeapHooks {
+  // Layout of a field by its index as written in GetField and SetField
+  std::function<std::optional<FieldLayout>(uint64_t field_index)> resolve_field;
+  // Young generation bounds, read by the write barrier on every reference store as they move with collections
+  const uintptr_t* young_start = nullptr;
+  const uintptr_t* young_size = nullptr;
+  // Slow path of the write barrier, called when an object outside the young generation gets a young value.
+  // The barrier is not emitted without it.
+  void (*remember_reference)(void* object, void* value) = nullptr;
+
+  // Layout of the object built by a constructor as written in CallConstructor
+  std::function<std::optional<ConstructorLayout>(std::string_view constructor_id)> resolve_constructor;
+  // Buffer memory is zeroed by the VM, jitted code writes only the header and the vtable of new objects
+  AllocationBuffer* allocation_buffer = nullptr;
+  // Runtime allocator called when the buffer is exhausted, returns zeroed memory and may refill the buffer
+  void* (*allocate)(uint64_t size) = nullptr;
+  int64_t header_offset = 0;
+
+  // Address of a static slot as written in LoadStatic and SetStatic, fixed for the VM lifetime
+  std::function<uint64_t*(uint64_t slot)> resolve_static;
+};
+
+class ObjectHeap {
+public:
+  ObjectHeap() = delete;
+  ObjectHeap(const ObjectHeap&) = delete;
+  ObjectHeap(ObjectHeap&&) = delete;
+  ~ObjectHeap() = delete;
+  ObjectHeap& operator=(const ObjectHeap&) = delete;
+  ObjectHeap& operator=(ObjectHeap&&) = delete;
+
+  static void SetHooks(ObjectHeapHooks hooks);
+
+  [[nodiscard]] static const ObjectHeapHooks& GetHooks() noexcept {
+    return s_hooks;
+  }
+
+  [[nodiscard]] static std::optional<FieldLayout> ResolveField(uint64_t field_index);
+
+  [[nodiscard]] static std::optional<ConstructorLayout> ResolveConstructor(std::string_view constructor_id);
+
+  [[nodiscard]] static uint64_t* ResolveStatic(uint64_t slot);
+
+  [[nodiscard]] static bool HasAllocationBuffer() noexcept {
+    return s_hooks.allocation_buffer != nullptr && s_hooks.allocate != nullptr;
+  }
+
+  [[nodiscard]] static bool HasWriteBarrier() noexcept {
+    return s_hooks.remember_reference != nullptr && s_hooks.young_start != nullptr && s_hooks.young_size != nullptr;
+  }
+
+private:
+  static ObjectHeapHooks s_hooks;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_OBJECTHEAP_HPP
@@ -1,7 +1,19 @@
 #include "OilCommandAsmCompiler.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <iostream>
 
+#include <jit/oil-to-asm-realisation/AddressArithmetic.hpp>
+#include <jit/oil-to-asm-realisation/DeoptExits.hpp>
+#include <jit/oil-to-asm-realisation/FloatRegisterStack.hpp>
+#include <jit/oil-to-asm-realisation/LocalRegisters.hpp>
+#include <jit/oil-to-asm-realisation/RangeAnalysis.hpp>
+#include <jit/oil-to-asm-realisation/RedundantLoads.hpp>
+#include <jit/oil-to-asm-realisation/StackDepthVerifier.hpp>
+#include <jit/oil-to-asm-realisation/StaticEvaluationStack.hpp>
+#include <jit/oil-to-asm-realisation/StrengthReduction.hpp>
+
 namespace ovum::vm::jit {
 
 static const std::vector<AssemblyInstruction> prologue = {
@@ -165,7 +177,10 @@ const std::array<std::string_view, OilCommandAsmCompiler::s_all_command_num>
 
 std::unordered_map<std::string_view, std::vector<AssemblyInstruction>> OilCommandAsmCompiler::s_command_assemblers;
 
-void OilCommandAsmCompiler::InitializeStandardAssemblers() {
+CpuFeatures OilCommandAsmCompiler::s_target_features;
+
+void OilCommandAsmCompiler::InitializeStandardAssemblers(const CpuFeatures& target_features) {
+  s_target_features = target_features;
   InitializeStackOperations();
   InitializeIntegerOperations();
   InitializeFloatOperations();
@@ -185,38 +200,221 @@ void OilCommandAsmCompiler::InitializeStandardAssemblers() {
   // InitializeMemoryOperations();
 }
 
-std::vector<AssemblyInstruction> CreateArgumentPlacer(std::vector<std::string> args) {
-  // std::cout << "Called Create Arg placer with args size: " << args.size() << std::endl;
-  if (args.size() == 1) {
-    return {{AsmCommand::MOV, {Register::R11, make_imm_arg(std::stoi(args[0]))}}};
+std::expected<int64_t, std::runtime_error> ParseImmediateArgument(std::string_view command_name,
+                                                                 const std::string& argument) {
+  try {
+    if (command_name == "PushFloat") {
+      return std::bit_cast<int64_t>(std::stod(argument));
+    }
+
+    if (command_name == "PushBool") {
+      if (argument == "true") {
+        return 1;
+      }
+
+      if (argument == "false") {
+        return 0;
+      }
+
+      return std::stoll(argument) != 0 ? 1 : 0;
+    }
+
+    if (command_name == "PushChar" && argument.size() == 3 && argument.front() == '\'' && argument.back() == '\'') {
+      return static_cast<unsigned char>(argument[1]);
+    }
+
+    if (command_name == "PushByte") {
+      return static_cast<uint8_t>(std::stoll(argument));
+    }
+
+    return std::stoll(argument);
+  } catch (const std::exception&) {
+    return std::unexpected(std::runtime_error("ParseImmediateArgument: invalid argument '" + argument + "' for " +
+                                              std::string(command_name)));
+  }
+}
+
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateArgumentPlacer(
+    std::string_view command_name, const std::vector<std::string>& args) {
+  // Arguments are passed to the command template in R11, R10
+  static const std::array<Register, 2> argument_registers = {Register::R11, Register::R10};
+
+  if (args.size() > argument_registers.size()) {
+    return std::unexpected(std::runtime_error("CreateArgumentPlacer: too many arguments for " +
+                                              std::string(command_name)));
   }
-  if (args.size() == 2) {
-    return {{AsmCommand::MOV, {Register::R11, make_imm_arg(std::stoi(args[0]))}},
-            {AsmCommand::MOV, {Register::R10, make_imm_arg(std::stoi(args[1]))}}};
+
+  std::vector<AssemblyInstruction> result;
+  for (size_t i = 0; i < args.size(); ++i) {
+    auto value = ParseImmediateArgument(command_name, args[i]);
+    if (!value) {
+      return std::unexpected(value.error());
+    }
+    result.push_back({AsmCommand::MOV, {argument_registers[i], make_imm_arg(value.value())}});
   }
-  return {};
+
+  return result;
 }
 
-const std::vector<AssemblyInstruction> OilCommandAsmCompiler::Compile(std::vector<PackedOilCommand>& packed_oil_body) {
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> OilCommandAsmCompiler::Compile(
+    std::vector<PackedOilCommand>& packed_oil_body,
+    const JitCompileOptions& options,
+    DeoptTable* deopt_table,
+    JitCompileStatistics* statistics) {
+  // Unbalanced bodies would corrupt the machine stack, they are rejected before any code is emitted
+  auto stack_depth = StackDepthVerifier::Verify(packed_oil_body);
+  if (!stack_depth) {
+    return std::unexpected(stack_depth.error());
+  }
+
   std::vector<AssemblyInstruction> result;
+  LocalRegisters locals(result, packed_oil_body, options);
+  locals.SaveRegisters();
   result.insert(result.end(), prologue.begin(), prologue.end());
-  for (auto poc : packed_oil_body) {
-    if (poc.arguments.empty()) {
-      auto cmd = GetAssemblyForCommand(poc.command_name);
-      result.insert(result.end(), cmd.begin(), cmd.end());
-    } else {
-      auto cmd = GetAssemblyForCommandWithArgs(poc.command_name, poc.arguments);
-      result.insert(result.end(), cmd.begin(), cmd.end());
+  const size_t body_begin = result.size();
+  locals.LoadLiveIn();
+  FloatRegisterStack float_stack(result, packed_oil_body, locals, options.target_features);
+  DeoptExits deopt_exits(result, packed_oil_body, locals, deopt_table, options);
+  StrengthReduction strength_reduction(result, packed_oil_body);
+  AddressArithmetic address_arithmetic(result, packed_oil_body, locals);
+  RedundantLoads redundant_loads(result, packed_oil_body, options);
+  const RangeAnalysis ranges(packed_oil_body);
+  for (size_t i = 0; i < packed_oil_body.size(); ++i) {
+    auto& poc = packed_oil_body[i];
+    if (options.eliminate_redundant_loads) {
+      redundant_loads.Advance(i, options.fuse_address_arithmetic && address_arithmetic.IsInsideRun(i));
     }
+
+    if (options.keep_floats_in_registers) {
+      auto lowered = float_stack.TryLower(i);
+      if (!lowered) {
+        return std::unexpected(lowered.error());
+      }
+
+      if (lowered.value()) {
+        continue;
+      }
+
+      // Other commands work with the machine stack only
+      float_stack.Materialize();
+    }
+
+    if (options.eliminate_redundant_loads && redundant_loads.TryLower(i)) {
+      continue;
+    }
+
+    if (options.fuse_address_arithmetic && address_arithmetic.TryLower(i)) {
+      continue;
+    }
+
+    auto local = locals.TryLower(i);
+    if (!local) {
+      return std::unexpected(local.error());
+    }
+
+    if (local.value()) {
+      continue;
+    }
+
+    if (options.strength_reduction && strength_reduction.TryLower(i)) {
+      continue;
+    }
+
+    // Divisions proven not to fault need neither an exit nor a fault site and use the plain template
+    const bool is_division = IsTrappingCommand(poc.command_name);
+    const bool is_unchecked = is_division && options.eliminate_range_checks && ranges.IsNonFaulting(i);
+    if (is_division && statistics != nullptr) {
+      ++statistics->division_checks;
+      statistics->eliminated_division_checks += is_unchecked ? 1 : 0;
+    }
+
+    auto guarded = is_unchecked ? false : deopt_exits.TryLower(i);
+    if (!guarded) {
+      return std::unexpected(guarded.error());
+    }
+
+    if (guarded.value()) {
+      continue;
+    }
+
+    if (IsCallOperation(poc.command_name)) {
+      auto call = CreateCallOperation(poc);
+      if (!call) {
+        return std::unexpected(call.error());
+      }
+      result.insert(result.end(), call->begin(), call->end());
+      continue;
+    }
+
+    if (IsObjectOperation(poc.command_name)) {
+      auto operation = CreateObjectOperation(poc, options);
+      if (!operation) {
+        return std::unexpected(operation.error());
+      }
+      result.insert(result.end(), operation->begin(), operation->end());
+      continue;
+    }
+
+    // Commands without lowering make the whole body non-compilable, dropping them would miscompile it
+    auto cmd = GetAssemblyForCommandWithArgs(poc.command_name, poc.arguments);
+    if (!cmd) {
+      return std::unexpected(cmd.error());
+    }
+    result.insert(result.end(), cmd->begin(), cmd->end());
+  }
+  float_stack.Materialize();
+  locals.WriteBack();
+  // Result is taken from the evaluation stack, the rest of the epilogue restores RSP from the data buffer
+  result.push_back(epilogue.front());
+  deopt_exits.EmitExits();
+  if (options.static_evaluation_stack) {
+    const std::vector<AssemblyInstruction> body(result.begin() + static_cast<ptrdiff_t>(body_begin), result.end());
+    auto lowered = StaticEvaluationStack::Lower(body, deopt_exits.GetFaultEntryDepths());
+    if (lowered) {
+      result.resize(body_begin);
+      result.insert(result.end(), lowered->begin(), lowered->end());
+    }
+  }
+  deopt_exits.EmitExitLabel();
+
+  // Division errors leave through the rest of the epilogue, which does not depend on RSP
+  const auto jumps_to_division_error = [](const AssemblyInstruction& instruction) {
+    const auto label = instruction.get_argument<std::string>(0);
+    return instruction.command != AsmCommand::LABEL && label && label.value() == DivisionErrorLabel;
+  };
+  const bool reports_division_errors =
+      std::any_of(result.begin() + static_cast<ptrdiff_t>(body_begin), result.end(), jumps_to_division_error);
+  const std::string leave_label = DivisionErrorLabel + "_leave";
+  result.push_back(epilogue[1]);
+  if (reports_division_errors) {
+    result.push_back({AsmCommand::LABEL, {leave_label}});
+  }
+  result.insert(result.end(), epilogue.begin() + 2, epilogue.end() - 1);
+  locals.RestoreRegisters();
+  result.push_back(epilogue.back());
+
+  if (reports_division_errors) {
+    result.push_back({AsmCommand::LABEL, {DivisionErrorLabel}});
+    const auto exit = static_cast<int64_t>(AsmDataBuffer::kDivisionErrorExit);
+    result.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(exit)}});
+    result.push_back({AsmCommand::MOV, {addr(Register::R14, AsmDataBuffer::GetDeoptExitOffset()), Register::RAX}});
+    result.push_back({AsmCommand::JMP, {leave_label}});
   }
-  // result.insert(result.end(), caller.begin(), caller.end());
-  result.insert(result.end(), epilogue.begin(), epilogue.end());
   return result;
 }
 
+const std::vector<AssemblyInstruction>& OilCommandAsmCompiler::GetPrologue() noexcept {
+  return prologue;
+}
+
+const std::vector<AssemblyInstruction>& OilCommandAsmCompiler::GetEpilogue() noexcept {
+  return epilogue;
+}
+
 void OilCommandAsmCompiler::AddStandardAssembly(std::string_view command_name,
                                                 std::vector<AssemblyInstruction>&& instructions) {
-  s_command_assemblers.emplace(command_name, std::move(instructions));
+  // Initialization for other target features replaces the assemblies of the previous one
+  s_command_assemblers.insert_or_assign(command_name, std::move(instructions));
 }
 
 /*
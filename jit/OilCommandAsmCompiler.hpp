@@ -2,13 +2,18 @@
 
 #include <array>
 #include <cstdint>
+#include <expected>
 #include <functional>
+#include <limits>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include <jit/AsmCompiler.hpp>
+#include <jit/CpuFeatures.hpp>
 #include <jit/machine-code-runner/AsmDataBuffer.hpp>
 #include <jit/oil-to-asm-realisation/AsmComplexOperationManager.hpp>
 #include "AsmData.hpp"
@@ -17,12 +22,97 @@ namespace ovum::vm::jit {
 
 const uint64_t ShadowSpaceSizeBytes = 32;
 
+// First integer argument registers of the native calling convention, for JIT functions: data buffer, argc, argv
+#ifdef _WIN32
+const std::array<Register, 3> CallArgumentRegisters = {Register::RCX, Register::RDX, Register::R8};
+#else
+const std::array<Register, 3> CallArgumentRegisters = {Register::RDI, Register::RSI, Register::RDX};
+#endif
+
+// Division errors, null Unwraps and virtual calls without a native target in frames the interpreter cannot
+// resume, and in native callees, jump here. The frame returns with AsmDataBuffer::kDivisionErrorExit, so its
+// native callers do the same.
+const std::string DivisionErrorLabel = "division_error";
+
+// Sign bit of a double, negation flips it
+const int64_t FloatSignMask = std::numeric_limits<int64_t>::min();
+
+struct DeoptTable;
+
+struct JitCompileOptions {
+  // Float values stay in XMM registers between Float* commands and reach the stack only at other commands
+  bool keep_floats_in_registers = true;
+  // Instruction set extensions lowering may use, defaults to baseline x86-64
+  CpuFeatures target_features;
+  // Locals used more than once stay in callee-saved registers, the VM frame is updated at calls and the exit
+  bool keep_locals_in_registers = true;
+  // Evaluation stack frame is reserved once and addressed from RSP with offsets known at compile time,
+  // bodies with run time stack changes keep pushing to RSP
+  bool static_evaluation_stack = true;
+  // Statics are addressed RIP-relative, absolute addresses are used when the code lands out of their reach
+  bool rip_relative_statics = true;
+  // Guarded commands are lowered for the common case and leave to the interpreter otherwise,
+  // without speculation bodies containing them are not compiled
+  bool speculate = true;
+  // Unwrap followed by a field access of the value is checked by the fault of the access itself
+  bool implicit_null_checks = true;
+  // Divisions in frames entered from the interpreter leave to it by their fault instead of an explicit check
+  // of the operands
+  bool implicit_division_checks = true;
+  // Multiplications, divisions and modulos by a pushed constant are lowered without IMUL, IDIV and DIV
+  bool strength_reduction = true;
+  // Additions of locals, constants and scaled locals are computed by a single LEA
+  bool fuse_address_arithmetic = true;
+  // Repeated loads of a field of the same object or of a static are taken from a register while no store
+  // or call in between can change them
+  bool eliminate_redundant_loads = true;
+  // Integer computations repeated with the same operands are taken from a register as well, as hoisting
+  // invariant computations out of a loop would
+  bool reuse_computations = true;
+  // Divisions whose operand ranges rule out the zero divisor and the overflow of the minimum divided by -1
+  // run without a check
+  bool eliminate_range_checks = true;
+  // Optimizing tier code is reordered within straight-line runs to hide the latencies of the target
+  // microarchitecture
+  bool schedule_instructions = true;
+};
+
+// Counts of one compiled body
+struct JitCompileStatistics {
+  // Integer and byte divisions left to IDIV and DIV, each needs a check for the zero divisor and the overflow
+  size_t division_checks = 0;
+  // Those of them proven never to fault
+  size_t eliminated_division_checks = 0;
+};
+
 std::vector<AssemblyInstruction> CreateOperationCaller(CalledOperationCode op_code);
-std::vector<AssemblyInstruction> CreateArgumentPlacer(std::vector<std::string> args);
+// Native call of a registered JIT function, arguments are taken from the evaluation stack and replaced by the result
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateNativeCall(const std::string& function_id);
+// Virtual call through a polymorphic inline cache on the receiver vtable, the receiver is the first argument.
+// A target that cannot be called natively jumps to miss_label with the arguments still on the stack.
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateVirtualCall(const std::string& method_name,
+                                                                                    const std::string& miss_label);
+// Allocation from the VM allocation buffer with the constructor body called on the new object, which is pushed
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateConstructorCall(
+    const std::string& constructor_name);
+// Call and inlined frame boundaries, their code depends on the callee and is not available as a template
+bool IsCallOperation(std::string_view command_name);
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateCallOperation(
+    const PackedOilCommand& command);
+// Vtable, field and static commands, class vtables, field layouts and static slots come from the VM hooks
+// at compile time
+bool IsObjectOperation(std::string_view command_name);
+bool CanCreateObjectOperation(const PackedOilCommand& command);
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateObjectOperation(
+    const PackedOilCommand& command, const JitCompileOptions& options);
+std::expected<int64_t, std::runtime_error> ParseImmediateArgument(std::string_view command_name,
+                                                                 const std::string& argument);
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateArgumentPlacer(
+    std::string_view command_name, const std::vector<std::string>& args);
 
 class OilCommandAsmCompiler {
 private:
-  static const size_t s_all_command_num = 125;
+  static const size_t s_all_command_num = 133;
 
 public:
   OilCommandAsmCompiler() = delete;
@@ -31,7 +121,16 @@ public:
   OilCommandAsmCompiler& operator=(const OilCommandAsmCompiler&) = delete;
   OilCommandAsmCompiler& operator=(OilCommandAsmCompiler&&) = delete;
 
-  [[nodiscard]] static const std::vector<AssemblyInstruction> Compile(std::vector<PackedOilCommand>& packed_oil_body);
+  // Guards are emitted only when the table for their metadata is given
+  [[nodiscard]] static std::expected<std::vector<AssemblyInstruction>, std::runtime_error> Compile(
+      std::vector<PackedOilCommand>& packed_oil_body,
+      const JitCompileOptions& options = {},
+      DeoptTable* deopt_table = nullptr,
+      JitCompileStatistics* statistics = nullptr);
+
+  [[nodiscard]] static const std::vector<AssemblyInstruction>& GetPrologue() noexcept;
+
+  [[nodiscard]] static const std::vector<AssemblyInstruction>& GetEpilogue() noexcept;
 
   [[nodiscard]] static const std::vector<AssemblyInstruction>& GetAssemblyForCommand(
       std::string_view command_name) noexcept {
@@ -44,19 +143,23 @@ public:
     return empty_vector;
   }
 
-  [[nodiscard]] static const std::vector<AssemblyInstruction> GetAssemblyForCommandWithArgs(
-      std::string_view command_name, std::vector<std::string>& command_args) noexcept {
-    static const std::vector<AssemblyInstruction> empty_vector;
+  [[nodiscard]] static std::expected<std::vector<AssemblyInstruction>, std::runtime_error>
+  GetAssemblyForCommandWithArgs(std::string_view command_name, std::vector<std::string>& command_args) {
     std::vector<AssemblyInstruction> result;
 
     const auto it = s_command_assemblers.find(command_name);
-    if (it != s_command_assemblers.end()) {
-      auto arg_placer = CreateArgumentPlacer(command_args);
-      result.insert(result.end(), arg_placer.begin(), arg_placer.end());
-      result.insert(result.end(), it->second.begin(), it->second.end());
-      return result;
+    if (it == s_command_assemblers.end()) {
+      return std::unexpected(std::runtime_error("No assembly for command: " + std::string(command_name)));
     }
-    return empty_vector;
+
+    auto arg_placer = CreateArgumentPlacer(command_name, command_args);
+    if (!arg_placer) {
+      return std::unexpected(arg_placer.error());
+    }
+
+    result.insert(result.end(), arg_placer->begin(), arg_placer->end());
+    result.insert(result.end(), it->second.begin(), it->second.end());
+    return result;
   }
 
   [[nodiscard]] static bool HasAssemblyForCommand(std::string_view command_name) noexcept {
@@ -67,17 +170,29 @@ public:
     return s_all_command_names;
   }
 
+  [[nodiscard]] static const std::unordered_map<std::string_view, std::vector<AssemblyInstruction>>&
+  GetAllCommandAssemblers() noexcept {
+    return s_command_assemblers;
+  }
+
   static bool RegisterCustomAssembly(std::string_view command_name, std::vector<AssemblyInstruction>&& instructions) {
     return s_command_assemblers.emplace(command_name, std::move(instructions)).second;
   }
 
-  static void InitializeStandardAssemblers();
+  // Templates are specialized for the target features, they have to be supported by the CPU running the code
+  static void InitializeStandardAssemblers(const CpuFeatures& target_features = {});
+
+  [[nodiscard]] static const CpuFeatures& GetTargetFeatures() noexcept {
+    return s_target_features;
+  }
 
 private:
   static const std::array<std::string_view, s_all_command_num> s_all_command_names;
 
   static std::unordered_map<std::string_view, std::vector<AssemblyInstruction>> s_command_assemblers;
 
+  static CpuFeatures s_target_features;
+
   static void InitializeStackOperations();
 
   static void InitializeIntegerOperations();
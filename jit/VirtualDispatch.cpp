@@ -0,0 +1,104 @@
+#include "VirtualDispatch.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#include <jit/JitExecutor.hpp>
+
+namespace ovum::vm::jit {
+
+VirtualDispatchHooks VirtualDispatch::s_hooks;
+std::mutex VirtualDispatch::s_mutex;
+std::vector<std::unique_ptr<InlineCacheSite>> VirtualDispatch::s_sites;
+std::unordered_map<std::pair<const void*, std::string>,
+                   std::unique_ptr<InlineCacheEntry>,
+                   VirtualDispatch::MegamorphicKeyHash>
+    VirtualDispatch::s_megamorphic_cache;
+
+size_t VirtualDispatch::MegamorphicKeyHash::operator()(const std::pair<const void*, std::string>& key) const noexcept {
+  return std::hash<const void*>{}(key.first) ^ (std::hash<std::string>{}(key.second) << 1);
+}
+
+void VirtualDispatch::SetHooks(VirtualDispatchHooks hooks) {
+  std::lock_guard lock(s_mutex);
+  s_hooks = std::move(hooks);
+}
+
+InlineCacheSite* VirtualDispatch::CreateSite(std::string_view method_id) {
+  std::lock_guard lock(s_mutex);
+  auto& site = s_sites.emplace_back(std::make_unique<InlineCacheSite>());
+  site->method_id = method_id;
+  return site.get();
+}
+
+const InlineCacheEntry* VirtualDispatch::HandleMiss(InlineCacheSite* site, const void* vtable) {
+  std::lock_guard lock(s_mutex);
+  ++site->misses;
+
+  if (!site->megamorphic) {
+    // Another thread may have cached the vtable since the machine code compared it
+    const auto cached_end = site->entries.begin() + static_cast<ptrdiff_t>(site->entry_count);
+    const auto cached = std::find_if(site->entries.begin(), cached_end, [vtable](const InlineCacheEntry& entry) {
+      return entry.vtable == vtable;
+    });
+    if (cached != cached_end) {
+      return &*cached;
+    }
+
+    if (site->entry_count < InlineCacheSite::kMaxEntries) {
+      InlineCacheEntry& entry = site->entries[site->entry_count];
+      if (!FillEntry(entry, site->method_id, vtable)) {
+        return nullptr;
+      }
+      ++site->entry_count;
+      return &entry;
+    }
+
+    site->megamorphic = true;
+  }
+
+  auto [it, inserted] = s_megamorphic_cache.try_emplace({vtable, site->method_id});
+  if (inserted) {
+    it->second = std::make_unique<InlineCacheEntry>();
+    if (!FillEntry(*it->second, site->method_id, vtable)) {
+      s_megamorphic_cache.erase(it);
+      return nullptr;
+    }
+  }
+  return it->second.get();
+}
+
+std::vector<InlineCacheStatistics> VirtualDispatch::GetStatistics() {
+  std::lock_guard lock(s_mutex);
+  std::vector<InlineCacheStatistics> result;
+  result.reserve(s_sites.size());
+  for (const auto& site : s_sites) {
+    const uint64_t hits = std::atomic_ref<uint64_t>(site->hits).load(std::memory_order_relaxed);
+    result.push_back({site->method_id, hits, site->misses, site->entry_count, site->megamorphic});
+  }
+  return result;
+}
+
+bool VirtualDispatch::FillEntry(InlineCacheEntry& entry, const std::string& method_id, const void* vtable) {
+  const auto function_name = s_hooks.resolve_method(vtable, method_id);
+  const auto arity = s_hooks.method_arity(method_id);
+  JitFunctionEntry* target = function_name ? JitFunctionRegistry::Find(function_name.value()) : nullptr;
+  if (target == nullptr || target->executor == nullptr || !arity) {
+    return false;
+  }
+
+  // Overrides share the arity of the method
+  JitFunctionRegistry::SetArity(function_name.value(), arity.value());
+  const auto local_slot_count = target->executor->GetLocalSlotCount();
+  if (!local_slot_count || target->arity != arity) {
+    return false;
+  }
+
+  entry.target = target;
+  entry.local_slot_count = std::max(arity.value(), local_slot_count.value());
+  entry.frame_size = sizeof(AsmDataBuffer) + entry.local_slot_count * sizeof(uint64_t);
+  std::atomic_ref<const void*>(entry.vtable).store(vtable, std::memory_order_release);
+  return true;
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,108 @@
+#ifndef JIT_VIRTUALDISPATCH_HPP
+#define JIT_VIRTUALDISPATCH_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <jit/JitFunctionRegistry.hpp>
+
+namespace ovum::vm::jit {
+
+// Object model knowledge supplied by the VM, CallVirtual and vtable commands are not compiled until it is set
+struct VirtualDispatchHooks {
+  // Name of the function implementing the method for the vtable, as registered in JitFunctionRegistry
+  std::function<std::optional<std::string>(const void* vtable, std::string_view method_id)> resolve_method;
+  // Number of method arguments, the receiver is the first one
+  std::function<std::optional<uint64_t>(std::string_view method_id)> method_arity;
+  // Vtable of the class with the given name
+  std::function<const void*(std::string_view class_name)> resolve_vtable;
+  // Offset of the vtable pointer in an object
+  int64_t vtable_offset = 0;
+};
+
+// Cached dispatch target, layout is read by the CallVirtual machine code.
+// The vtable is stored last when an entry is filled, so a matching vtable implies a valid target.
+struct InlineCacheEntry {
+  const void* vtable = nullptr;
+  JitFunctionEntry* target = nullptr;
+  // Callee data buffer and local slots reserved by the call site
+  uint64_t frame_size = 0;
+  uint64_t local_slot_count = 0;
+};
+
+// State of one CallVirtual site, never freed while code referencing it may run
+struct InlineCacheSite {
+  static constexpr size_t kMaxEntries = 4;
+
+  std::string method_id;
+  std::array<InlineCacheEntry, kMaxEntries> entries;
+  // Hits are counted by the machine code without synchronization
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  size_t entry_count = 0;
+  bool megamorphic = false;
+};
+
+struct InlineCacheStatistics {
+  std::string method_id;
+  uint64_t hits;
+  uint64_t misses;
+  size_t cached_targets;
+  bool megamorphic;
+};
+
+class VirtualDispatch {
+public:
+  VirtualDispatch() = delete;
+  VirtualDispatch(const VirtualDispatch&) = delete;
+  VirtualDispatch(VirtualDispatch&&) = delete;
+  ~VirtualDispatch() = delete;
+  VirtualDispatch& operator=(const VirtualDispatch&) = delete;
+  VirtualDispatch& operator=(VirtualDispatch&&) = delete;
+
+  static void SetHooks(VirtualDispatchHooks hooks);
+
+  [[nodiscard]] static const VirtualDispatchHooks& GetHooks() noexcept {
+    return s_hooks;
+  }
+
+  [[nodiscard]] static bool HasHooks() noexcept {
+    return s_hooks.resolve_method && s_hooks.method_arity;
+  }
+
+  [[nodiscard]] static InlineCacheSite* CreateSite(std::string_view method_id);
+
+  // Called by the machine code when no cached vtable matches. Caches the target in the site while it has
+  // free entries, after that the site is megamorphic and misses are served from a shared hash table.
+  // nullptr when the target cannot be called natively, the call site leaves the call to the interpreter then.
+  static const InlineCacheEntry* HandleMiss(InlineCacheSite* site, const void* vtable);
+
+  [[nodiscard]] static std::vector<InlineCacheStatistics> GetStatistics();
+
+private:
+  struct MegamorphicKeyHash {
+    size_t operator()(const std::pair<const void*, std::string>& key) const noexcept;
+  };
+
+  // Resolves and checks the target, the entry is left unfilled when it cannot be called natively
+  [[nodiscard]] static bool FillEntry(InlineCacheEntry& entry, const std::string& method_id, const void* vtable);
+
+  static VirtualDispatchHooks s_hooks;
+  static std::mutex s_mutex;
+  static std::vector<std::unique_ptr<InlineCacheSite>> s_sites;
+  static std::unordered_map<std::pair<const void*, std::string>, std::unique_ptr<InlineCacheEntry>, MegamorphicKeyHash>
+      s_megamorphic_cache;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_VIRTUALDISPATCH_HPP
@@ -65,4 +65,12 @@ uint64_t AsmDataBuffer::GetResultOffset() {
   return offsetof(AsmDataBuffer, Result);
 }
 
+uint64_t AsmDataBuffer::GetDeoptExitOffset() {
+  return offsetof(AsmDataBuffer, DeoptExit);
+}
+
+uint64_t AsmDataBuffer::GetDeoptStackOffset() {
+  return offsetof(AsmDataBuffer, DeoptStack);
+}
+
 } // namespace ovum::vm::jit
@@ -28,12 +28,22 @@ struct AsmDataBuffer {
   uint64_t RegisterXMM4DataCell = 0; //| 120
   uint64_t RegisterXMM5DataCell = 0; //| 128
 #endif
+  // Number of the exit of a failed guard plus one, and the buffer its frame stack is copied to, top first.
+  // The buffer is 0 in frames of native calls, they cannot leave to the interpreter.
+  uint64_t DeoptExit = 0;
+  uint64_t DeoptStack = 0;
+
+  // DeoptExit of a frame stopped by an integer division error, a null Unwrap or a virtual call target without
+  // native code, it could not leave to the interpreter with
+  static constexpr uint64_t kDivisionErrorExit = UINT64_MAX;
 
   AsmDataBuffer() = default;
   ~AsmDataBuffer() = default;
 
   static uint64_t GetOffset(Register reg);
   static uint64_t GetResultOffset();
+  static uint64_t GetDeoptExitOffset();
+  static uint64_t GetDeoptStackOffset();
 };
 
 } // namespace ovum::vm::jit
@@ -9,11 +9,19 @@ void code_vector::append_uint64(uint64_t value) {
   }
 }
 
-ExecutableMemory::ExecutableMemory(size_t size) : size_(size) {
+ExecutableMemory::ExecutableMemory(size_t size, const void* near_address) : size_(size) {
 #ifdef _WIN32
+  (void)near_address;
   data_ = VirtualAlloc(0, size, MEM_COMMIT, PAGE_READWRITE);
 #else
-  data_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  // Only a hint, the mapping goes elsewhere when the range below near_address is taken
+  constexpr uintptr_t kNearDistance = uintptr_t{1} << 30;
+  void* hint = nullptr;
+  const auto near_value = reinterpret_cast<uintptr_t>(near_address);
+  if (near_value > kNearDistance) {
+    hint = reinterpret_cast<void*>((near_value - kNearDistance) & ~uintptr_t{0xFFFF});
+  }
+  data_ = mmap(hint, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
 #endif
 }
 
@@ -13,9 +13,28 @@
 
 namespace ovum::vm::jit {
 
+// RIP-relative displacement at offset, the instruction ends right after it
+struct RipRelocation {
+  size_t offset;
+  uint64_t target;
+};
+
+// kNullAccess - access through a null object, kDivide - division by zero or overflowing division
+enum class FaultKind : uint8_t { kNullAccess, kDivide };
+
+// Instruction at offset may fault, execution continues at target then
+struct FaultRedirect {
+  size_t offset;
+  size_t target;
+  FaultKind kind;
+};
+
 class code_vector : public std::vector<uint8_t> {
 public:
   void append_uint64(uint64_t value);
+
+  std::vector<RipRelocation> rip_relocations;
+  std::vector<FaultRedirect> fault_redirects;
 };
 
 class ExecutableMemory {
@@ -23,7 +42,8 @@ class ExecutableMemory {
   size_t size_;
 
 public:
-  ExecutableMemory(size_t size);
+  // Memory is placed close to near_address when the system allows it
+  ExecutableMemory(size_t size, const void* near_address = nullptr);
 
   ~ExecutableMemory();
 
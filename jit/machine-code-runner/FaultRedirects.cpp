@@ -0,0 +1,139 @@
+#include "FaultRedirects.hpp"
+
+#ifndef _WIN32
+#include <csignal>
+#include <ucontext.h>
+#endif
+
+#include "AsmDataBuffer.hpp"
+
+namespace ovum::vm::jit {
+
+std::mutex FaultRedirects::s_mutex;
+std::map<uintptr_t, FaultRedirects::Target> FaultRedirects::s_targets;
+bool FaultRedirects::s_installed = false;
+
+namespace {
+
+bool IsNullPageAccess(uintptr_t address) {
+  return address < static_cast<uintptr_t>(FaultRedirects::kNullPageSize);
+}
+
+#ifdef _WIN32
+LONG CALLBACK HandleException(EXCEPTION_POINTERS* exception) {
+  const EXCEPTION_RECORD* record = exception->ExceptionRecord;
+  FaultKind kind = FaultKind::kDivide;
+  if (record->ExceptionCode == EXCEPTION_ACCESS_VIOLATION) {
+    if (record->NumberParameters < 2 || !IsNullPageAccess(static_cast<uintptr_t>(record->ExceptionInformation[1]))) {
+      return EXCEPTION_CONTINUE_SEARCH;
+    }
+    kind = FaultKind::kNullAccess;
+  } else if (record->ExceptionCode != EXCEPTION_INT_DIVIDE_BY_ZERO &&
+             record->ExceptionCode != EXCEPTION_INT_OVERFLOW) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+
+  CONTEXT* context = exception->ContextRecord;
+  const uintptr_t target =
+      FaultRedirects::Find(kind, static_cast<uintptr_t>(context->Rip), static_cast<uintptr_t>(context->R14));
+  if (target == 0) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+  context->Rip = target;
+  return EXCEPTION_CONTINUE_EXECUTION;
+}
+#elif defined(__linux__) && defined(__x86_64__)
+struct sigaction s_previous_segv_action;
+struct sigaction s_previous_fpe_action;
+
+void HandleSignal(int signal, siginfo_t* info, void* context) {
+  auto* machine_context = &static_cast<ucontext_t*>(context)->uc_mcontext;
+  const bool is_divide = signal == SIGFPE;
+  if (is_divide || IsNullPageAccess(reinterpret_cast<uintptr_t>(info->si_addr))) {
+    const uintptr_t target = FaultRedirects::Find(is_divide ? FaultKind::kDivide : FaultKind::kNullAccess,
+                                                  static_cast<uintptr_t>(machine_context->gregs[REG_RIP]),
+                                                  static_cast<uintptr_t>(machine_context->gregs[REG_R14]));
+    if (target != 0) {
+      machine_context->gregs[REG_RIP] = static_cast<greg_t>(target);
+      return;
+    }
+  }
+
+  // Not an implicit check, the previous handler or the default action takes the fault
+  const struct sigaction& previous = is_divide ? s_previous_fpe_action : s_previous_segv_action;
+  if ((previous.sa_flags & SA_SIGINFO) != 0) {
+    previous.sa_sigaction(signal, info, context);
+  } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+    previous.sa_handler(signal);
+  } else {
+    // Returning retries the instruction, which faults again with the default action
+    sigaction(signal, &previous, nullptr);
+  }
+}
+#endif
+
+} // namespace
+
+bool FaultRedirects::IsSupported() noexcept {
+#if defined(_WIN32) || (defined(__linux__) && defined(__x86_64__))
+  return true;
+#else
+  return false;
+#endif
+}
+
+void FaultRedirects::Register(const void* code, const std::vector<FaultRedirect>& redirects) {
+  if (redirects.empty()) {
+    return;
+  }
+
+  std::lock_guard lock(s_mutex);
+  InstallHandler();
+  const auto base = reinterpret_cast<uintptr_t>(code);
+  for (const FaultRedirect& redirect : redirects) {
+    s_targets[base + redirect.offset] = {base + redirect.target, redirect.kind};
+  }
+}
+
+void FaultRedirects::Unregister(const void* code, const std::vector<FaultRedirect>& redirects) {
+  std::lock_guard lock(s_mutex);
+  const auto base = reinterpret_cast<uintptr_t>(code);
+  for (const FaultRedirect& redirect : redirects) {
+    s_targets.erase(base + redirect.offset);
+  }
+}
+
+uintptr_t FaultRedirects::Find(FaultKind kind, uintptr_t pc, uintptr_t data_buffer) {
+  std::lock_guard lock(s_mutex);
+  const auto it = s_targets.find(pc);
+  if (it == s_targets.end() || it->second.kind != kind) {
+    return 0;
+  }
+
+  // Frames of native calls have no deoptimization stack, the exits of divisions report the error there
+  if (data_buffer == 0 ||
+      (kind != FaultKind::kDivide && reinterpret_cast<const AsmDataBuffer*>(data_buffer)->DeoptStack == 0)) {
+    return 0;
+  }
+  return it->second.address;
+}
+
+void FaultRedirects::InstallHandler() {
+  if (s_installed) {
+    return;
+  }
+  s_installed = true;
+
+#ifdef _WIN32
+  AddVectoredExceptionHandler(1, HandleException);
+#elif defined(__linux__) && defined(__x86_64__)
+  struct sigaction action = {};
+  action.sa_sigaction = HandleSignal;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &s_previous_segv_action);
+  sigaction(SIGFPE, &action, &s_previous_fpe_action);
+#endif
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,57 @@
+#ifndef JIT_FAULTREDIRECTS_HPP
+#define JIT_FAULTREDIRECTS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "ExecutableMemory.hpp"
+
+namespace ovum::vm::jit {
+
+// Implicit checks: placed code dereferences possibly null objects and divides without testing the operands.
+// A fault of a registered instruction continues at the code its redirect points to, when the frame running it
+// was entered from the interpreter or the fault is a division. Other faults go to the previous handler.
+class FaultRedirects {
+public:
+  FaultRedirects() = delete;
+  FaultRedirects(const FaultRedirects&) = delete;
+  FaultRedirects(FaultRedirects&&) = delete;
+  ~FaultRedirects() = delete;
+  FaultRedirects& operator=(const FaultRedirects&) = delete;
+  FaultRedirects& operator=(FaultRedirects&&) = delete;
+
+  // Accesses below this offset from a null object are caught, larger ones need explicit checks
+  static constexpr int64_t kNullPageSize = 4096;
+
+  // False when the fault handler cannot be installed on this system, operands are checked explicitly then
+  [[nodiscard]] static bool IsSupported() noexcept;
+
+  // Redirects of code placed at code, the handler is installed with the first of them
+  static void Register(const void* code, const std::vector<FaultRedirect>& redirects);
+
+  static void Unregister(const void* code, const std::vector<FaultRedirect>& redirects);
+
+  // Target of an instruction at pc faulting with the kind, 0 if the fault is not redirected.
+  // data_buffer is the AsmDataBuffer of the faulting frame.
+  [[nodiscard]] static uintptr_t Find(FaultKind kind, uintptr_t pc, uintptr_t data_buffer);
+
+private:
+  struct Target {
+    uintptr_t address;
+    FaultKind kind;
+  };
+
+  static void InstallHandler();
+
+  // Locked by the handler too, faults come from placed code only, never from a thread holding the lock
+  static std::mutex s_mutex;
+  static std::map<uintptr_t, Target> s_targets;
+  static bool s_installed;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_FAULTREDIRECTS_HPP
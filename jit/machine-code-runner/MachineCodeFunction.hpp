@@ -3,9 +3,11 @@
 
 #include <cstdint>
 #include <cstring>
+#include <limits>
 #include <vector>
 
 #include "ExecutableMemory.hpp"
+#include "FaultRedirects.hpp"
 
 namespace ovum::vm::jit {
 
@@ -13,19 +15,58 @@ template<typename Func>
 class MachineCodeFunction {
 public:
   ExecutableMemory memory;
-  MachineCodeFunction(const code_vector& code) : memory(code.size()) {
+  MachineCodeFunction(const code_vector& code) :
+      memory(code.size(),
+             code.rip_relocations.empty() ? nullptr : reinterpret_cast<const void*>(code.rip_relocations[0].target)) {
     memcpy(memory.data(), code.data(), code.size());
+    relocated_ = ApplyRelocations(code);
     memory.make_executable();
+    if (relocated_) {
+      fault_redirects_ = code.fault_redirects;
+      FaultRedirects::Register(memory.data(), fault_redirects_);
+    }
+  }
+
+  MachineCodeFunction(const MachineCodeFunction&) = delete;
+  MachineCodeFunction& operator=(const MachineCodeFunction&) = delete;
+
+  ~MachineCodeFunction() {
+    if (!fault_redirects_.empty()) {
+      FaultRedirects::Unregister(memory.data(), fault_redirects_);
+    }
   }
 
   Func* get() const {
     return reinterpret_cast<Func*>(memory.data());
   }
 
+  // False when some RIP-relative target is out of reach of the placed code, the code must not run then
+  [[nodiscard]] bool IsRelocated() const noexcept {
+    return relocated_;
+  }
+
   template<typename... Args>
   auto operator()(Args... args) const -> decltype(get()(args...)) {
     return get()(args...);
   }
+
+private:
+  bool ApplyRelocations(const code_vector& code) {
+    auto* bytes = static_cast<uint8_t*>(memory.data());
+    for (const auto& relocation : code.rip_relocations) {
+      const auto next_instruction = reinterpret_cast<int64_t>(bytes + relocation.offset + sizeof(int32_t));
+      const int64_t displacement = static_cast<int64_t>(relocation.target) - next_instruction;
+      if (displacement < std::numeric_limits<int32_t>::min() || displacement > std::numeric_limits<int32_t>::max()) {
+        return false;
+      }
+      const auto displacement32 = static_cast<int32_t>(displacement);
+      memcpy(bytes + relocation.offset, &displacement32, sizeof(displacement32));
+    }
+    return true;
+  }
+
+  bool relocated_ = true;
+  std::vector<FaultRedirect> fault_redirects_;
 };
 
 } // namespace ovum::vm::jit
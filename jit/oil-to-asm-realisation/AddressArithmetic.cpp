@@ -0,0 +1,219 @@
+#include "AddressArithmetic.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <utility>
+
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/oil-to-asm-realisation/LocalRegisters.hpp>
+
+namespace ovum::vm::jit {
+
+namespace {
+
+// Longer runs are rare, the search from every command stays cheap
+constexpr size_t kMaxRunCommands = 16;
+
+bool FitsDisplacement(uint64_t value) {
+  const auto signed_value = static_cast<int64_t>(value);
+  return signed_value >= std::numeric_limits<int32_t>::min() && signed_value <= std::numeric_limits<int32_t>::max();
+}
+
+} // namespace
+
+AddressArithmetic::AddressArithmetic(std::vector<AssemblyInstruction>& output,
+                                     const std::vector<PackedOilCommand>& body,
+                                     const LocalRegisters& locals) : output_(output), body_(body), locals_(locals) {
+}
+
+bool AddressArithmetic::TryLower(size_t index) {
+  if (index < run_end_) {
+    return true;
+  }
+
+  const auto run = FindRun(index);
+  if (!run) {
+    return false;
+  }
+
+  // Locals are not written inside the run, so all of it is computed at its first command
+  Emit(run->form);
+  run_end_ = run->end + 1;
+  return true;
+}
+
+bool AddressArithmetic::IsInsideRun(size_t index) const {
+  return index < run_end_;
+}
+
+std::optional<AddressArithmetic::Run> AddressArithmetic::FindRun(size_t index) const {
+  std::vector<LinearForm> stack;
+  bool stack_value_used = false;
+  bool has_addition = false;
+  std::optional<Run> run;
+
+  // Operand of the command, the value below the run is taken once when the run has none left
+  auto pop = [&]() -> std::optional<LinearForm> {
+    if (!stack.empty()) {
+      LinearForm form = stack.back();
+      stack.pop_back();
+      return form;
+    }
+    if (stack_value_used) {
+      return std::nullopt;
+    }
+    stack_value_used = true;
+    return LinearForm{.base = Leaf{}};
+  };
+
+  const size_t end = std::min(body_.size(), index + kMaxRunCommands);
+  for (size_t i = index; i < end; ++i) {
+    const PackedOilCommand& command = body_[i];
+    const std::string& name = command.command_name;
+
+    if (name == "LoadLocal" || name == "PushInt") {
+      const auto value = ParseImmediateArgument(name, command.arguments.at(0));
+      if (!value || (name == "LoadLocal" && value.value() < 0)) {
+        break;
+      }
+      if (name == "LoadLocal") {
+        stack.push_back({.base = Leaf{static_cast<uint64_t>(value.value())}});
+      } else {
+        stack.push_back({.displacement = static_cast<uint64_t>(value.value())});
+      }
+    } else if (name == "IntAdd" || name == "IntSubtract" || name == "IntMultiply" || name == "IntLeftShift") {
+      const auto rhs = pop();
+      const auto lhs = rhs ? pop() : std::nullopt;
+      if (!lhs) {
+        break;
+      }
+
+      std::optional<LinearForm> result;
+      const bool rhs_is_constant = !rhs->base && !rhs->index;
+      if (name == "IntAdd") {
+        result = Add(lhs.value(), rhs.value());
+      } else if (name == "IntSubtract" && rhs_is_constant) {
+        result = Add(lhs.value(), {.displacement = 0 - rhs->displacement});
+      } else if (name == "IntMultiply" && rhs_is_constant) {
+        result = Multiply(lhs.value(), rhs->displacement);
+      } else if (name == "IntLeftShift" && rhs_is_constant && rhs->displacement < 4) {
+        result = Multiply(lhs.value(), uint64_t{1} << rhs->displacement);
+      } else if (name == "IntMultiply" && !lhs->base && !lhs->index) {
+        result = Multiply(rhs.value(), lhs->displacement);
+      }
+
+      if (!result) {
+        break;
+      }
+      has_addition = has_addition || name == "IntAdd" || name == "IntSubtract";
+      stack.push_back(result.value());
+    } else {
+      break;
+    }
+
+    const bool is_constant = stack.size() == 1 && !stack.back().base && !stack.back().index;
+    if (has_addition && stack.size() == 1 && (is_constant || FitsDisplacement(stack.back().displacement))) {
+      run = Run{i, stack.back()};
+    }
+  }
+  return run;
+}
+
+void AddressArithmetic::Emit(const LinearForm& form) {
+  if (!form.base && !form.index) {
+    output_.push_back({AsmCommand::MOV, {Register::RAX, static_cast<int64_t>(form.displacement)}});
+    output_.push_back({AsmCommand::PUSH, {Register::RAX}});
+    return;
+  }
+
+  // The value below the run is popped before the locals are read
+  if (form.base == Leaf{} || form.index == Leaf{}) {
+    output_.push_back({AsmCommand::POP, {form.base == Leaf{} ? Register::RAX : Register::RBX}});
+  }
+
+  auto get_register = [&](const Leaf& leaf, Register scratch) {
+    if (!leaf.local) {
+      return scratch;
+    }
+    if (const auto reg = locals_.GetRegister(leaf.local.value())) {
+      return reg.value();
+    }
+    output_.push_back({AsmCommand::MOV, {scratch, addr(Register::R13, static_cast<int64_t>(*leaf.local * 8))}});
+    return scratch;
+  };
+
+  std::optional<Register> base;
+  std::optional<Register> index;
+  if (form.base) {
+    base = get_register(form.base.value(), Register::RAX);
+  }
+  if (form.index) {
+    index = form.index == form.base ? base : get_register(form.index.value(), Register::RBX);
+  }
+
+  if (form.base && !form.index && form.displacement == 0) {
+    output_.push_back({AsmCommand::PUSH, {base.value()}});
+    return;
+  }
+
+  const auto displacement = static_cast<int64_t>(form.displacement);
+  output_.push_back({AsmCommand::LEA, {Register::RAX, create_memory_addr(base, index, form.scale, displacement)}});
+  output_.push_back({AsmCommand::PUSH, {Register::RAX}});
+}
+
+std::optional<AddressArithmetic::LinearForm> AddressArithmetic::Add(const LinearForm& lhs, const LinearForm& rhs) {
+  // Terms of both sides, at most two fit and only one of them may be scaled
+  std::vector<std::pair<Leaf, uint8_t>> terms;
+  for (const LinearForm* form : {&lhs, &rhs}) {
+    if (form->base) {
+      terms.emplace_back(form->base.value(), 1);
+    }
+    if (form->index) {
+      terms.emplace_back(form->index.value(), form->scale);
+    }
+  }
+  if (terms.size() > 2 || (terms.size() == 2 && terms[0].second != 1 && terms[1].second != 1)) {
+    return std::nullopt;
+  }
+
+  LinearForm result = {.displacement = lhs.displacement + rhs.displacement};
+  for (const auto& [leaf, scale] : terms) {
+    if (scale == 1 && !result.base) {
+      result.base = leaf;
+    } else {
+      result.index = leaf;
+      result.scale = scale;
+    }
+  }
+  return result;
+}
+
+std::optional<AddressArithmetic::LinearForm> AddressArithmetic::Multiply(const LinearForm& form, uint64_t factor) {
+  LinearForm result = {.displacement = form.displacement * factor};
+  if (!form.base && !form.index) {
+    return result;
+  }
+
+  // Only a single term is scaled, by a factor giving scale 2, 4 or 8 or by 3, 5 or 9 as x + x * (factor - 1)
+  if ((form.base && form.index) || factor > 9) {
+    return std::nullopt;
+  }
+  const Leaf leaf = form.base ? form.base.value() : form.index.value();
+  const uint64_t scale = (form.base ? 1 : form.scale) * factor;
+  if (scale == 1) {
+    result.base = leaf;
+  } else if (scale == 2 || scale == 4 || scale == 8) {
+    result.index = leaf;
+    result.scale = static_cast<uint8_t>(scale);
+  } else if (scale == 3 || scale == 5 || scale == 9) {
+    result.base = leaf;
+    result.index = leaf;
+    result.scale = static_cast<uint8_t>(scale - 1);
+  } else {
+    return std::nullopt;
+  }
+  return result;
+}
+
+} // namespace ovum::vm::jit
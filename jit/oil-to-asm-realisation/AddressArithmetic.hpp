@@ -0,0 +1,70 @@
+#ifndef JIT_ADDRESSARITHMETIC_HPP
+#define JIT_ADDRESSARITHMETIC_HPP
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+#include <jit/AsmData.hpp>
+
+namespace ovum::vm::jit {
+
+class LocalRegisters;
+
+// Integer additions of locals, constants and locals scaled by 1, 2, 4 or 8, like index computations.
+// A run of such commands computing base + index * scale + displacement becomes a single LEA reading promoted
+// locals from their registers, which are left intact. The run may start from the value already on the stack.
+class AddressArithmetic {
+public:
+  AddressArithmetic(std::vector<AssemblyInstruction>& output,
+                    const std::vector<PackedOilCommand>& body,
+                    const LocalRegisters& locals);
+
+  // Lowers the run starting at the index or skips a command of the run lowered before,
+  // returns false for other commands
+  [[nodiscard]] bool TryLower(size_t index);
+
+  // Whether the command at the index belongs to a run lowered at an earlier command
+  [[nodiscard]] bool IsInsideRun(size_t index) const;
+
+private:
+  // Value read by the run, a local or the value below the run on the stack
+  struct Leaf {
+    std::optional<uint64_t> local;
+
+    bool operator==(const Leaf&) const = default;
+  };
+
+  // base + index * scale + displacement, displacement wraps as the 64-bit arithmetic does
+  struct LinearForm {
+    std::optional<Leaf> base = std::nullopt;
+    std::optional<Leaf> index = std::nullopt;
+    uint8_t scale = 1;
+    uint64_t displacement = 0;
+  };
+
+  struct Run {
+    size_t end;
+    LinearForm form;
+  };
+
+  // Longest run from the index leaving one value on the stack, with at least one addition
+  [[nodiscard]] std::optional<Run> FindRun(size_t index) const;
+
+  void Emit(const LinearForm& form);
+
+  [[nodiscard]] static std::optional<LinearForm> Add(const LinearForm& lhs, const LinearForm& rhs);
+
+  [[nodiscard]] static std::optional<LinearForm> Multiply(const LinearForm& form, uint64_t factor);
+
+  std::vector<AssemblyInstruction>& output_;
+  const std::vector<PackedOilCommand>& body_;
+  const LocalRegisters& locals_;
+  // Commands of the lowered run up to this index are skipped
+  size_t run_end_ = 0;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_ADDRESSARITHMETIC_HPP
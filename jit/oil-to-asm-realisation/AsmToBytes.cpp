@@ -1,6 +1,7 @@
 #include "AsmToBytes.hpp"
 
 #include <cstring>
+#include <limits>
 #include <stdexcept>
 
 #include <iostream>
@@ -15,6 +16,7 @@ std::expected<code_vector, std::runtime_error> AsmToBytes::Convert(
   code_vector output;
   label_addresses_.clear();
   jump_patches_.clear();
+  rip_relocations_.clear();
   current_position_ = 0;
 
   // First pass: encode all instructions and collect label addresses
@@ -70,6 +72,7 @@ std::expected<code_vector, std::runtime_error> AsmToBytes::Convert(
     output[offset_pos + 3] = static_cast<uint8_t>((relative_offset >> 24) & 0xFF);
   }
 
+  output.rip_relocations = rip_relocations_;
   return output;
 }
 
@@ -120,6 +123,39 @@ std::expected<void, std::runtime_error> AsmToBytes::EncodeInstruction(const Asse
       break;
     }
 
+    // Bit counting operations
+    case AsmCommand::POPCNT:
+    case AsmCommand::LZCNT:
+    case AsmCommand::TZCNT:
+    case AsmCommand::BSR: {
+      auto result = EncodeBitCount(instr, output);
+      if (!result) {
+        return result;
+      }
+      break;
+    }
+
+    // VEX-encoded operations
+    case AsmCommand::SHLX:
+    case AsmCommand::SARX:
+    case AsmCommand::SHRX:
+    case AsmCommand::VADDSD:
+    case AsmCommand::VSUBSD:
+    case AsmCommand::VMULSD:
+    case AsmCommand::VDIVSD:
+    case AsmCommand::VMINSD:
+    case AsmCommand::VMAXSD:
+    case AsmCommand::VSQRTSD:
+    case AsmCommand::VANDPD:
+    case AsmCommand::VXORPD:
+    case AsmCommand::VROUNDSD: {
+      auto result = EncodeVex(instr, output);
+      if (!result) {
+        return result;
+      }
+      break;
+    }
+
     // Jump operations
     case AsmCommand::JMP:
     case AsmCommand::CALL:
@@ -158,6 +194,8 @@ std::expected<void, std::runtime_error> AsmToBytes::EncodeInstruction(const Asse
     case AsmCommand::MULSD:
     case AsmCommand::DIVSD:
     case AsmCommand::SQRTSD:
+    case AsmCommand::MINSD:
+    case AsmCommand::MAXSD:
     case AsmCommand::COMISD:
     case AsmCommand::UCOMISD:
     case AsmCommand::CVTSI2SD:
@@ -171,6 +209,7 @@ std::expected<void, std::runtime_error> AsmToBytes::EncodeInstruction(const Asse
     case AsmCommand::ANDNPD:
     case AsmCommand::ORPD:
     case AsmCommand::XORPD:
+    case AsmCommand::ROUNDSD:
     case AsmCommand::CVTTSD2SI:
     case AsmCommand::CVTTSD2SIQ: {
       auto result = EncodeSSE2(instr, output);
@@ -362,34 +401,19 @@ std::expected<void, std::runtime_error> AsmToBytes::EncodeInstruction(const Asse
 uint8_t AsmToBytes::EncodeRegister(Register reg) const {
   uint8_t value = static_cast<uint8_t>(reg);
 
-  // Map register enum to ModR/M register encoding
-  if (value >= 0 && value <= 15) {
-    // RAX-R15 (64-bit) - need special handling for R8-R15
-    return value & 0x0F; // RAX-RDI: 0-7
-  } else if (value >= 0x20 && value <= 0x2F) {
-    // EAX-R15D (32-bit)
-    if (value >= 0x28) { // R8D-R15D
-      return (value - 0x28) & 0x0F;
-    }
-    return (value - 0x20) & 0x0F; // EAX-EDI
-  } else if (value >= 0x40 && value <= 0x4F) {
-    // AX-R15W (16-bit)
-    if (value >= 0x48) { // R8W-R15W
-      return (value - 0x48) & 0x0F;
-    }
-    return (value - 0x40) & 0x0F; // AX-DI
-  } else if (value >= 0x60 && value <= 0x6F) {
-    // AL-R15B (8-bit)
-    if (value >= 0x68) { // R8B-R15B
-      return (value - 0x68) & 0x0F;
-    }
-    return (value - 0x60) & 0x0F; // AL-DIL
-  } else if (value >= 0x80 && value <= 0x8F) {
-    // XMM0-XMM15 (SSE registers)
-    return (value - 0x80) & 0x0F; // Only 3 bits needed for ModR/M
-  } else if (value >= 0x90 && value <= 0x9F) {
-    // XMM0-XMM15 (для GetRegisterSize)
-    return (value - 0x90) & 0x0F;
+  // Map register enum to ModR/M register encoding, R8-R15 derivatives return 8-15
+  if (value <= 0x3F) {
+    // RAX-R15 (64-bit), EAX-R15D (32-bit), AX-R15W (16-bit), AL-R15B (8-bit)
+    return value & 0x0F;
+  } else if (value >= 0x40 && value <= 0x43) {
+    // AH-BH share encodings 4-7 with SPL-DIL, usable only without REX
+    return (value - 0x40) + 4;
+  } else if (value >= 0x80 && value <= 0x87) {
+    // MM0-MM7
+    return value - 0x80;
+  } else if (value >= 0x90 && value <= 0xAF) {
+    // XMM0-XMM15, YMM0-YMM15
+    return value & 0x0F;
   }
 
   return value & 0x0F;
@@ -399,15 +423,17 @@ uint8_t AsmToBytes::GetRegisterSize(Register reg) const {
   uint8_t value = static_cast<uint8_t>(reg);
 
   // Check ranges for each size
-  if (value >= 0 && value <= 15) { // RAX-R15 (64-bit)
+  if (value <= 0x0F) { // RAX-R15 (64-bit)
     return 64;
-  } else if (value >= 0x20 && value <= 0x2F) { // EAX-R15D (32-bit)
+  } else if (value >= 0x10 && value <= 0x1F) { // EAX-R15D (32-bit)
     return 32;
-  } else if (value >= 0x40 && value <= 0x4F) { // AX-R15W (16-bit)
+  } else if (value >= 0x20 && value <= 0x2F) { // AX-R15W (16-bit)
     return 16;
-  } else if (value >= 0x60 && value <= 0x6F) { // AL-R15B (8-bit)
+  } else if (value >= 0x30 && value <= 0x43) { // AL-R15B, AH-BH (8-bit)
     return 8;
-  } else if (value >= 0x80 && value <= 0x9F) { // XMM0-XMM15 (128-bit)
+  } else if (value >= 0x80 && value <= 0x87) { // MM0-MM7 (64-bit)
+    return 64;
+  } else if (value >= 0x90 && value <= 0x9F) { // XMM0-XMM15 (128-bit)
     return 128;
   }
 
@@ -416,18 +442,19 @@ uint8_t AsmToBytes::GetRegisterSize(Register reg) const {
 
 bool AsmToBytes::IsXMMRegister(Register reg) const {
   uint8_t value = static_cast<uint8_t>(reg);
-  return (value >= 0x80 && value <= 0x8F) || (value >= 0x90 && value <= 0x9F);
+  return value >= 0x90 && value <= 0x9F;
 }
 
 bool AsmToBytes::IsExtendedRegister(Register reg) const {
   uint8_t value = static_cast<uint8_t>(reg);
   // Check if register is R8-R15 or their derivatives
-  return (value >= 8 && value <= 15) ||      // R8-R15 (64-bit)
-         (value >= 0x28 && value <= 0x2F) || // R8D-R15D (32-bit)
-         (value >= 0x48 && value <= 0x4F) || // R8W-R15W (16-bit)
-         (value >= 0x68 && value <= 0x6F) || // R8B-R15B (8-bit)
-         (value >= 0x88 && value <= 0x8F) || // XMM8-XMM15 (старый диапазон)
-         (value >= 0x98 && value <= 0x9F);   // XMM8-XMM15 (новый диапазон)
+  return (value <= 0x3F && (value & 0x0F) >= 8) || // R8-R15, R8D-R15D, R8W-R15W, R8B-R15B
+         (value >= 0x98 && value <= 0x9F);          // XMM8-XMM15
+}
+
+bool AsmToBytes::IsByteRegisterRequiringRex(Register reg) const {
+  // SPL, BPL, SIL, DIL are encoded as AH-BH unless REX prefix is present
+  return reg == Register::SPL || reg == Register::BPL || reg == Register::SIL || reg == Register::DIL;
 }
 
 uint8_t AsmToBytes::GetSSEPrefix(AsmCommand cmd) const {
@@ -437,23 +464,26 @@ uint8_t AsmToBytes::GetSSEPrefix(AsmCommand cmd) const {
     case AsmCommand::MULSD:
     case AsmCommand::DIVSD:
     case AsmCommand::SQRTSD:
-    case AsmCommand::COMISD:
-    case AsmCommand::UCOMISD:
+    case AsmCommand::MINSD:
+    case AsmCommand::MAXSD:
     case AsmCommand::CVTSI2SD:
     case AsmCommand::CVTSD2SI:
     case AsmCommand::CVTTSD2SI:
     case AsmCommand::CVTTSD2SIQ:
+    case AsmCommand::CVTSD2SS:
     case AsmCommand::MOVSD:
       return 0xF2; // REPNE prefix for scalar double-precision
+    case AsmCommand::COMISD:
+    case AsmCommand::UCOMISD:
     case AsmCommand::MOVAPD:
     case AsmCommand::MOVUPD:
     case AsmCommand::ANDPD:
     case AsmCommand::ANDNPD:
     case AsmCommand::ORPD:
     case AsmCommand::XORPD:
+    case AsmCommand::ROUNDSD:
       return 0x66; // Operand size prefix for packed double-precision
     case AsmCommand::CVTSS2SD:
-    case AsmCommand::CVTSD2SS:
       return 0xF3; // REP prefix for scalar single-precision
     default:
       return 0x00;
@@ -472,6 +502,10 @@ uint16_t AsmToBytes::GetSSEOpcode(AsmCommand cmd) const {
       return 0x5E0F;
     case AsmCommand::SQRTSD:
       return 0x510F;
+    case AsmCommand::MINSD:
+      return 0x5D0F;
+    case AsmCommand::MAXSD:
+      return 0x5F0F;
     case AsmCommand::COMISD:
       return 0x2F0F;
     case AsmCommand::UCOMISD:
@@ -498,6 +532,8 @@ uint16_t AsmToBytes::GetSSEOpcode(AsmCommand cmd) const {
       return 0x560F;
     case AsmCommand::XORPD:
       return 0x570F;
+    case AsmCommand::ROUNDSD:
+      return 0x3A0F; // 0F 3A 0B /r ib, last opcode byte is appended by EncodeSSE2
     case AsmCommand::CVTTSD2SI:
       return 0x2C0F;
     case AsmCommand::CVTTSD2SIQ:
@@ -664,10 +700,11 @@ void AsmToBytes::EncodeMemoryAddress(const MemoryAddress& addr, std::vector<uint
 
 void AsmToBytes::EncodeMemoryAddressWithReg(
     const MemoryAddress& mem, std::vector<uint8_t>& output, uint8_t reg_field, uint8_t base_low3, uint8_t index_low3) {
-  // Simple case: direct address [disp32] or [RIP+disp32]
+  // [RIP+disp32], displacement holds the absolute target and is fixed up when the code is placed
   if (!mem.base && !mem.index && mem.scale == 1) {
     output.push_back(0x05 | (reg_field << 3)); // mod=00, r/m=101
-    EncodeImmediate(mem.displacement, 32, output);
+    rip_relocations_.push_back({output.size(), static_cast<uint64_t>(mem.displacement)});
+    EncodeImmediate(int64_t{0}, 32, output);
     return;
   }
 
@@ -682,10 +719,19 @@ void AsmToBytes::EncodeMemoryAddressWithReg(
     } else if (disp >= -128 && disp <= 127) {
       mod = 0x01; // [base + disp8]
       output.push_back((mod << 6) | (reg_field << 3) | base_low3);
-      EncodeImmediate(disp, 8, output);
     } else {
       mod = 0x02; // [base + disp32]
       output.push_back((mod << 6) | (reg_field << 3) | base_low3);
+    }
+
+    if (base_low3 == 4) {
+      // r/m=100 means SIB follows, RSP/R12 base is encoded as SIB without index
+      output.push_back(0x24);
+    }
+
+    if (mod == 0x01) {
+      EncodeImmediate(disp, 8, output);
+    } else if (mod == 0x02) {
       EncodeImmediate(disp, 32, output);
     }
     return;
@@ -705,11 +751,10 @@ void AsmToBytes::EncodeMemoryAddressWithReg(
       mod = 0x02;
     }
 
-    // For [index*scale] (no base), use ESP as base
-    uint8_t sib_base = mem.base ? base_low3 : 0x04; // 0x04 = ESP/RSP
-    if (!mem.base && mod == 0x00) {
-      mod = 0x00;      // Special case for [index*scale]
-      sib_base = 0x05; // Means no base
+    // [index*scale + disp32] without base: mod=00 and SIB base=101, displacement is always 32-bit
+    uint8_t sib_base = mem.base ? base_low3 : 0x05;
+    if (!mem.base) {
+      mod = 0x00;
     }
 
     // Create SIB byte
@@ -761,6 +806,34 @@ std::expected<void, std::runtime_error> AsmToBytes::EncodeMov(const AssemblyInst
     return EncodeMOVQ(instr, output);
   }
 
+  if (instr.command == AsmCommand::MOVZX || instr.command == AsmCommand::MOVSX) {
+    return EncodeMovExtend(instr, output);
+  }
+
+  if (instr.command == AsmCommand::LEA) {
+    if (!std::holds_alternative<Register>(arg1) || !std::holds_alternative<MemoryAddress>(arg2)) {
+      return std::unexpected(std::runtime_error("LEA requires register and memory operands"));
+    }
+
+    Register dst = std::get<Register>(arg1);
+    return EncodeRegRm({0x8D}, dst, arg2, GetRegisterSize(dst) == 64, output); // LEA r, m
+  }
+
+  if (instr.command == AsmCommand::XCHG) {
+    const bool first_is_reg = std::holds_alternative<Register>(arg1);
+    if (!first_is_reg && !std::holds_alternative<Register>(arg2)) {
+      return std::unexpected(std::runtime_error("XCHG requires at least one register operand"));
+    }
+
+    Register reg = first_is_reg ? std::get<Register>(arg1) : std::get<Register>(arg2);
+    const Argument& rm = first_is_reg ? arg2 : arg1;
+    uint8_t reg_size = GetRegisterSize(reg);
+    if (reg_size == 16) {
+      output.push_back(0x66); // 16-bit prefix
+    }
+    return EncodeRegRm({static_cast<uint8_t>(reg_size == 8 ? 0x86 : 0x87)}, reg, rm, reg_size == 64, output);
+  }
+
   // Determine data transfer direction
   bool is_reg_to_reg = std::holds_alternative<Register>(arg1) && std::holds_alternative<Register>(arg2);
   bool is_reg_to_mem = std::holds_alternative<MemoryAddress>(arg1) && std::holds_alternative<Register>(arg2);
@@ -1034,249 +1107,165 @@ std::expected<void, std::runtime_error> AsmToBytes::EncodeMov(const AssemblyInst
   return {};
 }
 
-std::expected<void, std::runtime_error> AsmToBytes::EncodeMOVQ(const AssemblyInstruction& instr,
-                                                               std::vector<uint8_t>& output) {
-  if (instr.arguments.size() < 2) {
-    return std::unexpected(std::runtime_error("MOVQ requires 2 arguments"));
-  }
-
-  auto arg1 = instr.arguments[0];
-  auto arg2 = instr.arguments[1];
-
-  bool xmm_to_int = false;
-  bool int_to_xmm = false;
-  bool xmm_to_xmm = false;
-  bool mem_to_xmm = false;
-  bool xmm_to_mem = false;
+std::expected<void, std::runtime_error> AsmToBytes::EncodeRegRm(const std::vector<uint8_t>& opcode,
+                                                                Register reg,
+                                                                const Argument& rm,
+                                                                bool rex_w,
+                                                                std::vector<uint8_t>& output) {
+  uint8_t rex = 0x40;
+  bool need_rex = rex_w || IsByteRegisterRequiringRex(reg);
 
-  if (std::holds_alternative<Register>(arg1) && std::holds_alternative<Register>(arg2)) {
-    Register reg1 = std::get<Register>(arg1);
-    Register reg2 = std::get<Register>(arg2);
+  if (rex_w) {
+    rex |= 0x08; // REX.W
+  }
 
-    if (IsXMMRegister(reg1) && !IsXMMRegister(reg2)) {
-      // MOVQ xmm, r64 - integer to XMM
-      int_to_xmm = true;
-    } else if (!IsXMMRegister(reg1) && IsXMMRegister(reg2)) {
-      // MOVQ r64, xmm - XMM to integer
-      xmm_to_int = true;
-    } else if (IsXMMRegister(reg1) && IsXMMRegister(reg2)) {
-      // MOVQ xmm, xmm - XMM to XMM
-      xmm_to_xmm = true;
-    }
-  } else if (std::holds_alternative<Register>(arg1) && std::holds_alternative<MemoryAddress>(arg2)) {
-    Register reg = std::get<Register>(arg1);
-    if (IsXMMRegister(reg)) {
-      // MOVQ xmm, [mem] - memory to XMM
-      mem_to_xmm = true;
-    }
-  } else if (std::holds_alternative<MemoryAddress>(arg1) && std::holds_alternative<Register>(arg2)) {
-    Register reg = std::get<Register>(arg2);
-    if (IsXMMRegister(reg)) {
-      // MOVQ [mem], xmm - XMM to memory
-      xmm_to_mem = true;
-    }
+  uint8_t reg_code = EncodeRegister(reg);
+  if (reg_code >= 8) {
+    rex |= 0x04; // REX.R for reg field
+    need_rex = true;
   }
 
-  // Handle MOVQ xmm, r64 (integer to XMM)
-  if (int_to_xmm) {
-    Register xmm_reg = std::get<Register>(arg1);
-    Register int_reg = std::get<Register>(arg2);
-
-    // First check if this is actually MOVD (32-bit) based on register size
-    uint8_t int_size = GetRegisterSize(int_reg);
-
-    if (int_size == 32) {
-      // This is actually MOVD, not MOVQ
-      uint8_t rex = 0x40; // Base REX
-      if (int_size == 64)
-        rex |= 0x08; // REX.W only for 64-bit
-      if (IsExtendedRegister(int_reg))
-        rex |= 0x01; // REX.B for integer reg
-      if (IsExtendedRegister(xmm_reg))
-        rex |= 0x04; // REX.R for XMM reg
-      if (rex != 0x40)
-        output.push_back(rex); // Only push if needed
-
-      output.push_back(0x66); // Operand size prefix
-      output.push_back(0x0F);
-      output.push_back(0x6E); // MOVD xmm, r/m32
+  if (std::holds_alternative<Register>(rm)) {
+    Register rm_reg = std::get<Register>(rm);
+    uint8_t rm_code = EncodeRegister(rm_reg);
+    if (rm_code >= 8) {
+      rex |= 0x01; // REX.B for r/m field
+      need_rex = true;
+    }
+    need_rex = need_rex || IsByteRegisterRequiringRex(rm_reg);
 
-      uint8_t modrm = 0xC0;
-      modrm |= (EncodeRegister(xmm_reg) << 3);
-      modrm |= EncodeRegister(int_reg);
-      output.push_back(modrm);
-    } else if (int_size == 64) {
-      // This is MOVQ for 64-bit registers
-      // Order: 66 REX.W 0F 6E /r
-      output.push_back(0x66); // Operand size prefix FIRST
-
-      uint8_t rex = 0x48; // REX.W = 1 (0x40 | 0x08)
-      if (IsExtendedRegister(int_reg))
-        rex |= 0x01; // REX.B for integer reg
-      if (IsExtendedRegister(xmm_reg))
-        rex |= 0x04; // REX.R for XMM reg
+    if (need_rex) {
       output.push_back(rex);
-
-      output.push_back(0x0F);
-      output.push_back(0x6E); // MOVQ xmm, r/m64
-
-      uint8_t modrm = 0xC0;
-      modrm |= (EncodeRegister(xmm_reg) << 3);
-      modrm |= EncodeRegister(int_reg);
-      output.push_back(modrm);
     }
+    output.insert(output.end(), opcode.begin(), opcode.end());
+    output.push_back(0xC0 | ((reg_code & 0x07) << 3) | (rm_code & 0x07));
+    return {};
   }
-  // Handle MOVQ r64, xmm (XMM to integer)
-  else if (xmm_to_int) {
-    Register int_reg = std::get<Register>(arg1);
-    Register xmm_reg = std::get<Register>(arg2);
 
-    // First check if this is actually MOVD (32-bit) based on register size
-    uint8_t int_size = GetRegisterSize(int_reg);
-
-    if (int_size == 32) {
-      // This is actually MOVD, not MOVQ
-      uint8_t rex = 0x40; // Base REX
-      if (int_size == 64)
-        rex |= 0x08; // REX.W only for 64-bit
-      if (IsExtendedRegister(int_reg))
-        rex |= 0x01; // REX.B for integer reg
-      if (IsExtendedRegister(xmm_reg))
-        rex |= 0x04; // REX.R for XMM reg
-      if (rex != 0x40)
-        output.push_back(rex); // Only push if needed
-
-      output.push_back(0x66); // Operand size prefix
-      output.push_back(0x0F);
-      output.push_back(0x7E); // MOVD r/m32, xmm
+  if (std::holds_alternative<MemoryAddress>(rm)) {
+    const MemoryAddress& mem = std::get<MemoryAddress>(rm);
+    uint8_t base_low3 = 0;
+    uint8_t index_low3 = 0;
 
-      uint8_t modrm = 0xC0;
-      modrm |= (EncodeRegister(xmm_reg) << 3);
-      modrm |= EncodeRegister(int_reg);
-      output.push_back(modrm);
-    } else if (int_size == 64) {
-      // This is MOVQ for 64-bit registers
-      // Order: 66 REX.W 0F 7E /r
-      output.push_back(0x66); // Operand size prefix FIRST
-
-      uint8_t rex = 0x48; // REX.W = 1 (0x40 | 0x08)
-      if (IsExtendedRegister(int_reg))
-        rex |= 0x01; // REX.B for integer reg
-      if (IsExtendedRegister(xmm_reg))
-        rex |= 0x04; // REX.R for XMM reg
-      output.push_back(rex);
+    if (mem.base) {
+      uint8_t base_code = EncodeRegister(*mem.base);
+      if (base_code >= 8) {
+        rex |= 0x01; // REX.B for base
+        need_rex = true;
+      }
+      base_low3 = base_code & 0x07;
+    }
 
-      output.push_back(0x0F);
-      output.push_back(0x7E); // MOVQ r/m64, xmm
+    if (mem.index) {
+      uint8_t index_code = EncodeRegister(*mem.index);
+      if (index_code >= 8) {
+        rex |= 0x02; // REX.X for index
+        need_rex = true;
+      }
+      index_low3 = index_code & 0x07;
+    }
 
-      uint8_t modrm = 0xC0;
-      modrm |= (EncodeRegister(xmm_reg) << 3);
-      modrm |= EncodeRegister(int_reg);
-      output.push_back(modrm);
+    if (need_rex) {
+      output.push_back(rex);
     }
+    output.insert(output.end(), opcode.begin(), opcode.end());
+    EncodeMemoryAddressWithReg(mem, output, reg_code & 0x07, base_low3, index_low3);
+    return {};
   }
-  // Handle MOVQ xmm, xmm (XMM to XMM)
-  else if (xmm_to_xmm) {
-    Register dst = std::get<Register>(arg1);
-    Register src = std::get<Register>(arg2);
-
-    // Order: F3 REX 0F 7E /r
-    output.push_back(0xF3); // REP prefix for XMM to XMM MOVQ FIRST
 
-    uint8_t rex = 0x40; // Base REX
-    if (IsExtendedRegister(dst))
-      rex |= 0x04; // REX.R
-    if (IsExtendedRegister(src))
-      rex |= 0x01; // REX.B
-    if (rex != 0x40)
-      output.push_back(rex);
+  return std::unexpected(std::runtime_error("Unsupported r/m operand"));
+}
 
-    output.push_back(0x0F);
-    output.push_back(0x7E); // MOVQ xmm, xmm/m64
+std::expected<void, std::runtime_error> AsmToBytes::EncodeMovExtend(const AssemblyInstruction& instr,
+                                                                    std::vector<uint8_t>& output) {
+  auto dst = instr.get_argument<Register>(0);
+  if (!dst) {
+    return std::unexpected(std::runtime_error("MOVZX/MOVSX requires register destination"));
+  }
 
-    uint8_t modrm = 0xC0;
-    modrm |= (EncodeRegister(dst) << 3);
-    modrm |= EncodeRegister(src);
-    output.push_back(modrm);
+  // Source size is taken from the register, memory source is treated as byte
+  uint8_t src_size = 8;
+  if (auto src = instr.get_argument<Register>(1)) {
+    src_size = GetRegisterSize(*src);
   }
-  // Handle MOVQ xmm, [mem] (memory to XMM)
-  else if (mem_to_xmm) {
-    Register xmm_reg = std::get<Register>(arg1);
-    MemoryAddress mem = std::get<MemoryAddress>(arg2);
 
-    // Order: F3 REX 0F 7E /r
-    output.push_back(0xF3); // REP prefix for memory to XMM FIRST
-
-    uint8_t rex = 0x40; // Base REX
-    if (IsExtendedRegister(xmm_reg))
-      rex |= 0x04; // REX.R for XMM reg
-    if (mem.base && IsExtendedRegister(*mem.base))
-      rex |= 0x01; // REX.B for base
-    if (mem.index && IsExtendedRegister(*mem.index))
-      rex |= 0x02; // REX.X for index
-    if (rex != 0x40)
-      output.push_back(rex);
+  uint8_t dst_size = GetRegisterSize(*dst);
+  const bool is_signed = instr.command == AsmCommand::MOVSX;
 
-    output.push_back(0x0F);
-    output.push_back(0x7E); // MOVQ xmm, m64
+  if (dst_size == 16) {
+    output.push_back(0x66); // 16-bit prefix
+  }
 
-    // Используем EncodeMemoryAddressWithReg вместо EncodeMemoryAddress
-    uint8_t base_low3 = 0;
-    uint8_t index_low3 = 0;
+  if (src_size == 8) {
+    // MOVZX r, r/m8: 0F B6, MOVSX r, r/m8: 0F BE
+    return EncodeRegRm({0x0F, static_cast<uint8_t>(is_signed ? 0xBE : 0xB6)}, *dst, instr.arguments[1],
+                       dst_size == 64, output);
+  }
 
-    if (mem.base) {
-      uint8_t base_code = EncodeRegister(*mem.base);
-      base_low3 = base_code & 0x07;
-    }
+  if (src_size == 16) {
+    // MOVZX r, r/m16: 0F B7, MOVSX r, r/m16: 0F BF
+    return EncodeRegRm({0x0F, static_cast<uint8_t>(is_signed ? 0xBF : 0xB7)}, *dst, instr.arguments[1],
+                       dst_size == 64, output);
+  }
 
-    if (mem.index) {
-      uint8_t index_code = EncodeRegister(*mem.index);
-      index_low3 = index_code & 0x07;
+  if (src_size == 32 && dst_size == 64) {
+    if (is_signed) {
+      return EncodeRegRm({0x63}, *dst, instr.arguments[1], true, output); // MOVSXD r64, r/m32
     }
 
-    EncodeMemoryAddressWithReg(mem, output, EncodeRegister(xmm_reg), base_low3, index_low3);
+    // Writing 32-bit register zero-extends it: MOV r32, r/m32
+    return EncodeRegRm({0x8B}, *dst, instr.arguments[1], false, output);
   }
-  // Handle MOVQ [mem], xmm (XMM to memory)
-  else if (xmm_to_mem) {
-    MemoryAddress mem = std::get<MemoryAddress>(arg1);
-    Register xmm_reg = std::get<Register>(arg2);
 
-    // Order: 66 REX 0F D6 /r
-    output.push_back(0x66); // Operand size prefix FIRST
-
-    uint8_t rex = 0x40; // Base REX
-    if (IsExtendedRegister(xmm_reg))
-      rex |= 0x04; // REX.R for XMM reg
-    if (mem.base && IsExtendedRegister(*mem.base))
-      rex |= 0x01; // REX.B for base
-    if (mem.index && IsExtendedRegister(*mem.index))
-      rex |= 0x02; // REX.X for index
-    if (rex != 0x40)
-      output.push_back(rex);
+  return std::unexpected(std::runtime_error("Unsupported MOVZX/MOVSX operand sizes"));
+}
 
-    output.push_back(0x0F);
-    output.push_back(0xD6); // MOVQ m64, xmm
+std::expected<void, std::runtime_error> AsmToBytes::EncodeMOVQ(const AssemblyInstruction& instr,
+                                                               std::vector<uint8_t>& output) {
+  if (instr.arguments.size() < 2) {
+    return std::unexpected(std::runtime_error("MOVQ requires 2 arguments"));
+  }
 
-    // Используем EncodeMemoryAddressWithReg вместо EncodeMemoryAddress
-    uint8_t base_low3 = 0;
-    uint8_t index_low3 = 0;
+  auto arg1 = instr.arguments[0];
+  auto arg2 = instr.arguments[1];
 
-    if (mem.base) {
-      uint8_t base_code = EncodeRegister(*mem.base);
-      base_low3 = base_code & 0x07;
-    }
+  // Mandatory prefix goes before REX, EncodeRegRm emits REX after it
+  if (std::holds_alternative<Register>(arg1) && std::holds_alternative<Register>(arg2)) {
+    Register reg1 = std::get<Register>(arg1);
+    Register reg2 = std::get<Register>(arg2);
 
-    if (mem.index) {
-      uint8_t index_code = EncodeRegister(*mem.index);
-      index_low3 = index_code & 0x07;
+    if (IsXMMRegister(reg1) && IsXMMRegister(reg2)) {
+      // MOVQ xmm, xmm: F3 0F 7E /r
+      output.push_back(0xF3);
+      return EncodeRegRm({0x0F, 0x7E}, reg1, reg2, false, output);
     }
 
-    EncodeMemoryAddressWithReg(mem, output, EncodeRegister(xmm_reg), base_low3, index_low3);
-  } else {
-    return std::unexpected(std::runtime_error("Unsupported MOVQ operand combination"));
+    if (IsXMMRegister(reg1) != IsXMMRegister(reg2)) {
+      // MOVQ xmm, r64: 66 REX.W 0F 6E /r, MOVQ r64, xmm: 66 REX.W 0F 7E /r (MOVD for 32-bit registers)
+      const bool int_to_xmm = IsXMMRegister(reg1);
+      Register xmm_reg = int_to_xmm ? reg1 : reg2;
+      Register int_reg = int_to_xmm ? reg2 : reg1;
+      output.push_back(0x66);
+      const uint8_t opcode = int_to_xmm ? 0x6E : 0x7E;
+      return EncodeRegRm({0x0F, opcode}, xmm_reg, int_reg, GetRegisterSize(int_reg) == 64, output);
+    }
+  } else if (std::holds_alternative<Register>(arg1) && std::holds_alternative<MemoryAddress>(arg2)) {
+    Register xmm_reg = std::get<Register>(arg1);
+    if (IsXMMRegister(xmm_reg)) {
+      // MOVQ xmm, m64: F3 0F 7E /r
+      output.push_back(0xF3);
+      return EncodeRegRm({0x0F, 0x7E}, xmm_reg, arg2, false, output);
+    }
+  } else if (std::holds_alternative<MemoryAddress>(arg1) && std::holds_alternative<Register>(arg2)) {
+    Register xmm_reg = std::get<Register>(arg2);
+    if (IsXMMRegister(xmm_reg)) {
+      // MOVQ m64, xmm: 66 0F D6 /r
+      output.push_back(0x66);
+      return EncodeRegRm({0x0F, 0xD6}, xmm_reg, arg1, false, output);
+    }
   }
 
-  return {};
+  return std::unexpected(std::runtime_error("Unsupported MOVQ operand combination"));
 }
 
 std::expected<void, std::runtime_error> AsmToBytes::EncodeArithmetic(const AssemblyInstruction& instr,
@@ -1331,6 +1320,37 @@ std::expected<void, std::runtime_error> AsmToBytes::EncodeArithmetic(const Assem
     case AsmCommand::DEC:
     case AsmCommand::NEG:
     case AsmCommand::NOT:
+    case AsmCommand::IMUL:
+      // Двух- и трехоперандные формы: IMUL r, r/m и IMUL r, r/m, imm
+      if (instr.arguments.size() >= 2) {
+        const auto dst = instr.get_argument<Register>(0);
+        const uint8_t dst_size = dst ? GetRegisterSize(*dst) : 0;
+        if (!dst || dst_size < 32) {
+          return std::unexpected(std::runtime_error("IMUL destination must be a 32 or 64-bit register"));
+        }
+
+        if (instr.arguments.size() == 2) {
+          return EncodeRegRm({0x0F, 0xAF}, *dst, instr.arguments[1], dst_size == 64, output); // IMUL r, r/m
+        }
+
+        const auto imm = instr.get_argument<int64_t>(2);
+        if (!imm || *imm < std::numeric_limits<int32_t>::min() || *imm > std::numeric_limits<int32_t>::max()) {
+          return std::unexpected(std::runtime_error("IMUL immediate must fit in 32 bits"));
+        }
+
+        const bool short_imm = *imm >= std::numeric_limits<int8_t>::min() && *imm <= std::numeric_limits<int8_t>::max();
+        auto result = EncodeRegRm({static_cast<uint8_t>(short_imm ? 0x6B : 0x69)}, *dst, instr.arguments[1],
+                                  dst_size == 64, output); // IMUL r, r/m, imm8 / imm32
+        if (!result) {
+          return result;
+        }
+        EncodeImmediate(*imm, short_imm ? 8 : 32, output);
+        return {};
+      }
+      break;
+    case AsmCommand::MUL:
+    case AsmCommand::DIV:
+    case AsmCommand::IDIV:
     case AsmCommand::SHL:
     case AsmCommand::SHR:
     case AsmCommand::SAR:
@@ -1342,10 +1362,11 @@ std::expected<void, std::runtime_error> AsmToBytes::EncodeArithmetic(const Assem
 
   auto arg1 = instr.arguments[0];
 
-  // Обработка однооперандных инструкций (INC, DEC, NEG, NOT)
+  // Обработка однооперандных инструкций (INC, DEC, NEG, NOT, MUL, IMUL, DIV, IDIV)
   if (std::holds_alternative<Register>(arg1) &&
       (instr.command == AsmCommand::INC || instr.command == AsmCommand::DEC || instr.command == AsmCommand::NEG ||
-       instr.command == AsmCommand::NOT)) {
+       instr.command == AsmCommand::NOT || instr.command == AsmCommand::MUL || instr.command == AsmCommand::IMUL ||
+       instr.command == AsmCommand::DIV || instr.command == AsmCommand::IDIV)) {
     Register reg = std::get<Register>(arg1);
     uint8_t reg_size = GetRegisterSize(reg);
 
@@ -1445,6 +1466,23 @@ std::expected<void, std::runtime_error> AsmToBytes::EncodeArithmetic(const Assem
         uint8_t modrm = 0xC0 | (2 << 3) | reg_enc;
         output.push_back(modrm);
       }
+    } else {
+      // MUL, IMUL, DIV и IDIV работают с RDX:RAX (AX для 8 бит)
+      uint8_t extension = 4; // MUL /4, IMUL /5, DIV /6, IDIV /7
+      if (instr.command == AsmCommand::IMUL) {
+        extension = 5;
+      } else if (instr.command == AsmCommand::DIV) {
+        extension = 6;
+      } else if (instr.command == AsmCommand::IDIV) {
+        extension = 7;
+      }
+
+      if (reg_size == 16) {
+        output.push_back(0x66); // 16-bit operand size
+      }
+      output.push_back(reg_size == 8 ? 0xF6 : 0xF7);
+      uint8_t modrm = 0xC0 | (extension << 3) | reg_enc;
+      output.push_back(modrm);
     }
 
     return {};
@@ -2085,242 +2123,219 @@ std::expected<void, std::runtime_error> AsmToBytes::EncodeSSE2(const AssemblyIns
     return std::unexpected(std::runtime_error("Unsupported SSE2 instruction"));
   }
 
-  bool reg_to_reg = std::holds_alternative<Register>(arg1) && std::holds_alternative<Register>(arg2);
-  bool mem_to_reg = std::holds_alternative<Register>(arg1) && std::holds_alternative<MemoryAddress>(arg2);
-  bool reg_to_mem = std::holds_alternative<MemoryAddress>(arg1) && std::holds_alternative<Register>(arg2);
-
-  // Handle CVTSI2SD: integer to XMM
-  if (instr.command == AsmCommand::CVTSI2SD) {
-    if (reg_to_reg) {
-      Register xmm_reg = std::get<Register>(arg1);
-      Register int_reg = std::get<Register>(arg2);
-
-      if (!IsXMMRegister(xmm_reg)) {
-        return std::unexpected(std::runtime_error("CVTSI2SD first operand must be XMM register"));
-      }
-
-      uint8_t rex = 0x40;
-      if (IsExtendedRegister(xmm_reg))
-        rex |= 0x04; // REX.R for XMM
-      if (IsExtendedRegister(int_reg))
-        rex |= 0x01; // REX.B for integer
-      output.push_back(rex);
-
-      if (prefix != 0x00)
-        output.push_back(prefix);
-      output.push_back(static_cast<uint8_t>(opcode16 & 0xFF));
-      output.push_back(static_cast<uint8_t>(opcode16 >> 8));
-
-      uint8_t modrm = 0xC0;
-      modrm |= (EncodeRegister(xmm_reg) << 3);
-      modrm |= EncodeRegister(int_reg);
-      output.push_back(modrm);
-    } else if (mem_to_reg) {
-      Register xmm_reg = std::get<Register>(arg1);
-      MemoryAddress mem = std::get<MemoryAddress>(arg2);
-
-      uint8_t rex = 0x40;
-      if (IsExtendedRegister(xmm_reg))
-        rex |= 0x04; // REX.R for XMM
-      if (mem.base && IsExtendedRegister(*mem.base))
-        rex |= 0x01; // REX.B for base
-      if (mem.index && IsExtendedRegister(*mem.index))
-        rex |= 0x02; // REX.X for index
-      output.push_back(rex);
-
-      if (prefix != 0x00)
-        output.push_back(prefix);
-      output.push_back(static_cast<uint8_t>(opcode16 & 0xFF));
-      output.push_back(static_cast<uint8_t>(opcode16 >> 8));
+  uint8_t opcode = static_cast<uint8_t>(opcode16 >> 8);
 
-      // Используем EncodeMemoryAddressWithReg
-      uint8_t base_low3 = 0;
-      uint8_t index_low3 = 0;
-
-      if (mem.base) {
-        uint8_t base_code = EncodeRegister(*mem.base);
-        base_low3 = base_code & 0x07;
-      }
-
-      if (mem.index) {
-        uint8_t index_code = EncodeRegister(*mem.index);
-        index_low3 = index_code & 0x07;
-      }
+  bool reg_to_mem = std::holds_alternative<MemoryAddress>(arg1) && std::holds_alternative<Register>(arg2);
+  if (!std::holds_alternative<Register>(arg1) && !reg_to_mem) {
+    return std::unexpected(std::runtime_error("Unsupported SSE2 operand combination"));
+  }
 
-      EncodeMemoryAddressWithReg(mem, output, EncodeRegister(xmm_reg), base_low3, index_low3);
+  // reg field operand and r/m operand
+  Register reg = reg_to_mem ? std::get<Register>(arg2) : std::get<Register>(arg1);
+  const Argument& rm = reg_to_mem ? arg1 : arg2;
+  bool rex_w = false;
+
+  if (reg_to_mem) {
+    // Stores have their own opcodes
+    if (instr.command == AsmCommand::MOVSD || instr.command == AsmCommand::MOVUPD) {
+      opcode = 0x11;
+    } else if (instr.command == AsmCommand::MOVAPD) {
+      opcode = 0x29;
+    } else {
+      return std::unexpected(std::runtime_error("SSE2 instruction cannot store to memory"));
     }
   }
-  // Handle CVTSD2SI: XMM to integer
-  else if (instr.command == AsmCommand::CVTSD2SI || instr.command == AsmCommand::CVTTSD2SI ||
-           instr.command == AsmCommand::CVTTSD2SIQ) {
-    if (reg_to_reg) {
-      Register int_reg = std::get<Register>(arg1);
-      Register xmm_reg = std::get<Register>(arg2);
-
-      if (!IsXMMRegister(xmm_reg)) {
-        return std::unexpected(std::runtime_error("CVTSD2SI second operand must be XMM register"));
-      }
 
-      uint8_t rex = 0x40;
-      if (instr.command == AsmCommand::CVTTSD2SIQ)
-        rex |= 0x08; // REX.W for 64-bit result
-      if (IsExtendedRegister(int_reg))
-        rex |= 0x01; // REX.B for integer
-      if (IsExtendedRegister(xmm_reg))
-        rex |= 0x04; // REX.R for XMM
-      output.push_back(rex);
-
-      if (prefix != 0x00)
-        output.push_back(prefix);
-      output.push_back(static_cast<uint8_t>(opcode16 & 0xFF));
-      output.push_back(static_cast<uint8_t>(opcode16 >> 8));
-
-      uint8_t modrm = 0xC0;
-      modrm |= (EncodeRegister(xmm_reg) << 3);
-      modrm |= EncodeRegister(int_reg);
-      output.push_back(modrm);
-    } else if (mem_to_reg) {
-      Register int_reg = std::get<Register>(arg1);
-      MemoryAddress mem = std::get<MemoryAddress>(arg2);
-
-      uint8_t rex = 0x40;
-      if (instr.command == AsmCommand::CVTTSD2SIQ)
-        rex |= 0x08; // REX.W for 64-bit result
-      if (IsExtendedRegister(int_reg))
-        rex |= 0x01; // REX.B for integer
-      if (mem.base && IsExtendedRegister(*mem.base))
-        rex |= 0x01; // REX.B for base
-      if (mem.index && IsExtendedRegister(*mem.index))
-        rex |= 0x02; // REX.X for index
-      output.push_back(rex);
-
-      if (prefix != 0x00)
-        output.push_back(prefix);
-      output.push_back(static_cast<uint8_t>(opcode16 & 0xFF));
-      output.push_back(static_cast<uint8_t>(opcode16 >> 8));
-
-      // Используем EncodeMemoryAddressWithReg
-      uint8_t base_low3 = 0;
-      uint8_t index_low3 = 0;
+  if (instr.command == AsmCommand::CVTSI2SD) {
+    // CVTSI2SD xmm, r/m: REX.W for 64-bit integer source, memory source is treated as 64-bit
+    if (!IsXMMRegister(reg)) {
+      return std::unexpected(std::runtime_error("CVTSI2SD first operand must be XMM register"));
+    }
+    auto int_reg = instr.get_argument<Register>(1);
+    rex_w = !int_reg || GetRegisterSize(*int_reg) == 64;
+  } else if (instr.command == AsmCommand::CVTSD2SI || instr.command == AsmCommand::CVTTSD2SI ||
+             instr.command == AsmCommand::CVTTSD2SIQ) {
+    // CVTSD2SI r, xmm/m64: integer register goes to reg field
+    if (IsXMMRegister(reg)) {
+      return std::unexpected(std::runtime_error("CVTSD2SI first operand must be integer register"));
+    }
+    rex_w = instr.command == AsmCommand::CVTTSD2SIQ || GetRegisterSize(reg) == 64;
+  } else {
+    if (!IsXMMRegister(reg)) {
+      return std::unexpected(std::runtime_error("SSE2 operation requires XMM register"));
+    }
+    if (std::holds_alternative<Register>(rm) && !IsXMMRegister(std::get<Register>(rm))) {
+      return std::unexpected(std::runtime_error("SSE2 operation requires XMM registers"));
+    }
+  }
 
-      if (mem.base) {
-        uint8_t base_code = EncodeRegister(*mem.base);
-        base_low3 = base_code & 0x07;
-      }
+  // Mandatory prefix goes before REX, EncodeRegRm emits REX after it
+  if (prefix != 0x00) {
+    output.push_back(prefix);
+  }
 
-      if (mem.index) {
-        uint8_t index_code = EncodeRegister(*mem.index);
-        index_low3 = index_code & 0x07;
-      }
+  if (instr.command == AsmCommand::ROUNDSD) {
+    // ROUNDSD xmm, xmm/m64, imm8
+    auto rounding_mode = instr.get_argument<int64_t>(2);
+    if (!rounding_mode || reg_to_mem) {
+      return std::unexpected(std::runtime_error("ROUNDSD requires XMM destination and rounding mode immediate"));
+    }
 
-      EncodeMemoryAddressWithReg(mem, output, EncodeRegister(int_reg), base_low3, index_low3);
+    auto result = EncodeRegRm({static_cast<uint8_t>(opcode16 & 0xFF), opcode, 0x0B}, reg, rm, rex_w, output);
+    if (!result) {
+      return result;
     }
+    output.push_back(static_cast<uint8_t>(*rounding_mode));
+    return {};
   }
-  // Handle XMM to XMM operations
-  else if (reg_to_reg) {
-    Register dst = std::get<Register>(arg1);
-    Register src = std::get<Register>(arg2);
 
-    if (!IsXMMRegister(dst) || !IsXMMRegister(src)) {
-      return std::unexpected(std::runtime_error("SSE2 operation requires XMM registers"));
-    }
+  return EncodeRegRm({static_cast<uint8_t>(opcode16 & 0xFF), opcode}, reg, rm, rex_w, output);
+}
 
-    uint8_t rex = 0x40;
-    if (IsExtendedRegister(dst))
-      rex |= 0x04; // REX.R
-    if (IsExtendedRegister(src))
-      rex |= 0x01; // REX.B
-    output.push_back(rex);
-
-    if (prefix != 0x00)
-      output.push_back(prefix);
-    output.push_back(static_cast<uint8_t>(opcode16 & 0xFF));
-    output.push_back(static_cast<uint8_t>(opcode16 >> 8));
-
-    uint8_t modrm = 0xC0;
-    modrm |= (EncodeRegister(dst) << 3);
-    modrm |= EncodeRegister(src);
-    output.push_back(modrm);
+std::expected<void, std::runtime_error> AsmToBytes::EncodeBitCount(const AssemblyInstruction& instr,
+                                                                   std::vector<uint8_t>& output) {
+  auto dst = instr.get_argument<Register>(0);
+  if (!dst || instr.arguments.size() != 2 || GetRegisterSize(*dst) < 32) {
+    return std::unexpected(std::runtime_error("Bit count instruction requires 32 or 64-bit register destination"));
   }
-  // Handle memory to XMM
-  else if (mem_to_reg) {
-    Register xmm_reg = std::get<Register>(arg1);
-    MemoryAddress mem = std::get<MemoryAddress>(arg2);
 
-    if (!IsXMMRegister(xmm_reg)) {
-      return std::unexpected(std::runtime_error("SSE2 operation requires XMM register destination"));
-    }
+  // POPCNT F3 0F B8, LZCNT F3 0F BD, TZCNT F3 0F BC, BSR 0F BD
+  uint8_t opcode = 0xBD;
+  if (instr.command == AsmCommand::POPCNT) {
+    opcode = 0xB8;
+  } else if (instr.command == AsmCommand::TZCNT) {
+    opcode = 0xBC;
+  }
 
-    uint8_t rex = 0x40;
-    if (IsExtendedRegister(xmm_reg))
-      rex |= 0x04; // REX.R
-    if (mem.base && IsExtendedRegister(*mem.base))
-      rex |= 0x01; // REX.B
-    if (mem.index && IsExtendedRegister(*mem.index))
-      rex |= 0x02; // REX.X
-    output.push_back(rex);
-
-    if (prefix != 0x00)
-      output.push_back(prefix);
-    output.push_back(static_cast<uint8_t>(opcode16 & 0xFF));
-    output.push_back(static_cast<uint8_t>(opcode16 >> 8));
-
-    // Используем EncodeMemoryAddressWithReg
-    uint8_t base_low3 = 0;
-    uint8_t index_low3 = 0;
+  if (instr.command != AsmCommand::BSR) {
+    output.push_back(0xF3);
+  }
+  return EncodeRegRm({0x0F, opcode}, *dst, instr.arguments[1], GetRegisterSize(*dst) == 64, output);
+}
 
-    if (mem.base) {
-      uint8_t base_code = EncodeRegister(*mem.base);
-      base_low3 = base_code & 0x07;
-    }
+std::expected<void, std::runtime_error> AsmToBytes::EncodeVex(const AssemblyInstruction& instr,
+                                                              std::vector<uint8_t>& output) {
+  // pp: 0 - none, 1 - 66, 2 - F3, 3 - F2; map: 1 - 0F, 2 - 0F38, 3 - 0F3A
+  uint8_t pp = 3;
+  uint8_t map = 1;
+  uint8_t opcode = 0;
+  bool is_shift = false;
 
-    if (mem.index) {
-      uint8_t index_code = EncodeRegister(*mem.index);
-      index_low3 = index_code & 0x07;
-    }
+  switch (instr.command) {
+    case AsmCommand::VADDSD:
+      opcode = 0x58;
+      break;
+    case AsmCommand::VSUBSD:
+      opcode = 0x5C;
+      break;
+    case AsmCommand::VMULSD:
+      opcode = 0x59;
+      break;
+    case AsmCommand::VDIVSD:
+      opcode = 0x5E;
+      break;
+    case AsmCommand::VMINSD:
+      opcode = 0x5D;
+      break;
+    case AsmCommand::VMAXSD:
+      opcode = 0x5F;
+      break;
+    case AsmCommand::VSQRTSD:
+      opcode = 0x51;
+      break;
+    case AsmCommand::VANDPD:
+      pp = 1;
+      opcode = 0x54;
+      break;
+    case AsmCommand::VXORPD:
+      pp = 1;
+      opcode = 0x57;
+      break;
+    case AsmCommand::VROUNDSD:
+      pp = 1;
+      map = 3;
+      opcode = 0x0B;
+      break;
+    case AsmCommand::SHLX:
+      pp = 1;
+      map = 2;
+      opcode = 0xF7;
+      is_shift = true;
+      break;
+    case AsmCommand::SARX:
+      pp = 2;
+      map = 2;
+      opcode = 0xF7;
+      is_shift = true;
+      break;
+    case AsmCommand::SHRX:
+      pp = 3;
+      map = 2;
+      opcode = 0xF7;
+      is_shift = true;
+      break;
+    default:
+      return std::unexpected(std::runtime_error("Unknown VEX instruction"));
+  }
 
-    EncodeMemoryAddressWithReg(mem, output, EncodeRegister(xmm_reg), base_low3, index_low3);
+  // AVX: reg = dst, vvvv = src1, r/m = src2; BMI2 shifts: reg = dst, r/m = src, vvvv = count
+  auto reg = instr.get_argument<Register>(0);
+  auto vvvv = instr.get_argument<Register>(is_shift ? 2 : 1);
+  const size_t rm_index = is_shift ? 1 : 2;
+  if (!reg || !vvvv || instr.arguments.size() <= rm_index) {
+    return std::unexpected(std::runtime_error("VEX instruction requires register operands"));
   }
-  // Handle XMM to memory
-  else if (reg_to_mem) {
-    MemoryAddress mem = std::get<MemoryAddress>(arg1);
-    Register xmm_reg = std::get<Register>(arg2);
 
-    if (!IsXMMRegister(xmm_reg)) {
-      return std::unexpected(std::runtime_error("SSE2 operation requires XMM register source"));
-    }
+  const Argument& rm = instr.arguments[rm_index];
+  if (is_shift ? (IsXMMRegister(*reg) || IsXMMRegister(*vvvv) || GetRegisterSize(*reg) < 32)
+               : (!IsXMMRegister(*reg) || !IsXMMRegister(*vvvv))) {
+    return std::unexpected(std::runtime_error("VEX instruction operand has wrong register class"));
+  }
 
-    uint8_t rex = 0x40;
-    if (IsExtendedRegister(xmm_reg))
-      rex |= 0x04; // REX.R
-    if (mem.base && IsExtendedRegister(*mem.base))
-      rex |= 0x01; // REX.B
-    if (mem.index && IsExtendedRegister(*mem.index))
-      rex |= 0x02; // REX.X
-    output.push_back(rex);
-
-    if (prefix != 0x00)
-      output.push_back(prefix);
-    output.push_back(static_cast<uint8_t>(opcode16 & 0xFF));
-    output.push_back(static_cast<uint8_t>(opcode16 >> 8));
-
-    // Используем EncodeMemoryAddressWithReg
-    uint8_t base_low3 = 0;
-    uint8_t index_low3 = 0;
+  const bool w = is_shift && GetRegisterSize(*reg) == 64;
+  const uint8_t reg_code = EncodeRegister(*reg);
+  const uint8_t vvvv_code = EncodeRegister(*vvvv);
+  uint8_t rm_code = 0;
+  uint8_t index_code = 0;
+
+  if (std::holds_alternative<Register>(rm)) {
+    rm_code = EncodeRegister(std::get<Register>(rm));
+  } else if (std::holds_alternative<MemoryAddress>(rm)) {
+    const MemoryAddress& mem = std::get<MemoryAddress>(rm);
+    rm_code = mem.base ? EncodeRegister(*mem.base) : 0;
+    index_code = mem.index ? EncodeRegister(*mem.index) : 0;
+  } else {
+    return std::unexpected(std::runtime_error("Unsupported VEX r/m operand"));
+  }
 
-    if (mem.base) {
-      uint8_t base_code = EncodeRegister(*mem.base);
-      base_low3 = base_code & 0x07;
-    }
+  // VEX stores R, X, B and vvvv inverted
+  const uint8_t r_bit = reg_code >= 8 ? 0x00 : 0x80;
+  const uint8_t x_bit = index_code >= 8 ? 0x00 : 0x40;
+  const uint8_t b_bit = rm_code >= 8 ? 0x00 : 0x20;
+  const uint8_t vvvv_lpp = static_cast<uint8_t>(((~vvvv_code & 0x0F) << 3) | pp);
 
-    if (mem.index) {
-      uint8_t index_code = EncodeRegister(*mem.index);
-      index_low3 = index_code & 0x07;
-    }
+  if (map == 1 && !w && x_bit != 0 && b_bit != 0) {
+    output.push_back(0xC5);
+    output.push_back(r_bit | vvvv_lpp);
+  } else {
+    output.push_back(0xC4);
+    output.push_back(r_bit | x_bit | b_bit | map);
+    output.push_back((w ? 0x80 : 0x00) | vvvv_lpp);
+  }
+  output.push_back(opcode);
 
-    EncodeMemoryAddressWithReg(mem, output, EncodeRegister(xmm_reg), base_low3, index_low3);
+  if (std::holds_alternative<Register>(rm)) {
+    output.push_back(0xC0 | ((reg_code & 0x07) << 3) | (rm_code & 0x07));
   } else {
-    return std::unexpected(std::runtime_error("Unsupported SSE2 operand combination"));
+    EncodeMemoryAddressWithReg(std::get<MemoryAddress>(rm), output, reg_code & 0x07, rm_code & 0x07, index_code & 0x07);
+  }
+
+  if (instr.command == AsmCommand::VROUNDSD) {
+    auto rounding_mode = instr.get_argument<int64_t>(3);
+    if (!rounding_mode) {
+      return std::unexpected(std::runtime_error("VROUNDSD requires rounding mode immediate"));
+    }
+    output.push_back(static_cast<uint8_t>(*rounding_mode));
   }
 
   return {};
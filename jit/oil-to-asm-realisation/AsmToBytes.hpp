@@ -38,6 +38,7 @@ private:
 
   // Check if register is extended (R8-R15)
   bool IsExtendedRegister(Register reg) const;
+  bool IsByteRegisterRequiringRex(Register reg) const;
   bool IsXMMRegister(Register reg) const;
   uint8_t GetSSEPrefix(AsmCommand cmd) const;
   uint16_t GetSSEOpcode(AsmCommand cmd) const;
@@ -55,11 +56,25 @@ private:
   // Encode specific instruction types
   std::expected<void, std::runtime_error> EncodeMov(const AssemblyInstruction& instr, std::vector<uint8_t>& output);
   std::expected<void, std::runtime_error> EncodeMOVQ(const AssemblyInstruction& instr, std::vector<uint8_t>& output);
+  std::expected<void, std::runtime_error> EncodeMovExtend(const AssemblyInstruction& instr,
+                                                          std::vector<uint8_t>& output);
+
+  // Encode "opcode reg, r/m" with REX prefix and ModR/M for register or memory r/m operand
+  std::expected<void, std::runtime_error> EncodeRegRm(const std::vector<uint8_t>& opcode,
+                                                      Register reg,
+                                                      const Argument& rm,
+                                                      bool rex_w,
+                                                      std::vector<uint8_t>& output);
   std::expected<void, std::runtime_error> EncodeArithmetic(const AssemblyInstruction& instr,
                                                            std::vector<uint8_t>& output);
   std::expected<void, std::runtime_error> EncodeJump(const AssemblyInstruction& instr, std::vector<uint8_t>& output);
   void EncodeStackOp(const AssemblyInstruction& instr, std::vector<uint8_t>& output);
   std::expected<void, std::runtime_error> EncodeSSE2(const AssemblyInstruction& instr, std::vector<uint8_t>& output);
+  std::expected<void, std::runtime_error> EncodeBitCount(const AssemblyInstruction& instr,
+                                                         std::vector<uint8_t>& output);
+
+  // Encode VEX prefixed instruction (AVX three-operand forms and BMI2 shifts)
+  std::expected<void, std::runtime_error> EncodeVex(const AssemblyInstruction& instr, std::vector<uint8_t>& output);
   void EncodeLabel(const AssemblyInstruction& instr, std::vector<uint8_t>& output);
 
   // Get opcode for instruction
@@ -71,6 +86,9 @@ private:
   // Positions where jump offsets need to be patched (position -> label name)
   std::vector<std::pair<size_t, std::string>> jump_patches_;
 
+  // RIP-relative operands of absolute targets
+  std::vector<RipRelocation> rip_relocations_;
+
   // Current output position (for label resolution)
   size_t current_position_;
 };
@@ -0,0 +1,484 @@
+#include "DeoptExits.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/machine-code-runner/FaultRedirects.hpp>
+#include <jit/oil-to-asm-realisation/LocalRegisters.hpp>
+#include <jit/oil-to-asm-realisation/StackDepthVerifier.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/EscapeAnalysis.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/Inliner.hpp>
+
+namespace ovum::vm::jit {
+
+namespace {
+
+const std::string kExitLabel = "deopt_exit";
+
+// Interpreter type of the value pushed by a command, kUnknown when it depends on run time values
+DeoptValueKind GetResultKind(const std::string& name) {
+  static constexpr std::array<std::string_view, 6> kComparisons = {
+      "Equal", "NotEqual", "LessThan", "LessEqual", "GreaterThan", "GreaterEqual"};
+  static constexpr std::array<std::pair<std::string_view, DeoptValueKind>, 18> kResults = {
+      {{"PushInt", DeoptValueKind::kInt},
+       {"PushFloat", DeoptValueKind::kFloat},
+       {"PushBool", DeoptValueKind::kBool},
+       {"PushChar", DeoptValueKind::kChar},
+       {"PushByte", DeoptValueKind::kByte},
+       {"PushNull", DeoptValueKind::kPointer},
+       {"IntToString", DeoptValueKind::kPointer},
+       {"FloatToString", DeoptValueKind::kPointer},
+       {"IntToFloat", DeoptValueKind::kFloat},
+       {"StringToFloat", DeoptValueKind::kFloat},
+       {"FloatToInt", DeoptValueKind::kInt},
+       {"ByteToInt", DeoptValueKind::kInt},
+       {"StringToInt", DeoptValueKind::kInt},
+       {"StringLength", DeoptValueKind::kInt},
+       {"CharToByte", DeoptValueKind::kByte},
+       {"BoolToByte", DeoptValueKind::kByte},
+       {"ByteToChar", DeoptValueKind::kChar},
+       {"IsNull", DeoptValueKind::kBool}}};
+  static constexpr std::array<std::pair<std::string_view, DeoptValueKind>, 4> kTypePrefixes = {
+      {{"Int", DeoptValueKind::kInt},
+       {"Float", DeoptValueKind::kFloat},
+       {"Byte", DeoptValueKind::kByte},
+       {"Bool", DeoptValueKind::kBool}}};
+
+  const auto it = std::find_if(kResults.begin(), kResults.end(), [&name](const auto& entry) {
+    return entry.first == name;
+  });
+  if (it != kResults.end()) {
+    return it->second;
+  }
+
+  for (const auto& [prefix, kind] : kTypePrefixes) {
+    if (name.starts_with(prefix)) {
+      const std::string_view suffix = std::string_view(name).substr(prefix.size());
+      const bool comparison = std::find(kComparisons.begin(), kComparisons.end(), suffix) != kComparisons.end();
+      return comparison ? DeoptValueKind::kBool : kind;
+    }
+  }
+  return DeoptValueKind::kUnknown;
+}
+
+// Instructions before the faulting one only pop operands or work on registers, so the pops can become reads
+bool ReadsOperandsInPlace(const std::vector<AssemblyInstruction>& operation, ptrdiff_t trap) {
+  return std::all_of(operation.begin(), operation.begin() + trap, [](const AssemblyInstruction& instruction) {
+    if (instruction.command == AsmCommand::POP) {
+      return true;
+    }
+    return instruction.command != AsmCommand::PUSH && instruction.command != AsmCommand::CALL &&
+           std::none_of(instruction.arguments.begin(), instruction.arguments.end(), [](const Argument& argument) {
+             const auto* reg = std::get_if<Register>(&argument);
+             const auto* memory = std::get_if<MemoryAddress>(&argument);
+             return (reg != nullptr && *reg == Register::RSP) || (memory != nullptr && memory->base == Register::RSP);
+           });
+  });
+}
+
+} // namespace
+
+bool IsGuardedCommand(const std::string& command_name) {
+  return command_name == "Unwrap";
+}
+
+bool IsTrappingCommand(const std::string& command_name) {
+  return command_name == "IntDivide" || command_name == "IntModulo" || command_name == "ByteDivide" ||
+         command_name == "ByteModulo";
+}
+
+DeoptExits::DeoptExits(std::vector<AssemblyInstruction>& output,
+                       const std::vector<PackedOilCommand>& body,
+                       const LocalRegisters& locals,
+                       DeoptTable* table,
+                       const JitCompileOptions& options) :
+    output_(output), body_(body), locals_(locals), table_(table), options_(options) {
+  Analyse();
+}
+
+std::expected<bool, std::runtime_error> DeoptExits::TryLower(size_t index) {
+  if (pending_access_ && pending_access_->command_index == index) {
+    const ImplicitAccess access = std::move(pending_access_.value());
+    pending_access_.reset();
+    EmitFaulting(access.operation, access.access, access.exit, access.pushed, FaultKind::kNullAccess);
+    return true;
+  }
+
+  if (IsTrappingCommand(body_.at(index).command_name)) {
+    return LowerTrapping(index);
+  }
+
+  if (body_.at(index).command_name == "CallVirtual") {
+    return LowerVirtualCall(index);
+  }
+
+  const PackedOilCommand& command = body_.at(index);
+  if (!IsGuardedCommand(command.command_name)) {
+    return false;
+  }
+
+  // Unwrap of a null value is an error of the program. Without speculation, in inlined frames and where the
+  // frame cannot be described it is reported by the code.
+  const auto state = states_.find(index);
+  if (!options_.speculate || table_ == nullptr || state == states_.end() || !HasTypedValues(state->second)) {
+    EmitNullCheck(DivisionErrorLabel);
+    return true;
+  }
+
+  auto label = AddExit(index);
+  if (!label) {
+    return std::unexpected(label.error());
+  }
+
+  if (auto access = FindImplicitAccess(index)) {
+    access->exit = exits_.size() - 1;
+    pending_access_ = std::move(access);
+    return true;
+  }
+
+  // Unwrap: the value is used as it is, null leaves to the interpreter which reports it
+  EmitNullCheck(label.value());
+  return true;
+}
+
+void DeoptExits::EmitExits() {
+  if (exits_.empty()) {
+    return;
+  }
+
+  output_.push_back({AsmCommand::JMP, {kExitLabel}});
+  for (size_t k = 0; k < exits_.size(); ++k) {
+    const Exit& exit = exits_[k];
+    const auto stack_size = static_cast<int64_t>(exit.stack_depth * sizeof(uint64_t));
+
+    output_.push_back({AsmCommand::LABEL, {exit.label}});
+    if (exit.fault_depth && exit.fault_depth.value() != exit.stack_depth) {
+      // Values pushed after the Unwrap are dropped
+      const auto pushed = static_cast<int64_t>((exit.fault_depth.value() - exit.stack_depth) * sizeof(uint64_t));
+      output_.push_back({AsmCommand::ADD, {Register::RSP, make_imm_arg(pushed)}});
+    }
+    // The same code runs in frames of native calls, which cannot resume in the interpreter
+    if (!table_->points[k].is_guard) {
+      output_.push_back({AsmCommand::MOV, {Register::R11, addr(Register::R14, AsmDataBuffer::GetDeoptStackOffset())}});
+      output_.push_back({AsmCommand::TEST, {Register::R11, Register::R11}});
+      output_.push_back({AsmCommand::JE, {DivisionErrorLabel}});
+    }
+    output_.insert(output_.end(), exit.write_back.begin(), exit.write_back.end());
+
+    output_.push_back({AsmCommand::MOV, {Register::R11, addr(Register::R14, AsmDataBuffer::GetDeoptStackOffset())}});
+    for (int64_t offset = 0; offset < stack_size; offset += static_cast<int64_t>(sizeof(uint64_t))) {
+      output_.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::RSP, offset)}});
+      output_.push_back({AsmCommand::MOV, {addr(Register::R11, offset), Register::RAX}});
+    }
+    output_.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(static_cast<int64_t>(k + 1))}});
+    output_.push_back({AsmCommand::MOV, {addr(Register::R14, AsmDataBuffer::GetDeoptExitOffset()), Register::RAX}});
+
+    // Machine stack is restored by the epilogue, the scalar frame is dropped as by ScalarFrameLeave
+    if (exit.scalar_slots) {
+      const auto slots_size = static_cast<int64_t>(exit.scalar_slots.value() * sizeof(uint64_t));
+      output_.push_back({AsmCommand::MOV, {Register::R15, addr(Register::R15, slots_size)}});
+    }
+    output_.push_back({AsmCommand::JMP, {kExitLabel}});
+  }
+}
+
+void DeoptExits::EmitExitLabel() {
+  if (!exits_.empty()) {
+    output_.push_back({AsmCommand::LABEL, {kExitLabel}});
+  }
+}
+
+std::unordered_map<std::string, int64_t> DeoptExits::GetFaultEntryDepths() const {
+  std::unordered_map<std::string, int64_t> depths;
+  for (const Exit& exit : exits_) {
+    if (exit.fault_depth) {
+      const uint64_t frame_slots = exit.scalar_slots ? exit.scalar_slots.value() + 1 : 0;
+      depths.emplace(exit.label, static_cast<int64_t>((exit.fault_depth.value() + frame_slots) * sizeof(uint64_t)));
+    }
+  }
+  return depths;
+}
+
+void DeoptExits::Analyse() {
+  // Kinds are followed through the frame entered from the interpreter, inlined frames count as their result
+  FrameState state;
+  size_t inline_depth = 0;
+
+  for (size_t i = 0; i < body_.size(); ++i) {
+    const PackedOilCommand& command = body_[i];
+    const std::string& name = command.command_name;
+
+    if (name == InlineEnterCommand || name == InlineLeaveCommand) {
+      if (name == InlineEnterCommand && inline_depth++ == 0) {
+        auto arity = ParseImmediateArgument(name, command.arguments.at(0));
+        const auto argument_count = arity ? static_cast<size_t>(std::max<int64_t>(arity.value(), 0)) : 0;
+        state.stack.resize(state.stack.size() - std::min(argument_count, state.stack.size()));
+      } else if (name == InlineLeaveCommand && inline_depth != 0 && --inline_depth == 0) {
+        state.stack.emplace_back();
+      }
+      continue;
+    }
+    if (inline_depth != 0) {
+      continue;
+    }
+
+    if (IsGuardedCommand(name) || IsTrappingCommand(name) || name == "CallVirtual") {
+      states_.emplace(i, state);
+    }
+
+    std::optional<uint64_t> index;
+    if (!command.arguments.empty()) {
+      auto value = ParseImmediateArgument(name, command.arguments.at(0));
+      if (value && value.value() >= 0) {
+        index = static_cast<uint64_t>(value.value());
+      }
+    }
+
+    if (name == "LoadLocal" && index) {
+      const DeoptValue entry_value{.entry_local = static_cast<uint32_t>(index.value())};
+      state.stack.push_back(index.value() < state.locals.size() ? state.locals[index.value()] : entry_value);
+    } else if (name == "SetLocal" && index && !state.stack.empty()) {
+      // Locals not set yet still hold their entry values
+      for (size_t local = state.locals.size(); local <= index.value(); ++local) {
+        state.locals.push_back({.entry_local = static_cast<uint32_t>(local)});
+      }
+      state.locals[index.value()] = state.stack.back();
+      state.stack.pop_back();
+    } else if (name == "Dup" && !state.stack.empty()) {
+      state.stack.push_back(state.stack.back());
+    } else if (name == "Swap" && state.stack.size() >= 2) {
+      std::swap(state.stack[state.stack.size() - 1], state.stack[state.stack.size() - 2]);
+    } else {
+      if (name == ScalarFrameEnterCommand) {
+        state.scalar_slots = index;
+      } else if (name == ScalarFrameLeaveCommand) {
+        state.scalar_slots.reset();
+      }
+
+      // Bodies are verified before code generation, every other command has a known effect
+      const auto effect = StackDepthVerifier::GetStackEffect(command);
+      if (!effect) {
+        return;
+      }
+      state.stack.resize(state.stack.size() - std::min(effect->popped, state.stack.size()));
+      const DeoptValue result{effect->pushed == 1 ? GetResultKind(name) : DeoptValueKind::kUnknown};
+      state.stack.insert(state.stack.end(), effect->pushed, result);
+    }
+  }
+}
+
+std::optional<DeoptExits::ImplicitAccess> DeoptExits::FindImplicitAccess(size_t index) const {
+  if (!options_.implicit_null_checks || !FaultRedirects::IsSupported()) {
+    return std::nullopt;
+  }
+
+  // GetField of the value right away, or SetField of it after the stored value is pushed
+  size_t access_index = index + 1;
+  if (access_index < body_.size() && body_[access_index].command_name != "GetField") {
+    const std::string& pushed = body_[access_index].command_name;
+    if (pushed != "LoadLocal" && pushed != "PushInt" && pushed != "PushBool" && pushed != "PushChar" &&
+        pushed != "PushByte" && pushed != "PushNull") {
+      return std::nullopt;
+    }
+    ++access_index;
+    if (access_index < body_.size() && body_[access_index].command_name != "SetField") {
+      return std::nullopt;
+    }
+  }
+  if (access_index >= body_.size()) {
+    return std::nullopt;
+  }
+
+  auto operation = CreateObjectOperation(body_[access_index], options_);
+  if (!operation) {
+    return std::nullopt;
+  }
+
+  // Only an access within the null page is sure to fault, a larger offset may reach mapped memory
+  const auto access = std::find_if(operation->begin(), operation->end(), [](const AssemblyInstruction& instruction) {
+    return std::any_of(instruction.arguments.begin(), instruction.arguments.end(), [](const Argument& argument) {
+      const auto* memory = std::get_if<MemoryAddress>(&argument);
+      return memory != nullptr && memory->base && memory->base != Register::RSP;
+    });
+  });
+  if (access == operation->end() || !ReadsOperandsInPlace(operation.value(), access - operation->begin())) {
+    return std::nullopt;
+  }
+  for (const Argument& argument : access->arguments) {
+    const auto* memory = std::get_if<MemoryAddress>(&argument);
+    if (memory != nullptr && (memory->index || memory->displacement < 0 ||
+                              memory->displacement >= FaultRedirects::kNullPageSize)) {
+      return std::nullopt;
+    }
+  }
+
+  const auto access_position = static_cast<size_t>(access - operation->begin());
+  return ImplicitAccess{access_index, 0, access_index - index - 1, std::move(operation.value()), access_position};
+}
+
+std::expected<bool, std::runtime_error> DeoptExits::LowerTrapping(size_t index) {
+  // Divisions take no arguments, the template is used as it is
+  const auto& operation = OilCommandAsmCompiler::GetAssemblyForCommand(body_.at(index).command_name);
+  const auto trap = std::find_if(operation.begin(), operation.end(), [](const AssemblyInstruction& instruction) {
+    return instruction.command == AsmCommand::IDIV || instruction.command == AsmCommand::DIV;
+  });
+  if (trap == operation.end()) {
+    return false;
+  }
+
+  std::string target = DivisionErrorLabel;
+  if (CanResume(index)) {
+    auto label = AddExit(index);
+    if (!label) {
+      return std::unexpected(label.error());
+    }
+
+    const auto trap_index = static_cast<size_t>(trap - operation.begin());
+    if (options_.implicit_division_checks && FaultRedirects::IsSupported() &&
+        ReadsOperandsInPlace(operation, trap - operation.begin())) {
+      EmitFaulting(operation, trap_index, exits_.size() - 1, 0, FaultKind::kDivide);
+      return true;
+    }
+    target = label.value();
+  }
+
+  EmitDivisionCheck(index, target);
+  output_.insert(output_.end(), operation.begin(), operation.end());
+  return true;
+}
+
+std::expected<bool, std::runtime_error> DeoptExits::LowerVirtualCall(size_t index) {
+  std::string target = DivisionErrorLabel;
+  if (CanResume(index)) {
+    auto label = AddExit(index);
+    if (!label) {
+      return std::unexpected(label.error());
+    }
+    target = label.value();
+  }
+
+  auto call = CreateVirtualCall(body_.at(index).arguments.at(0), target);
+  if (!call) {
+    return std::unexpected(call.error());
+  }
+  output_.insert(output_.end(), call->begin(), call->end());
+  return true;
+}
+
+bool DeoptExits::CanResume(size_t index) const {
+  // Frames the interpreter cannot resume, scalar replaced objects it cannot see and values it cannot type
+  // report the error themselves
+  const auto state = states_.find(index);
+  return table_ != nullptr && state != states_.end() && !state->second.scalar_slots &&
+         HasTypedValues(state->second);
+}
+
+bool DeoptExits::HasTypedValues(const FrameState& state) {
+  const auto is_typed = [](const DeoptValue& value) {
+    return value.kind != DeoptValueKind::kUnknown || value.entry_local.has_value();
+  };
+  return std::all_of(state.locals.begin(), state.locals.end(), is_typed) &&
+         std::all_of(state.stack.begin(), state.stack.end(), is_typed);
+}
+
+void DeoptExits::EmitNullCheck(const std::string& target) {
+  output_.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::RSP)}});
+  output_.push_back({AsmCommand::TEST, {Register::RAX, Register::RAX}});
+  output_.push_back({AsmCommand::JE, {target}});
+}
+
+void DeoptExits::EmitDivisionCheck(size_t index, const std::string& target) {
+  // Divisor is on top, a zero one faults and so does the minimum divided by -1
+  output_.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::RSP)}});
+  if (body_.at(index).command_name.starts_with("Byte")) {
+    output_.push_back({AsmCommand::TEST, {Register::AL, Register::AL}});
+    output_.push_back({AsmCommand::JE, {target}});
+    return;
+  }
+
+  const std::string checked_label = "division_checked_" + std::to_string(index);
+  output_.push_back({AsmCommand::TEST, {Register::RAX, Register::RAX}});
+  output_.push_back({AsmCommand::JE, {target}});
+  output_.push_back({AsmCommand::CMP, {Register::RAX, make_imm_arg(-1)}});
+  output_.push_back({AsmCommand::JNE, {checked_label}});
+  output_.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::RSP, static_cast<int64_t>(sizeof(uint64_t)))}});
+  output_.push_back({AsmCommand::MOV, {Register::RBX, make_imm_arg(std::numeric_limits<int64_t>::min())}});
+  output_.push_back({AsmCommand::CMP, {Register::RAX, Register::RBX}});
+  output_.push_back({AsmCommand::JE, {target}});
+  output_.push_back({AsmCommand::LABEL, {checked_label}});
+}
+
+void DeoptExits::EmitFaulting(const std::vector<AssemblyInstruction>& operation,
+                              size_t trap,
+                              size_t exit_index,
+                              size_t pushed,
+                              FaultKind kind) {
+  // Operands are popped after the faulting instruction, a fault leaves the values above RSP where neither
+  // the handler nor the exception dispatch overwrites them
+  Exit& exit = exits_[exit_index];
+  exit.fault_depth = exit.stack_depth + pushed;
+
+  int64_t popped = 0;
+  for (size_t k = 0; k < trap; ++k) {
+    const AssemblyInstruction& instruction = operation[k];
+    if (instruction.command == AsmCommand::POP) {
+      output_.push_back({AsmCommand::MOV, {instruction.arguments.at(0), addr(Register::RSP, popped)}});
+      popped += static_cast<int64_t>(sizeof(uint64_t));
+    } else {
+      output_.push_back(instruction);
+    }
+  }
+
+  const std::string label = exit.label + "_fault";
+  output_.push_back({AsmCommand::LABEL, {label}});
+  output_.push_back(operation[trap]);
+  if (popped != 0) {
+    output_.push_back({AsmCommand::ADD, {Register::RSP, make_imm_arg(popped)}});
+  }
+  output_.insert(output_.end(), operation.begin() + static_cast<ptrdiff_t>(trap + 1), operation.end());
+  table_->fault_sites.push_back({label, exit.label, kind});
+}
+
+std::expected<std::string, std::runtime_error> DeoptExits::AddExit(size_t index) {
+  const PackedOilCommand& command = body_.at(index);
+  if (table_ == nullptr) {
+    return std::unexpected(std::runtime_error("DeoptExits: no deoptimization table for " + command.command_name));
+  }
+
+  const auto it = states_.find(index);
+  if (it == states_.end()) {
+    return std::unexpected(std::runtime_error("DeoptExits: no guards in inlined frames for " + command.command_name));
+  }
+
+  const FrameState& state = it->second;
+  if (!HasTypedValues(state)) {
+    return std::unexpected(std::runtime_error("DeoptExits: untyped value in the frame of " + command.command_name));
+  }
+
+  constexpr size_t kMaxCount = std::numeric_limits<uint16_t>::max();
+  if (state.locals.size() > kMaxCount || state.stack.size() > kMaxCount ||
+      table_->values.size() + state.locals.size() + state.stack.size() > std::numeric_limits<uint32_t>::max()) {
+    return std::unexpected(std::runtime_error("DeoptExits: frame state is too large for " + command.command_name));
+  }
+
+  table_->points.push_back({static_cast<uint32_t>(command.source_index),
+                            static_cast<uint32_t>(table_->values.size()),
+                            static_cast<uint16_t>(state.locals.size()),
+                            static_cast<uint16_t>(state.stack.size()),
+                            IsGuardedCommand(command.command_name)});
+  table_->values.insert(table_->values.end(), state.locals.begin(), state.locals.end());
+  table_->values.insert(table_->values.end(), state.stack.begin(), state.stack.end());
+  table_->failures.push_back(0);
+  table_->max_stack_depth = std::max(table_->max_stack_depth, state.stack.size());
+
+  exits_.push_back(
+      {"deopt_" + std::to_string(exits_.size()), locals_.CreateWriteBack(), state.stack.size(), state.scalar_slots});
+  return exits_.back().label;
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,166 @@
+#ifndef JIT_DEOPTEXITS_HPP
+#define JIT_DEOPTEXITS_HPP
+
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+#include <jit/AsmData.hpp>
+#include <jit/machine-code-runner/ExecutableMemory.hpp>
+
+namespace ovum::vm::jit {
+
+class LocalRegisters;
+struct JitCompileOptions;
+
+// Interpreter type of a value of a deoptimized frame
+enum class DeoptValueKind : uint8_t { kUnknown, kInt, kFloat, kBool, kChar, kByte, kPointer };
+
+// A value of kUnknown has the type the local entry_local had when the code was entered, a pointer without it
+struct DeoptValue {
+  DeoptValueKind kind = DeoptValueKind::kUnknown;
+  std::optional<uint32_t> entry_local = std::nullopt;
+};
+
+// Frame state at one guard. Values of the locals and then of the stack from the bottom start at values_begin,
+// locals past local_count are unchanged since the entry.
+struct DeoptPoint {
+  uint32_t command_index;
+  uint32_t values_begin;
+  uint16_t local_count;
+  uint16_t stack_depth;
+  // Failed guards count towards invalidation, division exits leave for errors of the program instead
+  // and virtual call exits for targets without native code
+  bool is_guard;
+};
+
+// Instruction faulting instead of an explicit guard, both are labels of the assembly
+struct DeoptFaultSite {
+  std::string fault_label;
+  std::string exit_label;
+  FaultKind kind;
+};
+
+// Guards of one compiled body, exit k leaves k + 1 in the data buffer
+struct DeoptTable {
+  std::vector<DeoptPoint> points;
+  std::vector<DeoptValue> values;
+  std::vector<uint32_t> failures;
+  std::vector<DeoptFaultSite> fault_sites;
+  size_t max_stack_depth = 0;
+};
+
+// Commands lowered with a guard leaving to the interpreter when their speculation fails
+[[nodiscard]] bool IsGuardedCommand(const std::string& command_name);
+
+// Commands whose fault leaves to the interpreter where the frame allows it, elsewhere the code reports it
+[[nodiscard]] bool IsTrappingCommand(const std::string& command_name);
+
+// Guards of the body being compiled and their exits. A failed guard writes back the promoted locals, copies
+// the stack of the frame to the data buffer and leaves through the epilogue, the interpreter resumes at the
+// guarded command. Guards are placed only in the frame entered from the interpreter, not in inlined ones.
+// Unwrap of an object whose field is accessed next has no guard, the exit is entered from the access fault.
+// Frames holding values of unknown type, other than unchanged entry values, are not handed back, a null
+// Unwrap reports an error there.
+// Divisions leave the same way when they fault, or after an explicit check of the operands, and so do virtual
+// calls whose target cannot be called natively. In inlined frames, scalar frames and native callees they jump
+// to DivisionErrorLabel instead.
+class DeoptExits {
+public:
+  DeoptExits(std::vector<AssemblyInstruction>& output,
+             const std::vector<PackedOilCommand>& body,
+             const LocalRegisters& locals,
+             DeoptTable* table,
+             const JitCompileOptions& options);
+
+  // Lowers a guarded or trapping command, a virtual call or the field access checking a guard at the index,
+  // returns false for other commands
+  [[nodiscard]] std::expected<bool, std::runtime_error> TryLower(size_t index);
+
+  // Emitted right after the last command, the exits are skipped by the normal path
+  void EmitExits();
+
+  // Emitted after the code the static evaluation stack lowers, the exits and the normal path meet there
+  void EmitExitLabel();
+
+  // Stack depth in bytes at the labels of exits entered only by a fault, nothing in the body jumps to them
+  [[nodiscard]] std::unordered_map<std::string, int64_t> GetFaultEntryDepths() const;
+
+private:
+  // Frame state before a guarded command
+  struct FrameState {
+    std::vector<DeoptValue> locals;
+    std::vector<DeoptValue> stack;
+    // Slots of the scalar frame entered by the body
+    std::optional<uint64_t> scalar_slots;
+  };
+
+  struct Exit {
+    std::string label;
+    std::vector<AssemblyInstruction> write_back;
+    size_t stack_depth;
+    std::optional<uint64_t> scalar_slots;
+    // Stack depth at the faulting instruction for exits entered only by a fault
+    std::optional<size_t> fault_depth = std::nullopt;
+  };
+
+  // Field access the null check of an Unwrap is folded into
+  struct ImplicitAccess {
+    size_t command_index;
+    size_t exit;
+    // Values pushed between the Unwrap and the access
+    size_t pushed;
+    std::vector<AssemblyInstruction> operation;
+    // Instruction of the operation dereferencing the object
+    size_t access;
+  };
+
+  void Analyse();
+
+  // Field access at most one push after the Unwrap at the index, if it faults on a null object
+  [[nodiscard]] std::optional<ImplicitAccess> FindImplicitAccess(size_t index) const;
+
+  [[nodiscard]] std::expected<bool, std::runtime_error> LowerTrapping(size_t index);
+
+  [[nodiscard]] std::expected<bool, std::runtime_error> LowerVirtualCall(size_t index);
+
+  // Whether the command at the index can leave to the interpreter instead of reporting an error
+  [[nodiscard]] bool CanResume(size_t index) const;
+
+  // Results of calls, field and static loads have no type the interpreter could be given back
+  [[nodiscard]] static bool HasTypedValues(const FrameState& state);
+
+  // Jumps to the target when the value on top of the stack is null
+  void EmitNullCheck(const std::string& target);
+
+  // Jumps to the target when the division at the index would fault, its operands stay on the stack
+  void EmitDivisionCheck(size_t index, const std::string& target);
+
+  // Emits the operation with its stack operands read in place, the instruction at trap enters the exit on a fault
+  void EmitFaulting(const std::vector<AssemblyInstruction>& operation,
+                    size_t trap,
+                    size_t exit,
+                    size_t pushed,
+                    FaultKind kind);
+
+  // Registers the frame state of the command and returns the label its guard jumps to
+  [[nodiscard]] std::expected<std::string, std::runtime_error> AddExit(size_t index);
+
+  std::vector<AssemblyInstruction>& output_;
+  const std::vector<PackedOilCommand>& body_;
+  const LocalRegisters& locals_;
+  DeoptTable* table_;
+  const JitCompileOptions& options_;
+  std::unordered_map<size_t, FrameState> states_;
+  std::vector<Exit> exits_;
+  std::optional<ImplicitAccess> pending_access_;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_DEOPTEXITS_HPP
@@ -0,0 +1,321 @@
+#include "FloatRegisterStack.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+#include <jit/OilCommandAsmCompiler.hpp>
+
+namespace ovum::vm::jit {
+
+namespace {
+
+// Float comparison as UCOMISD first, second and SETcc, unordered result (NaN) is fixed by the parity flag
+struct FloatCompareLowering {
+  bool swap_operands;
+  AsmCommand set_condition;
+  std::optional<AsmCommand> set_parity;
+  AsmCommand combine;
+};
+
+const std::unordered_map<std::string_view, FloatCompareLowering> kFloatCompareLowerings = {
+    {"FloatEqual", {false, AsmCommand::SETZ, AsmCommand::SETNP, AsmCommand::AND}},
+    {"FloatNotEqual", {false, AsmCommand::SETNZ, AsmCommand::SETP, AsmCommand::OR}},
+    {"FloatLessThan", {true, AsmCommand::SETNBE, std::nullopt, AsmCommand::AND}},
+    {"FloatLessEqual", {true, AsmCommand::SETNB, std::nullopt, AsmCommand::AND}},
+    {"FloatGreaterThan", {false, AsmCommand::SETNBE, std::nullopt, AsmCommand::AND}},
+    {"FloatGreaterEqual", {false, AsmCommand::SETNB, std::nullopt, AsmCommand::AND}},
+};
+
+// SSE2 two-operand and AVX three-operand forms of the operation
+struct FloatArithmeticLowering {
+  AsmCommand sse;
+  AsmCommand avx;
+};
+
+const std::unordered_map<std::string_view, FloatArithmeticLowering> kFloatArithmeticLowerings = {
+    {"FloatAdd", {AsmCommand::ADDSD, AsmCommand::VADDSD}},
+    {"FloatSubtract", {AsmCommand::SUBSD, AsmCommand::VSUBSD}},
+    {"FloatMultiply", {AsmCommand::MULSD, AsmCommand::VMULSD}},
+    {"FloatDivide", {AsmCommand::DIVSD, AsmCommand::VDIVSD}},
+};
+
+// XMM6-XMM15 are callee-saved in Microsoft x64 ABI and the prologue does not preserve them
+#ifdef _WIN32
+constexpr Register kLastFloatRegister = Register::XMM5;
+#else
+constexpr Register kLastFloatRegister = Register::XMM15;
+#endif
+
+} // namespace
+
+FloatRegisterStack::FloatRegisterStack(std::vector<AssemblyInstruction>& output,
+                                       const std::vector<PackedOilCommand>& body,
+                                       LocalRegisters& locals,
+                                       const CpuFeatures& features) :
+    output_(output), body_(body), locals_(locals), features_(features) {
+  // Free list is used as a stack, XMM0 is handed out first
+  for (auto reg = static_cast<uint8_t>(kLastFloatRegister); reg >= static_cast<uint8_t>(Register::XMM0); --reg) {
+    free_registers_.push_back(static_cast<Register>(reg));
+  }
+}
+
+std::expected<bool, std::runtime_error> FloatRegisterStack::TryLower(size_t index) {
+  const PackedOilCommand& command = body_.at(index);
+  const std::string_view name = command.command_name;
+
+  if (name == "LoadLocal" || name == "SetLocal") {
+    const bool is_load = name == "LoadLocal";
+    if (is_load ? !FeedsFloatOperation(index) : entries_.empty()) {
+      return false;
+    }
+
+    auto local_index = ParseImmediateArgument(name, command.arguments.at(0));
+    if (!local_index || local_index.value() < 0) {
+      return std::unexpected(std::runtime_error("FloatRegisterStack: invalid local for " + command.command_name));
+    }
+
+    if (is_load) {
+      LowerLoadLocal(static_cast<uint64_t>(local_index.value()));
+    } else {
+      LowerSetLocal(static_cast<uint64_t>(local_index.value()));
+    }
+    return true;
+  }
+
+  if (name == "PushFloat") {
+    auto value = ParseImmediateArgument(name, command.arguments.at(0));
+    if (!value) {
+      return std::unexpected(value.error());
+    }
+
+    const Register reg = AllocateRegister();
+    output_.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(value.value())}});
+    output_.push_back({AsmCommand::MOVQ, {reg, Register::RAX}});
+    entries_.push_back(reg);
+    return true;
+  }
+
+  if (const auto it = kFloatArithmeticLowerings.find(name); it != kFloatArithmeticLowerings.end()) {
+    LowerArithmetic(it->second.sse, it->second.avx);
+    return true;
+  }
+
+  if (name == "FloatNegate") {
+    LowerBitwiseMask(AsmCommand::XORPD, AsmCommand::VXORPD, FloatSignMask);
+    return true;
+  }
+
+  if (name == "FloatSqrt") {
+    LoadOperands(1);
+    const Register value = entries_.back();
+    const Register result = PrepareDestination(1);
+    entries_.pop_back();
+
+    if (features_.avx) {
+      output_.push_back({AsmCommand::VSQRTSD, {result, value, value}});
+    } else {
+      output_.push_back({AsmCommand::SQRTSD, {result, value}});
+    }
+    PushResult(result, {value});
+    return true;
+  }
+
+  if (kFloatCompareLowerings.contains(name)) {
+    LowerCompare(command);
+    return true;
+  }
+
+  // Stack commands are handled only while their operands are already in registers
+  if (name == "Pop" && !entries_.empty()) {
+    const Register reg = entries_.back();
+    entries_.pop_back();
+    ReleaseIfUnused(reg);
+    return true;
+  }
+
+  if (name == "Dup" && !entries_.empty()) {
+    // Both entries share the register until one of them is overwritten
+    entries_.push_back(entries_.back());
+    return true;
+  }
+
+  if (name == "Swap" && entries_.size() >= 2) {
+    std::swap(entries_[entries_.size() - 1], entries_[entries_.size() - 2]);
+    return true;
+  }
+
+  return false;
+}
+
+void FloatRegisterStack::Materialize() {
+  for (const Register reg : entries_) {
+    output_.push_back({AsmCommand::MOVQ, {Register::RAX, reg}});
+    output_.push_back({AsmCommand::PUSH, {Register::RAX}});
+  }
+
+  std::vector<Register> materialized;
+  materialized.swap(entries_);
+  for (const Register reg : materialized) {
+    ReleaseIfUnused(reg);
+  }
+}
+
+bool FloatRegisterStack::IsFloatOperation(std::string_view name) const {
+  return kFloatArithmeticLowerings.contains(name) || kFloatCompareLowerings.contains(name) ||
+         name == "FloatNegate" || name == "FloatSqrt";
+}
+
+bool FloatRegisterStack::FeedsFloatOperation(size_t index) const {
+  for (size_t i = index + 1; i < body_.size(); ++i) {
+    const std::string& name = body_[i].command_name;
+    if (name != "LoadLocal" && name != "PushFloat") {
+      return IsFloatOperation(name);
+    }
+  }
+  return false;
+}
+
+void FloatRegisterStack::LowerLoadLocal(uint64_t local_index) {
+  const Register reg = AllocateRegister();
+  if (const auto local = locals_.GetRegister(local_index)) {
+    output_.push_back({AsmCommand::MOVQ, {reg, local.value()}});
+  } else {
+    output_.push_back({AsmCommand::MOVSD, {reg, addr(Register::R13, static_cast<int64_t>(local_index * 8))}});
+  }
+  entries_.push_back(reg);
+}
+
+void FloatRegisterStack::LowerSetLocal(uint64_t local_index) {
+  const Register reg = entries_.back();
+  entries_.pop_back();
+  if (const auto local = locals_.GetRegister(local_index)) {
+    output_.push_back({AsmCommand::MOVQ, {local.value(), reg}});
+    locals_.MarkModified(local_index);
+  } else {
+    output_.push_back({AsmCommand::MOVSD, {addr(Register::R13, static_cast<int64_t>(local_index * 8)), reg}});
+  }
+  ReleaseIfUnused(reg);
+}
+
+Register FloatRegisterStack::AllocateRegister() {
+  while (free_registers_.empty()) {
+    // The bottom value is the deepest one, pushing it keeps the machine stack order
+    const Register spilled = entries_.front();
+    output_.push_back({AsmCommand::MOVQ, {Register::RAX, spilled}});
+    output_.push_back({AsmCommand::PUSH, {Register::RAX}});
+    entries_.erase(entries_.begin());
+    ReleaseIfUnused(spilled);
+  }
+
+  const Register reg = free_registers_.back();
+  free_registers_.pop_back();
+  return reg;
+}
+
+void FloatRegisterStack::ReleaseIfUnused(Register reg) {
+  if (std::find(entries_.begin(), entries_.end(), reg) == entries_.end() &&
+      std::find(free_registers_.begin(), free_registers_.end(), reg) == free_registers_.end()) {
+    free_registers_.push_back(reg);
+  }
+}
+
+void FloatRegisterStack::LoadOperands(size_t count) {
+  while (entries_.size() < count) {
+    const Register reg = AllocateRegister();
+    output_.push_back({AsmCommand::POP, {Register::RAX}});
+    output_.push_back({AsmCommand::MOVQ, {reg, Register::RAX}});
+    entries_.insert(entries_.begin(), reg);
+  }
+}
+
+Register FloatRegisterStack::PrepareDestination(size_t operand_count) {
+  const auto operands_begin = entries_.end() - static_cast<ptrdiff_t>(operand_count);
+  const Register first_operand = *operands_begin;
+
+  // The first operand register can be overwritten only if no value outside the operands lives in it
+  if (std::find(entries_.begin(), operands_begin, first_operand) == operands_begin) {
+    return first_operand;
+  }
+  return AllocateRegister();
+}
+
+void FloatRegisterStack::PushResult(Register result, std::initializer_list<Register> operands) {
+  entries_.push_back(result);
+  for (const Register reg : operands) {
+    ReleaseIfUnused(reg);
+  }
+}
+
+void FloatRegisterStack::EmitBinary(AsmCommand sse, AsmCommand avx, Register result, Register lhs, Register rhs) {
+  if (features_.avx) {
+    output_.push_back({avx, {result, lhs, rhs}});
+    return;
+  }
+
+  // result is either lhs or a fresh register, so it never aliases rhs here
+  if (result != lhs) {
+    output_.push_back({AsmCommand::MOVAPD, {result, lhs}});
+  }
+  output_.push_back({sse, {result, rhs}});
+}
+
+void FloatRegisterStack::LowerArithmetic(AsmCommand sse, AsmCommand avx) {
+  LoadOperands(2);
+  const Register result = PrepareDestination(2);
+  const Register rhs = entries_.back();
+  entries_.pop_back();
+  const Register lhs = entries_.back();
+  entries_.pop_back();
+
+  EmitBinary(sse, avx, result, lhs, rhs);
+  PushResult(result, {lhs, rhs});
+}
+
+void FloatRegisterStack::LowerBitwiseMask(AsmCommand sse, AsmCommand avx, int64_t mask_bits) {
+  LoadOperands(1);
+  const Register mask = AllocateRegister();
+  const Register result = PrepareDestination(1);
+  const Register value = entries_.back();
+  entries_.pop_back();
+
+  output_.push_back({AsmCommand::MOV, {Register::RAX, mask_bits}});
+  output_.push_back({AsmCommand::MOVQ, {mask, Register::RAX}});
+  EmitBinary(sse, avx, result, value, mask);
+  PushResult(result, {value, mask});
+}
+
+void FloatRegisterStack::LowerCompare(const PackedOilCommand& command) {
+  const auto& lowering = kFloatCompareLowerings.at(command.command_name);
+
+  LoadOperands(2);
+  const Register rhs = entries_.back();
+  entries_.pop_back();
+  const Register lhs = entries_.back();
+  entries_.pop_back();
+
+  // Integer result goes to the machine stack, so values below it have to be there first
+  Materialize();
+
+  if (lowering.swap_operands) {
+    output_.push_back({AsmCommand::UCOMISD, {rhs, lhs}});
+  } else {
+    output_.push_back({AsmCommand::UCOMISD, {lhs, rhs}});
+  }
+
+  output_.push_back({lowering.set_condition, {Register::AL}});
+  if (lowering.set_parity) {
+    output_.push_back({lowering.set_parity.value(), {Register::CL}});
+    output_.push_back({lowering.combine, {Register::AL, Register::CL}});
+  }
+  output_.push_back({AsmCommand::MOVZX, {Register::RAX, Register::AL}});
+  output_.push_back({AsmCommand::PUSH, {Register::RAX}});
+
+  ReleaseIfUnused(lhs);
+  ReleaseIfUnused(rhs);
+}
+
+} // namespace ovum::vm::jit
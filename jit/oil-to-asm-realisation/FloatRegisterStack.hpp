@@ -0,0 +1,80 @@
+#ifndef JIT_FLOATREGISTERSTACK_HPP
+#define JIT_FLOATREGISTERSTACK_HPP
+
+#include <cstdint>
+#include <expected>
+#include <initializer_list>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+#include <jit/AsmData.hpp>
+#include <jit/CpuFeatures.hpp>
+#include <jit/oil-to-asm-realisation/LocalRegisters.hpp>
+
+namespace ovum::vm::jit {
+
+// Top part of the evaluation stack kept in XMM registers while Float* commands follow each other.
+// Values below it stay on the machine stack, so materializing pushes the register part in order.
+// Several entries may share a register after Dup, the register is copied only when one of them is overwritten.
+// Locals are loaded straight into registers when a Float* command takes them, SetLocal stores the top register.
+class FloatRegisterStack {
+public:
+  FloatRegisterStack(std::vector<AssemblyInstruction>& output,
+                     const std::vector<PackedOilCommand>& body,
+                     LocalRegisters& locals,
+                     const CpuFeatures& features);
+
+  // Lowers the command at the index on register-resident values, returns false if the command is a boundary
+  // and has to be compiled by its template after Materialize
+  [[nodiscard]] std::expected<bool, std::runtime_error> TryLower(size_t index);
+
+  // Pushes all register-resident values to the machine stack
+  void Materialize();
+
+private:
+  // Whether the command is lowered on registers when its operands are there
+  [[nodiscard]] bool IsFloatOperation(std::string_view name) const;
+
+  // Whether the value pushed by the command at the index is taken by a Float* command, only pushes may come between
+  [[nodiscard]] bool FeedsFloatOperation(size_t index) const;
+
+  void LowerLoadLocal(uint64_t local_index);
+
+  void LowerSetLocal(uint64_t local_index);
+
+  // Allocates a free XMM register, spilling bottom register-resident values until one is freed
+  Register AllocateRegister();
+
+  void ReleaseIfUnused(Register reg);
+
+  // Pops values from the machine stack until at least count values are in registers
+  void LoadOperands(size_t count);
+
+  // Register for the result of an operation on the top operand_count entries, must be called before they are popped
+  Register PrepareDestination(size_t operand_count);
+
+  void PushResult(Register result, std::initializer_list<Register> operands);
+
+  // result = lhs op rhs, AVX form is used if available
+  void EmitBinary(AsmCommand sse, AsmCommand avx, Register result, Register lhs, Register rhs);
+
+  void LowerArithmetic(AsmCommand sse, AsmCommand avx);
+
+  // Applies a bitwise packed operation with a 64-bit mask to the top value
+  void LowerBitwiseMask(AsmCommand sse, AsmCommand avx, int64_t mask_bits);
+
+  void LowerCompare(const PackedOilCommand& command);
+
+  std::vector<AssemblyInstruction>& output_;
+  const std::vector<PackedOilCommand>& body_;
+  LocalRegisters& locals_;
+  CpuFeatures features_;
+  std::vector<Register> entries_;
+  std::vector<Register> free_registers_;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_FLOATREGISTERSTACK_HPP
@@ -0,0 +1,204 @@
+#include "LocalRegisters.hpp"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/EscapeAnalysis.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/Inliner.hpp>
+
+namespace ovum::vm::jit {
+
+namespace {
+
+// A local accessed once gains nothing from a register
+constexpr size_t kMinPromotedUses = 2;
+
+// Calls, allocations and write barriers may reach the VM, as may templates calling runtime operations
+bool CanObserveFrame(const PackedOilCommand& command) {
+  const std::string& name = command.command_name;
+  if (name == InlineEnterCommand || name == InlineLeaveCommand) {
+    return false;
+  }
+
+  if (IsCallOperation(name) || name == "SetField") {
+    return true;
+  }
+
+  const auto& assembly = OilCommandAsmCompiler::GetAssemblyForCommand(name);
+  return std::any_of(assembly.begin(), assembly.end(), [](const AssemblyInstruction& instruction) {
+    return instruction.command == AsmCommand::CALL;
+  });
+}
+
+} // namespace
+
+LocalRegisters::LocalRegisters(std::vector<AssemblyInstruction>& output,
+                               const std::vector<PackedOilCommand>& body,
+                               const JitCompileOptions& options) : output_(output), body_(body) {
+  Analyse(options);
+}
+
+void LocalRegisters::SaveRegisters() {
+  for (Register reg : saved_registers_) {
+    output_.push_back({AsmCommand::PUSH, {reg}});
+  }
+}
+
+void LocalRegisters::LoadLiveIn() {
+  for (const auto& [index, local] : promoted_) {
+    if (local.live_in) {
+      output_.push_back({AsmCommand::MOV, {local.reg, addr(Register::R13, static_cast<int64_t>(index * 8))}});
+    }
+  }
+}
+
+std::expected<bool, std::runtime_error> LocalRegisters::TryLower(size_t index) {
+  const PackedOilCommand& command = body_.at(index);
+  const bool is_load = command.command_name == "LoadLocal";
+  if (!is_load && command.command_name != "SetLocal") {
+    if (inline_depth_ == 0 && observes_frame_[index]) {
+      WriteBack();
+    }
+
+    if (command.command_name == InlineEnterCommand) {
+      ++inline_depth_;
+    } else if (command.command_name == InlineLeaveCommand && inline_depth_ != 0) {
+      --inline_depth_;
+    }
+    return false;
+  }
+
+  auto local_index = ParseImmediateArgument(command.command_name, command.arguments.at(0));
+  if (!local_index || local_index.value() < 0) {
+    return std::unexpected(std::runtime_error("LocalRegisters: invalid local for " + command.command_name));
+  }
+
+  const auto it = inline_depth_ == 0 ? promoted_.find(static_cast<uint64_t>(local_index.value())) : promoted_.end();
+  if (it != promoted_.end()) {
+    if (is_load) {
+      output_.push_back({AsmCommand::PUSH, {it->second.reg}});
+    } else {
+      output_.push_back({AsmCommand::POP, {it->second.reg}});
+      it->second.dirty = true;
+    }
+    return true;
+  }
+
+  const MemoryAddress slot = addr(Register::R13, local_index.value() * 8);
+  if (is_load) {
+    output_.push_back({AsmCommand::MOV, {Register::RAX, slot}});
+    output_.push_back({AsmCommand::PUSH, {Register::RAX}});
+  } else {
+    output_.push_back({AsmCommand::POP, {Register::RAX}});
+    output_.push_back({AsmCommand::MOV, {slot, Register::RAX}});
+  }
+  return true;
+}
+
+std::optional<Register> LocalRegisters::GetRegister(uint64_t local_index) const {
+  const auto it = inline_depth_ == 0 ? promoted_.find(local_index) : promoted_.end();
+  if (it == promoted_.end()) {
+    return std::nullopt;
+  }
+  return it->second.reg;
+}
+
+void LocalRegisters::MarkModified(uint64_t local_index) {
+  if (const auto it = promoted_.find(local_index); it != promoted_.end() && inline_depth_ == 0) {
+    it->second.dirty = true;
+  }
+}
+
+void LocalRegisters::WriteBack() {
+  const std::vector<AssemblyInstruction> stores = CreateWriteBack();
+  output_.insert(output_.end(), stores.begin(), stores.end());
+  for (auto& [index, local] : promoted_) {
+    local.dirty = false;
+  }
+}
+
+std::vector<AssemblyInstruction> LocalRegisters::CreateWriteBack() const {
+  std::vector<AssemblyInstruction> result;
+  for (const auto& [index, local] : promoted_) {
+    if (local.dirty) {
+      result.push_back({AsmCommand::MOV, {addr(Register::R13, static_cast<int64_t>(index * 8)), local.reg}});
+    }
+  }
+  return result;
+}
+
+void LocalRegisters::RestoreRegisters() {
+  for (auto it = saved_registers_.rbegin(); it != saved_registers_.rend(); ++it) {
+    output_.push_back({AsmCommand::POP, {*it}});
+  }
+}
+
+void LocalRegisters::Analyse(const JitCompileOptions& options) {
+  std::unordered_map<uint64_t, size_t> use_counts;
+  std::unordered_map<uint64_t, bool> read_first;
+  observes_frame_.assign(body_.size(), false);
+  bool has_scalar_frame = false;
+  size_t depth = 0;
+  size_t region_start = 0;
+
+  for (size_t i = 0; i < body_.size(); ++i) {
+    const PackedOilCommand& command = body_[i];
+    if (command.command_name == InlineEnterCommand) {
+      region_start = depth == 0 ? i : region_start;
+      ++depth;
+    } else if (command.command_name == InlineLeaveCommand) {
+      depth = depth == 0 ? 0 : depth - 1;
+    } else if (command.command_name == ScalarFrameEnterCommand) {
+      has_scalar_frame = true;
+    } else if (depth == 0 && (command.command_name == "LoadLocal" || command.command_name == "SetLocal")) {
+      auto local_index = ParseImmediateArgument(command.command_name, command.arguments.at(0));
+      if (local_index && local_index.value() >= 0) {
+        const auto local = static_cast<uint64_t>(local_index.value());
+        ++use_counts[local];
+        read_first.emplace(local, command.command_name == "LoadLocal");
+      }
+    }
+
+    // Inlined frames are not seen by the VM, the caller frame is written back before entering them
+    if (CanObserveFrame(command)) {
+      observes_frame_[depth == 0 ? i : region_start] = true;
+    }
+  }
+
+  // Code leaving from inside a scalar frame, as division errors do, takes the caller R15 from the saved ones
+  if (has_scalar_frame) {
+    saved_registers_.push_back(Register::R15);
+  }
+
+  if (!options.keep_locals_in_registers) {
+    return;
+  }
+
+  // R12 holds argc only in the prologue and is preserved by it. R15 is the scalar frame pointer when there is one.
+  std::vector<Register> free_registers = {Register::R12, Register::RBP};
+  if (!has_scalar_frame) {
+    free_registers.push_back(Register::R15);
+  }
+
+  std::vector<std::pair<uint64_t, size_t>> candidates;
+  for (const auto& [local, count] : use_counts) {
+    if (count >= kMinPromotedUses) {
+      candidates.emplace_back(local, count);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(), [](const auto& lhs, const auto& rhs) {
+    return lhs.second != rhs.second ? lhs.second > rhs.second : lhs.first < rhs.first;
+  });
+
+  for (size_t i = 0; i < candidates.size() && i < free_registers.size(); ++i) {
+    const Register reg = free_registers[i];
+    promoted_.emplace(candidates[i].first, PromotedLocal{reg, read_first[candidates[i].first]});
+    if (reg != Register::R12) {
+      saved_registers_.push_back(reg);
+    }
+  }
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,73 @@
+#ifndef JIT_LOCALREGISTERS_HPP
+#define JIT_LOCALREGISTERS_HPP
+
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+#include <jit/AsmData.hpp>
+
+namespace ovum::vm::jit {
+
+struct JitCompileOptions;
+
+// Locals of the compiled function kept in callee-saved registers for the whole body.
+// Live-in locals are loaded after the prologue, the VM frame gets modified locals back only before commands
+// that may observe it (calls, allocations, runtime operations) and at the exit.
+// Other locals and locals of inlined frames are addressed directly relative to R13.
+class LocalRegisters {
+public:
+  LocalRegisters(std::vector<AssemblyInstruction>& output,
+                 const std::vector<PackedOilCommand>& body,
+                 const JitCompileOptions& options);
+
+  // Saves the registers the prologue does not preserve, emitted before the prologue
+  void SaveRegisters();
+
+  // Loads the promoted locals read before they are written, emitted after the prologue
+  void LoadLiveIn();
+
+  // Lowers LoadLocal and SetLocal of the command at the index, returns false for other commands.
+  // Modified locals are written back before a command observing the frame.
+  [[nodiscard]] std::expected<bool, std::runtime_error> TryLower(size_t index);
+
+  // Register holding the local at the current command, std::nullopt if it is addressed relative to R13
+  [[nodiscard]] std::optional<Register> GetRegister(uint64_t local_index) const;
+
+  // Records a store to the register of the local done by other code, it is written back like SetLocal
+  void MarkModified(uint64_t local_index);
+
+  // Writes back modified locals, emitted before the epilogue
+  void WriteBack();
+
+  // Stores of the locals modified so far, for exits that leave the body without passing WriteBack
+  [[nodiscard]] std::vector<AssemblyInstruction> CreateWriteBack() const;
+
+  // Restores the registers saved by SaveRegisters, emitted right before RET
+  void RestoreRegisters();
+
+private:
+  struct PromotedLocal {
+    Register reg;
+    bool live_in = false;
+    bool dirty = false;
+  };
+
+  void Analyse(const JitCompileOptions& options);
+
+  std::vector<AssemblyInstruction>& output_;
+  const std::vector<PackedOilCommand>& body_;
+  std::unordered_map<uint64_t, PromotedLocal> promoted_;
+  std::vector<Register> saved_registers_;
+  // Commands the frame has to be up to date for, an inlined region counts at its InlineEnter
+  std::vector<bool> observes_frame_;
+  size_t inline_depth_ = 0;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_LOCALREGISTERS_HPP
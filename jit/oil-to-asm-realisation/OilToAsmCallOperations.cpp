@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+#include <jit/JitExecutor.hpp>
+#include <jit/JitFunctionRegistry.hpp>
+#include <jit/ObjectHeap.hpp>
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/VirtualDispatch.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/Inliner.hpp>
+
+namespace ovum::vm::jit {
+
+// Allocation labels have to be unique within a function
+static std::atomic<uint64_t> s_constructor_count = 0;
+
+// Emitted right after the call, the callee data buffer is at RSP. A division error stops the caller as well.
+static void AppendDivisionErrorCheck(std::vector<AssemblyInstruction>& result) {
+  result.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::RSP, AsmDataBuffer::GetDeoptExitOffset())}});
+  result.push_back({AsmCommand::TEST, {Register::RAX, Register::RAX}});
+  result.push_back({AsmCommand::JNE, {DivisionErrorLabel}});
+}
+
+// With a receiver the first argument is the object in RBX, it is pushed instead of the callee result
+static std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateFunctionCall(
+    const std::string& function_id, bool with_receiver) {
+  JitFunctionEntry* entry = JitFunctionRegistry::Find(function_id);
+  if (entry == nullptr || entry->executor == nullptr) {
+    return std::unexpected(std::runtime_error("CreateNativeCall: function is not registered: " + function_id));
+  }
+
+  if (!entry->arity || (with_receiver && entry->arity.value() == 0)) {
+    return std::unexpected(std::runtime_error("CreateNativeCall: arity is unknown for " + function_id));
+  }
+
+  // Checked here because the resolver stub cannot fall back to the interpreter
+  auto local_slot_count = entry->executor->GetLocalSlotCount();
+  if (!local_slot_count) {
+    return std::unexpected(std::runtime_error("CreateNativeCall: callee cannot be compiled: " + function_id));
+  }
+
+  // Callee data buffer and local slots are reserved below the arguments on the machine stack,
+  // first argument is the deepest one and becomes local 0
+  const uint64_t arity = entry->arity.value();
+  const uint64_t stack_arity = with_receiver ? arity - 1 : arity;
+  const uint64_t slot_count = std::max(arity, local_slot_count.value());
+  const auto locals_offset = static_cast<int64_t>(sizeof(AsmDataBuffer));
+  const auto frame_size = locals_offset + static_cast<int64_t>(slot_count * sizeof(uint64_t));
+  const auto arguments_size = static_cast<int64_t>(stack_arity * sizeof(uint64_t));
+
+  std::vector<AssemblyInstruction> result = {{AsmCommand::SUB, {Register::RSP, make_imm_arg(frame_size)}}};
+
+  if (with_receiver) {
+    result.push_back({AsmCommand::MOV, {addr(Register::RSP, locals_offset), Register::RBX}});
+  }
+
+  for (uint64_t i = 0; i < stack_arity; ++i) {
+    const auto argument_offset = frame_size + arguments_size - static_cast<int64_t>((i + 1) * sizeof(uint64_t));
+    const auto local_offset = locals_offset + static_cast<int64_t>((arity - stack_arity + i) * sizeof(uint64_t));
+    result.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::RSP, argument_offset)}});
+    result.push_back({AsmCommand::MOV, {addr(Register::RSP, local_offset), Register::RAX}});
+  }
+
+  // Callee frame cannot leave to the interpreter, only its division errors are reported through the exit
+  result.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(0)}});
+  result.push_back({AsmCommand::MOV, {addr(Register::RSP, AsmDataBuffer::GetDeoptStackOffset()), Register::RAX}});
+  result.push_back({AsmCommand::MOV, {addr(Register::RSP, AsmDataBuffer::GetDeoptExitOffset()), Register::RAX}});
+  for (uint64_t i = arity; i < slot_count; ++i) {
+    const auto local_offset = locals_offset + static_cast<int64_t>(i * sizeof(uint64_t));
+    result.push_back({AsmCommand::MOV, {addr(Register::RSP, local_offset), Register::RAX}});
+  }
+
+  // Profile for the inliner
+  result.push_back({AsmCommand::MOV, {Register::R11, make_imm_arg(reinterpret_cast<int64_t>(&entry->call_count))}});
+  result.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::R11)}});
+  result.push_back({AsmCommand::INC, {Register::RAX}});
+  result.push_back({AsmCommand::MOV, {addr(Register::R11), Register::RAX}});
+
+  result.push_back({AsmCommand::MOV, {CallArgumentRegisters[0], Register::RSP}});
+  result.push_back({AsmCommand::MOV, {CallArgumentRegisters[1], make_imm_arg(static_cast<int64_t>(arity))}});
+  result.push_back({AsmCommand::LEA, {CallArgumentRegisters[2], addr(Register::RSP, locals_offset)}});
+
+#ifdef _WIN32
+  result.push_back({AsmCommand::SUB, {Register::RSP, make_imm_arg(ShadowSpaceSizeBytes)}});
+#endif
+
+  void* call_target = entry->call_target.load(std::memory_order_acquire);
+  if (entry->executor->GetCompileTier() == JitCompileTier::kOptimizing &&
+      call_target != JitFunctionRegistry::GetResolverStub()) {
+    // Optimized code stays mapped after recompilation, the call goes straight to it
+    result.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(reinterpret_cast<int64_t>(call_target))}});
+    result.push_back({AsmCommand::CALL, {Register::RAX}});
+  } else {
+    // Entry cell is patched when the callee is compiled or tiers up, the stub gets the entry address in RAX
+    result.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(reinterpret_cast<int64_t>(entry))}});
+    result.push_back({AsmCommand::CALL, {addr(Register::RAX)}});
+  }
+
+#ifdef _WIN32
+  result.push_back({AsmCommand::ADD, {Register::RSP, make_imm_arg(ShadowSpaceSizeBytes)}});
+#endif
+  AppendDivisionErrorCheck(result);
+
+  // Callee frame and arguments are dropped, its result replaces them
+  if (!with_receiver) {
+    result.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::RSP, AsmDataBuffer::GetResultOffset())}});
+  }
+  result.push_back({AsmCommand::ADD, {Register::RSP, make_imm_arg(frame_size + arguments_size)}});
+  result.push_back({AsmCommand::PUSH, {with_receiver ? Register::RBX : Register::RAX}});
+  return result;
+}
+
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateNativeCall(const std::string& function_id) {
+  return CreateFunctionCall(function_id, false);
+}
+
+// Leaves the initialized object in RBX
+static std::vector<AssemblyInstruction> CreateAllocation(const ConstructorLayout& layout) {
+  const ObjectHeapHooks& hooks = ObjectHeap::GetHooks();
+
+  const auto object_size = static_cast<int64_t>((layout.object_size + 7) & ~uint64_t{7});
+  const auto* buffer = hooks.allocation_buffer;
+  const std::string label_prefix = "constructor_" + std::to_string(s_constructor_count.fetch_add(1)) + "_";
+  const std::string slow_label = label_prefix + "slow";
+  const std::string init_label = label_prefix + "init";
+
+  // Bump the buffer top, the runtime allocator is called only when the buffer is exhausted
+  std::vector<AssemblyInstruction> result = {
+      {AsmCommand::MOV, {Register::R11, make_imm_arg(reinterpret_cast<int64_t>(buffer))}},
+      {AsmCommand::MOV, {Register::RBX, addr(Register::R11, offsetof(AllocationBuffer, top))}},
+      {AsmCommand::LEA, {Register::RCX, addr(Register::RBX, object_size)}},
+      {AsmCommand::MOV, {Register::RDX, addr(Register::R11, offsetof(AllocationBuffer, end))}},
+      {AsmCommand::CMP, {Register::RCX, Register::RDX}},
+      {AsmCommand::JA, {slow_label}},
+      {AsmCommand::MOV, {addr(Register::R11, offsetof(AllocationBuffer, top)), Register::RCX}},
+      {AsmCommand::JMP, {init_label}},
+      {AsmCommand::LABEL, {slow_label}},
+      {AsmCommand::PUSH, {Register::RBP}},
+      {AsmCommand::MOV, {Register::RBP, Register::RSP}},
+      {AsmCommand::AND, {Register::RSP, make_imm_arg(-16)}}};
+#ifdef _WIN32
+  result.push_back({AsmCommand::SUB, {Register::RSP, make_imm_arg(ShadowSpaceSizeBytes)}});
+#endif
+  result.push_back({AsmCommand::MOV, {CallArgumentRegisters[0], make_imm_arg(object_size)}});
+  result.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(reinterpret_cast<int64_t>(hooks.allocate))}});
+  result.push_back({AsmCommand::CALL, {Register::RAX}});
+  result.push_back({AsmCommand::MOV, {Register::RSP, Register::RBP}});
+  result.push_back({AsmCommand::POP, {Register::RBP}});
+  result.push_back({AsmCommand::MOV, {Register::RBX, Register::RAX}});
+
+  // Object memory comes zeroed, only the header and the vtable are written
+  result.push_back({AsmCommand::LABEL, {init_label}});
+  result.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(static_cast<int64_t>(layout.header))}});
+  result.push_back({AsmCommand::MOV, {addr(Register::RBX, hooks.header_offset), Register::RAX}});
+  if (layout.vtable != nullptr) {
+    result.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(reinterpret_cast<int64_t>(layout.vtable))}});
+    const int64_t vtable_offset = VirtualDispatch::GetHooks().vtable_offset;
+    result.push_back({AsmCommand::MOV, {addr(Register::RBX, vtable_offset), Register::RAX}});
+  }
+  return result;
+}
+
+// NewObject of an inlined constructor, the new object is pushed
+static std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateNewObject(
+    const std::string& constructor_name) {
+  const std::string constructor_id(JitFunctionRegistry::StripQuotes(constructor_name));
+  const auto layout = ObjectHeap::ResolveConstructor(constructor_id);
+  if (!layout || !ObjectHeap::HasAllocationBuffer()) {
+    return std::unexpected(std::runtime_error("CreateNewObject: cannot allocate for " + constructor_id));
+  }
+
+  std::vector<AssemblyInstruction> result = CreateAllocation(layout.value());
+  result.push_back({AsmCommand::PUSH, {Register::RBX}});
+  return result;
+}
+
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateConstructorCall(
+    const std::string& constructor_name) {
+  const std::string constructor_id(JitFunctionRegistry::StripQuotes(constructor_name));
+  const auto layout = ObjectHeap::ResolveConstructor(constructor_id);
+  if (!layout || !ObjectHeap::HasAllocationBuffer()) {
+    return std::unexpected(std::runtime_error("CreateConstructorCall: cannot allocate for " + constructor_id));
+  }
+
+  std::vector<AssemblyInstruction> result = CreateAllocation(layout.value());
+
+  // Constructor body gets the object as its first argument, RBX survives the call
+  auto call = CreateFunctionCall(layout->function_name, true);
+  if (!call) {
+    return std::unexpected(call.error());
+  }
+  result.insert(result.end(), call->begin(), call->end());
+  return result;
+}
+
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateVirtualCall(const std::string& method_name,
+                                                                                    const std::string& miss_label) {
+  const std::string method_id(JitFunctionRegistry::StripQuotes(method_name));
+  if (!VirtualDispatch::HasHooks()) {
+    return std::unexpected(std::runtime_error("CreateVirtualCall: virtual dispatch hooks are not set"));
+  }
+
+  const auto method_arity = VirtualDispatch::GetHooks().method_arity(method_id);
+  if (!method_arity || method_arity.value() == 0) {
+    return std::unexpected(std::runtime_error("CreateVirtualCall: method has no receiver: " + method_id));
+  }
+
+  InlineCacheSite* site = VirtualDispatch::CreateSite(method_id);
+  const std::string label_prefix = "virtual_" + std::to_string(reinterpret_cast<uintptr_t>(site)) + "_";
+  const std::string call_label = label_prefix + "call";
+  const std::string fill_label = label_prefix + "fill";
+  const std::string filled_label = label_prefix + "filled";
+
+  const uint64_t arity = method_arity.value();
+  const auto locals_offset = static_cast<int64_t>(sizeof(AsmDataBuffer));
+  const auto arguments_size = static_cast<int64_t>(arity * sizeof(uint64_t));
+  const auto entry_size = static_cast<int64_t>(sizeof(InlineCacheEntry));
+
+  // Receiver is the first argument, the deepest one on the stack
+  std::vector<AssemblyInstruction> result = {
+      {AsmCommand::MOV, {Register::RAX, addr(Register::RSP, arguments_size - static_cast<int64_t>(sizeof(uint64_t)))}},
+      {AsmCommand::MOV, {Register::RAX, addr(Register::RAX, VirtualDispatch::GetHooks().vtable_offset)}},
+      {AsmCommand::MOV, {Register::R10, make_imm_arg(reinterpret_cast<int64_t>(site->entries.data()))}}};
+
+  for (size_t k = 0; k < InlineCacheSite::kMaxEntries; ++k) {
+    const auto vtable_offset = static_cast<int64_t>(k) * entry_size + offsetof(InlineCacheEntry, vtable);
+    result.push_back({AsmCommand::MOV, {Register::R11, addr(Register::R10, vtable_offset)}});
+    result.push_back({AsmCommand::CMP, {Register::RAX, Register::R11}});
+    result.push_back({AsmCommand::JE, {label_prefix + "hit_" + std::to_string(k)}});
+  }
+
+  // Miss handler fills the site or serves the megamorphic lookup, the stack is realigned for it
+  result.push_back({AsmCommand::PUSH, {Register::RBP}});
+  result.push_back({AsmCommand::MOV, {Register::RBP, Register::RSP}});
+  result.push_back({AsmCommand::AND, {Register::RSP, make_imm_arg(-16)}});
+#ifdef _WIN32
+  result.push_back({AsmCommand::SUB, {Register::RSP, make_imm_arg(ShadowSpaceSizeBytes)}});
+#endif
+  result.push_back({AsmCommand::MOV, {CallArgumentRegisters[0], make_imm_arg(reinterpret_cast<int64_t>(site))}});
+  result.push_back({AsmCommand::MOV, {CallArgumentRegisters[1], Register::RAX}});
+  result.push_back(
+      {AsmCommand::MOV, {Register::RAX, make_imm_arg(reinterpret_cast<int64_t>(&VirtualDispatch::HandleMiss))}});
+  result.push_back({AsmCommand::CALL, {Register::RAX}});
+  result.push_back({AsmCommand::MOV, {Register::RSP, Register::RBP}});
+  result.push_back({AsmCommand::POP, {Register::RBP}});
+  result.push_back({AsmCommand::TEST, {Register::RAX, Register::RAX}});
+  result.push_back({AsmCommand::JE, {miss_label}});
+  result.push_back({AsmCommand::MOV, {Register::R10, Register::RAX}});
+  result.push_back({AsmCommand::JMP, {call_label}});
+
+  // Hit on entry k falls through the later labels, each one advances R10 by one entry
+  for (size_t k = InlineCacheSite::kMaxEntries; k-- > 0;) {
+    result.push_back({AsmCommand::LABEL, {label_prefix + "hit_" + std::to_string(k)}});
+    if (k != 0) {
+      result.push_back({AsmCommand::ADD, {Register::R10, make_imm_arg(entry_size)}});
+    }
+  }
+  result.push_back({AsmCommand::MOV, {Register::R11, make_imm_arg(reinterpret_cast<int64_t>(&site->hits))}});
+  result.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::R11)}});
+  result.push_back({AsmCommand::INC, {Register::RAX}});
+  result.push_back({AsmCommand::MOV, {addr(Register::R11), Register::RAX}});
+
+  // R10 is the entry, frame size depends on the target and is kept in RBX which the callee preserves.
+  // RDX points to the arguments above the frame, locals past them are zeroed up to it.
+  result.push_back({AsmCommand::LABEL, {call_label}});
+  result.push_back({AsmCommand::MOV, {Register::RBX, addr(Register::R10, offsetof(InlineCacheEntry, frame_size))}});
+  result.push_back({AsmCommand::SUB, {Register::RSP, Register::RBX}});
+  result.push_back({AsmCommand::MOV, {Register::RDX, Register::RSP}});
+  result.push_back({AsmCommand::ADD, {Register::RDX, Register::RBX}});
+
+  for (uint64_t i = 0; i < arity; ++i) {
+    const auto argument_offset = arguments_size - static_cast<int64_t>((i + 1) * sizeof(uint64_t));
+    const auto local_offset = locals_offset + static_cast<int64_t>(i * sizeof(uint64_t));
+    result.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::RDX, argument_offset)}});
+    result.push_back({AsmCommand::MOV, {addr(Register::RSP, local_offset), Register::RAX}});
+  }
+
+  result.push_back({AsmCommand::LEA, {Register::RCX, addr(Register::RSP, locals_offset + arguments_size)}});
+  result.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(0)}});
+  result.push_back({AsmCommand::MOV, {addr(Register::RSP, AsmDataBuffer::GetDeoptStackOffset()), Register::RAX}});
+  result.push_back({AsmCommand::MOV, {addr(Register::RSP, AsmDataBuffer::GetDeoptExitOffset()), Register::RAX}});
+  result.push_back({AsmCommand::LABEL, {fill_label}});
+  result.push_back({AsmCommand::CMP, {Register::RCX, Register::RDX}});
+  result.push_back({AsmCommand::JAE, {filled_label}});
+  result.push_back({AsmCommand::MOV, {addr(Register::RCX), Register::RAX}});
+  result.push_back({AsmCommand::ADD, {Register::RCX, make_imm_arg(sizeof(uint64_t))}});
+  result.push_back({AsmCommand::JMP, {fill_label}});
+  result.push_back({AsmCommand::LABEL, {filled_label}});
+
+  result.push_back({AsmCommand::MOV, {CallArgumentRegisters[0], Register::RSP}});
+  result.push_back({AsmCommand::MOV, {CallArgumentRegisters[1], make_imm_arg(static_cast<int64_t>(arity))}});
+  result.push_back({AsmCommand::LEA, {CallArgumentRegisters[2], addr(Register::RSP, locals_offset)}});
+
+#ifdef _WIN32
+  result.push_back({AsmCommand::SUB, {Register::RSP, make_imm_arg(ShadowSpaceSizeBytes)}});
+#endif
+
+  // Same entry cell as a direct call, so the target tiers up and the resolver stub works unchanged
+  result.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::R10, offsetof(InlineCacheEntry, target))}});
+  result.push_back({AsmCommand::CALL, {addr(Register::RAX)}});
+
+#ifdef _WIN32
+  result.push_back({AsmCommand::ADD, {Register::RSP, make_imm_arg(ShadowSpaceSizeBytes)}});
+#endif
+  AppendDivisionErrorCheck(result);
+
+  result.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::RSP, AsmDataBuffer::GetResultOffset())}});
+  result.push_back({AsmCommand::ADD, {Register::RSP, Register::RBX}});
+  result.push_back({AsmCommand::ADD, {Register::RSP, make_imm_arg(arguments_size)}});
+  result.push_back({AsmCommand::PUSH, {Register::RAX}});
+  return result;
+}
+
+// Inlined callee locals live in a frame below the saved caller R13, R13 points to them while the body runs
+static std::vector<AssemblyInstruction> CreateInlineEnter(uint64_t arity, uint64_t slot_count, bool with_receiver) {
+  const auto frame_size = static_cast<int64_t>(slot_count * sizeof(uint64_t));
+  const auto arguments_size = static_cast<int64_t>(arity * sizeof(uint64_t));
+
+  std::vector<AssemblyInstruction> result = {{AsmCommand::PUSH, {Register::R13}}};
+  if (frame_size != 0) {
+    result.push_back({AsmCommand::SUB, {Register::RSP, make_imm_arg(frame_size)}});
+  }
+
+  // Arguments are above the saved R13, the first one is the deepest unless it is a receiver on top
+  for (uint64_t i = 0; i < arity; ++i) {
+    const uint64_t local = with_receiver ? (i + 1) % arity : i;
+    const auto argument_offset = frame_size + static_cast<int64_t>(sizeof(uint64_t)) + arguments_size -
+                                 static_cast<int64_t>((i + 1) * sizeof(uint64_t));
+    const auto local_offset = static_cast<int64_t>(local * sizeof(uint64_t));
+    result.push_back({AsmCommand::MOV, {Register::RAX, addr(Register::RSP, argument_offset)}});
+    result.push_back({AsmCommand::MOV, {addr(Register::RSP, local_offset), Register::RAX}});
+  }
+
+  if (slot_count > arity) {
+    result.push_back({AsmCommand::MOV, {Register::RAX, make_imm_arg(0)}});
+    for (uint64_t i = arity; i < slot_count; ++i) {
+      const auto local_offset = static_cast<int64_t>(i * sizeof(uint64_t));
+      result.push_back({AsmCommand::MOV, {addr(Register::RSP, local_offset), Register::RAX}});
+    }
+  }
+
+  result.push_back({AsmCommand::MOV, {Register::R13, Register::RSP}});
+  return result;
+}
+
+static std::vector<AssemblyInstruction> CreateInlineLeave(uint64_t arity, uint64_t slot_count, bool with_receiver) {
+  const auto frame_size = static_cast<int64_t>(slot_count * sizeof(uint64_t));
+  const auto arguments_size = static_cast<int64_t>(arity * sizeof(uint64_t));
+
+  // Result is the top of the callee stack as in the epilogue, values left below it are dropped with the frame.
+  // An inlined constructor results in its object.
+  std::vector<AssemblyInstruction> result = {
+      with_receiver ? AssemblyInstruction{AsmCommand::MOV, {Register::RAX, addr(Register::R13)}}
+                    : AssemblyInstruction{AsmCommand::POP, {Register::RAX}},
+      {AsmCommand::LEA, {Register::RSP, addr(Register::R13, frame_size)}},
+      {AsmCommand::POP, {Register::R13}}};
+  if (arguments_size != 0) {
+    result.push_back({AsmCommand::ADD, {Register::RSP, make_imm_arg(arguments_size)}});
+  }
+  result.push_back({AsmCommand::PUSH, {Register::RAX}});
+  return result;
+}
+
+bool IsCallOperation(std::string_view command_name) {
+  return command_name == "Call" || command_name == "CallVirtual" || command_name == "CallConstructor" ||
+         command_name == NewObjectCommand || command_name == InlineEnterCommand || command_name == InlineLeaveCommand;
+}
+
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateCallOperation(
+    const PackedOilCommand& command) {
+  if (command.command_name == "Call") {
+    return CreateNativeCall(command.arguments.at(0));
+  }
+
+  if (command.command_name == "CallVirtual") {
+    // DeoptExits lowers the call with an exit where the frame can resume in the interpreter
+    return CreateVirtualCall(command.arguments.at(0), DivisionErrorLabel);
+  }
+
+  if (command.command_name == "CallConstructor") {
+    return CreateConstructorCall(command.arguments.at(0));
+  }
+
+  if (command.command_name == NewObjectCommand) {
+    return CreateNewObject(command.arguments.at(0));
+  }
+
+  auto arity = ParseImmediateArgument(command.command_name, command.arguments.at(0));
+  auto slot_count = ParseImmediateArgument(command.command_name, command.arguments.at(1));
+  if (!arity || !slot_count) {
+    return std::unexpected(std::runtime_error("CreateCallOperation: invalid frame for " + command.command_name));
+  }
+
+  const bool with_receiver = command.arguments.size() > 2 && command.arguments[2] == "1";
+  if (with_receiver && arity.value() == 0) {
+    return std::unexpected(std::runtime_error("CreateCallOperation: constructor frame without receiver"));
+  }
+
+  if (command.command_name == InlineEnterCommand) {
+    return CreateInlineEnter(arity.value(), slot_count.value(), with_receiver);
+  }
+  return CreateInlineLeave(arity.value(), slot_count.value(), with_receiver);
+}
+
+} // namespace ovum::vm::jit
@@ -54,7 +54,6 @@ std::vector<AssemblyInstruction> CreateOperationCaller(CalledOperationCode op_co
       // Test RSP for fix needed
       {AsmCommand::MOV, {Register::RAX, Register::RSP}},
       {AsmCommand::AND, {Register::RAX, make_imm_arg(0x8)}},
-      {AsmCommand::MOV, {Register::R13, Register::RAX}},
 
       // fix the stack if needed
       {AsmCommand::SUB, {Register::RSP, Register::RAX}},
@@ -88,8 +87,7 @@ std::vector<AssemblyInstruction> CreateOperationCaller(CalledOperationCode op_co
       {AsmCommand::MOVSD, {Register::XMM1, addr(Register::R14, AsmDataBuffer::GetOffset(Register::XMM1))}},
       {AsmCommand::MOVSD, {Register::XMM0, addr(Register::R14, AsmDataBuffer::GetOffset(Register::XMM0))}},
 #else
-  // System V: fix RSP if needed (func must return RSP without additional bytes)
-  //{AsmCommand::ADD, {Register::RSP, Register::R13}},
+  // System V: the operation returns RSP without the alignment bytes, R13 keeps pointing to the locals
 #endif
   };
   return result;
@@ -43,77 +43,72 @@ void OilCommandAsmCompiler::InitializeFloatOperations() {
                                                        {AsmCommand::PUSH, {Register::RAX}}};
   AddStandardAssembly("FloatDivide", std::move(float_divide_asm));
 
-  // FloatNegate: -a
-  std::vector<AssemblyInstruction> float_negate_asm = {{AsmCommand::POP, {Register::RAX}},
-                                                       {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
-                                                       {AsmCommand::XOR, {Register::XMM1, Register::XMM1}},
-                                                       {AsmCommand::SUBSD, {Register::XMM1, Register::XMM0}},
-                                                       {AsmCommand::MOVQ, {Register::RAX, Register::XMM1}},
-                                                       {AsmCommand::PUSH, {Register::RAX}}};
+  // FloatNegate: -a (flip sign bit)
+  std::vector<AssemblyInstruction> float_negate_asm = {
+      {AsmCommand::POP, {Register::RAX}},
+      {AsmCommand::MOV, {Register::RBX, FloatSignMask}},
+      {AsmCommand::XOR, {Register::RAX, Register::RBX}},
+      {AsmCommand::PUSH, {Register::RAX}}};
   AddStandardAssembly("FloatNegate", std::move(float_negate_asm));
 
   // FloatSqrt: sqrt(a)
-  // std::vector<AssemblyInstruction> float_sqrt_asm = {
-  //    {AsmCommand::POP, {Register::RAX}},
-  //    {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
-  //    // sqrtsd xmm0, xmm0
-  //    // Нужна команда SQRTSD
-  //    {AsmCommand::CALL, {std::string("_sqrt")}}, // Временное решение
-  //    {AsmCommand::MOVQ, {Register::RAX, Register::XMM0}},
-  //    {AsmCommand::PUSH, {Register::RAX}}
-  //};
-  // AddStandardAssembly("FloatSqrt", std::move(float_sqrt_asm));
+  std::vector<AssemblyInstruction> float_sqrt_asm = {{AsmCommand::POP, {Register::RAX}},
+                                                     {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
+                                                     {AsmCommand::SQRTSD, {Register::XMM0, Register::XMM0}},
+                                                     {AsmCommand::MOVQ, {Register::RAX, Register::XMM0}},
+                                                     {AsmCommand::PUSH, {Register::RAX}}};
+  AddStandardAssembly("FloatSqrt", std::move(float_sqrt_asm));
 
-  // FloatEqual: a == b (возвращает bool)
-  std::vector<AssemblyInstruction> float_equal_asm = {// Снимаем операнды
-                                                      {AsmCommand::POP, {Register::RAX}},
-                                                      {AsmCommand::MOVQ, {Register::XMM1, Register::RAX}},
-                                                      {AsmCommand::POP, {Register::RAX}},
-                                                      {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
-                                                      // Сравнение
-                                                      {AsmCommand::CMP, {Register::XMM0, Register::XMM1}},
-                                                      // Подготовка bool результата
-                                                      {AsmCommand::MOV, {Register::RAX, static_cast<int64_t>(0)}},
-                                                      {AsmCommand::SETZ, {Register::AL}},
-                                                      {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
-                                                      // Помещаем результат на стек
-                                                      {AsmCommand::PUSH, {Register::RAX}}};
+  // FloatEqual: a == b, false for NaN (ZF=1 and PF=0)
+  std::vector<AssemblyInstruction> float_equal_asm = {
+      {AsmCommand::POP, {Register::RAX}},
+      {AsmCommand::MOVQ, {Register::XMM1, Register::RAX}},
+      {AsmCommand::POP, {Register::RAX}},
+      {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
+      {AsmCommand::UCOMISD, {Register::XMM0, Register::XMM1}},
+      {AsmCommand::SETZ, {Register::AL}},
+      {AsmCommand::SETNP, {Register::CL}},
+      {AsmCommand::AND, {Register::AL, Register::CL}},
+      {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
+      {AsmCommand::PUSH, {Register::RAX}}};
   AddStandardAssembly("FloatEqual", std::move(float_equal_asm));
 
-  // FloatNotEqual: a != b
-  std::vector<AssemblyInstruction> float_not_equal_asm = {{AsmCommand::POP, {Register::RAX}},
-                                                          {AsmCommand::MOVQ, {Register::XMM1, Register::RAX}},
-                                                          {AsmCommand::POP, {Register::RAX}},
-                                                          {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
-                                                          {AsmCommand::CMP, {Register::XMM0, Register::XMM1}},
-                                                          {AsmCommand::MOV, {Register::RAX, static_cast<int64_t>(0)}},
-                                                          {AsmCommand::SETNZ, {Register::AL}},
-                                                          {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
-                                                          {AsmCommand::PUSH, {Register::RAX}}};
+  // FloatNotEqual: a != b, true for NaN (ZF=0 or PF=1)
+  std::vector<AssemblyInstruction> float_not_equal_asm = {
+      {AsmCommand::POP, {Register::RAX}},
+      {AsmCommand::MOVQ, {Register::XMM1, Register::RAX}},
+      {AsmCommand::POP, {Register::RAX}},
+      {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
+      {AsmCommand::UCOMISD, {Register::XMM0, Register::XMM1}},
+      {AsmCommand::SETNZ, {Register::AL}},
+      {AsmCommand::SETP, {Register::CL}},
+      {AsmCommand::OR, {Register::AL, Register::CL}},
+      {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
+      {AsmCommand::PUSH, {Register::RAX}}};
   AddStandardAssembly("FloatNotEqual", std::move(float_not_equal_asm));
 
-  // FloatLessThan: a < b
-  std::vector<AssemblyInstruction> float_less_than_asm = {{AsmCommand::POP, {Register::RAX}},
-                                                          {AsmCommand::MOVQ, {Register::XMM1, Register::RAX}},
-                                                          {AsmCommand::POP, {Register::RAX}},
-                                                          {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
-                                                          {AsmCommand::CMP, {Register::XMM0, Register::XMM1}},
-                                                          {AsmCommand::MOV, {Register::RAX, static_cast<int64_t>(0)}},
-                                                          {AsmCommand::SETB, {Register::AL}},
-                                                          {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
-                                                          {AsmCommand::PUSH, {Register::RAX}}};
+  // FloatLessThan: a < b as b > a, unordered compare sets CF so NaN gives false
+  std::vector<AssemblyInstruction> float_less_than_asm = {
+      {AsmCommand::POP, {Register::RAX}},
+      {AsmCommand::MOVQ, {Register::XMM1, Register::RAX}},
+      {AsmCommand::POP, {Register::RAX}},
+      {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
+      {AsmCommand::UCOMISD, {Register::XMM1, Register::XMM0}},
+      {AsmCommand::SETNBE, {Register::AL}},
+      {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
+      {AsmCommand::PUSH, {Register::RAX}}};
   AddStandardAssembly("FloatLessThan", std::move(float_less_than_asm));
 
-  // FloatLessEqual: a <= b
-  std::vector<AssemblyInstruction> float_less_equal_asm = {{AsmCommand::POP, {Register::RAX}},
-                                                           {AsmCommand::MOVQ, {Register::XMM1, Register::RAX}},
-                                                           {AsmCommand::POP, {Register::RAX}},
-                                                           {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
-                                                           {AsmCommand::CMP, {Register::XMM0, Register::XMM1}},
-                                                           {AsmCommand::MOV, {Register::RAX, static_cast<int64_t>(0)}},
-                                                           {AsmCommand::SETBE, {Register::AL}},
-                                                           {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
-                                                           {AsmCommand::PUSH, {Register::RAX}}};
+  // FloatLessEqual: a <= b as b >= a
+  std::vector<AssemblyInstruction> float_less_equal_asm = {
+      {AsmCommand::POP, {Register::RAX}},
+      {AsmCommand::MOVQ, {Register::XMM1, Register::RAX}},
+      {AsmCommand::POP, {Register::RAX}},
+      {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
+      {AsmCommand::UCOMISD, {Register::XMM1, Register::XMM0}},
+      {AsmCommand::SETNB, {Register::AL}},
+      {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
+      {AsmCommand::PUSH, {Register::RAX}}};
   AddStandardAssembly("FloatLessEqual", std::move(float_less_equal_asm));
 
   // FloatGreaterThan: a > b
@@ -122,8 +117,7 @@ void OilCommandAsmCompiler::InitializeFloatOperations() {
       {AsmCommand::MOVQ, {Register::XMM1, Register::RAX}},
       {AsmCommand::POP, {Register::RAX}},
       {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
-      {AsmCommand::CMP, {Register::XMM0, Register::XMM1}},
-      {AsmCommand::MOV, {Register::RAX, static_cast<int64_t>(0)}},
+      {AsmCommand::UCOMISD, {Register::XMM0, Register::XMM1}},
       {AsmCommand::SETNBE, {Register::AL}},
       {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
       {AsmCommand::PUSH, {Register::RAX}}};
@@ -135,8 +129,7 @@ void OilCommandAsmCompiler::InitializeFloatOperations() {
       {AsmCommand::MOVQ, {Register::XMM1, Register::RAX}},
       {AsmCommand::POP, {Register::RAX}},
       {AsmCommand::MOVQ, {Register::XMM0, Register::RAX}},
-      {AsmCommand::CMP, {Register::XMM0, Register::XMM1}},
-      {AsmCommand::MOV, {Register::RAX, static_cast<int64_t>(0)}},
+      {AsmCommand::UCOMISD, {Register::XMM0, Register::XMM1}},
       {AsmCommand::SETNB, {Register::AL}},
       {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
       {AsmCommand::PUSH, {Register::RAX}}};
@@ -143,19 +143,35 @@ void OilCommandAsmCompiler::InitializeIntegerOperations() {
       {AsmCommand::POP, {Register::RAX}}, {AsmCommand::NOT, {Register::RAX}}, {AsmCommand::PUSH, {Register::RAX}}};
   AddStandardAssembly("IntNot", std::move(int_not_asm));
 
-  // IntLeftShift: a << b
-  std::vector<AssemblyInstruction> int_left_shift_asm = {{AsmCommand::POP, {Register::RCX}},
-                                                         {AsmCommand::POP, {Register::RAX}},
-                                                         {AsmCommand::SHL, {Register::RAX, Register::CL}},
-                                                         {AsmCommand::PUSH, {Register::RAX}}};
-  AddStandardAssembly("IntLeftShift", std::move(int_left_shift_asm));
-
-  // IntRightShift: a >> b
-  std::vector<AssemblyInstruction> int_right_shift_asm = {{AsmCommand::POP, {Register::RCX}},
-                                                          {AsmCommand::POP, {Register::RAX}},
-                                                          {AsmCommand::SAR, {Register::RAX, Register::CL}},
-                                                          {AsmCommand::PUSH, {Register::RAX}}};
-  AddStandardAssembly("IntRightShift", std::move(int_right_shift_asm));
+  // IntLeftShift: a << b, IntRightShift: a >> b (arithmetic)
+  if (s_target_features.bmi2) {
+    // SHLX/SARX take the count from any register
+    std::vector<AssemblyInstruction> int_left_shift_asm = {
+        {AsmCommand::POP, {Register::RBX}},
+        {AsmCommand::POP, {Register::RAX}},
+        {AsmCommand::SHLX, {Register::RAX, Register::RAX, Register::RBX}},
+        {AsmCommand::PUSH, {Register::RAX}}};
+    AddStandardAssembly("IntLeftShift", std::move(int_left_shift_asm));
+
+    std::vector<AssemblyInstruction> int_right_shift_asm = {
+        {AsmCommand::POP, {Register::RBX}},
+        {AsmCommand::POP, {Register::RAX}},
+        {AsmCommand::SARX, {Register::RAX, Register::RAX, Register::RBX}},
+        {AsmCommand::PUSH, {Register::RAX}}};
+    AddStandardAssembly("IntRightShift", std::move(int_right_shift_asm));
+  } else {
+    std::vector<AssemblyInstruction> int_left_shift_asm = {{AsmCommand::POP, {Register::RCX}},
+                                                           {AsmCommand::POP, {Register::RAX}},
+                                                           {AsmCommand::SHL, {Register::RAX, Register::CL}},
+                                                           {AsmCommand::PUSH, {Register::RAX}}};
+    AddStandardAssembly("IntLeftShift", std::move(int_left_shift_asm));
+
+    std::vector<AssemblyInstruction> int_right_shift_asm = {{AsmCommand::POP, {Register::RCX}},
+                                                            {AsmCommand::POP, {Register::RAX}},
+                                                            {AsmCommand::SAR, {Register::RAX, Register::CL}},
+                                                            {AsmCommand::PUSH, {Register::RAX}}};
+    AddStandardAssembly("IntRightShift", std::move(int_right_shift_asm));
+  }
 }
 
 } // namespace ovum::vm::jit
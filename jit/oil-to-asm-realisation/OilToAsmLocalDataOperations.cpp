@@ -1,23 +1,55 @@
 #include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/EscapeAnalysis.hpp>
 
 namespace ovum::vm::jit {
 
 void OilCommandAsmCompiler::InitializeLocalDataOperations() {
-  // Loadlocal n
-  // argument number (n) is placed to R11, void* pointer to local data in R13
+  // LoadLocal n
+  // argument number (n) is placed to R11, void* pointer to local data in R13.
+  // Baseline tier templates, the optimizing tier addresses locals directly or keeps them in registers.
   std::vector<AssemblyInstruction> load_local_asm = {{AsmCommand::SHL, {Register::R11, make_imm_arg(3)}},
                                                      {AsmCommand::ADD, {Register::R11, Register::R13}},
                                                      {AsmCommand::MOV, {Register::RAX, addr(Register::R11)}},
                                                      {AsmCommand::PUSH, {Register::RAX}}};
   AddStandardAssembly("LoadLocal", std::move(load_local_asm));
 
-  // Savelocal n
+  // SetLocal n
   // argument number (n) is placed to R11, void* pointer to local data in R13
   std::vector<AssemblyInstruction> save_local_asm = {{AsmCommand::SHL, {Register::R11, make_imm_arg(3)}},
                                                      {AsmCommand::ADD, {Register::R11, Register::R13}},
                                                      {AsmCommand::POP, {Register::RAX}},
                                                      {AsmCommand::MOV, {addr(Register::R11), Register::RAX}}};
-  AddStandardAssembly("SaveLocal", std::move(save_local_asm));
+  AddStandardAssembly("SetLocal", std::move(save_local_asm));
+
+  // LoadScalar n, SetScalar n
+  // fields of scalar replaced objects, slot number (n) is placed to R11, scalar frame is pointed by R15
+  std::vector<AssemblyInstruction> load_scalar_asm = {{AsmCommand::SHL, {Register::R11, make_imm_arg(3)}},
+                                                      {AsmCommand::ADD, {Register::R11, Register::R15}},
+                                                      {AsmCommand::MOV, {Register::RAX, addr(Register::R11)}},
+                                                      {AsmCommand::PUSH, {Register::RAX}}};
+  AddStandardAssembly(LoadScalarCommand, std::move(load_scalar_asm));
+
+  std::vector<AssemblyInstruction> set_scalar_asm = {{AsmCommand::SHL, {Register::R11, make_imm_arg(3)}},
+                                                     {AsmCommand::ADD, {Register::R11, Register::R15}},
+                                                     {AsmCommand::POP, {Register::RAX}},
+                                                     {AsmCommand::MOV, {addr(Register::R11), Register::RAX}}};
+  AddStandardAssembly(SetScalarCommand, std::move(set_scalar_asm));
+
+  // ScalarFrameEnter n, ScalarFrameLeave n
+  // slot count (n) is placed to R11, caller R15 is saved above the frame and the function result kept on leave
+  std::vector<AssemblyInstruction> scalar_frame_enter_asm = {{AsmCommand::PUSH, {Register::R15}},
+                                                             {AsmCommand::SHL, {Register::R11, make_imm_arg(3)}},
+                                                             {AsmCommand::SUB, {Register::RSP, Register::R11}},
+                                                             {AsmCommand::MOV, {Register::R15, Register::RSP}}};
+  AddStandardAssembly(ScalarFrameEnterCommand, std::move(scalar_frame_enter_asm));
+
+  std::vector<AssemblyInstruction> scalar_frame_leave_asm = {{AsmCommand::POP, {Register::RAX}},
+                                                             {AsmCommand::SHL, {Register::R11, make_imm_arg(3)}},
+                                                             {AsmCommand::MOV, {Register::RSP, Register::R15}},
+                                                             {AsmCommand::ADD, {Register::RSP, Register::R11}},
+                                                             {AsmCommand::POP, {Register::R15}},
+                                                             {AsmCommand::PUSH, {Register::RAX}}};
+  AddStandardAssembly(ScalarFrameLeaveCommand, std::move(scalar_frame_leave_asm));
 }
 
 } // namespace ovum::vm::jit
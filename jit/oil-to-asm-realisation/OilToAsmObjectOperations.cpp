@@ -0,0 +1,154 @@
+#include <atomic>
+
+#include <jit/ObjectHeap.hpp>
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/VirtualDispatch.hpp>
+
+namespace ovum::vm::jit {
+
+// Barrier labels have to be unique within a function, a global counter is simplest
+static std::atomic<uint64_t> s_write_barrier_count = 0;
+
+static std::optional<FieldLayout> ResolveFieldArgument(const PackedOilCommand& command) {
+  auto field_index = ParseImmediateArgument(command.command_name, command.arguments.at(0));
+  if (!field_index || field_index.value() < 0) {
+    return std::nullopt;
+  }
+  return ObjectHeap::ResolveField(static_cast<uint64_t>(field_index.value()));
+}
+
+// Object in R11 got the value in RAX. The slow path runs only for a young value stored into an object outside
+// the young generation, null is never young as the generation does not start at address 0.
+static std::vector<AssemblyInstruction> CreateWriteBarrier() {
+  const ObjectHeapHooks& hooks = ObjectHeap::GetHooks();
+  const std::string done_label = "write_barrier_" + std::to_string(s_write_barrier_count.fetch_add(1)) + "_done";
+
+  std::vector<AssemblyInstruction> result = {
+      {AsmCommand::MOV, {Register::RCX, make_imm_arg(reinterpret_cast<int64_t>(hooks.young_start))}},
+      {AsmCommand::MOV, {Register::RCX, addr(Register::RCX)}},
+      {AsmCommand::MOV, {Register::R10, make_imm_arg(reinterpret_cast<int64_t>(hooks.young_size))}},
+      {AsmCommand::MOV, {Register::R10, addr(Register::R10)}},
+      {AsmCommand::MOV, {Register::RDX, Register::RAX}},
+      {AsmCommand::SUB, {Register::RDX, Register::RCX}},
+      {AsmCommand::CMP, {Register::RDX, Register::R10}},
+      {AsmCommand::JAE, {done_label}},
+      {AsmCommand::MOV, {Register::RDX, Register::R11}},
+      {AsmCommand::SUB, {Register::RDX, Register::RCX}},
+      {AsmCommand::CMP, {Register::RDX, Register::R10}},
+      {AsmCommand::JB, {done_label}},
+      {AsmCommand::PUSH, {Register::RBP}},
+      {AsmCommand::MOV, {Register::RBP, Register::RSP}},
+      {AsmCommand::AND, {Register::RSP, make_imm_arg(-16)}}};
+#ifdef _WIN32
+  result.push_back({AsmCommand::SUB, {Register::RSP, make_imm_arg(ShadowSpaceSizeBytes)}});
+#endif
+  result.push_back({AsmCommand::MOV, {CallArgumentRegisters[0], Register::R11}});
+  result.push_back({AsmCommand::MOV, {CallArgumentRegisters[1], Register::RAX}});
+  result.push_back(
+      {AsmCommand::MOV, {Register::RAX, make_imm_arg(reinterpret_cast<int64_t>(hooks.remember_reference))}});
+  result.push_back({AsmCommand::CALL, {Register::RAX}});
+  result.push_back({AsmCommand::MOV, {Register::RSP, Register::RBP}});
+  result.push_back({AsmCommand::POP, {Register::RBP}});
+  result.push_back({AsmCommand::LABEL, {done_label}});
+  return result;
+}
+
+static uint64_t* ResolveStaticArgument(const PackedOilCommand& command) {
+  auto slot = ParseImmediateArgument(command.command_name, command.arguments.at(0));
+  if (!slot || slot.value() < 0) {
+    return nullptr;
+  }
+  return ObjectHeap::ResolveStatic(static_cast<uint64_t>(slot.value()));
+}
+
+bool IsObjectOperation(std::string_view command_name) {
+  return command_name == "GetVTable" || command_name == "SetVTable" || command_name == "GetField" ||
+         command_name == "SetField" || command_name == "LoadStatic" || command_name == "SetStatic";
+}
+
+bool CanCreateObjectOperation(const PackedOilCommand& command) {
+  if (command.command_name == "GetField" || command.command_name == "SetField") {
+    return ResolveFieldArgument(command).has_value();
+  }
+  if (command.command_name == "LoadStatic" || command.command_name == "SetStatic") {
+    return ResolveStaticArgument(command) != nullptr;
+  }
+  return static_cast<bool>(VirtualDispatch::GetHooks().resolve_vtable);
+}
+
+std::expected<std::vector<AssemblyInstruction>, std::runtime_error> CreateObjectOperation(
+    const PackedOilCommand& command, const JitCompileOptions& options) {
+  if (command.command_name == "LoadStatic" || command.command_name == "SetStatic") {
+    uint64_t* slot = ResolveStaticArgument(command);
+    if (slot == nullptr) {
+      return std::unexpected(std::runtime_error("CreateObjectOperation: unknown static " + command.arguments.at(0)));
+    }
+
+    // Slot is a direct operand, one load or store, or goes through an absolute address in R11
+    std::vector<AssemblyInstruction> result;
+    MemoryAddress slot_operand = rip_addr(slot);
+    if (!options.rip_relative_statics) {
+      result.push_back({AsmCommand::MOV, {Register::R11, make_imm_arg(reinterpret_cast<int64_t>(slot))}});
+      slot_operand = addr(Register::R11);
+    }
+
+    if (command.command_name == "LoadStatic") {
+      result.push_back({AsmCommand::MOV, {Register::RAX, slot_operand}});
+      result.push_back({AsmCommand::PUSH, {Register::RAX}});
+    } else {
+      result.push_back({AsmCommand::POP, {Register::RAX}});
+      result.push_back({AsmCommand::MOV, {slot_operand, Register::RAX}});
+    }
+    return result;
+  }
+
+  if (command.command_name == "GetField" || command.command_name == "SetField") {
+    // Offsets are resolved once at compile time, the access is a single move
+    const auto field = ResolveFieldArgument(command);
+    if (!field) {
+      return std::unexpected(std::runtime_error("CreateObjectOperation: unknown field " + command.arguments.at(0)));
+    }
+
+    if (command.command_name == "GetField") {
+      return std::vector<AssemblyInstruction>{{AsmCommand::POP, {Register::RAX}},
+                                              {AsmCommand::MOV, {Register::RAX, addr(Register::RAX, field->offset)}},
+                                              {AsmCommand::PUSH, {Register::RAX}}};
+    }
+
+    // SetField n: value is on top of the object, both are popped
+    std::vector<AssemblyInstruction> result = {{AsmCommand::POP, {Register::RAX}},
+                                               {AsmCommand::POP, {Register::R11}},
+                                               {AsmCommand::MOV, {addr(Register::R11, field->offset), Register::RAX}}};
+    if (field->is_reference && ObjectHeap::HasWriteBarrier()) {
+      auto barrier = CreateWriteBarrier();
+      result.insert(result.end(), barrier.begin(), barrier.end());
+    }
+    return result;
+  }
+
+  const auto& hooks = VirtualDispatch::GetHooks();
+  if (!hooks.resolve_vtable) {
+    return std::unexpected(std::runtime_error("CreateObjectOperation: vtable hook is not set"));
+  }
+
+  // Vtables are resolved once at compile time and embedded as immediates
+  const auto class_name = JitFunctionRegistry::StripQuotes(command.arguments.at(0));
+  const void* vtable = hooks.resolve_vtable(class_name);
+  if (vtable == nullptr) {
+    return std::unexpected(std::runtime_error("CreateObjectOperation: unknown class " + std::string(class_name)));
+  }
+  const int64_t vtable_imm = reinterpret_cast<int64_t>(vtable);
+
+  if (command.command_name == "GetVTable") {
+    return std::vector<AssemblyInstruction>{{AsmCommand::MOV, {Register::RAX, make_imm_arg(vtable_imm)}},
+                                            {AsmCommand::PUSH, {Register::RAX}}};
+  }
+
+  // SetVTable class: object on top of the stack gets the vtable and stays there
+  return std::vector<AssemblyInstruction>{
+      {AsmCommand::MOV, {Register::RAX, addr(Register::RSP)}},
+      {AsmCommand::MOV, {Register::R11, make_imm_arg(vtable_imm)}},
+      {AsmCommand::MOV, {addr(Register::RAX, hooks.vtable_offset), Register::R11}}};
+}
+
+} // namespace ovum::vm::jit
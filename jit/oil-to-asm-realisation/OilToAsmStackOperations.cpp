@@ -3,6 +3,12 @@
 namespace ovum::vm::jit {
 
 void OilCommandAsmCompiler::InitializeStackOperations() {
+  // PushInt, PushFloat, PushBool, PushChar, PushByte: immediate is placed to R11 by the argument placer
+  for (std::string_view push_command : {"PushInt", "PushFloat", "PushBool", "PushChar", "PushByte"}) {
+    std::vector<AssemblyInstruction> push_asm = {{AsmCommand::PUSH, {Register::R11}}};
+    AddStandardAssembly(push_command, std::move(push_asm));
+  }
+
   // PushNull
   std::vector<AssemblyInstruction> push_null_asm = {{AsmCommand::MOV, {Register::RAX, static_cast<int64_t>(0)}},
                                                     {AsmCommand::PUSH, {Register::RAX}}};
@@ -33,7 +39,8 @@ void OilCommandAsmCompiler::InitializeStackOperations() {
       {AsmCommand::MOV, {create_memory_addr(Register::RSP), Register::RAX}}};
   AddStandardAssembly("IsNull", std::move(is_null_asm));
 
-  // Unwrap
+  // Unwrap is lowered by DeoptExits, with a guard, checked by the fault of the field access after it
+  // or with a null check reporting the error
   // std::vector<AssemblyInstruction> unwrap_asm = {
   //    {AsmCommand::MOV, {Register::RAX, create_memory_addr(Register::RSP)}},
   //    {AsmCommand::TEST, {Register::RAX, Register::RAX}},
@@ -0,0 +1,350 @@
+#include "RangeAnalysis.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <initializer_list>
+#include <optional>
+#include <string_view>
+
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/oil-to-asm-realisation/DeoptExits.hpp>
+#include <jit/oil-to-asm-realisation/StackDepthVerifier.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/Inliner.hpp>
+
+namespace ovum::vm::jit {
+
+namespace {
+
+constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+
+constexpr IntegerRange kFull{};
+constexpr IntegerRange kBool{0, 1};
+constexpr IntegerRange kByte{0, 255};
+
+std::optional<int64_t> CheckedAdd(int64_t lhs, int64_t rhs) {
+  if ((rhs > 0 && lhs > kMax - rhs) || (rhs < 0 && lhs < kMin - rhs)) {
+    return std::nullopt;
+  }
+  return lhs + rhs;
+}
+
+std::optional<int64_t> CheckedSubtract(int64_t lhs, int64_t rhs) {
+  if ((rhs < 0 && lhs > kMax + rhs) || (rhs > 0 && lhs < kMin + rhs)) {
+    return std::nullopt;
+  }
+  return lhs - rhs;
+}
+
+std::optional<int64_t> CheckedMultiply(int64_t lhs, int64_t rhs) {
+  if (lhs > 0 ? (rhs > 0 ? lhs > kMax / rhs : rhs < kMin / lhs)
+              : (rhs > 0 ? lhs < kMin / rhs : lhs != 0 && rhs < kMax / lhs)) {
+    return std::nullopt;
+  }
+  return lhs * rhs;
+}
+
+// Range of the bounds, the full one if any of them overflows
+IntegerRange Span(std::initializer_list<std::optional<int64_t>> bounds) {
+  IntegerRange result{kMax, kMin};
+  for (const auto& bound : bounds) {
+    if (!bound) {
+      return kFull;
+    }
+    result.min = std::min(result.min, bound.value());
+    result.max = std::max(result.max, bound.value());
+  }
+  return result;
+}
+
+IntegerRange Add(const IntegerRange& lhs, const IntegerRange& rhs) {
+  return Span({CheckedAdd(lhs.min, rhs.min), CheckedAdd(lhs.max, rhs.max)});
+}
+
+IntegerRange Subtract(const IntegerRange& lhs, const IntegerRange& rhs) {
+  return Span({CheckedSubtract(lhs.min, rhs.max), CheckedSubtract(lhs.max, rhs.min)});
+}
+
+IntegerRange Multiply(const IntegerRange& lhs, const IntegerRange& rhs) {
+  return Span({CheckedMultiply(lhs.min, rhs.min),
+               CheckedMultiply(lhs.min, rhs.max),
+               CheckedMultiply(lhs.max, rhs.min),
+               CheckedMultiply(lhs.max, rhs.max)});
+}
+
+// Truncated quotient, the minimum divided by -1 faults and needs no result
+IntegerRange Divide(const IntegerRange& dividend, const IntegerRange& divisor) {
+  // Quotients grow with the dividend and shrink in magnitude with a positive divisor
+  if (divisor.min >= 1) {
+    return {dividend.min >= 0 ? dividend.min / divisor.max : dividend.min / divisor.min,
+            dividend.max >= 0 ? dividend.max / divisor.min : dividend.max / divisor.max};
+  }
+  if (dividend.min == kMin) {
+    return kFull;
+  }
+  const int64_t magnitude = std::max(-dividend.min, dividend.max < 0 ? -dividend.max : dividend.max);
+  return {-magnitude, magnitude};
+}
+
+// Remainder has the sign of the dividend and a magnitude below that of the divisor
+IntegerRange Modulo(const IntegerRange& dividend, const IntegerRange& divisor) {
+  const auto magnitude = [](int64_t value) {
+    return value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+  };
+  const uint64_t largest = std::max(magnitude(divisor.min), magnitude(divisor.max));
+  const int64_t bound = largest == 0 ? 0 : static_cast<int64_t>(std::min<uint64_t>(largest - 1, kMax));
+  if (dividend.min >= 0) {
+    return {0, std::min(bound, dividend.max)};
+  }
+  if (dividend.max <= 0) {
+    return {std::max(-bound, dividend.min), 0};
+  }
+  return {-bound, bound};
+}
+
+// Arithmetic shift by a count masked to 6 bits as SAR and SARX do
+IntegerRange RightShift(const IntegerRange& value, const IntegerRange& count) {
+  if (count.min < 0 || count.max > 63) {
+    const IntegerRange masked = count.min == count.max ? IntegerRange{count.min & 63, count.min & 63}
+                                                       : IntegerRange{0, 63};
+    return RightShift(value, masked);
+  }
+  return {value.min >= 0 ? value.min >> count.max : value.min >> count.min,
+          value.max >= 0 ? value.max >> count.min : value.max >> count.max};
+}
+
+IntegerRange LeftShift(const IntegerRange& value, const IntegerRange& count) {
+  if (count.min != count.max || (count.min & 63) == 63) {
+    return kFull;
+  }
+  const int64_t factor = int64_t{1} << (count.min & 63);
+  return Multiply(value, {factor, factor});
+}
+
+// Bitwise operations of non-negative operands stay below the next power of two of the larger one
+IntegerRange Bitwise(std::string_view operation, const IntegerRange& lhs, const IntegerRange& rhs) {
+  if (operation == "And" && (lhs.min >= 0 || rhs.min >= 0)) {
+    return {0, std::min(lhs.min >= 0 ? lhs.max : kMax, rhs.min >= 0 ? rhs.max : kMax)};
+  }
+  if (lhs.min < 0 || rhs.min < 0) {
+    return kFull;
+  }
+  const auto width = std::bit_width(static_cast<uint64_t>(std::max(lhs.max, rhs.max)));
+  return {0, static_cast<int64_t>((uint64_t{1} << width) - 1)};
+}
+
+bool IsComparison(std::string_view name) {
+  static constexpr std::array<std::string_view, 4> kTypePrefixes = {"Int", "Float", "Byte", "Bool"};
+  static constexpr std::array<std::string_view, 6> kComparisons = {
+      "Equal", "NotEqual", "LessThan", "LessEqual", "GreaterThan", "GreaterEqual"};
+  return std::any_of(kTypePrefixes.begin(), kTypePrefixes.end(), [name](std::string_view prefix) {
+    return name.starts_with(prefix) &&
+           std::find(kComparisons.begin(), kComparisons.end(), name.substr(prefix.size())) != kComparisons.end();
+  });
+}
+
+} // namespace
+
+RangeAnalysis::RangeAnalysis(const std::vector<PackedOilCommand>& body) :
+    body_(body), non_faulting_(body.size(), false) {
+  Analyse();
+}
+
+bool RangeAnalysis::IsNonFaulting(size_t index) const {
+  return index < non_faulting_.size() && non_faulting_[index];
+}
+
+void RangeAnalysis::Analyse() {
+  std::vector<IntegerRange> stack;
+  std::vector<std::vector<IntegerRange>> frames(1);
+  std::vector<size_t> frame_stack_heights;
+
+  // Locals not written yet hold what the caller passed
+  auto local = [&frames](uint64_t local_index) -> IntegerRange& {
+    auto& locals = frames.back();
+    if (local_index >= locals.size()) {
+      locals.resize(local_index + 1);
+    }
+    return locals[local_index];
+  };
+
+  for (size_t i = 0; i < body_.size(); ++i) {
+    const PackedOilCommand& command = body_[i];
+    const std::string& name = command.command_name;
+
+    std::optional<uint64_t> index;
+    if (!command.arguments.empty()) {
+      auto value = ParseImmediateArgument(name, command.arguments.at(0));
+      if (value && value.value() >= 0) {
+        index = static_cast<uint64_t>(value.value());
+      }
+    }
+
+    if (name == InlineEnterCommand || name == InlineLeaveCommand) {
+      const bool with_receiver = command.arguments.size() > 2 && command.arguments[2] == "1";
+      if (!index) {
+        return;
+      }
+
+      const auto argument_count = static_cast<size_t>(index.value());
+      if (name == InlineEnterCommand) {
+        if (stack.size() < argument_count) {
+          return;
+        }
+
+        // Arguments become the callee locals, the first one is the deepest unless it is a receiver on top
+        std::vector<IntegerRange> locals(argument_count);
+        const size_t base = stack.size() - argument_count;
+        for (size_t k = 0; k < argument_count; ++k) {
+          locals[with_receiver ? (k + 1) % argument_count : k] = stack[base + k];
+        }
+        stack.resize(base);
+        frame_stack_heights.push_back(base);
+        frames.push_back(std::move(locals));
+      } else {
+        if (frame_stack_heights.empty()) {
+          return;
+        }
+
+        // Values left by the callee are dropped with its frame
+        IntegerRange result;
+        if (with_receiver) {
+          result = local(0);
+        } else if (stack.size() > frame_stack_heights.back()) {
+          result = stack.back();
+        }
+        stack.resize(frame_stack_heights.back());
+        frame_stack_heights.pop_back();
+        frames.pop_back();
+        stack.push_back(result);
+      }
+      continue;
+    }
+
+    const std::optional<StackEffect> effect = StackDepthVerifier::GetStackEffect(command);
+    if (!effect || stack.size() < effect->popped) {
+      return;
+    }
+
+    if (name == "LoadLocal" || name == "SetLocal") {
+      if (!index) {
+        return;
+      }
+      if (name == "LoadLocal") {
+        stack.push_back(local(index.value()));
+      } else {
+        local(index.value()) = stack.back();
+        stack.pop_back();
+      }
+      continue;
+    }
+    if (name == "Dup") {
+      stack.push_back(stack.back());
+      continue;
+    }
+    if (name == "Swap") {
+      std::swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+      continue;
+    }
+
+    const std::vector<IntegerRange> operands(stack.end() - static_cast<ptrdiff_t>(effect->popped), stack.end());
+    stack.resize(stack.size() - effect->popped);
+    if (IsTrappingCommand(name) && operands.size() == 2) {
+      non_faulting_[i] = CannotFault(name, operands[0], operands[1]);
+    }
+    if (effect->pushed == 1) {
+      stack.push_back(Evaluate(command, operands));
+    } else {
+      stack.insert(stack.end(), effect->pushed, kFull);
+    }
+  }
+}
+
+IntegerRange RangeAnalysis::Evaluate(const PackedOilCommand& command, const std::vector<IntegerRange>& operands) {
+  const std::string& name = command.command_name;
+  if (name == "PushInt" || name == "PushByte" || name == "PushBool" || name == "PushChar") {
+    const auto value = ParseImmediateArgument(name, command.arguments.at(0));
+    return value ? IntegerRange{value.value(), value.value()} : kFull;
+  }
+  if (name == "Unwrap") {
+    return operands.front();
+  }
+  if (IsComparison(name) || name.starts_with("Bool") || name == "IsNull") {
+    return kBool;
+  }
+  if (name == "ByteToInt") {
+    const IntegerRange& value = operands.front();
+    return value.min >= 0 && value.max <= kByte.max ? value : kByte;
+  }
+  if (name.starts_with("Byte") || name == "CharToByte") {
+    return kByte;
+  }
+  if (name == "StringLength") {
+    return {0, kMax};
+  }
+  if (!name.starts_with("Int")) {
+    return kFull;
+  }
+
+  const std::string_view operation = std::string_view(name).substr(3);
+  if (operands.size() == 1) {
+    const IntegerRange& value = operands.front();
+    if (operation == "Negate") {
+      return value.min == kMin ? kFull : IntegerRange{-value.max, -value.min};
+    }
+    if (operation == "Not") {
+      return {~value.max, ~value.min};
+    }
+    if (operation == "Increment") {
+      return Add(value, {1, 1});
+    }
+    if (operation == "Decrement") {
+      return Subtract(value, {1, 1});
+    }
+    return kFull;
+  }
+
+  if (operands.size() != 2) {
+    return kFull;
+  }
+  const IntegerRange& lhs = operands[0];
+  const IntegerRange& rhs = operands[1];
+  if (operation == "Add") {
+    return Add(lhs, rhs);
+  }
+  if (operation == "Subtract") {
+    return Subtract(lhs, rhs);
+  }
+  if (operation == "Multiply") {
+    return Multiply(lhs, rhs);
+  }
+  if (operation == "Divide") {
+    return Divide(lhs, rhs);
+  }
+  if (operation == "Modulo") {
+    return Modulo(lhs, rhs);
+  }
+  if (operation == "And" || operation == "Or" || operation == "Xor") {
+    return Bitwise(operation, lhs, rhs);
+  }
+  if (operation == "RightShift") {
+    return RightShift(lhs, rhs);
+  }
+  if (operation == "LeftShift") {
+    return LeftShift(lhs, rhs);
+  }
+  return kFull;
+}
+
+bool RangeAnalysis::CannotFault(const std::string& command_name,
+                                const IntegerRange& dividend,
+                                const IntegerRange& divisor) {
+  // DIV takes the low byte of the divisor, a zero extended dividend below 256 gives no quotient overflow
+  if (command_name.starts_with("Byte")) {
+    return divisor.min >= 1 && divisor.max <= kByte.max;
+  }
+  return !divisor.Contains(0) && (!divisor.Contains(-1) || !dividend.Contains(kMin));
+}
+
+} // namespace ovum::vm::jit
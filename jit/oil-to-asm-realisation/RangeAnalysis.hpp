@@ -0,0 +1,53 @@
+#ifndef JIT_RANGEANALYSIS_HPP
+#define JIT_RANGEANALYSIS_HPP
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+
+namespace ovum::vm::jit {
+
+// Values an integer may take, bounds included
+struct IntegerRange {
+  int64_t min = std::numeric_limits<int64_t>::min();
+  int64_t max = std::numeric_limits<int64_t>::max();
+
+  [[nodiscard]] bool Contains(int64_t value) const {
+    return min <= value && value <= max;
+  }
+
+  bool operator==(const IntegerRange&) const = default;
+};
+
+// Ranges of the integer values of a body, from constants, locals set to them and operations whose results are
+// bounded by their operands or by their type. An operation that may overflow gives the full range. Bodies are
+// straight-line, every value has one range. Divisions whose operands rule out both the zero divisor and the
+// minimum divided by -1 cannot fault and need no check.
+class RangeAnalysis {
+public:
+  explicit RangeAnalysis(const std::vector<PackedOilCommand>& body);
+
+  // Whether the division or modulo at the index never faults
+  [[nodiscard]] bool IsNonFaulting(size_t index) const;
+
+private:
+  void Analyse();
+
+  // Range of the result of a command popping the operands, which are given from the deepest
+  [[nodiscard]] static IntegerRange Evaluate(const PackedOilCommand& command,
+                                             const std::vector<IntegerRange>& operands);
+
+  [[nodiscard]] static bool CannotFault(const std::string& command_name,
+                                        const IntegerRange& dividend,
+                                        const IntegerRange& divisor);
+
+  const std::vector<PackedOilCommand>& body_;
+  std::vector<bool> non_faulting_;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_RANGEANALYSIS_HPP
@@ -0,0 +1,381 @@
+#include "RedundantLoads.hpp"
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include <jit/ObjectHeap.hpp>
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/oil-to-asm-realisation/DeoptExits.hpp>
+#include <jit/oil-to-asm-realisation/StackDepthVerifier.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/EscapeAnalysis.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/Inliner.hpp>
+
+namespace ovum::vm::jit {
+
+namespace {
+
+// Commands writing no object and no static except the slot they name. Those of them calling out are caught
+// by the code scan.
+bool KeepsMemory(const std::string& name) {
+  static const std::unordered_set<std::string> kCommands = {"Pop",
+                                                            "Dup",
+                                                            "Swap",
+                                                            "LoadLocal",
+                                                            "SetLocal",
+                                                            "GetField",
+                                                            "SetField",
+                                                            "LoadStatic",
+                                                            "SetStatic",
+                                                            "Unwrap",
+                                                            "IsNull",
+                                                            "GetVTable",
+                                                            LoadScalarCommand,
+                                                            SetScalarCommand,
+                                                            InlineEnterCommand,
+                                                            InlineLeaveCommand};
+  return kCommands.contains(name) || name.starts_with("Int") || name.starts_with("Float") ||
+         name.starts_with("Byte") || name.starts_with("Bool") || name.starts_with("Push");
+}
+
+const std::unordered_set<std::string> kUnaryComputations = {"IntNegate", "IntNot", "IntIncrement", "IntDecrement"};
+const std::unordered_set<std::string> kBinaryComputations = {
+    "IntAdd", "IntSubtract", "IntMultiply", "IntAnd", "IntOr", "IntXor", "IntLeftShift", "IntRightShift"};
+const std::unordered_set<std::string> kCommutativeComputations = {"IntAdd", "IntMultiply", "IntAnd", "IntOr", "IntXor"};
+// Computations AddressArithmetic may fuse into a LEA
+const std::unordered_set<std::string> kAddressComputations = {"IntAdd", "IntSubtract", "IntMultiply", "IntLeftShift"};
+
+// Number of the 64-bit register an operand register is part of
+std::optional<uint8_t> GetRegisterNumber(Register reg) {
+  const auto value = static_cast<uint8_t>(reg);
+  if (value < static_cast<uint8_t>(Register::AH)) {
+    return static_cast<uint8_t>(value & 0x0F);
+  }
+  if (value <= static_cast<uint8_t>(Register::BH)) {
+    return static_cast<uint8_t>(value - static_cast<uint8_t>(Register::AH));
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+RedundantLoads::RedundantLoads(std::vector<AssemblyInstruction>& output,
+                               const std::vector<PackedOilCommand>& body,
+                               const JitCompileOptions& options) :
+    output_(output), body_(body), reuse_computations_(options.reuse_computations),
+    fuse_address_arithmetic_(options.fuse_address_arithmetic), values_(body.size()),
+    candidates_(body.size()), scanned_(output.size()) {
+  Analyse();
+}
+
+void RedundantLoads::Advance(size_t index, bool in_fused_run) {
+  for (; scanned_ < output_.size(); ++scanned_) {
+    Invalidate(output_[scanned_]);
+  }
+  in_fused_run_ = in_fused_run;
+
+  // Value of the previous command is on top of the stack, unless it came from a register or the command is
+  // inside a fused run emitted as a whole
+  if (index == 0 || index <= replaced_end_ || in_fused_run || !values_[index - 1]) {
+    return;
+  }
+  const uint64_t number = values_[index - 1].value();
+  if (!repeated_.contains(number) || FindKept(number)) {
+    return;
+  }
+
+  for (size_t k = 0; k < kRegisters.size(); ++k) {
+    if (!kept_[k]) {
+      output_.push_back({AsmCommand::MOV, {kRegisters[k], addr(Register::RSP)}});
+      kept_[k] = number;
+      scanned_ = output_.size();
+      return;
+    }
+  }
+}
+
+bool RedundantLoads::TryLower(size_t index) {
+  if (index < replaced_end_) {
+    return true;
+  }
+  if (in_fused_run_) {
+    return false;
+  }
+
+  // Longest computation starting at the index whose value is kept
+  for (auto it = candidates_[index].rbegin(); it != candidates_[index].rend(); ++it) {
+    if (const auto reg = FindKept(it->number)) {
+      output_.push_back({AsmCommand::PUSH, {reg.value()}});
+      replaced_end_ = it->end + 1;
+      scanned_ = output_.size();
+      return true;
+    }
+  }
+
+  // Field of an object already on the stack, unless the access is the null check of an Unwrap
+  if (body_[index].command_name != "GetField" || !values_[index] ||
+      (index != 0 && IsGuardedCommand(body_[index - 1].command_name))) {
+    return false;
+  }
+  const auto reg = FindKept(values_[index].value());
+  if (!reg) {
+    return false;
+  }
+  output_.push_back({AsmCommand::MOV, {addr(Register::RSP), reg.value()}});
+  replaced_end_ = index + 1;
+  scanned_ = output_.size();
+  return true;
+}
+
+void RedundantLoads::Analyse() {
+  uint64_t value_count = 0;
+  std::vector<Value> stack;
+  std::vector<std::vector<std::optional<uint64_t>>> frames(1);
+  std::vector<size_t> frame_stack_heights;
+  // Known contents of fields by object value and offset and of statics by slot
+  std::map<std::pair<uint64_t, int64_t>, uint64_t> fields;
+  std::unordered_map<uint64_t, uint64_t> statics;
+  // Values of constants and of computations by their operands
+  std::map<std::pair<std::string, int64_t>, uint64_t> constants;
+  std::map<std::tuple<std::string, uint64_t, uint64_t>, uint64_t> computations;
+  std::unordered_set<uint64_t> constant_numbers;
+  std::unordered_set<uint64_t> produced;
+  // Last command a computation cannot extend over
+  std::optional<size_t> barrier;
+
+  // Locals not written yet keep the value they had, equal for every read
+  auto local = [&](uint64_t local_index) -> uint64_t& {
+    auto& locals = frames.back();
+    if (local_index >= locals.size()) {
+      locals.resize(local_index + 1);
+    }
+    if (!locals[local_index]) {
+      locals[local_index] = value_count++;
+    }
+    return locals[local_index].value();
+  };
+
+  auto pop = [&stack]() {
+    const Value value = stack.back();
+    stack.pop_back();
+    return value;
+  };
+
+  // Value produced by a command, leaves and computations a single LEA covers are never kept
+  auto push = [&](size_t i, Value value, bool is_leaf) {
+    if (value.begin && barrier && value.begin.value() <= barrier.value()) {
+      value.begin.reset();
+    }
+    stack.push_back(value);
+    if (is_leaf || (value.is_address && fuse_address_arithmetic_)) {
+      return;
+    }
+    values_[i] = value.number;
+    if (value.begin) {
+      candidates_[value.begin.value()].push_back({i, value.number});
+    }
+    if (!produced.insert(value.number).second) {
+      repeated_.insert(value.number);
+    }
+  };
+
+  // Bodies are straight-line, values are exact up to the first command of unknown effect
+  for (size_t i = 0; i < body_.size(); ++i) {
+    const PackedOilCommand& poc = body_[i];
+    const std::string& name = poc.command_name;
+
+    std::optional<uint64_t> index;
+    if (!poc.arguments.empty()) {
+      auto value = ParseImmediateArgument(name, poc.arguments.at(0));
+      if (value && value.value() >= 0) {
+        index = static_cast<uint64_t>(value.value());
+      }
+    }
+
+    const std::optional<StackEffect> effect = StackDepthVerifier::GetStackEffect(poc);
+    const bool is_frame = name == InlineEnterCommand || name == InlineLeaveCommand;
+    if (!is_frame && (!effect || stack.size() < effect->popped)) {
+      return;
+    }
+
+    bool is_computation = true;
+    if (name == "LoadLocal" || name == "SetLocal" || name == "LoadStatic" || name == "SetStatic") {
+      if (!index) {
+        return;
+      }
+      if (name == "LoadLocal") {
+        push(i, {local(index.value()), i, true}, true);
+      } else if (name == "SetLocal") {
+        local(index.value()) = pop().number;
+        is_computation = false;
+      } else if (name == "SetStatic") {
+        statics[index.value()] = pop().number;
+        is_computation = false;
+      } else {
+        const auto [it, inserted] = statics.try_emplace(index.value(), value_count);
+        value_count += inserted ? 1 : 0;
+        push(i, {it->second, i}, false);
+      }
+    } else if (name == "GetField" || name == "SetField") {
+      const auto field = index ? ObjectHeap::ResolveField(index.value()) : std::nullopt;
+      if (!field) {
+        return;
+      }
+
+      if (name == "SetField") {
+        const uint64_t value = pop().number;
+        const uint64_t object = pop().number;
+        std::erase_if(fields, [&field](const auto& entry) { return entry.first.second == field->offset; });
+        fields[{object, field->offset}] = value;
+        is_computation = false;
+      } else {
+        const Value object = pop();
+        const auto [it, inserted] = fields.try_emplace({object.number, field->offset}, value_count);
+        value_count += inserted ? 1 : 0;
+        push(i, {it->second, object.begin}, false);
+      }
+    } else if (reuse_computations_ && (name == "PushInt" || name == "PushByte")) {
+      const auto value = ParseImmediateArgument(name, poc.arguments.at(0));
+      if (!value) {
+        return;
+      }
+      const auto [it, inserted] = constants.try_emplace({name, value.value()}, value_count);
+      value_count += inserted ? 1 : 0;
+      constant_numbers.insert(it->second);
+      push(i, {it->second, i, name == "PushInt"}, true);
+    } else if (reuse_computations_ && (kUnaryComputations.contains(name) || kBinaryComputations.contains(name))) {
+      const Value rhs = kBinaryComputations.contains(name) ? pop() : Value{};
+      const Value lhs = pop();
+      auto operands = std::make_pair(lhs.number, rhs.number);
+      if (kCommutativeComputations.contains(name) && operands.first > operands.second) {
+        std::swap(operands.first, operands.second);
+      }
+      const auto [it, inserted] = computations.try_emplace({name, operands.first, operands.second}, value_count);
+      value_count += inserted ? 1 : 0;
+      const bool is_binary = kBinaryComputations.contains(name);
+      // Products are fused only with a constant factor
+      const bool is_scaling = name == "IntMultiply" || name == "IntLeftShift";
+      const bool is_address = kAddressComputations.contains(name) && lhs.is_address && rhs.is_address &&
+                              (!is_scaling || constant_numbers.contains(rhs.number) ||
+                               (name == "IntMultiply" && constant_numbers.contains(lhs.number)));
+      push(i, {it->second, rhs.begin || !is_binary ? lhs.begin : std::nullopt, is_address}, false);
+    } else {
+      is_computation = false;
+      if (name == "Unwrap") {
+        // Value passes unchanged when the guard holds
+      } else if (name == "Pop") {
+        stack.pop_back();
+      } else if (name == "Dup") {
+        stack.push_back({stack.back().number, std::nullopt});
+      } else if (name == "Swap") {
+        std::swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+      } else if (is_frame) {
+        auto arity = ParseImmediateArgument(name, poc.arguments.at(0));
+        const bool with_receiver = poc.arguments.size() > 2 && poc.arguments[2] == "1";
+        if (!arity || arity.value() < 0) {
+          return;
+        }
+
+        const auto argument_count = static_cast<size_t>(arity.value());
+        if (name == InlineEnterCommand) {
+          if (stack.size() < argument_count) {
+            return;
+          }
+
+          // Arguments become the callee locals, the first one is the deepest unless it is a receiver on top
+          std::vector<std::optional<uint64_t>> locals(argument_count);
+          const size_t base = stack.size() - argument_count;
+          for (size_t k = 0; k < argument_count; ++k) {
+            locals[with_receiver ? (k + 1) % argument_count : k] = stack[base + k].number;
+          }
+          stack.resize(base);
+          frame_stack_heights.push_back(base);
+          frames.push_back(std::move(locals));
+        } else {
+          if (frame_stack_heights.empty()) {
+            return;
+          }
+
+          // Values left by the callee are dropped with its frame
+          uint64_t result = 0;
+          if (with_receiver) {
+            result = local(0);
+          } else if (stack.size() > frame_stack_heights.back()) {
+            result = stack.back().number;
+          } else {
+            result = value_count++;
+          }
+          stack.resize(frame_stack_heights.back());
+          frame_stack_heights.pop_back();
+          frames.pop_back();
+          stack.push_back({result, std::nullopt});
+        }
+      } else {
+        stack.resize(stack.size() - effect->popped);
+        for (size_t k = 0; k < effect->pushed; ++k) {
+          stack.push_back({value_count++, std::nullopt});
+        }
+      }
+    }
+
+    if (!is_computation) {
+      barrier = i;
+    }
+    if (!KeepsMemory(name)) {
+      fields.clear();
+      statics.clear();
+    }
+  }
+}
+
+std::optional<Register> RedundantLoads::FindKept(uint64_t number) const {
+  for (size_t k = 0; k < kRegisters.size(); ++k) {
+    if (kept_[k] == number) {
+      return kRegisters[k];
+    }
+  }
+  return std::nullopt;
+}
+
+void RedundantLoads::Invalidate(const AssemblyInstruction& instruction) {
+  switch (instruction.command) {
+    case AsmCommand::CALL:
+      kept_.fill(std::nullopt);
+      return;
+    case AsmCommand::LOOP:
+    case AsmCommand::LOOPE:
+    case AsmCommand::LOOPNE:
+      Drop(Register::RCX);
+      return;
+    case AsmCommand::PUSH:
+    case AsmCommand::CMP:
+    case AsmCommand::TEST:
+      return;
+    default:
+      break;
+  }
+
+  // Any other instruction naming a register may write it
+  for (const Argument& argument : instruction.arguments) {
+    if (const auto* reg = std::get_if<Register>(&argument)) {
+      Drop(*reg);
+    }
+  }
+}
+
+void RedundantLoads::Drop(Register reg) {
+  const auto number = GetRegisterNumber(reg);
+  if (!number) {
+    return;
+  }
+  for (size_t k = 0; k < kRegisters.size(); ++k) {
+    if (GetRegisterNumber(kRegisters[k]) == number) {
+      kept_[k].reset();
+    }
+  }
+}
+
+} // namespace ovum::vm::jit
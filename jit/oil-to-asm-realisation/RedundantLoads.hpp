@@ -0,0 +1,83 @@
+#ifndef JIT_REDUNDANTLOADS_HPP
+#define JIT_REDUNDANTLOADS_HPP
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+#include <jit/AsmData.hpp>
+
+namespace ovum::vm::jit {
+
+struct JitCompileOptions;
+
+// Field and static loads repeating a value loaded before. Value numbers of the body give equal numbers to loads
+// of the same field of the same object value and of the same static, a store gives its slot the number of the
+// stored value. A store to a field offset kills that offset of every object as objects may alias, calls and other
+// commands writing memory kill all loads. With reuse_computations integer computations of equal operands are
+// numbered equal as well. A value produced again later is kept in a scratch register until code writes it, the
+// commands computing it again, from the LoadLocal of an object or the first operand on, push the register instead.
+// Repeated LoadLocal needs nothing here, locals used more than once already stay in registers.
+class RedundantLoads {
+public:
+  RedundantLoads(std::vector<AssemblyInstruction>& output,
+                 const std::vector<PackedOilCommand>& body,
+                 const JitCompileOptions& options);
+
+  // Called before each command, keeps the value produced by the previous command and drops the registers
+  // written by its code. Commands inside a fused run are emitted with its first one, their values are not kept.
+  void Advance(size_t index, bool in_fused_run);
+
+  // Pushes the kept value of the commands starting at the index or skips a command of them lowered before,
+  // returns false for other commands
+  [[nodiscard]] bool TryLower(size_t index);
+
+private:
+  static constexpr std::array<Register, 4> kRegisters = {Register::R8, Register::R9, Register::R10, Register::RCX};
+
+  // Value on the abstract stack, computed from nothing below it by the commands from begin on
+  struct Value {
+    uint64_t number = 0;
+    std::optional<size_t> begin;
+    // Sum of locals and constants scaled by constants
+    bool is_address = false;
+  };
+
+  struct Candidate {
+    size_t end;
+    uint64_t number;
+  };
+
+  void Analyse();
+
+  [[nodiscard]] std::optional<Register> FindKept(uint64_t number) const;
+
+  void Invalidate(const AssemblyInstruction& instruction);
+
+  void Drop(Register reg);
+
+  std::vector<AssemblyInstruction>& output_;
+  const std::vector<PackedOilCommand>& body_;
+  bool reuse_computations_;
+  bool fuse_address_arithmetic_;
+  // Value number produced by each load and computation
+  std::vector<std::optional<uint64_t>> values_;
+  // Commands computing a value from nothing below it, by their first command in the order of their ends
+  std::vector<std::vector<Candidate>> candidates_;
+  // Value numbers produced more than once, only they are kept
+  std::unordered_set<uint64_t> repeated_;
+  // Value number in each of the registers
+  std::array<std::optional<uint64_t>, kRegisters.size()> kept_;
+  // Instructions up to this one are accounted for in kept_
+  size_t scanned_ = 0;
+  // Commands up to this one were replaced by a kept value
+  size_t replaced_end_ = 0;
+  bool in_fused_run_ = false;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_REDUNDANTLOADS_HPP
@@ -0,0 +1,172 @@
+#include "StackDepthVerifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+
+#include <jit/JitFunctionRegistry.hpp>
+#include <jit/ObjectHeap.hpp>
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/VirtualDispatch.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/EscapeAnalysis.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/Inliner.hpp>
+
+namespace ovum::vm::jit {
+
+std::optional<StackEffect> StackDepthVerifier::GetStackEffect(const PackedOilCommand& command) {
+  static constexpr std::array<std::string_view, 4> kTypePrefixes = {"Int", "Float", "Byte", "Bool"};
+  static constexpr std::array<std::string_view, 16> kBinarySuffixes = {
+      "Add", "Subtract", "Multiply", "Divide", "Modulo", "Equal", "NotEqual", "LessThan", "LessEqual",
+      "GreaterThan", "GreaterEqual", "And", "Or", "Xor", "LeftShift", "RightShift"};
+  static constexpr std::array<std::string_view, 5> kUnarySuffixes = {"Negate", "Increment", "Decrement", "Not", "Sqrt"};
+  static constexpr std::array<std::string_view, 15> kUnaryCommands = {
+      "IsNull", "Unwrap", "IntToString", "FloatToString", "IntToFloat", "FloatToInt", "ByteToInt",
+      "CharToByte", "ByteToChar", "BoolToByte", "StringLength", "StringToInt", "StringToFloat",
+      "GetField", "SetVTable"};
+  static constexpr std::array<std::string_view, 9> kPushCommands = {
+      "PushInt", "PushFloat", "PushBool", "PushChar", "PushByte", "PushString", "PushNull", "GetVTable", "LoadStatic"};
+  static constexpr std::array<std::string_view, 5> kStoreCommands = {"Pop", "Print", "PrintLine", "SetStatic",
+                                                                     "SetLocal"};
+
+  const std::string& name = command.command_name;
+  for (std::string_view prefix : kTypePrefixes) {
+    if (!name.starts_with(prefix)) {
+      continue;
+    }
+    const std::string_view suffix = std::string_view(name).substr(prefix.size());
+    if (std::find(kBinarySuffixes.begin(), kBinarySuffixes.end(), suffix) != kBinarySuffixes.end()) {
+      return StackEffect{2, 1};
+    }
+    if (std::find(kUnarySuffixes.begin(), kUnarySuffixes.end(), suffix) != kUnarySuffixes.end()) {
+      return StackEffect{1, 1};
+    }
+  }
+
+  if (name == "Dup") {
+    return StackEffect{1, 2};
+  }
+  if (std::find(kUnaryCommands.begin(), kUnaryCommands.end(), name) != kUnaryCommands.end()) {
+    return StackEffect{1, 1};
+  }
+  if (std::find(kPushCommands.begin(), kPushCommands.end(), name) != kPushCommands.end() || name == "LoadLocal" ||
+      name == LoadScalarCommand || name == NewObjectCommand) {
+    return StackEffect{0, 1};
+  }
+  if (std::find(kStoreCommands.begin(), kStoreCommands.end(), name) != kStoreCommands.end() ||
+      name == SetScalarCommand) {
+    return StackEffect{1, 0};
+  }
+  if (name == "StringConcat" || name == "NullCoalesce" || name == "Swap") {
+    return StackEffect{2, name == "Swap" ? 2U : 1U};
+  }
+  if (name == "SetField") {
+    return StackEffect{2, 0};
+  }
+  if (name == ScalarFrameEnterCommand || name == ScalarFrameLeaveCommand) {
+    return StackEffect{0, 0};
+  }
+
+  // Calls consume their arguments, arities are known for every call the compiler accepts
+  if (name == "Call") {
+    const JitFunctionEntry* entry = JitFunctionRegistry::Find(command.arguments.at(0));
+    if (entry != nullptr && entry->arity) {
+      return StackEffect{entry->arity.value(), 1};
+    }
+  } else if (name == "CallVirtual" && VirtualDispatch::HasHooks()) {
+    const auto method_id = JitFunctionRegistry::StripQuotes(command.arguments.at(0));
+    const auto arity = VirtualDispatch::GetHooks().method_arity(method_id);
+    if (arity) {
+      return StackEffect{arity.value(), 1};
+    }
+  } else if (name == "CallConstructor") {
+    const auto layout = ObjectHeap::ResolveConstructor(JitFunctionRegistry::StripQuotes(command.arguments.at(0)));
+    const JitFunctionEntry* entry = layout ? JitFunctionRegistry::Find(layout->function_name) : nullptr;
+    if (entry != nullptr && entry->arity && entry->arity.value() != 0) {
+      return StackEffect{entry->arity.value() - 1, 1};
+    }
+  }
+
+  // Control flow and unknown commands
+  return std::nullopt;
+}
+
+std::expected<size_t, std::runtime_error> StackDepthVerifier::Verify(const std::vector<PackedOilCommand>& body) {
+  auto depths = Walk(body, body.size());
+  if (!depths) {
+    return std::unexpected(depths.error());
+  }
+  return depths->max;
+}
+
+std::expected<size_t, std::runtime_error> StackDepthVerifier::GetDepth(const std::vector<PackedOilCommand>& body,
+                                                                       size_t command_count) {
+  if (command_count > body.size()) {
+    return std::unexpected(std::runtime_error("StackDepthVerifier: command index is out of the body"));
+  }
+
+  auto depths = Walk(body, command_count);
+  if (!depths) {
+    return std::unexpected(depths.error());
+  }
+  return depths->current;
+}
+
+std::expected<StackDepthVerifier::Depths, std::runtime_error> StackDepthVerifier::Walk(
+    const std::vector<PackedOilCommand>& body, size_t command_count) {
+  // Depth of the current frame and the caller depths below inlined frames
+  size_t depth = 0;
+  size_t max_depth = 0;
+  size_t frames_depth = 0;
+  std::vector<size_t> caller_depths;
+
+  for (size_t i = 0; i < command_count; ++i) {
+    const PackedOilCommand& command = body[i];
+    const std::string at = " at command " + std::to_string(i) + " (" + command.command_name + ")";
+
+    if (command.command_name == InlineEnterCommand || command.command_name == InlineLeaveCommand) {
+      auto arity = ParseImmediateArgument(command.command_name, command.arguments.at(0));
+      if (!arity || arity.value() < 0) {
+        return std::unexpected(std::runtime_error("StackDepthVerifier: invalid frame" + at));
+      }
+
+      if (command.command_name == InlineEnterCommand) {
+        // Arguments become the callee locals, they stay on the machine stack below its frame
+        const auto argument_count = static_cast<size_t>(arity.value());
+        if (depth < argument_count) {
+          return std::unexpected(std::runtime_error("StackDepthVerifier: stack underflow" + at));
+        }
+        caller_depths.push_back(depth - argument_count);
+        frames_depth += depth;
+        depth = 0;
+        continue;
+      }
+
+      if (caller_depths.empty()) {
+        return std::unexpected(std::runtime_error("StackDepthVerifier: unmatched inlined frame" + at));
+      }
+      frames_depth -= caller_depths.back() + static_cast<size_t>(arity.value());
+      depth = caller_depths.back() + 1;
+      caller_depths.pop_back();
+      max_depth = std::max(max_depth, frames_depth + depth);
+      continue;
+    }
+
+    const auto effect = GetStackEffect(command);
+    if (!effect) {
+      return std::unexpected(std::runtime_error("StackDepthVerifier: unknown stack effect" + at));
+    }
+    if (depth < effect->popped) {
+      return std::unexpected(std::runtime_error("StackDepthVerifier: stack underflow" + at));
+    }
+    depth = depth - effect->popped + effect->pushed;
+    max_depth = std::max(max_depth, frames_depth + depth);
+  }
+
+  if (!caller_depths.empty()) {
+    return std::unexpected(std::runtime_error("StackDepthVerifier: inlined frame is not left"));
+  }
+  return Depths{depth, max_depth};
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,55 @@
+#ifndef JIT_STACKDEPTHVERIFIER_HPP
+#define JIT_STACKDEPTHVERIFIER_HPP
+
+#include <cstddef>
+#include <expected>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+
+namespace ovum::vm::jit {
+
+// Number of evaluation stack values a command pops and then pushes
+struct StackEffect {
+  size_t popped;
+  size_t pushed;
+};
+
+// Checks the evaluation stack of a body before code generation. Bodies are straight-line,
+// so the depth is exact at every command.
+class StackDepthVerifier {
+public:
+  StackDepthVerifier() = delete;
+  StackDepthVerifier(const StackDepthVerifier&) = delete;
+  StackDepthVerifier(StackDepthVerifier&&) = delete;
+  ~StackDepthVerifier() = delete;
+  StackDepthVerifier& operator=(const StackDepthVerifier&) = delete;
+  StackDepthVerifier& operator=(StackDepthVerifier&&) = delete;
+
+  // Effect of a command on the stack of its frame, std::nullopt for control flow, inlined frame boundaries
+  // and calls of unknown arity
+  [[nodiscard]] static std::optional<StackEffect> GetStackEffect(const PackedOilCommand& command);
+
+  // Maximum depth of the evaluation stack, inlined frames included. Fails on a command with unknown effect
+  // and on a command popping more values than its frame has.
+  [[nodiscard]] static std::expected<size_t, std::runtime_error> Verify(const std::vector<PackedOilCommand>& body);
+
+  // Depth of the outermost frame stack after the first command_count commands, fails as Verify does
+  [[nodiscard]] static std::expected<size_t, std::runtime_error> GetDepth(const std::vector<PackedOilCommand>& body,
+                                                                          size_t command_count);
+
+private:
+  struct Depths {
+    size_t current;
+    size_t max;
+  };
+
+  [[nodiscard]] static std::expected<Depths, std::runtime_error> Walk(const std::vector<PackedOilCommand>& body,
+                                                                      size_t command_count);
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_STACKDEPTHVERIFIER_HPP
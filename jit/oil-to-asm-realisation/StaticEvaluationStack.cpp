@@ -0,0 +1,371 @@
+#include "StaticEvaluationStack.hpp"
+
+#include <algorithm>
+#include <variant>
+
+#include <jit/OilCommandAsmCompiler.hpp>
+
+namespace ovum::vm::jit {
+
+namespace {
+
+constexpr uint8_t kStackPointerNumber = static_cast<uint8_t>(Register::RSP);
+// Number of operands that are not general purpose registers
+constexpr uint8_t kNoRegisterNumber = 0xFF;
+constexpr int64_t kSlotSize = 8;
+constexpr int64_t kStackAlignment = 16;
+
+#ifdef _WIN32
+// Shadow space of the callees stays reserved below the region
+constexpr int64_t kReservedBelowRegion = ShadowSpaceSizeBytes;
+#else
+constexpr int64_t kReservedBelowRegion = 0;
+#endif
+
+std::optional<int64_t> GetImmediate(const AssemblyInstruction& instruction, size_t index) {
+  if (auto value = instruction.get_argument<int64_t>(index)) {
+    return value;
+  }
+  if (auto value = instruction.get_argument<uint64_t>(index)) {
+    return static_cast<int64_t>(value.value());
+  }
+  return std::nullopt;
+}
+
+int64_t AlignUp(int64_t value) {
+  return (value + kStackAlignment - 1) / kStackAlignment * kStackAlignment;
+}
+
+} // namespace
+
+std::optional<std::vector<AssemblyInstruction>> StaticEvaluationStack::Lower(
+    const std::vector<AssemblyInstruction>& body, const std::unordered_map<std::string, int64_t>& entry_depths) {
+  std::vector<AssemblyInstruction> lowered;
+  lowered.reserve(body.size() + 2);
+  std::unordered_map<std::string, LabelState> labels;
+  State state;
+  bool reachable = true;
+  int64_t lowest = 0;
+  int64_t highest = 0;
+  const auto access = [&lowest, &highest](int64_t offset) {
+    lowest = std::min(lowest, offset);
+    highest = std::max(highest, offset + kSlotSize);
+  };
+
+  for (const AssemblyInstruction& instruction : body) {
+    const AsmCommand command = instruction.command;
+
+    // Labels take the state of every jump to them, registers known differently become unknown
+    if (command == AsmCommand::LABEL) {
+      const auto name = instruction.get_argument<std::string>(0);
+      if (!name) {
+        return std::nullopt;
+      }
+
+      auto it = labels.find(name.value());
+      if (it != labels.end() && it->second.conflicting) {
+        return std::nullopt;
+      }
+      const auto entry = entry_depths.find(name.value());
+      if (entry != entry_depths.end()) {
+        // Nothing but the stack depth is known where the label is entered from outside
+        State entered;
+        entered.stack_offset = -entry->second;
+        if (it == labels.end()) {
+          it = labels.emplace(name.value(), LabelState{entered, false}).first;
+        } else if (!MergeInto(it->second.state, entered)) {
+          return std::nullopt;
+        }
+      }
+
+      if (it == labels.end()) {
+        labels.emplace(name.value(), LabelState{state, true});
+      } else {
+        if (reachable && !MergeInto(it->second.state, state)) {
+          return std::nullopt;
+        }
+        state = it->second.state;
+        it->second.passed = true;
+      }
+      reachable = true;
+      lowered.push_back(instruction);
+      continue;
+    }
+
+    if (IsJump(command)) {
+      const auto name = instruction.get_argument<std::string>(0);
+      if (!name) {
+        return std::nullopt;
+      }
+
+      if (command == AsmCommand::LOOP || command == AsmCommand::LOOPE || command == AsmCommand::LOOPNE) {
+        state.registers[static_cast<uint8_t>(Register::RCX)].reset();
+      }
+
+      const auto it = labels.find(name.value());
+      if (it == labels.end()) {
+        labels.emplace(name.value(), LabelState{state, false});
+      } else if (it->second.passed) {
+        // Backward jump, the code after the label was lowered with the state at the label
+        const State& target = it->second.state;
+        if (target.stack_offset != state.stack_offset) {
+          return std::nullopt;
+        }
+        for (size_t i = 0; i < target.registers.size(); ++i) {
+          if (target.registers[i] && target.registers[i] != state.registers[i]) {
+            return std::nullopt;
+          }
+        }
+      } else if (!MergeInto(it->second.state, state)) {
+        it->second.conflicting = true;
+      }
+
+      reachable = command != AsmCommand::JMP;
+      lowered.push_back(instruction);
+      continue;
+    }
+
+    if (command == AsmCommand::RET) {
+      return std::nullopt;
+    }
+
+    const auto destination = instruction.get_argument<Register>(0);
+    const uint8_t destination_number =
+        destination ? GetRegisterNumber(destination.value()).value_or(kNoRegisterNumber) : kNoRegisterNumber;
+
+    if (command == AsmCommand::PUSH || command == AsmCommand::POP) {
+      if (destination_number == kNoRegisterNumber || destination_number == kStackPointerNumber) {
+        return std::nullopt;
+      }
+
+      if (command == AsmCommand::PUSH) {
+        state.stack_offset -= kSlotSize;
+        access(state.stack_offset);
+        lowered.push_back({AsmCommand::MOV, {addr(Register::RSP, state.stack_offset), destination.value()}});
+      } else {
+        access(state.stack_offset);
+        lowered.push_back({AsmCommand::MOV, {destination.value(), addr(Register::RSP, state.stack_offset)}});
+        state.registers[destination_number].reset();
+        state.stack_offset += kSlotSize;
+      }
+      continue;
+    }
+
+    // Changes of RSP only move the compile time stack top
+    if (destination_number == kStackPointerNumber) {
+      if (destination.value() != Register::RSP) {
+        return std::nullopt;
+      }
+
+      if (command == AsmCommand::ADD || command == AsmCommand::SUB) {
+        std::optional<int64_t> amount = GetImmediate(instruction, 1);
+        const auto source = instruction.get_argument<Register>(1);
+        const auto source_number = source ? GetRegisterNumber(source.value()) : std::nullopt;
+        if (!amount && source_number && state.registers[source_number.value()] &&
+            !state.registers[source_number.value()]->stack_relative) {
+          amount = state.registers[source_number.value()]->value;
+        }
+        if (!amount) {
+          return std::nullopt;
+        }
+        state.stack_offset += command == AsmCommand::ADD ? amount.value() : -amount.value();
+      } else if (command == AsmCommand::AND) {
+        // Alignment for a call, RSP is aligned for the whole body
+        if (!GetImmediate(instruction, 1)) {
+          return std::nullopt;
+        }
+      } else if (command == AsmCommand::MOV) {
+        const auto source = instruction.get_argument<Register>(1);
+        const auto source_number = source ? GetRegisterNumber(source.value()) : std::nullopt;
+        if (!source_number || !state.registers[source_number.value()] ||
+            !state.registers[source_number.value()]->stack_relative) {
+          return std::nullopt;
+        }
+        state.stack_offset = state.registers[source_number.value()]->value;
+      } else if (command == AsmCommand::LEA && instruction.arguments.size() == 2) {
+        const auto* memory = std::get_if<MemoryAddress>(&instruction.arguments[1]);
+        if (memory == nullptr || !memory->base || memory->index) {
+          return std::nullopt;
+        }
+        const auto base_number = GetRegisterNumber(memory->base.value());
+        if (base_number == kStackPointerNumber) {
+          state.stack_offset += memory->displacement;
+        } else if (base_number && state.registers[base_number.value()] &&
+                   state.registers[base_number.value()]->stack_relative) {
+          state.stack_offset = state.registers[base_number.value()]->value + memory->displacement;
+        } else {
+          return std::nullopt;
+        }
+      } else {
+        return std::nullopt;
+      }
+      // Frames reserved below the top, such as the callee frames of native calls, are part of the region
+      lowest = std::min(lowest, state.stack_offset);
+      continue;
+    }
+
+    // Callee runs below the region, everything down to the stack top has to be inside it
+    if (command == AsmCommand::CALL) {
+      lowest = std::min(lowest, state.stack_offset);
+    }
+
+    // Operands relative to RSP are moved to the region, copies of RSP become LEA
+    AssemblyInstruction rewritten = instruction;
+    for (size_t i = 0; i < rewritten.arguments.size(); ++i) {
+      if (const auto* reg = std::get_if<Register>(&rewritten.arguments[i])) {
+        if (GetRegisterNumber(*reg) == kStackPointerNumber) {
+          if (command != AsmCommand::MOV || i != 1 || destination_number == kNoRegisterNumber ||
+              destination.value() != static_cast<Register>(destination_number) || *reg != Register::RSP) {
+            return std::nullopt;
+          }
+          rewritten = {AsmCommand::LEA, {destination.value(), addr(Register::RSP, state.stack_offset)}};
+          break;
+        }
+      } else if (auto* memory = std::get_if<MemoryAddress>(&rewritten.arguments[i])) {
+        const auto index_number = memory->index ? GetRegisterNumber(memory->index.value()) : std::nullopt;
+        const uint8_t base_number =
+            memory->base ? GetRegisterNumber(memory->base.value()).value_or(kNoRegisterNumber) : kNoRegisterNumber;
+        if (index_number == kStackPointerNumber) {
+          return std::nullopt;
+        }
+        if (base_number == kStackPointerNumber) {
+          memory->base = Register::RSP;
+          memory->displacement += state.stack_offset;
+          access(memory->displacement);
+        } else if (base_number != kNoRegisterNumber && !memory->index && state.registers[base_number] &&
+                   state.registers[base_number]->stack_relative) {
+          access(state.registers[base_number]->value + memory->displacement);
+        }
+      }
+    }
+
+    // Constants and copies of RSP are tracked through the instructions fixups are computed with
+    const bool full_destination =
+        destination_number != kNoRegisterNumber && destination.value() == static_cast<Register>(destination_number);
+    const auto immediate = GetImmediate(instruction, 1);
+    std::optional<TrackedValue> tracked;
+    bool handled = false;
+    if (full_destination && command == AsmCommand::MOV && instruction.arguments.size() == 2) {
+      const auto source = instruction.get_argument<Register>(1);
+      const auto source_number = source ? GetRegisterNumber(source.value()) : std::nullopt;
+      if (source == Register::RSP) {
+        tracked = TrackedValue{true, state.stack_offset};
+      } else if (immediate) {
+        tracked = TrackedValue{false, immediate.value()};
+      } else if (source_number && source.value() == static_cast<Register>(source_number.value())) {
+        tracked = state.registers[source_number.value()];
+      }
+      handled = true;
+    } else if (full_destination && immediate && state.registers[destination_number]) {
+      const TrackedValue current = state.registers[destination_number].value();
+      handled = true;
+      if (command == AsmCommand::ADD) {
+        tracked = TrackedValue{current.stack_relative, current.value + immediate.value()};
+      } else if (command == AsmCommand::SUB) {
+        tracked = TrackedValue{current.stack_relative, current.value - immediate.value()};
+      } else if (command == AsmCommand::SHL && !current.stack_relative) {
+        tracked = TrackedValue{false, current.value << immediate.value()};
+      } else if (command == AsmCommand::AND &&
+                 (!current.stack_relative || (immediate.value() >= 0 && immediate.value() < kStackAlignment))) {
+        // RSP and the region top are aligned, low bits of an address in the region are the low bits of its offset
+        tracked = TrackedValue{false, current.value & immediate.value()};
+      } else {
+        handled = false;
+      }
+    }
+
+    if (handled) {
+      state.registers[destination_number] = tracked;
+    } else {
+      Invalidate(state, instruction);
+    }
+    lowered.push_back(std::move(rewritten));
+  }
+
+  // Region covers every accessed slot and is reserved at once, offsets above were relative to its aligned top
+  const int64_t below_top = AlignUp(-lowest);
+  const int64_t region_size = below_top + AlignUp(highest);
+  const int64_t top = kReservedBelowRegion + below_top;
+  for (AssemblyInstruction& instruction : lowered) {
+    for (auto& argument : instruction.arguments) {
+      auto* memory = std::get_if<MemoryAddress>(&argument);
+      if (memory != nullptr && memory->base == Register::RSP) {
+        memory->displacement += top;
+      }
+    }
+  }
+
+  std::vector<AssemblyInstruction> result = {
+      {AsmCommand::SUB, {Register::RSP, make_imm_arg(region_size + kReservedBelowRegion)}},
+      {AsmCommand::AND, {Register::RSP, make_imm_arg(-kStackAlignment)}}};
+  result.insert(result.end(), lowered.begin(), lowered.end());
+  return result;
+}
+
+bool StaticEvaluationStack::IsJump(AsmCommand command) noexcept {
+  return command == AsmCommand::JMP || (command >= AsmCommand::JE && command <= AsmCommand::LOOPNE);
+}
+
+std::optional<uint8_t> StaticEvaluationStack::GetRegisterNumber(Register reg) noexcept {
+  const auto value = static_cast<uint8_t>(reg);
+  if (value < static_cast<uint8_t>(Register::AH)) {
+    return static_cast<uint8_t>(value & 0x0F);
+  }
+  if (value <= static_cast<uint8_t>(Register::BH)) {
+    return static_cast<uint8_t>(value - static_cast<uint8_t>(Register::AH));
+  }
+  return std::nullopt;
+}
+
+void StaticEvaluationStack::Invalidate(State& state, const AssemblyInstruction& instruction) {
+  const auto reset = [&state](Register reg) {
+    if (const auto number = GetRegisterNumber(reg)) {
+      state.registers[number.value()].reset();
+    }
+  };
+
+  switch (instruction.command) {
+    case AsmCommand::CMP:
+    case AsmCommand::TEST:
+      return;
+    case AsmCommand::CALL:
+      for (Register reg : {Register::RAX, Register::RCX, Register::RDX, Register::RSI, Register::RDI, Register::R8,
+                           Register::R9, Register::R10, Register::R11}) {
+        reset(reg);
+      }
+      return;
+    case AsmCommand::MUL:
+    case AsmCommand::IMUL:
+    case AsmCommand::DIV:
+    case AsmCommand::IDIV:
+    case AsmCommand::CQO:
+      reset(Register::RAX);
+      reset(Register::RDX);
+      break;
+    case AsmCommand::XCHG:
+      if (const auto second = instruction.get_argument<Register>(1)) {
+        reset(second.value());
+      }
+      break;
+    default:
+      break;
+  }
+
+  if (const auto destination = instruction.get_argument<Register>(0)) {
+    reset(destination.value());
+  }
+}
+
+bool StaticEvaluationStack::MergeInto(State& target, const State& incoming) {
+  if (target.stack_offset != incoming.stack_offset) {
+    return false;
+  }
+  for (size_t i = 0; i < target.registers.size(); ++i) {
+    if (target.registers[i] != incoming.registers[i]) {
+      target.registers[i].reset();
+    }
+  }
+  return true;
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,69 @@
+#ifndef JIT_STATICEVALUATIONSTACK_HPP
+#define JIT_STATICEVALUATIONSTACK_HPP
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <jit/AsmData.hpp>
+
+namespace ovum::vm::jit {
+
+// Evaluation stack frame reserved once with a single RSP adjustment after the prologue.
+// Every RSP change of the lowered body is resolved at compile time: pushes and pops become stores and loads
+// at fixed offsets from RSP, copies of RSP become LEA and alignment fixups become constants. RSP is aligned once
+// and keeps the native call alignment for the whole body.
+class StaticEvaluationStack {
+public:
+  StaticEvaluationStack() = delete;
+  StaticEvaluationStack(const StaticEvaluationStack&) = delete;
+  StaticEvaluationStack(StaticEvaluationStack&&) = delete;
+  ~StaticEvaluationStack() = delete;
+  StaticEvaluationStack& operator=(const StaticEvaluationStack&) = delete;
+  StaticEvaluationStack& operator=(StaticEvaluationStack&&) = delete;
+
+  // Code between the prologue and the epilogue with the region reserved in front of it. Returns nullopt
+  // when some RSP change depends on run time values, the evaluation stack has to stay on RSP then.
+  // Labels entered from outside the body, as fault handlers do, are given with the stack depth in bytes at them.
+  // Jumps to labels after the body may leave with any stack depth, the epilogue restores RSP.
+  [[nodiscard]] static std::optional<std::vector<AssemblyInstruction>> Lower(
+      const std::vector<AssemblyInstruction>& body, const std::unordered_map<std::string, int64_t>& entry_depths = {});
+
+private:
+  // Compile time value of a general purpose register
+  struct TrackedValue {
+    bool stack_relative;
+    int64_t value;
+
+    auto operator<=>(const TrackedValue&) const = default;
+  };
+
+  struct State {
+    // Offset of the evaluation stack top from the region top
+    int64_t stack_offset = 0;
+    std::array<std::optional<TrackedValue>, 16> registers;
+  };
+
+  struct LabelState {
+    State state;
+    bool passed = false;
+    // Jumps to it left with different stack depths, which only a label after the body allows
+    bool conflicting = false;
+  };
+
+  static bool IsJump(AsmCommand command) noexcept;
+
+  // 64-bit register of a general purpose register of any size
+  static std::optional<uint8_t> GetRegisterNumber(Register reg) noexcept;
+
+  static void Invalidate(State& state, const AssemblyInstruction& instruction);
+
+  static bool MergeInto(State& target, const State& incoming);
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_STATICEVALUATIONSTACK_HPP
@@ -0,0 +1,277 @@
+#include "StrengthReduction.hpp"
+
+#include <bit>
+#include <limits>
+
+#include <jit/OilCommandAsmCompiler.hpp>
+
+namespace ovum::vm::jit {
+
+namespace {
+
+using Code = std::vector<AssemblyInstruction>;
+
+bool FitsInt32(int64_t value) {
+  return value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max();
+}
+
+// Magnitude of the constant, 2^63 for the minimum
+uint64_t Magnitude(int64_t value) {
+  return value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+}
+
+// Signed division by a constant as the high half of a multiplication, Hacker's Delight 10-1.
+// The divisor is at least 2 by magnitude.
+struct DivisionMagic {
+  int64_t multiplier;
+  int64_t shift;
+};
+
+DivisionMagic GetDivisionMagic(int64_t divisor) {
+  constexpr uint64_t kTwo63 = uint64_t{1} << 63;
+  const uint64_t magnitude = Magnitude(divisor);
+  const uint64_t t = kTwo63 + (static_cast<uint64_t>(divisor) >> 63);
+  const uint64_t anc = t - 1 - t % magnitude;
+  int64_t p = 63;
+  uint64_t q1 = kTwo63 / anc;
+  uint64_t r1 = kTwo63 - q1 * anc;
+  uint64_t q2 = kTwo63 / magnitude;
+  uint64_t r2 = kTwo63 - q2 * magnitude;
+  uint64_t delta = 0;
+  do {
+    ++p;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      ++q1;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= magnitude) {
+      ++q2;
+      r2 -= magnitude;
+    }
+    delta = magnitude - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+
+  const auto multiplier = static_cast<int64_t>(q2 + 1);
+  return {divisor < 0 ? static_cast<int64_t>(0 - static_cast<uint64_t>(multiplier)) : multiplier, p - 64};
+}
+
+// RAX * constant, products of 2^k, 3, 5, 9, 2^k + 1 and 2^k - 1 need no IMUL
+std::optional<Code> Multiply(int64_t constant) {
+  if (constant == 0) {
+    return Code{{AsmCommand::MOV, {Register::RAX, int64_t{0}}}};
+  }
+
+  const uint64_t magnitude = Magnitude(constant);
+  const auto shift = static_cast<int64_t>(std::countr_zero(magnitude));
+  const uint64_t odd = magnitude >> shift;
+  Code code;
+  if (odd == 3 || odd == 5 || odd == 9) {
+    const auto scale = static_cast<uint8_t>(odd - 1);
+    code.push_back({AsmCommand::LEA, {Register::RAX, indexed_addr(Register::RAX, Register::RAX, scale)}});
+  } else if (odd != 1) {
+    const bool is_sum = std::has_single_bit(magnitude - 1);
+    if (!is_sum && !std::has_single_bit(magnitude + 1)) {
+      if (!FitsInt32(constant)) {
+        return std::nullopt;
+      }
+      return Code{{AsmCommand::IMUL, {Register::RAX, Register::RAX, constant}}};
+    }
+
+    const auto power = static_cast<int64_t>(std::bit_width(magnitude) - (is_sum ? 1 : 0));
+    code.push_back({AsmCommand::MOV, {Register::RDX, Register::RAX}});
+    code.push_back({AsmCommand::SHL, {Register::RAX, power}});
+    code.push_back({is_sum ? AsmCommand::ADD : AsmCommand::SUB, {Register::RAX, Register::RDX}});
+    if (constant < 0) {
+      code.push_back({AsmCommand::NEG, {Register::RAX}});
+    }
+    return code;
+  }
+
+  if (shift != 0) {
+    code.push_back({AsmCommand::SHL, {Register::RAX, shift}});
+  }
+  if (constant < 0) {
+    code.push_back({AsmCommand::NEG, {Register::RAX}});
+  }
+  return code;
+}
+
+// RDX = 2^k - 1 for negative RAX and 0 otherwise, rounds the shifted RAX towards zero
+void AppendPowerOfTwoBias(Code& code, int64_t shift) {
+  code.push_back({AsmCommand::MOV, {Register::RDX, Register::RAX}});
+  code.push_back({AsmCommand::SAR, {Register::RDX, int64_t{63}}});
+  code.push_back({AsmCommand::SHR, {Register::RDX, 64 - shift}});
+}
+
+// RAX = RAX / divisor truncated, RBX keeps the dividend
+void AppendMagicDivision(Code& code, int64_t divisor) {
+  const DivisionMagic magic = GetDivisionMagic(divisor);
+  code.push_back({AsmCommand::MOV, {Register::RBX, Register::RAX}});
+  code.push_back({AsmCommand::MOV, {Register::RAX, magic.multiplier}});
+  code.push_back({AsmCommand::IMUL, {Register::RBX}});
+  if (divisor > 0 && magic.multiplier < 0) {
+    code.push_back({AsmCommand::ADD, {Register::RDX, Register::RBX}});
+  } else if (divisor < 0 && magic.multiplier > 0) {
+    code.push_back({AsmCommand::SUB, {Register::RDX, Register::RBX}});
+  }
+  if (magic.shift != 0) {
+    code.push_back({AsmCommand::SAR, {Register::RDX, magic.shift}});
+  }
+  // Negative quotients are one less than truncated ones
+  code.push_back({AsmCommand::MOV, {Register::RAX, Register::RDX}});
+  code.push_back({AsmCommand::SHR, {Register::RAX, int64_t{63}}});
+  code.push_back({AsmCommand::ADD, {Register::RAX, Register::RDX}});
+}
+
+// RAX = RBX - RAX * constant
+void AppendRemainder(Code& code, int64_t constant) {
+  if (FitsInt32(constant)) {
+    code.push_back({AsmCommand::IMUL, {Register::RAX, Register::RAX, constant}});
+  } else {
+    code.push_back({AsmCommand::MOV, {Register::RDX, constant}});
+    code.push_back({AsmCommand::IMUL, {Register::RAX, Register::RDX}});
+  }
+  code.push_back({AsmCommand::SUB, {Register::RBX, Register::RAX}});
+  code.push_back({AsmCommand::MOV, {Register::RAX, Register::RBX}});
+}
+
+// IDIV faults on 0 and on the minimum divided by -1, the minimum divisor is left to it as well
+std::optional<Code> Divide(int64_t divisor, bool remainder) {
+  if (divisor == 0 || divisor == -1 || divisor == std::numeric_limits<int64_t>::min()) {
+    return std::nullopt;
+  }
+  if (divisor == 1) {
+    return remainder ? Code{{AsmCommand::MOV, {Register::RAX, int64_t{0}}}} : Code{};
+  }
+
+  Code code;
+  const uint64_t magnitude = Magnitude(divisor);
+  if (!std::has_single_bit(magnitude)) {
+    AppendMagicDivision(code, divisor);
+    if (remainder) {
+      AppendRemainder(code, divisor);
+    }
+    return code;
+  }
+
+  // Remainder of a power of two is the masked biased dividend with the bias taken back
+  const auto shift = static_cast<int64_t>(std::countr_zero(magnitude));
+  AppendPowerOfTwoBias(code, shift);
+  code.push_back({AsmCommand::ADD, {Register::RAX, Register::RDX}});
+  if (!remainder) {
+    code.push_back({AsmCommand::SAR, {Register::RAX, shift}});
+    if (divisor < 0) {
+      code.push_back({AsmCommand::NEG, {Register::RAX}});
+    }
+    return code;
+  }
+
+  const auto mask = static_cast<int64_t>(magnitude - 1);
+  if (FitsInt32(mask)) {
+    code.push_back({AsmCommand::AND, {Register::RAX, mask}});
+  } else {
+    code.push_back({AsmCommand::MOV, {Register::RBX, mask}});
+    code.push_back({AsmCommand::AND, {Register::RAX, Register::RBX}});
+  }
+  code.push_back({AsmCommand::SUB, {Register::RAX, Register::RDX}});
+  return code;
+}
+
+// Unsigned division of a byte, (a * (2^16 / divisor + 1)) >> 16 is exact for dividends and divisors below 256
+std::optional<Code> DivideByte(int64_t divisor, bool remainder) {
+  if (divisor == 0) {
+    return std::nullopt;
+  }
+
+  // DIV reads only AL of the dividend
+  Code code = {{AsmCommand::MOVZX, {Register::RAX, Register::AL}}};
+  const auto magnitude = static_cast<uint64_t>(divisor);
+  if (std::has_single_bit(magnitude)) {
+    if (remainder) {
+      code.push_back({AsmCommand::AND, {Register::RAX, divisor - 1}});
+    } else if (divisor != 1) {
+      code.push_back({AsmCommand::SHR, {Register::RAX, static_cast<int64_t>(std::countr_zero(magnitude))}});
+    }
+    return code;
+  }
+
+  if (remainder) {
+    code.push_back({AsmCommand::MOV, {Register::RBX, Register::RAX}});
+  }
+  code.push_back({AsmCommand::IMUL, {Register::RAX, Register::RAX, (int64_t{1} << 16) / divisor + 1}});
+  code.push_back({AsmCommand::SHR, {Register::RAX, int64_t{16}}});
+  if (remainder) {
+    AppendRemainder(code, divisor);
+  }
+  return code;
+}
+
+} // namespace
+
+StrengthReduction::StrengthReduction(std::vector<AssemblyInstruction>& output,
+                                     const std::vector<PackedOilCommand>& body) :
+    output_(output), body_(body) {
+}
+
+bool StrengthReduction::TryLower(size_t index) {
+  if (reduced_index_ == index) {
+    output_.push_back({AsmCommand::POP, {Register::RAX}});
+    output_.insert(output_.end(), reduced_.begin(), reduced_.end());
+    output_.push_back({AsmCommand::PUSH, {Register::RAX}});
+    reduced_index_.reset();
+    return true;
+  }
+
+  if (index + 1 >= body_.size()) {
+    return false;
+  }
+
+  const PackedOilCommand& push = body_[index];
+  const std::string& operation = body_[index + 1].command_name;
+  if (!(push.command_name == "PushInt" && operation.starts_with("Int")) &&
+      !(push.command_name == "PushByte" && operation.starts_with("Byte"))) {
+    return false;
+  }
+
+  const auto constant = ParseImmediateArgument(push.command_name, push.arguments.at(0));
+  if (!constant) {
+    return false;
+  }
+
+  auto reduced = Reduce(operation, constant.value());
+  if (!reduced) {
+    return false;
+  }
+
+  // The constant is not pushed, the operation is emitted when its index is reached
+  reduced_ = std::move(reduced.value());
+  reduced_index_ = index + 1;
+  return true;
+}
+
+std::optional<std::vector<AssemblyInstruction>> StrengthReduction::Reduce(std::string_view command_name,
+                                                                          int64_t constant) {
+  if (command_name == "IntMultiply") {
+    return Multiply(constant);
+  }
+  if (command_name == "IntDivide" || command_name == "IntModulo") {
+    return Divide(constant, command_name == "IntModulo");
+  }
+  if (command_name == "ByteMultiply") {
+    auto code = Multiply(constant);
+    if (code && constant != 0) {
+      code->push_back({AsmCommand::MOVZX, {Register::RAX, Register::AL}});
+    }
+    return code;
+  }
+  if (command_name == "ByteDivide" || command_name == "ByteModulo") {
+    return DivideByte(constant, command_name == "ByteModulo");
+  }
+  return std::nullopt;
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,39 @@
+#ifndef JIT_STRENGTHREDUCTION_HPP
+#define JIT_STRENGTHREDUCTION_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+#include <jit/AsmData.hpp>
+
+namespace ovum::vm::jit {
+
+// Multiplications, divisions and modulos whose right operand is pushed right before them. The constant is not
+// pushed, the operation becomes shifts, LEA, masking or a multiplication by the reciprocal instead of IMUL/IDIV.
+// Divisors the division faults on keep the division.
+class StrengthReduction {
+public:
+  StrengthReduction(std::vector<AssemblyInstruction>& output, const std::vector<PackedOilCommand>& body);
+
+  // Lowers the constant push and the operation after it, returns false for other commands
+  [[nodiscard]] bool TryLower(size_t index);
+
+  // Code replacing the left operand in RAX with the result, std::nullopt if the constant gives nothing cheaper.
+  // Byte results are zero-extended.
+  [[nodiscard]] static std::optional<std::vector<AssemblyInstruction>> Reduce(std::string_view command_name,
+                                                                             int64_t constant);
+
+private:
+  std::vector<AssemblyInstruction>& output_;
+  const std::vector<PackedOilCommand>& body_;
+  // Operation whose constant push was dropped and its code
+  std::optional<size_t> reduced_index_;
+  std::vector<AssemblyInstruction> reduced_;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_STRENGTHREDUCTION_HPP
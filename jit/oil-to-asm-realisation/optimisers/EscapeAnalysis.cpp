@@ -0,0 +1,221 @@
+#include "EscapeAnalysis.hpp"
+
+#include <algorithm>
+
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/oil-to-asm-realisation/DeoptExits.hpp>
+#include <jit/oil-to-asm-realisation/StackDepthVerifier.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/Inliner.hpp>
+
+namespace ovum::vm::jit {
+
+std::vector<PackedOilCommand> EscapeAnalysis::ReplaceScalars(const std::vector<PackedOilCommand>& body) {
+  std::vector<ObjectInfo> objects;
+  // Object operand of each GetField and SetField
+  std::vector<int64_t> field_objects(body.size(), kUnknown);
+
+  // Bodies are straight-line, the abstract stack and locals are exact at every command
+  std::vector<int64_t> stack;
+  std::vector<std::vector<int64_t>> frames(1);
+  std::vector<size_t> frame_stack_heights;
+
+  auto escape = [&objects](int64_t value) {
+    if (value != kUnknown) {
+      objects[static_cast<size_t>(value)].escapes = true;
+    }
+  };
+
+  for (size_t i = 0; i < body.size(); ++i) {
+    const PackedOilCommand& poc = body[i];
+    const std::string& name = poc.command_name;
+
+    std::optional<uint64_t> index;
+    if (!poc.arguments.empty()) {
+      auto value = ParseImmediateArgument(name, poc.arguments.at(0));
+      if (value && value.value() >= 0) {
+        index = static_cast<uint64_t>(value.value());
+      }
+    }
+
+    // A failed guard hands the frame to the interpreter, which has to see every live object
+    if (IsGuardedCommand(name)) {
+      std::for_each(stack.begin(), stack.end(), escape);
+      for (const auto& locals : frames) {
+        std::for_each(locals.begin(), locals.end(), escape);
+      }
+    }
+
+    size_t popped = 0;
+    if (name == NewObjectCommand) {
+      objects.push_back({i});
+      stack.push_back(static_cast<int64_t>(objects.size() - 1));
+      continue;
+    } else if (name == "LoadLocal" || name == "SetLocal" || name == "GetField" || name == "SetField") {
+      popped = name == "LoadLocal" ? 0 : (name == "SetField" ? 2 : 1);
+      if (!index || stack.size() < popped) {
+        return body;
+      }
+    } else if (name == "Pop" || name == "Dup" || name == "Swap") {
+      popped = name == "Swap" ? 2 : 1;
+      if (stack.size() < popped) {
+        return body;
+      }
+    }
+
+    if (name == "LoadLocal") {
+      auto& locals = frames.back();
+      stack.push_back(index.value() < locals.size() ? locals[index.value()] : kUnknown);
+    } else if (name == "SetLocal") {
+      auto& locals = frames.back();
+      if (index.value() >= locals.size()) {
+        locals.resize(index.value() + 1, kUnknown);
+      }
+      locals[index.value()] = stack.back();
+      stack.pop_back();
+    } else if (name == "GetField" || name == "SetField") {
+      if (name == "SetField") {
+        // Objects stored into other objects are reachable from the heap
+        escape(stack.back());
+        stack.pop_back();
+      }
+      field_objects[i] = stack.back();
+      stack.pop_back();
+      if (field_objects[i] != kUnknown) {
+        AddField(objects[static_cast<size_t>(field_objects[i])], index.value());
+      }
+      if (name == "GetField") {
+        stack.push_back(kUnknown);
+      }
+    } else if (name == "Pop") {
+      stack.pop_back();
+    } else if (name == "Dup") {
+      stack.push_back(stack.back());
+    } else if (name == "Swap") {
+      std::swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+    } else if (name == InlineEnterCommand || name == InlineLeaveCommand) {
+      auto arity = ParseImmediateArgument(name, poc.arguments.at(0));
+      auto frame_slots = ParseImmediateArgument(name, poc.arguments.at(1));
+      const bool with_receiver = poc.arguments.size() > 2 && poc.arguments[2] == "1";
+      if (!arity || !frame_slots) {
+        return body;
+      }
+
+      if (name == InlineEnterCommand) {
+        const auto argument_count = static_cast<size_t>(arity.value());
+        if (stack.size() < argument_count) {
+          return body;
+        }
+
+        // Arguments stay below the frame until leave, the first one is the deepest unless it is a receiver on top
+        std::vector<int64_t> locals(static_cast<size_t>(std::max(arity.value(), frame_slots.value())), kUnknown);
+        const size_t base = stack.size() - argument_count;
+        for (size_t k = 0; k < argument_count; ++k) {
+          const size_t local = with_receiver ? (k + 1) % argument_count : k;
+          locals[local] = stack[base + k];
+        }
+        stack.resize(base);
+        frame_stack_heights.push_back(base);
+        frames.push_back(std::move(locals));
+        continue;
+      }
+
+      if (frame_stack_heights.empty()) {
+        return body;
+      }
+
+      // Values left by the callee are dropped with its frame
+      int64_t result = kUnknown;
+      if (with_receiver) {
+        result = frames.back().at(0);
+      } else if (stack.size() > frame_stack_heights.back()) {
+        result = stack.back();
+      }
+      stack.resize(frame_stack_heights.back());
+      frame_stack_heights.pop_back();
+      frames.pop_back();
+      stack.push_back(result);
+    } else {
+      std::optional<StackEffect> effect = StackDepthVerifier::GetStackEffect(poc);
+      if (!effect || stack.size() < effect->popped) {
+        return body;
+      }
+
+      // Any other use passes the object where it can be kept, objects stored to statics escape as well
+      for (size_t k = 0; k < effect->popped; ++k) {
+        escape(stack.back());
+        stack.pop_back();
+      }
+      stack.insert(stack.end(), effect->pushed, kUnknown);
+    }
+  }
+
+  // Result of the function
+  if (!stack.empty()) {
+    escape(stack.back());
+  }
+
+  std::vector<int64_t> allocation_objects(body.size(), kUnknown);
+  uint64_t slot_count = 0;
+  bool replaced = false;
+  for (size_t k = 0; k < objects.size(); ++k) {
+    if (!objects[k].escapes) {
+      allocation_objects[objects[k].allocation_index] = static_cast<int64_t>(k);
+      objects[k].first_slot = slot_count;
+      slot_count += objects[k].fields.size();
+      replaced = true;
+    }
+  }
+
+  if (!replaced) {
+    return body;
+  }
+
+  std::vector<PackedOilCommand> result = {{ScalarFrameEnterCommand, {std::to_string(slot_count)}}};
+  result.reserve(body.size() + 2);
+  for (size_t i = 0; i < body.size(); ++i) {
+    const PackedOilCommand& poc = body[i];
+
+    if (allocation_objects[i] != kUnknown) {
+      // Fields start zeroed as in a fresh allocation, the reference is a null placeholder nobody dereferences
+      const ObjectInfo& allocated = objects[static_cast<size_t>(allocation_objects[i])];
+      for (uint64_t k = 0; k < allocated.fields.size(); ++k) {
+        result.push_back({"PushInt", {"0"}});
+        result.push_back({SetScalarCommand, {std::to_string(allocated.first_slot + k)}});
+      }
+      result.push_back({"PushNull", {}});
+      continue;
+    }
+
+    const int64_t object = field_objects[i];
+    if (object == kUnknown || objects[static_cast<size_t>(object)].escapes) {
+      result.push_back(poc);
+      continue;
+    }
+
+    ObjectInfo& accessed = objects[static_cast<size_t>(object)];
+    auto field_index = ParseImmediateArgument(poc.command_name, poc.arguments.at(0));
+    const std::string slot =
+        std::to_string(accessed.first_slot + AddField(accessed, static_cast<uint64_t>(field_index.value())));
+    if (poc.command_name == "GetField") {
+      result.push_back({"Pop", {}});
+      result.push_back({LoadScalarCommand, {slot}});
+    } else {
+      result.push_back({"Swap", {}});
+      result.push_back({"Pop", {}});
+      result.push_back({SetScalarCommand, {slot}});
+    }
+  }
+  result.push_back({ScalarFrameLeaveCommand, {std::to_string(slot_count)}});
+  return result;
+}
+
+uint64_t EscapeAnalysis::AddField(ObjectInfo& object, uint64_t field_index) {
+  const auto it = std::find(object.fields.begin(), object.fields.end(), field_index);
+  if (it != object.fields.end()) {
+    return static_cast<uint64_t>(it - object.fields.begin());
+  }
+  object.fields.push_back(field_index);
+  return object.fields.size() - 1;
+}
+
+} // namespace ovum::vm::jit
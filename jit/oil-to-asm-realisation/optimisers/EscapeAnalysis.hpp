@@ -0,0 +1,51 @@
+#ifndef JIT_ESCAPEANALYSIS_HPP
+#define JIT_ESCAPEANALYSIS_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+
+namespace ovum::vm::jit {
+
+// Pseudo-commands of scalar replaced objects. Their fields live in a frame on the machine stack pointed by R15,
+// the enter and leave commands around the body take the number of its slots.
+const std::string LoadScalarCommand = "LoadScalar";
+const std::string SetScalarCommand = "SetScalar";
+const std::string ScalarFrameEnterCommand = "ScalarFrameEnter";
+const std::string ScalarFrameLeaveCommand = "ScalarFrameLeave";
+
+// Replaces objects allocated by NewObject which never leave the function by their fields.
+// Runs after inlining, a constructor called out of line gets the object and makes it escape.
+class EscapeAnalysis {
+public:
+  EscapeAnalysis() = delete;
+  EscapeAnalysis(const EscapeAnalysis&) = delete;
+  EscapeAnalysis(EscapeAnalysis&&) = delete;
+  ~EscapeAnalysis() = delete;
+  EscapeAnalysis& operator=(const EscapeAnalysis&) = delete;
+  EscapeAnalysis& operator=(EscapeAnalysis&&) = delete;
+
+  [[nodiscard]] static std::vector<PackedOilCommand> ReplaceScalars(const std::vector<PackedOilCommand>& body);
+
+private:
+  // Abstract value of a stack slot or a local, an object index or kUnknown
+  static constexpr int64_t kUnknown = -1;
+
+  struct ObjectInfo {
+    size_t allocation_index;
+    bool escapes = false;
+    // Accessed fields, field k lives in scalar slot first_slot + k
+    std::vector<uint64_t> fields = {};
+    uint64_t first_slot = 0;
+  };
+
+  // Position of the field in the accessed fields of the object, added on first access
+  static uint64_t AddField(ObjectInfo& object, uint64_t field_index);
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_ESCAPEANALYSIS_HPP
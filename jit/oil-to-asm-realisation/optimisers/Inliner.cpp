@@ -0,0 +1,89 @@
+#include "Inliner.hpp"
+
+#include <algorithm>
+
+#include <jit/JitExecutor.hpp>
+#include <jit/JitFunctionRegistry.hpp>
+#include <jit/ObjectHeap.hpp>
+
+namespace ovum::vm::jit {
+
+std::vector<PackedOilCommand> Inliner::Inline(const std::vector<PackedOilCommand>& body,
+                                              const std::string& function_name) {
+  std::vector<PackedOilCommand> result;
+  result.reserve(body.size());
+
+  std::vector<std::string> call_chain = {function_name};
+  size_t inlined_commands = 0;
+  InlineBody(body, call_chain, inlined_commands, result);
+  return result;
+}
+
+void Inliner::InlineBody(const std::vector<PackedOilCommand>& body,
+                         std::vector<std::string>& call_chain,
+                         size_t& inlined_commands,
+                         std::vector<PackedOilCommand>& output) {
+  for (const auto& poc : body) {
+    const bool is_constructor = poc.command_name == "CallConstructor";
+    if ((poc.command_name != "Call" && !is_constructor) || call_chain.size() > kMaxInlineDepth) {
+      output.push_back(poc);
+      continue;
+    }
+
+    // Constructor body is called with the new object, allocation stays in the caller
+    std::string callee_id = poc.arguments.at(0);
+    if (is_constructor) {
+      const auto layout = ObjectHeap::ResolveConstructor(JitFunctionRegistry::StripQuotes(callee_id));
+      if (!layout || !ObjectHeap::HasAllocationBuffer()) {
+        output.push_back(poc);
+        continue;
+      }
+      callee_id = layout->function_name;
+    }
+
+    JitFunctionEntry* entry = JitFunctionRegistry::Find(callee_id);
+    if (entry == nullptr || entry->executor == nullptr || !entry->arity ||
+        (is_constructor && entry->arity.value() == 0)) {
+      output.push_back(poc);
+      continue;
+    }
+
+    // Recursive callees are never expanded, the native call handles them
+    JitExecutor* callee = entry->executor;
+    if (std::find(call_chain.begin(), call_chain.end(), callee->GetFunctionName()) != call_chain.end()) {
+      output.push_back(poc);
+      continue;
+    }
+
+    const auto local_slot_count = callee->GetLocalSlotCount();
+    const auto* callee_body = callee->GetPackedBody();
+    if (!local_slot_count || callee_body == nullptr) {
+      output.push_back(poc);
+      continue;
+    }
+
+    const uint64_t call_count = entry->call_count.load(std::memory_order_relaxed) + callee->GetRunCount();
+    const bool small = callee_body->size() <= kAlwaysInlineSize;
+    const bool hot = callee_body->size() <= kHotInlineSize && call_count >= kHotCallCount;
+    if ((!small && !hot) || inlined_commands + callee_body->size() > kMaxInlinedCommands) {
+      output.push_back(poc);
+      continue;
+    }
+
+    inlined_commands += callee_body->size();
+    std::vector<std::string> frame = {std::to_string(entry->arity.value()),
+                                      std::to_string(std::max(entry->arity.value(), local_slot_count.value()))};
+    if (is_constructor) {
+      frame.emplace_back("1");
+      output.push_back({NewObjectCommand, {poc.arguments.at(0)}});
+    }
+
+    output.push_back({InlineEnterCommand, frame});
+    call_chain.push_back(callee->GetFunctionName());
+    InlineBody(*callee_body, call_chain, inlined_commands, output);
+    call_chain.pop_back();
+    output.push_back({InlineLeaveCommand, frame});
+  }
+}
+
+} // namespace ovum::vm::jit
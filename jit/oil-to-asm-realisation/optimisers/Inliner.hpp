@@ -0,0 +1,53 @@
+#ifndef JIT_INLINER_HPP
+#define JIT_INLINER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <jit/AsmCompiler.hpp>
+
+namespace ovum::vm::jit {
+
+// Pseudo-commands around an inlined callee body, arguments are the callee arity and local slot count.
+// Enter moves the arguments into a local frame on the machine stack and points locals to it,
+// leave drops the frame and the arguments and pushes the callee result.
+// An optional third argument "1" marks an inlined constructor: the object on top of the arguments becomes
+// the first one and is pushed on leave instead of the result.
+const std::string InlineEnterCommand = "InlineEnter";
+const std::string InlineLeaveCommand = "InlineLeave";
+// Allocation part of CallConstructor, pushes the initialized object of the constructor given as the argument
+const std::string NewObjectCommand = "NewObject";
+
+// Replaces OIL Call and CallConstructor commands by the callee body for small or hot callees
+class Inliner {
+public:
+  Inliner() = delete;
+  Inliner(const Inliner&) = delete;
+  Inliner(Inliner&&) = delete;
+  ~Inliner() = delete;
+  Inliner& operator=(const Inliner&) = delete;
+  Inliner& operator=(Inliner&&) = delete;
+
+  [[nodiscard]] static std::vector<PackedOilCommand> Inline(const std::vector<PackedOilCommand>& body,
+                                                            const std::string& function_name);
+
+private:
+  // Callees up to this size are inlined regardless of the profile
+  static constexpr size_t kAlwaysInlineSize = 8;
+  // Larger callees up to this size are inlined once they were called kHotCallCount times
+  static constexpr size_t kHotInlineSize = 32;
+  static constexpr uint64_t kHotCallCount = 100;
+  static constexpr size_t kMaxInlineDepth = 3;
+  // Commands added to one function by inlining
+  static constexpr size_t kMaxInlinedCommands = 256;
+
+  static void InlineBody(const std::vector<PackedOilCommand>& body,
+                         std::vector<std::string>& call_chain,
+                         size_t& inlined_commands,
+                         std::vector<PackedOilCommand>& output);
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_INLINER_HPP
@@ -0,0 +1,631 @@
+#include "InstructionScheduler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <optional>
+#include <utility>
+#include <variant>
+
+namespace ovum::vm::jit {
+
+namespace {
+
+enum class LatencyClass : uint8_t {
+  kAlu,
+  kMultiply,
+  kDivide,
+  kLoad,
+  kFloatAdd,
+  kFloatMultiply,
+  kFloatDivide,
+  kFloatSqrt,
+  kFloatRound,
+  kConvert,
+  kBitCount,
+  kCount
+};
+
+using LatencyTable = std::array<uint32_t, static_cast<size_t>(LatencyClass::kCount)>;
+
+// Cycles until the result can be used, for 64-bit integers and doubles, in the order of LatencyClass
+constexpr LatencyTable kGenericLatencies = {1, 3, 40, 4, 4, 4, 14, 18, 6, 5, 3};
+constexpr LatencyTable kIntelCoreLatencies = {1, 3, 42, 5, 4, 4, 14, 18, 8, 6, 3};
+constexpr LatencyTable kAmdZenLatencies = {1, 3, 18, 4, 3, 3, 13, 20, 3, 5, 1};
+
+// General registers come first, then vector registers and the flags
+constexpr size_t kVectorResources = 16;
+constexpr size_t kFlagsResource = 48;
+using Resources = std::bitset<kFlagsResource + 1>;
+
+struct MemoryAccess {
+  bool is_store = false;
+  // Offset from RSP, std::nullopt when the address may be anywhere
+  std::optional<int64_t> stack_offset = std::nullopt;
+  int64_t size = 8;
+};
+
+struct Effects {
+  bool is_barrier = false;
+  bool loads = false;
+  Resources reads;
+  Resources writes;
+  std::vector<MemoryAccess> memory;
+};
+
+// How an instruction uses its first operand, the others are read
+enum class Role : uint8_t { kWrite, kReadWrite, kRead };
+
+const LatencyTable& GetLatencies(Microarchitecture target) {
+  switch (target) {
+    case Microarchitecture::kIntelCore:
+      return kIntelCoreLatencies;
+    case Microarchitecture::kAmdZen:
+      return kAmdZenLatencies;
+    default:
+      return kGenericLatencies;
+  }
+}
+
+std::optional<size_t> GetResource(Register reg) {
+  const auto value = static_cast<uint8_t>(reg);
+  if (value < 0x40) {
+    return value & 0xF;
+  }
+  if (value <= static_cast<uint8_t>(Register::BH)) {
+    return value - static_cast<uint8_t>(Register::AH);
+  }
+  if (value >= static_cast<uint8_t>(Register::XMM0) && value < static_cast<uint8_t>(Register::ZMM0)) {
+    return kVectorResources + (value & 0xF);
+  }
+  if (value >= static_cast<uint8_t>(Register::ZMM0) && value <= static_cast<uint8_t>(Register::ZMM31)) {
+    return kVectorResources + (value - static_cast<uint8_t>(Register::ZMM0));
+  }
+  return std::nullopt;
+}
+
+// 8 and 16-bit writes keep the rest of the register
+bool IsPartial(Register reg) {
+  const auto value = static_cast<uint8_t>(reg);
+  return value >= static_cast<uint8_t>(Register::AX) && value <= static_cast<uint8_t>(Register::BH);
+}
+
+bool IsSetcc(AsmCommand command) {
+  return command >= AsmCommand::SETO && command <= AsmCommand::SETNLE;
+}
+
+bool IsCmovcc(AsmCommand command) {
+  return command >= AsmCommand::CMOVE && command <= AsmCommand::CMOVAE;
+}
+
+bool IsMove(AsmCommand command) {
+  switch (command) {
+    case AsmCommand::MOV:
+    case AsmCommand::MOVSX:
+    case AsmCommand::MOVZX:
+    case AsmCommand::MOVQ:
+    case AsmCommand::MOVSD:
+    case AsmCommand::MOVAPD:
+    case AsmCommand::MOVUPD:
+    case AsmCommand::POP:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// std::nullopt for control flow and instructions not modelled, they are never moved
+std::optional<Role> GetRole(const AssemblyInstruction& instruction) {
+  const AsmCommand command = instruction.command;
+  if (IsSetcc(command)) {
+    return Role::kWrite;
+  }
+  if (IsCmovcc(command)) {
+    return Role::kReadWrite;
+  }
+
+  switch (command) {
+    case AsmCommand::MOV:
+    case AsmCommand::MOVSX:
+    case AsmCommand::MOVZX:
+    case AsmCommand::LEA:
+    case AsmCommand::MOVQ:
+    case AsmCommand::POPCNT:
+    case AsmCommand::LZCNT:
+    case AsmCommand::TZCNT:
+    case AsmCommand::SHLX:
+    case AsmCommand::SARX:
+    case AsmCommand::SHRX:
+    case AsmCommand::POP:
+    case AsmCommand::CVTSD2SI:
+    case AsmCommand::CVTTSD2SI:
+    case AsmCommand::CVTTSD2SIQ:
+    case AsmCommand::MOVAPD:
+    case AsmCommand::MOVUPD:
+    case AsmCommand::VADDSD:
+    case AsmCommand::VSUBSD:
+    case AsmCommand::VMULSD:
+    case AsmCommand::VDIVSD:
+    case AsmCommand::VMINSD:
+    case AsmCommand::VMAXSD:
+    case AsmCommand::VSQRTSD:
+    case AsmCommand::VANDPD:
+    case AsmCommand::VXORPD:
+    case AsmCommand::VROUNDSD:
+      return Role::kWrite;
+    case AsmCommand::MOVSD:
+      // Moves between registers keep the upper half of the destination
+      return std::holds_alternative<Register>(instruction.arguments.at(0)) &&
+                     std::holds_alternative<Register>(instruction.arguments.at(1))
+                 ? Role::kReadWrite
+                 : Role::kWrite;
+    case AsmCommand::IMUL:
+      if (instruction.argument_count() == 3) {
+        return Role::kWrite;
+      }
+      return instruction.argument_count() == 2 ? Role::kReadWrite : Role::kRead;
+    case AsmCommand::ADD:
+    case AsmCommand::SUB:
+    case AsmCommand::AND:
+    case AsmCommand::OR:
+    case AsmCommand::XOR:
+    case AsmCommand::NOT:
+    case AsmCommand::NEG:
+    case AsmCommand::INC:
+    case AsmCommand::DEC:
+    case AsmCommand::SHL:
+    case AsmCommand::SHR:
+    case AsmCommand::SAR:
+    case AsmCommand::ROL:
+    case AsmCommand::ROR:
+    case AsmCommand::RCL:
+    case AsmCommand::RCR:
+    case AsmCommand::BSR:
+    case AsmCommand::XCHG:
+    case AsmCommand::ADDSD:
+    case AsmCommand::SUBSD:
+    case AsmCommand::MULSD:
+    case AsmCommand::DIVSD:
+    case AsmCommand::SQRTSD:
+    case AsmCommand::MINSD:
+    case AsmCommand::MAXSD:
+    case AsmCommand::ROUNDSD:
+    case AsmCommand::CVTSI2SD:
+    case AsmCommand::CVTSS2SD:
+    case AsmCommand::CVTSD2SS:
+    case AsmCommand::ANDPD:
+    case AsmCommand::ANDNPD:
+    case AsmCommand::ORPD:
+    case AsmCommand::XORPD:
+      return Role::kReadWrite;
+    case AsmCommand::MUL:
+    case AsmCommand::DIV:
+    case AsmCommand::IDIV:
+    case AsmCommand::CMP:
+    case AsmCommand::TEST:
+    case AsmCommand::COMISD:
+    case AsmCommand::UCOMISD:
+    case AsmCommand::PUSH:
+    case AsmCommand::PUSHF:
+    case AsmCommand::POPF:
+    case AsmCommand::CQO:
+    case AsmCommand::CLC:
+    case AsmCommand::STC:
+    case AsmCommand::CMC:
+      return Role::kRead;
+    default:
+      return std::nullopt;
+  }
+}
+
+LatencyClass GetLatencyClass(AsmCommand command) {
+  switch (command) {
+    case AsmCommand::IMUL:
+    case AsmCommand::MUL:
+      return LatencyClass::kMultiply;
+    case AsmCommand::IDIV:
+    case AsmCommand::DIV:
+      return LatencyClass::kDivide;
+    case AsmCommand::ADDSD:
+    case AsmCommand::SUBSD:
+    case AsmCommand::MINSD:
+    case AsmCommand::MAXSD:
+    case AsmCommand::VADDSD:
+    case AsmCommand::VSUBSD:
+    case AsmCommand::VMINSD:
+    case AsmCommand::VMAXSD:
+      return LatencyClass::kFloatAdd;
+    case AsmCommand::MULSD:
+    case AsmCommand::VMULSD:
+      return LatencyClass::kFloatMultiply;
+    case AsmCommand::DIVSD:
+    case AsmCommand::VDIVSD:
+      return LatencyClass::kFloatDivide;
+    case AsmCommand::SQRTSD:
+    case AsmCommand::VSQRTSD:
+      return LatencyClass::kFloatSqrt;
+    case AsmCommand::ROUNDSD:
+    case AsmCommand::VROUNDSD:
+      return LatencyClass::kFloatRound;
+    case AsmCommand::CVTSI2SD:
+    case AsmCommand::CVTSD2SI:
+    case AsmCommand::CVTSS2SD:
+    case AsmCommand::CVTSD2SS:
+    case AsmCommand::CVTTSD2SI:
+    case AsmCommand::CVTTSD2SIQ:
+    case AsmCommand::MOVQ:
+    case AsmCommand::COMISD:
+    case AsmCommand::UCOMISD:
+      return LatencyClass::kConvert;
+    case AsmCommand::POPCNT:
+    case AsmCommand::LZCNT:
+    case AsmCommand::TZCNT:
+    case AsmCommand::BSR:
+      return LatencyClass::kBitCount;
+    default:
+      return LatencyClass::kAlu;
+  }
+}
+
+// Flags read by the instruction, INC, DEC and shifts and rotates by a count that may be zero keep some of them
+bool ReadsFlags(const AssemblyInstruction& instruction) {
+  switch (instruction.command) {
+    case AsmCommand::SHL:
+    case AsmCommand::SHR:
+    case AsmCommand::SAR:
+    case AsmCommand::ROL:
+    case AsmCommand::ROR: {
+      const auto count = instruction.get_argument<int64_t>(1);
+      return !count || (count.value() & 0x3F) == 0;
+    }
+    case AsmCommand::INC:
+    case AsmCommand::DEC:
+    case AsmCommand::RCL:
+    case AsmCommand::RCR:
+    case AsmCommand::CMC:
+    case AsmCommand::PUSHF:
+      return true;
+    default:
+      return IsSetcc(instruction.command) || IsCmovcc(instruction.command);
+  }
+}
+
+bool WritesFlags(AsmCommand command) {
+  switch (command) {
+    case AsmCommand::ADD:
+    case AsmCommand::SUB:
+    case AsmCommand::IMUL:
+    case AsmCommand::MUL:
+    case AsmCommand::IDIV:
+    case AsmCommand::DIV:
+    case AsmCommand::INC:
+    case AsmCommand::DEC:
+    case AsmCommand::NEG:
+    case AsmCommand::AND:
+    case AsmCommand::OR:
+    case AsmCommand::XOR:
+    case AsmCommand::TEST:
+    case AsmCommand::CMP:
+    case AsmCommand::POPCNT:
+    case AsmCommand::LZCNT:
+    case AsmCommand::TZCNT:
+    case AsmCommand::BSR:
+    case AsmCommand::SHL:
+    case AsmCommand::SHR:
+    case AsmCommand::SAR:
+    case AsmCommand::ROL:
+    case AsmCommand::ROR:
+    case AsmCommand::RCL:
+    case AsmCommand::RCR:
+    case AsmCommand::COMISD:
+    case AsmCommand::UCOMISD:
+    case AsmCommand::CLC:
+    case AsmCommand::STC:
+    case AsmCommand::CMC:
+    case AsmCommand::POPF:
+      return true;
+    default:
+      return false;
+  }
+}
+
+Effects GetEffects(const AssemblyInstruction& instruction) {
+  Effects effects;
+  const AsmCommand command = instruction.command;
+  const auto role = GetRole(instruction);
+  if (!role) {
+    effects.is_barrier = true;
+    return effects;
+  }
+
+  const int64_t access_size = command == AsmCommand::MOVAPD || command == AsmCommand::MOVUPD ? 16 : 8;
+  for (size_t i = 0; i < instruction.argument_count(); ++i) {
+    Role operand_role = i == 0 ? role.value() : Role::kRead;
+    if (command == AsmCommand::XCHG) {
+      operand_role = Role::kReadWrite;
+    }
+
+    if (const auto* reg = std::get_if<Register>(&instruction.arguments[i])) {
+      const auto resource = GetResource(*reg);
+      if (!resource) {
+        effects.is_barrier = true;
+        return effects;
+      }
+      if (operand_role != Role::kWrite || IsPartial(*reg)) {
+        effects.reads.set(resource.value());
+      }
+      if (operand_role != Role::kRead) {
+        effects.writes.set(resource.value());
+      }
+    } else if (const auto* address = std::get_if<MemoryAddress>(&instruction.arguments[i])) {
+      for (const auto& reg : {address->base, address->index}) {
+        if (!reg) {
+          continue;
+        }
+        const auto resource = GetResource(reg.value());
+        if (!resource) {
+          effects.is_barrier = true;
+          return effects;
+        }
+        effects.reads.set(resource.value());
+      }
+      if (command == AsmCommand::LEA) {
+        continue;
+      }
+
+      const bool is_stack_slot = address->base == Register::RSP && !address->index && !address->segment;
+      const auto stack_offset = is_stack_slot ? std::optional<int64_t>(address->displacement) : std::nullopt;
+      if (operand_role != Role::kWrite) {
+        effects.memory.push_back({.is_store = false, .stack_offset = stack_offset, .size = access_size});
+        effects.loads = true;
+      }
+      if (operand_role != Role::kRead) {
+        effects.memory.push_back({.is_store = true, .stack_offset = stack_offset, .size = access_size});
+      }
+    }
+  }
+
+  // Operands the instructions do not name
+  constexpr auto kRax = static_cast<size_t>(Register::RAX);
+  constexpr auto kRdx = static_cast<size_t>(Register::RDX);
+  constexpr auto kRsp = static_cast<size_t>(Register::RSP);
+  const bool is_one_operand_multiply = command == AsmCommand::IMUL && instruction.argument_count() == 1;
+  if (command == AsmCommand::MUL || command == AsmCommand::DIV || command == AsmCommand::IDIV ||
+      is_one_operand_multiply) {
+    effects.reads.set(kRax).set(kRdx);
+    effects.writes.set(kRax).set(kRdx);
+  } else if (command == AsmCommand::CQO) {
+    effects.reads.set(kRax);
+    effects.writes.set(kRdx);
+  } else if (command == AsmCommand::PUSH || command == AsmCommand::POP || command == AsmCommand::PUSHF ||
+             command == AsmCommand::POPF) {
+    effects.reads.set(kRsp);
+    effects.writes.set(kRsp);
+    const bool is_push = command == AsmCommand::PUSH || command == AsmCommand::PUSHF;
+    effects.memory.push_back({.is_store = is_push});
+    effects.loads = effects.loads || !is_push;
+  }
+
+  if (ReadsFlags(instruction)) {
+    effects.reads.set(kFlagsResource);
+  }
+  if (WritesFlags(command)) {
+    effects.writes.set(kFlagsResource);
+  }
+  return effects;
+}
+
+uint32_t GetLatency(const AssemblyInstruction& instruction, const Effects& effects, const LatencyTable& latencies) {
+  const uint32_t load = effects.loads ? latencies[static_cast<size_t>(LatencyClass::kLoad)] : 0;
+  if (load != 0 && IsMove(instruction.command)) {
+    return load;
+  }
+  return latencies[static_cast<size_t>(GetLatencyClass(instruction.command))] + load;
+}
+
+bool MayOverlap(const MemoryAccess& lhs, const MemoryAccess& rhs) {
+  if (!lhs.stack_offset || !rhs.stack_offset) {
+    return true;
+  }
+  return lhs.stack_offset.value() < rhs.stack_offset.value() + rhs.size &&
+         rhs.stack_offset.value() < lhs.stack_offset.value() + lhs.size;
+}
+
+// Instructions splitting the runs, the one after a label is where a fault may be redirected from
+bool IsFixed(const std::vector<AssemblyInstruction>& instructions, size_t index) {
+  if (index > 0 && instructions[index - 1].command == AsmCommand::LABEL) {
+    return true;
+  }
+  return GetEffects(instructions[index]).is_barrier;
+}
+
+} // namespace
+
+std::vector<AssemblyInstruction> InstructionScheduler::Schedule(const std::vector<AssemblyInstruction>& instructions,
+                                                                Microarchitecture target) {
+  std::vector<AssemblyInstruction> output;
+  output.reserve(instructions.size());
+
+  size_t run_begin = 0;
+  for (size_t i = 0; i <= instructions.size(); ++i) {
+    const bool is_fixed = i < instructions.size() && IsFixed(instructions, i);
+    if (i < instructions.size() && !is_fixed && i - run_begin < kMaxRunInstructions) {
+      continue;
+    }
+
+    ScheduleRun(instructions, run_begin, i, target, output);
+    run_begin = i;
+    if (is_fixed) {
+      output.push_back(instructions[i]);
+      run_begin = i + 1;
+    }
+  }
+  return output;
+}
+
+void InstructionScheduler::ScheduleRun(const std::vector<AssemblyInstruction>& instructions,
+                                       size_t begin,
+                                       size_t end,
+                                       Microarchitecture target,
+                                       std::vector<AssemblyInstruction>& output) {
+  const size_t count = end - begin;
+  if (count < 2) {
+    output.insert(output.end(), instructions.begin() + begin, instructions.begin() + end);
+    return;
+  }
+
+  const LatencyTable& latencies = GetLatencies(target);
+  std::vector<Effects> effects;
+  std::vector<uint32_t> latency;
+  effects.reserve(count);
+  latency.reserve(count);
+  for (size_t i = begin; i < end; ++i) {
+    effects.push_back(GetEffects(instructions[i]));
+    latency.push_back(GetLatency(instructions[i], effects.back(), latencies));
+  }
+
+  // Edges carry the cycles from the issue of an instruction to the issue of its successor
+  std::vector<std::vector<std::pair<size_t, uint32_t>>> successors(count);
+  std::vector<size_t> predecessors(count, 0);
+  auto add_edge = [&](size_t from, size_t to, uint32_t cycles) {
+    successors[from].emplace_back(to, cycles);
+    ++predecessors[to];
+  };
+
+  // Reads wait for the last write, writes wait for the reads and the write before them
+  std::array<std::optional<size_t>, kFlagsResource> last_writer{};
+  std::array<std::vector<size_t>, kFlagsResource> readers{};
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t resource = 0; resource < kFlagsResource; ++resource) {
+      if (!effects[i].reads.test(resource)) {
+        continue;
+      }
+      if (const auto writer = last_writer[resource]) {
+        add_edge(writer.value(), i, latency[writer.value()]);
+      }
+      readers[resource].push_back(i);
+    }
+    for (size_t resource = 0; resource < kFlagsResource; ++resource) {
+      if (!effects[i].writes.test(resource)) {
+        continue;
+      }
+      if (const auto writer = last_writer[resource]; writer && writer != i) {
+        add_edge(writer.value(), i, 0);
+      }
+      for (const size_t reader : readers[resource]) {
+        if (reader != i) {
+          add_edge(reader, i, 0);
+        }
+      }
+      readers[resource].clear();
+      last_writer[resource] = i;
+    }
+  }
+
+  // Stores keep their order with every access they may overlap
+  std::vector<std::pair<size_t, MemoryAccess>> accesses;
+  for (size_t i = 0; i < count; ++i) {
+    for (const MemoryAccess& access : effects[i].memory) {
+      for (const auto& [earlier, earlier_access] : accesses) {
+        if ((earlier_access.is_store || access.is_store) && MayOverlap(earlier_access, access)) {
+          add_edge(earlier, i, earlier_access.is_store && !access.is_store ? latency[earlier] : 0);
+        }
+      }
+    }
+    for (const MemoryAccess& access : effects[i].memory) {
+      accesses.emplace_back(i, access);
+    }
+  }
+
+  // Almost every instruction writes the flags, most of the writes are never read. A write is ordered only against
+  // the writes whose flags are read, by the readers or by code after the run, it goes before such a write or
+  // after its last reader.
+  struct FlagsUse {
+    std::optional<size_t> writer;
+    std::vector<size_t> readers;
+  };
+  std::vector<FlagsUse> used;
+  std::vector<size_t> flag_writers;
+  FlagsUse current;
+  for (size_t i = 0; i < count; ++i) {
+    if (effects[i].reads.test(kFlagsResource)) {
+      current.readers.push_back(i);
+    }
+    if (effects[i].writes.test(kFlagsResource)) {
+      if (!current.readers.empty()) {
+        used.push_back(current);
+      }
+      current = {.writer = i, .readers = {}};
+      flag_writers.push_back(i);
+    }
+  }
+  if (current.writer || !current.readers.empty()) {
+    used.push_back(current);
+  }
+
+  for (const FlagsUse& use : used) {
+    for (const size_t reader : use.readers) {
+      if (use.writer) {
+        add_edge(use.writer.value(), reader, latency[use.writer.value()]);
+      }
+    }
+    const size_t first = use.writer ? use.writer.value() : use.readers.front();
+    const size_t last = use.readers.empty() ? first : use.readers.back();
+    for (const size_t writer : flag_writers) {
+      if (writer < first) {
+        add_edge(writer, first, 0);
+      } else if (writer > last) {
+        add_edge(last, writer, 0);
+      }
+    }
+  }
+
+  // Longest chain of latencies from each instruction to the end of the run, edges only lead forward
+  std::vector<uint64_t> height(count, 0);
+  for (size_t i = count; i-- > 0;) {
+    height[i] = latency[i];
+    for (const auto& [successor, cycles] : successors[i]) {
+      height[i] = std::max(height[i], cycles + height[successor]);
+    }
+  }
+
+  // Each cycle the ready instruction with the longest chain is issued, ties keep the original order
+  std::vector<uint64_t> earliest(count, 0);
+  std::vector<size_t> ready;
+  for (size_t i = 0; i < count; ++i) {
+    if (predecessors[i] == 0) {
+      ready.push_back(i);
+    }
+  }
+
+  uint64_t cycle = 0;
+  while (!ready.empty()) {
+    auto best = ready.end();
+    for (auto it = ready.begin(); it != ready.end(); ++it) {
+      if (earliest[*it] > cycle) {
+        continue;
+      }
+      if (best == ready.end() || height[*it] > height[*best] || (height[*it] == height[*best] && *it < *best)) {
+        best = it;
+      }
+    }
+    if (best == ready.end()) {
+      // Nothing has its operands yet, the cycles until the first one has them are stalls
+      cycle = earliest[*std::ranges::min_element(ready, {}, [&](size_t i) { return earliest[i]; })];
+      continue;
+    }
+
+    const size_t chosen = *best;
+    ready.erase(best);
+    output.push_back(instructions[begin + chosen]);
+    for (const auto& [successor, cycles] : successors[chosen]) {
+      earliest[successor] = std::max(earliest[successor], cycle + cycles);
+      if (--predecessors[successor] == 0) {
+        ready.push_back(successor);
+      }
+    }
+    ++cycle;
+  }
+}
+
+} // namespace ovum::vm::jit
@@ -0,0 +1,43 @@
+#ifndef JIT_INSTRUCTIONSCHEDULER_HPP
+#define JIT_INSTRUCTIONSCHEDULER_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <jit/AsmData.hpp>
+#include <jit/CpuFeatures.hpp>
+
+namespace ovum::vm::jit {
+
+// List scheduling of straight-line runs of instructions. An instruction goes first when the longest chain of
+// latencies from it to the end of its run is the longest, so independent work fills the latency of divisions,
+// square roots and loads. Labels, branches, calls and the instructions right after labels, which may be fault
+// sites, stay where they are and split the runs. Memory accesses keep their order unless both are RSP slots that
+// do not overlap.
+class InstructionScheduler {
+public:
+  InstructionScheduler() = delete;
+  InstructionScheduler(const InstructionScheduler&) = delete;
+  InstructionScheduler(InstructionScheduler&&) = delete;
+  ~InstructionScheduler() = delete;
+  InstructionScheduler& operator=(const InstructionScheduler&) = delete;
+  InstructionScheduler& operator=(InstructionScheduler&&) = delete;
+
+  // Reorders each run by the latencies of the target, an instruction is issued per cycle
+  [[nodiscard]] static std::vector<AssemblyInstruction> Schedule(const std::vector<AssemblyInstruction>& instructions,
+                                                                 Microarchitecture target);
+
+private:
+  // Longer runs are scheduled in parts, dependences between memory accesses are found for every pair
+  static constexpr size_t kMaxRunInstructions = 256;
+
+  static void ScheduleRun(const std::vector<AssemblyInstruction>& instructions,
+                          size_t begin,
+                          size_t end,
+                          Microarchitecture target,
+                          std::vector<AssemblyInstruction>& output);
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_INSTRUCTIONSCHEDULER_HPP
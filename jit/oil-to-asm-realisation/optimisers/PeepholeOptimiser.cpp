@@ -0,0 +1,292 @@
+#include "PeepholeOptimiser.hpp"
+
+#include <algorithm>
+
+namespace ovum::vm::jit {
+
+using PeepholeResult = std::optional<std::vector<AssemblyInstruction>>;
+
+static bool IsGeneralRegister64(Register reg) {
+  return static_cast<uint8_t>(reg) <= static_cast<uint8_t>(Register::R15);
+}
+
+static bool IsXmmRegister(Register reg) {
+  return static_cast<uint8_t>(reg) >= static_cast<uint8_t>(Register::XMM0) &&
+         static_cast<uint8_t>(reg) <= static_cast<uint8_t>(Register::XMM15);
+}
+
+static Register GetLowByteRegister(Register reg) {
+  return static_cast<Register>(static_cast<uint8_t>(Register::AL) + static_cast<uint8_t>(reg));
+}
+
+// Register operand of the instruction if it is the given command with register operands only
+static std::optional<Register> GetRegisterOperand(const AssemblyInstruction& instr,
+                                                  AsmCommand command,
+                                                  size_t index,
+                                                  size_t argument_count) {
+  if (instr.command != command || instr.arguments.size() != argument_count) {
+    return std::nullopt;
+  }
+  return instr.get_argument<Register>(index);
+}
+
+static bool ReadsFlags(AsmCommand command) {
+  switch (command) {
+    case AsmCommand::JE:
+    case AsmCommand::JNE:
+    case AsmCommand::JG:
+    case AsmCommand::JGE:
+    case AsmCommand::JL:
+    case AsmCommand::JLE:
+    case AsmCommand::JA:
+    case AsmCommand::JAE:
+    case AsmCommand::JB:
+    case AsmCommand::JBE:
+    case AsmCommand::LOOPE:
+    case AsmCommand::LOOPNE:
+    case AsmCommand::CMOVE:
+    case AsmCommand::CMOVNE:
+    case AsmCommand::CMOVB:
+    case AsmCommand::CMOVBE:
+    case AsmCommand::CMOVA:
+    case AsmCommand::CMOVAE:
+    case AsmCommand::RCL:
+    case AsmCommand::RCR:
+    case AsmCommand::PUSHF:
+    case AsmCommand::CMC:
+      return true;
+    default:
+      return command >= AsmCommand::SETO && command <= AsmCommand::SETNLE;
+  }
+}
+
+// Instructions setting every status flag without reading any
+static bool WritesFlags(AsmCommand command) {
+  switch (command) {
+    case AsmCommand::ADD:
+    case AsmCommand::SUB:
+    case AsmCommand::NEG:
+    case AsmCommand::AND:
+    case AsmCommand::OR:
+    case AsmCommand::XOR:
+    case AsmCommand::TEST:
+    case AsmCommand::CMP:
+    case AsmCommand::COMISD:
+    case AsmCommand::UCOMISD:
+    case AsmCommand::POPF:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Rules are tried in order, each one either shortens the window or produces a window no rule matches again,
+// so repeating passes until nothing changes terminates.
+const std::vector<PeepholeRule> PeepholeOptimiser::s_rules = {
+    // PUSH r; POP r -> nothing
+    {"push_pop_same_register",
+     2,
+     [](std::span<const AssemblyInstruction> window) -> PeepholeResult {
+       auto pushed = GetRegisterOperand(window[0], AsmCommand::PUSH, 0, 1);
+       auto popped = GetRegisterOperand(window[1], AsmCommand::POP, 0, 1);
+       if (!pushed || !popped || *pushed != *popped || !IsGeneralRegister64(*pushed)) {
+         return std::nullopt;
+       }
+       return std::vector<AssemblyInstruction>{};
+     }},
+
+    // PUSH r1; POP r2 -> MOV r2, r1
+    {"push_pop_rename",
+     2,
+     [](std::span<const AssemblyInstruction> window) -> PeepholeResult {
+       auto pushed = GetRegisterOperand(window[0], AsmCommand::PUSH, 0, 1);
+       auto popped = GetRegisterOperand(window[1], AsmCommand::POP, 0, 1);
+       if (!pushed || !popped || !IsGeneralRegister64(*pushed) || !IsGeneralRegister64(*popped) ||
+           *popped == Register::RSP) {
+         return std::nullopt;
+       }
+       return std::vector<AssemblyInstruction>{{AsmCommand::MOV, {*popped, *pushed}}};
+     }},
+
+    // MOV r, r -> nothing (only 64-bit, 32-bit move clears upper half)
+    {"mov_same_register",
+     1,
+     [](std::span<const AssemblyInstruction> window) -> PeepholeResult {
+       auto dst = GetRegisterOperand(window[0], AsmCommand::MOV, 0, 2);
+       auto src = GetRegisterOperand(window[0], AsmCommand::MOV, 1, 2);
+       if (!dst || !src || *dst != *src || !IsGeneralRegister64(*dst)) {
+         return std::nullopt;
+       }
+       return std::vector<AssemblyInstruction>{};
+     }},
+
+    // MOV r, imm; SETcc r8; MOVZX r, r8 -> SETcc r8; MOVZX r, r8
+    {"setcc_zero_extend",
+     3,
+     [](std::span<const AssemblyInstruction> window) -> PeepholeResult {
+       if (window[0].command != AsmCommand::MOV || !window[0].is_argument_type<int64_t>(1) ||
+           window[1].command < AsmCommand::SETO || window[1].command > AsmCommand::SETNLE) {
+         return std::nullopt;
+       }
+
+       auto cleared = window[0].get_argument<Register>(0);
+       auto set_byte = window[1].get_argument<Register>(0);
+       auto extended = GetRegisterOperand(window[2], AsmCommand::MOVZX, 0, 2);
+       auto extended_byte = GetRegisterOperand(window[2], AsmCommand::MOVZX, 1, 2);
+       if (!cleared || !set_byte || !extended || !extended_byte || !IsGeneralRegister64(*cleared) ||
+           *extended != *cleared || *set_byte != GetLowByteRegister(*cleared) || *extended_byte != *set_byte) {
+         return std::nullopt;
+       }
+       return std::vector<AssemblyInstruction>{window[1], window[2]};
+     }},
+
+    // MOVQ x, r; MOVQ r, x -> MOVQ x, r
+    {"movq_round_trip",
+     2,
+     [](std::span<const AssemblyInstruction> window) -> PeepholeResult {
+       auto xmm_dst = GetRegisterOperand(window[0], AsmCommand::MOVQ, 0, 2);
+       auto gpr_src = GetRegisterOperand(window[0], AsmCommand::MOVQ, 1, 2);
+       auto gpr_dst = GetRegisterOperand(window[1], AsmCommand::MOVQ, 0, 2);
+       auto xmm_src = GetRegisterOperand(window[1], AsmCommand::MOVQ, 1, 2);
+       if (!xmm_dst || !gpr_src || !gpr_dst || !xmm_src || !IsXmmRegister(*xmm_dst) ||
+           !IsGeneralRegister64(*gpr_src) || *xmm_dst != *xmm_src || *gpr_src != *gpr_dst) {
+         return std::nullopt;
+       }
+       return std::vector<AssemblyInstruction>{window[0]};
+     }},
+
+    // MOVQ r, x1; MOVQ x2, r -> MOVQ r, x1; MOVQ x2, x1 (second one is dropped if x1 == x2)
+    {"movq_xmm_transfer",
+     2,
+     [](std::span<const AssemblyInstruction> window) -> PeepholeResult {
+       auto gpr_dst = GetRegisterOperand(window[0], AsmCommand::MOVQ, 0, 2);
+       auto xmm_src = GetRegisterOperand(window[0], AsmCommand::MOVQ, 1, 2);
+       auto xmm_dst = GetRegisterOperand(window[1], AsmCommand::MOVQ, 0, 2);
+       auto gpr_src = GetRegisterOperand(window[1], AsmCommand::MOVQ, 1, 2);
+       if (!gpr_dst || !xmm_src || !xmm_dst || !gpr_src || !IsGeneralRegister64(*gpr_dst) ||
+           !IsXmmRegister(*xmm_src) || *gpr_dst != *gpr_src) {
+         return std::nullopt;
+       }
+
+       if (*xmm_dst == *xmm_src) {
+         return std::vector<AssemblyInstruction>{window[0]};
+       }
+       return std::vector<AssemblyInstruction>{window[0], {AsmCommand::MOVQ, {*xmm_dst, *xmm_src}}};
+     }},
+
+    // SHL r, k; ADD r, b -> LEA r, [b + r * 2^k]
+    {"shift_add_to_lea",
+     2,
+     [](std::span<const AssemblyInstruction> window) -> PeepholeResult {
+       if (window[0].command != AsmCommand::SHL) {
+         return std::nullopt;
+       }
+
+       auto shifted = window[0].get_argument<Register>(0);
+       auto shift = window[0].get_argument<int64_t>(1);
+       auto sum = GetRegisterOperand(window[1], AsmCommand::ADD, 0, 2);
+       auto base = GetRegisterOperand(window[1], AsmCommand::ADD, 1, 2);
+       if (!shifted || !shift || !sum || !base || *shift < 1 || *shift > 3 || *sum != *shifted ||
+           *base == *shifted || !IsGeneralRegister64(*shifted) || !IsGeneralRegister64(*base) ||
+           *shifted == Register::RSP) {
+         return std::nullopt;
+       }
+
+       const auto scale = static_cast<uint8_t>(1 << *shift);
+       return std::vector<AssemblyInstruction>{{AsmCommand::LEA, {*shifted, indexed_addr(*base, *shifted, scale)}}};
+     },
+     true},
+};
+
+std::vector<std::atomic<uint64_t>> PeepholeOptimiser::s_rule_hits(PeepholeOptimiser::s_rules.size());
+
+bool PeepholeOptimiser::OptimisePass(const std::vector<AssemblyInstruction>& instructions,
+                                     std::vector<AssemblyInstruction>& output) {
+  bool changed = false;
+  output.clear();
+  output.reserve(instructions.size());
+
+  // Instructions waiting to be appended, rewrite results are put back here to be matched again
+  std::vector<AssemblyInstruction> pending(instructions.rbegin(), instructions.rend());
+
+  while (!pending.empty()) {
+    output.push_back(std::move(pending.back()));
+    pending.pop_back();
+
+    for (size_t rule_index = 0; rule_index < s_rules.size(); ++rule_index) {
+      const auto& rule = s_rules[rule_index];
+      if (output.size() < rule.window_size) {
+        continue;
+      }
+
+      auto window = std::span<const AssemblyInstruction>(output).last(rule.window_size);
+      if (std::any_of(window.begin(), window.end(), [](const AssemblyInstruction& instr) {
+            return instr.command == AsmCommand::LABEL;
+          })) {
+        // Jump targets split the code, patterns never cross them
+        continue;
+      }
+
+      if (rule.drops_flags && !AreFlagsDead(pending)) {
+        continue;
+      }
+
+      auto replacement = rule.rewrite(window);
+      if (!replacement) {
+        continue;
+      }
+
+      s_rule_hits[rule_index].fetch_add(1, std::memory_order_relaxed);
+      changed = true;
+      output.resize(output.size() - rule.window_size);
+      pending.insert(pending.end(), replacement->rbegin(), replacement->rend());
+      break;
+    }
+  }
+
+  return changed;
+}
+
+std::vector<AssemblyInstruction> PeepholeOptimiser::Optimise(const std::vector<AssemblyInstruction>& instructions) {
+  std::vector<AssemblyInstruction> current = instructions;
+  std::vector<AssemblyInstruction> next;
+
+  while (OptimisePass(current, next)) {
+    std::swap(current, next);
+  }
+
+  return current;
+}
+
+bool PeepholeOptimiser::AreFlagsDead(const std::vector<AssemblyInstruction>& pending) {
+  for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+    if (ReadsFlags(it->command)) {
+      return false;
+    }
+    if (WritesFlags(it->command) || it->command == AsmCommand::CALL || it->command == AsmCommand::RET) {
+      return true;
+    }
+    if (it->command == AsmCommand::JMP) {
+      // The target may read them
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<std::pair<std::string_view, uint64_t>> PeepholeOptimiser::GetRuleHits() {
+  std::vector<std::pair<std::string_view, uint64_t>> result;
+  result.reserve(s_rules.size());
+  for (size_t i = 0; i < s_rules.size(); ++i) {
+    result.emplace_back(s_rules[i].name, s_rule_hits[i].load(std::memory_order_relaxed));
+  }
+  return result;
+}
+
+void PeepholeOptimiser::ResetRuleHits() noexcept {
+  for (auto& hits : s_rule_hits) {
+    hits.store(0, std::memory_order_relaxed);
+  }
+}
+
+} // namespace ovum::vm::jit
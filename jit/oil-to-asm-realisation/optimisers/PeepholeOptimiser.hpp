@@ -0,0 +1,60 @@
+#ifndef JIT_PEEPHOLEOPTIMISER_HPP
+#define JIT_PEEPHOLEOPTIMISER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <jit/AsmData.hpp>
+
+namespace ovum::vm::jit {
+
+// Rewrites a window of window_size consecutive instructions,
+// returns std::nullopt if the window does not match the pattern
+using PeepholeRewrite =
+    std::function<std::optional<std::vector<AssemblyInstruction>>(std::span<const AssemblyInstruction> window)>;
+
+struct PeepholeRule {
+  std::string_view name;
+  size_t window_size;
+  PeepholeRewrite rewrite;
+  // The rewrite drops flag writes, it is applied only if no following instruction reads them
+  bool drops_flags = false;
+};
+
+class PeepholeOptimiser {
+public:
+  PeepholeOptimiser() = delete;
+  PeepholeOptimiser(const PeepholeOptimiser&) = delete;
+  PeepholeOptimiser(PeepholeOptimiser&&) = delete;
+  ~PeepholeOptimiser() = delete;
+  PeepholeOptimiser& operator=(const PeepholeOptimiser&) = delete;
+  PeepholeOptimiser& operator=(PeepholeOptimiser&&) = delete;
+
+  // Applies rules with a sliding window until a pass over the whole body matches no rule
+  [[nodiscard]] static std::vector<AssemblyInstruction> Optimise(const std::vector<AssemblyInstruction>& instructions);
+
+  // Rule name and number of rewrites done by it since start or last reset
+  [[nodiscard]] static std::vector<std::pair<std::string_view, uint64_t>> GetRuleHits();
+
+  static void ResetRuleHits() noexcept;
+
+private:
+  static bool OptimisePass(const std::vector<AssemblyInstruction>& instructions,
+                           std::vector<AssemblyInstruction>& output);
+
+  // Pending instructions are in reverse order, the next one is the last
+  static bool AreFlagsDead(const std::vector<AssemblyInstruction>& pending);
+
+  static const std::vector<PeepholeRule> s_rules;
+  static std::vector<std::atomic<uint64_t>> s_rule_hits;
+};
+
+} // namespace ovum::vm::jit
+
+#endif // JIT_PEEPHOLEOPTIMISER_HPP
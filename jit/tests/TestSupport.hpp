@@ -0,0 +1,34 @@
+#ifndef JIT_TESTSUPPORT_HPP
+#define JIT_TESTSUPPORT_HPP
+
+#include <initializer_list>
+#include <iostream>
+#include <string_view>
+#include <utility>
+
+namespace ovum::vm::jit::tests {
+
+using TestCase = std::pair<std::string_view, bool (*)()>;
+
+// Reports a failed expectation and passes the condition through
+inline bool Expect(bool condition, std::string_view description) {
+  if (!condition) {
+    std::cerr << "FAILED: " << description << '\n';
+  }
+  return condition;
+}
+
+// Runs every test even after a failure, the result is the exit code of the test executable
+inline int RunTests(std::initializer_list<TestCase> tests) {
+  int failed = 0;
+  for (const auto& [name, test] : tests) {
+    const bool passed = test();
+    std::cout << (passed ? "passed: " : "FAILED: ") << name << '\n';
+    failed += passed ? 0 : 1;
+  }
+  return failed == 0 ? 0 : 1;
+}
+
+} // namespace ovum::vm::jit::tests
+
+#endif // JIT_TESTSUPPORT_HPP
@@ -0,0 +1,90 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <jit/AsmData.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/PeepholeOptimiser.hpp>
+
+#include "TestSupport.hpp"
+
+// Rewrites of the peephole optimiser, compared by the commands they leave
+
+namespace {
+
+using ovum::vm::jit::AsmCommand;
+using ovum::vm::jit::AssemblyInstruction;
+using ovum::vm::jit::PeepholeOptimiser;
+using ovum::vm::jit::Register;
+using ovum::vm::jit::tests::Expect;
+
+std::vector<AsmCommand> GetCommands(const std::vector<AssemblyInstruction>& instructions) {
+  std::vector<AsmCommand> commands;
+  for (const auto& instr : instructions) {
+    commands.push_back(instr.command);
+  }
+  return commands;
+}
+
+// Pushes and pops nested deeper than any fixed number of passes vanish completely
+bool TestNestedPushPop() {
+  const std::vector<Register> registers = {
+      Register::RAX, Register::RBX, Register::RCX, Register::RDX, Register::RSI, Register::RDI, Register::R8};
+  std::vector<AssemblyInstruction> body;
+  for (Register reg : registers) {
+    body.push_back({AsmCommand::PUSH, {reg}});
+  }
+  for (auto it = registers.rbegin(); it != registers.rend(); ++it) {
+    body.push_back({AsmCommand::POP, {*it}});
+  }
+  return Expect(PeepholeOptimiser::Optimise(body).empty(), "nested push/pop: everything is dropped");
+}
+
+// A rename chain collapses into moves, the moves between the same register are dropped
+bool TestRenameChain() {
+  const std::vector<AssemblyInstruction> body = {{AsmCommand::PUSH, {Register::RAX}},
+                                                 {AsmCommand::POP, {Register::RBX}},
+                                                 {AsmCommand::MOV, {Register::RBX, Register::RBX}},
+                                                 {AsmCommand::PUSH, {Register::RBX}},
+                                                 {AsmCommand::POP, {Register::RCX}}};
+  const auto optimised = PeepholeOptimiser::Optimise(body);
+  return Expect(GetCommands(optimised) == std::vector{AsmCommand::MOV, AsmCommand::MOV}, "rename chain: two moves") &&
+         Expect(optimised[1].get_argument<Register>(0) == Register::RCX, "rename chain: last move writes RCX");
+}
+
+std::vector<AssemblyInstruction> ShiftAdd(std::vector<AssemblyInstruction> following) {
+  std::vector<AssemblyInstruction> body = {{AsmCommand::SHL, {Register::RAX, int64_t{3}}},
+                                           {AsmCommand::ADD, {Register::RAX, Register::RBX}}};
+  body.insert(body.end(), following.begin(), following.end());
+  return body;
+}
+
+// The flags of ADD stay when a later instruction reads them before another one writes them
+bool TestShiftAddFlags() {
+  const std::string label = "peephole_target";
+  bool passed = Expect(GetCommands(PeepholeOptimiser::Optimise(ShiftAdd({}))) == std::vector{AsmCommand::LEA},
+                       "shift add: fused at the end of the body");
+
+  const auto read_later = PeepholeOptimiser::Optimise(
+      ShiftAdd({{AsmCommand::MOV, {Register::RCX, Register::RDX}}, {AsmCommand::JE, {label}}}));
+  passed = Expect(read_later.size() == 4 && read_later[0].command == AsmCommand::SHL,
+                  "shift add: kept when a jump two instructions later reads the flags") &&
+           passed;
+
+  const auto written_first = PeepholeOptimiser::Optimise(ShiftAdd({{AsmCommand::MOV, {Register::RCX, Register::RDX}},
+                                                                    {AsmCommand::CMP, {Register::RCX, int64_t{0}}},
+                                                                    {AsmCommand::JE, {label}}}));
+  passed = Expect(written_first.size() == 4 && written_first[0].command == AsmCommand::LEA,
+                  "shift add: fused when a compare writes the flags before the jump") &&
+           passed;
+
+  const auto jumped = PeepholeOptimiser::Optimise(ShiftAdd({{AsmCommand::JMP, {label}}}));
+  return Expect(jumped.size() == 3, "shift add: kept before a jump, the target may read the flags") && passed;
+}
+
+} // namespace
+
+int main() {
+  return ovum::vm::jit::tests::RunTests({{"nested push/pop", &TestNestedPushPop},
+                                         {"rename chain", &TestRenameChain},
+                                         {"shift add flags", &TestShiftAddFlags}});
+}
@@ -0,0 +1,433 @@
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <jit/CopyAndPatchCompiler.hpp>
+#include <jit/CpuFeatures.hpp>
+#include <jit/JitExecutor.hpp>
+#include <jit/JitFunctionRegistry.hpp>
+#include <jit/ObjectHeap.hpp>
+#include <jit/OilCommandAsmCompiler.hpp>
+#include <jit/VirtualDispatch.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/Inliner.hpp>
+
+#include "TestSupport.hpp"
+
+// Bodies that crashed the process before their fix: frame layout of native calls, division errors and the
+// frame state handed back to the interpreter, also by code entered on the stack. Each case runs in this process,
+// a regression kills it.
+
+namespace {
+
+using ovum::vm::execution_tree::PassedExecutionData;
+using ovum::vm::jit::DeoptTable;
+using ovum::vm::jit::FieldLayout;
+using ovum::vm::jit::Inliner;
+using ovum::vm::jit::JitCompileOptions;
+using ovum::vm::jit::JitExecutor;
+using ovum::vm::jit::JitFunctionRegistry;
+using ovum::vm::jit::ObjectHeap;
+using ovum::vm::jit::ObjectHeapHooks;
+using ovum::vm::jit::OilCommandAsmCompiler;
+using ovum::vm::jit::PackedOilCommand;
+using ovum::vm::jit::VirtualDispatch;
+using ovum::vm::jit::VirtualDispatchHooks;
+using ovum::vm::jit::tests::Expect;
+
+// Runs past the tier-up threshold, so the optimizing tier code runs with call profiles too
+constexpr int kTierUpRuns = 1100;
+// More than the failures of one guard after which code is invalidated
+constexpr int kRepeatedFaults = 30;
+
+// Registered as Call targets are, the executor leaves the registry when destroyed
+std::unique_ptr<JitExecutor> CreateFunction(const std::string& name,
+                                            std::vector<PackedOilCommand> body,
+                                            uint64_t arity,
+                                            const JitCompileOptions& options = {}) {
+  auto executor = std::make_unique<JitExecutor>(std::move(body), name, options);
+  JitFunctionRegistry::RegisterExecutor(name, executor.get());
+  JitFunctionRegistry::SetArity(name, arity);
+  return executor;
+}
+
+// Pads the body above the inlining limits, calls of it stay native calls
+std::vector<PackedOilCommand> PadBody(const std::vector<PackedOilCommand>& body) {
+  std::vector<PackedOilCommand> padded;
+  for (int value = 0; value < 40; ++value) {
+    padded.push_back({"PushInt", {std::to_string(value)}});
+    padded.push_back({"Pop", {}});
+  }
+  padded.insert(padded.end(), body.begin(), body.end());
+  return padded;
+}
+
+template <typename... Locals>
+void EnterFrame(PassedExecutionData& data, Locals... locals) {
+  data.memory.stack_frames.emplace();
+  (data.memory.stack_frames.top().local_variables.push_back(locals), ...);
+}
+
+// Result of a body returning a pointer-sized value, as Run pushes it
+int64_t GetResult(const PassedExecutionData& data) {
+  return static_cast<int64_t>(reinterpret_cast<intptr_t>(std::get<void*>(data.memory.machine_stack.top())));
+}
+
+// Runs a body with two integer locals and compares its result
+bool ExpectResult(JitExecutor& executor, int64_t lhs, int64_t rhs, int64_t expected) {
+  PassedExecutionData data;
+  EnterFrame(data, lhs, rhs);
+  const auto result = executor.Run(data);
+  return result && !executor.TakeResumeIndex() && GetResult(data) == expected;
+}
+
+// A division by zero left to the interpreter, which resumes at the division with both operands on its stack
+bool ExpectDivisionDeopt(JitExecutor& executor, size_t division_index) {
+  PassedExecutionData data;
+  EnterFrame(data, int64_t{7}, int64_t{0});
+  const auto result = executor.Run(data);
+  return result && executor.TakeResumeIndex() == division_index && data.memory.machine_stack.size() == 2 &&
+         std::get<int64_t>(data.memory.machine_stack.top()) == 0;
+}
+
+// A division by zero the frame cannot leave to the interpreter with is reported by Run
+bool ExpectDivisionError(JitExecutor& executor) {
+  PassedExecutionData data;
+  EnterFrame(data, int64_t{7}, int64_t{0});
+  return !executor.Run(data) && !executor.TakeResumeIndex();
+}
+
+// The callee frame reserved by a native call lies inside the static evaluation stack region
+bool TestTwoNativeCalls() {
+  auto callee = CreateFunction("regression_callee", PadBody({{"PushInt", {"21"}}}), 0);
+  auto caller = CreateFunction(
+      "regression_two_calls",
+      {{"Call", {"\"regression_callee\""}}, {"Call", {"\"regression_callee\""}}, {"IntAdd", {}}},
+      0);
+  if (!Expect(callee->TryCompile() && caller->TryCompile(), "two native calls: bodies compile")) {
+    return false;
+  }
+
+  for (int run = 0; run < kTierUpRuns; ++run) {
+    PassedExecutionData data;
+    EnterFrame(data);
+    if (!Expect(caller->Run(data).has_value() && GetResult(data) == 42, "two native calls: result is 42")) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Zero divisions are errors of the program, they never invalidate the code and never reach a bare IDIV
+bool TestRepeatedZeroDivisions() {
+  const std::vector<PackedOilCommand> division = {{"LoadLocal", {"0"}}, {"LoadLocal", {"1"}}, {"IntDivide", {}}};
+  bool passed = true;
+
+  JitCompileOptions without_speculation;
+  without_speculation.speculate = false;
+  JitCompileOptions explicit_checks;
+  explicit_checks.implicit_division_checks = false;
+  for (const JitCompileOptions& options : {JitCompileOptions{}, without_speculation, explicit_checks}) {
+    auto divide = CreateFunction("regression_divide", division, 2, options);
+    passed = Expect(divide->TryCompile(), "zero divisions: body compiles") && passed;
+    for (int run = 0; run < kRepeatedFaults && passed; ++run) {
+      passed = Expect(ExpectDivisionDeopt(*divide, 2), "zero divisions: interpreter resumes at the division");
+    }
+    passed = passed && Expect(ExpectResult(*divide, 42, 5, 8), "zero divisions: code stays installed");
+  }
+
+  // Native callee, and the same division inlined into its caller
+  auto native_callee = CreateFunction("regression_native_divide", PadBody(division), 2);
+  auto inlined_callee = CreateFunction("regression_inlined_divide", division, 2);
+  for (const std::string callee : {"regression_native_divide", "regression_inlined_divide"}) {
+    const std::vector<PackedOilCommand> body = {
+        {"LoadLocal", {"0"}}, {"LoadLocal", {"1"}}, {"Call", {"\"" + callee + "\""}}};
+    const bool inlined = Inliner::Inline(body, "regression_caller").size() != body.size();
+    passed = Expect(inlined == (callee == "regression_inlined_divide"), "zero divisions: small callee is inlined") &&
+             passed;
+
+    auto caller = CreateFunction("regression_caller", body, 2);
+    passed = Expect(caller->TryCompile(), "zero divisions: caller compiles") && passed;
+    for (int run = 0; run < kTierUpRuns && passed; ++run) {
+      passed = Expect(ExpectResult(*caller, 42, 5, 8), "zero divisions: caller result is 8");
+    }
+    for (int run = 0; run < kRepeatedFaults && passed; ++run) {
+      passed = Expect(ExpectDivisionError(*caller), "zero divisions: callee error is reported");
+    }
+  }
+  return passed;
+}
+
+// A null Unwrap hands the frame back with the stack below the Unwrap and resumes at it
+bool TestUnwrapDeopt() {
+  auto unwrap = CreateFunction("regression_unwrap",
+                               {{"PushInt", {"5"}},
+                                {"SetLocal", {"2"}},
+                                {"LoadLocal", {"0"}},
+                                {"LoadLocal", {"1"}},
+                                {"Unwrap", {}},
+                                {"Pop", {}},
+                                {"PushInt", {"1"}},
+                                {"IntAdd", {}}},
+                               2);
+  if (!Expect(unwrap->TryCompile(), "unwrap: body compiles")) {
+    return false;
+  }
+
+  PassedExecutionData data;
+  EnterFrame(data, int64_t{41}, static_cast<void*>(nullptr));
+  const auto result = unwrap->Run(data);
+  if (!Expect(result.has_value() && unwrap->TakeResumeIndex() == 4, "unwrap: interpreter resumes at the Unwrap")) {
+    return false;
+  }
+
+  const auto& locals = data.memory.stack_frames.top().local_variables;
+  auto& stack = data.memory.machine_stack;
+  bool passed = Expect(locals.size() >= 3 && std::get<int64_t>(locals[2]) == 5, "unwrap: stored local is back");
+  passed = Expect(stack.size() == 2 && std::get<void*>(stack.top()) == nullptr, "unwrap: null is on top") && passed;
+  if (stack.size() == 2) {
+    stack.pop();
+    passed = Expect(std::get<int64_t>(stack.top()) == 41, "unwrap: value below the null is kept") && passed;
+  }
+  return passed;
+}
+
+// A vtable whose target cannot be called natively sends the call to the interpreter instead of stopping
+bool TestUncompilableVirtualTarget() {
+  static const int native_vtable = 0;
+  static const int guarded_vtable = 0;
+  static const void* native_object = &native_vtable;
+  static const void* guarded_object = &guarded_vtable;
+
+  VirtualDispatchHooks hooks;
+  hooks.resolve_method = [](const void* vtable, std::string_view) -> std::optional<std::string> {
+    return vtable == &native_vtable ? "regression_native_target" : "regression_guarded_target";
+  };
+  hooks.method_arity = [](std::string_view) -> std::optional<uint64_t> { return 1; };
+  VirtualDispatch::SetHooks(std::move(hooks));
+
+  // Unwrap resumes only in frames entered from the interpreter, the target has no native entry
+  auto native_target = CreateFunction("regression_native_target", {{"PushInt", {"41"}}}, 1);
+  auto guarded_target = CreateFunction("regression_guarded_target", {{"LoadLocal", {"0"}}, {"Unwrap", {}}}, 1);
+  auto caller = CreateFunction(
+      "regression_virtual_caller",
+      {{"LoadLocal", {"0"}}, {"CallVirtual", {"\"regression_method\""}}, {"PushInt", {"1"}}, {"IntAdd", {}}},
+      1);
+  auto native_caller =
+      CreateFunction("regression_virtual_native_caller",
+                     PadBody({{"LoadLocal", {"0"}}, {"Call", {"\"regression_virtual_caller\""}}}),
+                     1);
+  if (!Expect(native_target->TryCompile() && caller->TryCompile() && native_caller->TryCompile(),
+              "virtual target: bodies compile")) {
+    return false;
+  }
+
+  bool passed = true;
+  for (int run = 0; run < kRepeatedFaults && passed; ++run) {
+    PassedExecutionData native_data;
+    EnterFrame(native_data, const_cast<void*>(static_cast<const void*>(&native_object)));
+    passed = Expect(caller->Run(native_data).has_value() && !caller->TakeResumeIndex() && GetResult(native_data) == 42,
+                    "virtual target: native target is called");
+
+    PassedExecutionData guarded_data;
+    EnterFrame(guarded_data, const_cast<void*>(static_cast<const void*>(&guarded_object)));
+    passed = passed && Expect(caller->Run(guarded_data).has_value() && caller->TakeResumeIndex() == 1,
+                              "virtual target: interpreter resumes at the call");
+    passed = passed && Expect(guarded_data.memory.machine_stack.size() == 1 &&
+                                  std::get<void*>(guarded_data.memory.machine_stack.top()) == &guarded_object,
+                              "virtual target: receiver is on the stack");
+  }
+
+  // The native caller cannot resume its callee in the interpreter, the call is reported
+  PassedExecutionData data;
+  EnterFrame(data, const_cast<void*>(static_cast<const void*>(&guarded_object)));
+  return Expect(!native_caller->Run(data) && !native_caller->TakeResumeIndex(),
+                "virtual target: native caller reports the call") &&
+         passed;
+}
+
+// Unwrap checked by the fault of the field access after it leaves as its guard would, the object is null on top
+bool TestImplicitNullFaults() {
+  ObjectHeapHooks hooks;
+  hooks.resolve_field = [](uint64_t field_index) -> std::optional<FieldLayout> {
+    return field_index == 0 ? std::optional<FieldLayout>(FieldLayout{8, false}) : std::nullopt;
+  };
+  ObjectHeap::SetHooks(std::move(hooks));
+
+  const std::vector<PackedOilCommand> get_field = {
+      {"LoadLocal", {"0"}}, {"LoadLocal", {"1"}}, {"Unwrap", {}}, {"GetField", {"0"}}, {"IntAdd", {}}};
+  const std::vector<PackedOilCommand> set_field = {{"LoadLocal", {"0"}},
+                                                   {"LoadLocal", {"1"}},
+                                                   {"Unwrap", {}},
+                                                   {"PushInt", {"5"}},
+                                                   {"SetField", {"0"}},
+                                                   {"LoadLocal", {"1"}},
+                                                   {"GetField", {"0"}},
+                                                   {"IntAdd", {}}};
+  bool passed = true;
+  // Field holds 37 before the body runs, SetField stores 5 into it
+  for (const auto& [body, expected] : {std::pair{get_field, int64_t{42}}, std::pair{set_field, int64_t{10}}}) {
+    // The access is the only check, no explicit compare of the object is emitted
+    std::vector<PackedOilCommand> implicit_body = body;
+    DeoptTable implicit_table;
+    passed = Expect(OilCommandAsmCompiler::Compile(implicit_body, {}, &implicit_table).has_value() &&
+                        implicit_table.fault_sites.size() == 1,
+                    "implicit null: the access is the fault site") &&
+             passed;
+
+    std::vector<PackedOilCommand> explicit_body = body;
+    DeoptTable explicit_table;
+    JitCompileOptions explicit_checks;
+    explicit_checks.implicit_null_checks = false;
+    passed = Expect(OilCommandAsmCompiler::Compile(explicit_body, explicit_checks, &explicit_table).has_value() &&
+                        explicit_table.fault_sites.empty(),
+                    "implicit null: explicit checks have no fault site") &&
+             passed;
+
+    auto unwrap = CreateFunction("regression_implicit_null", body, 2);
+    if (!Expect(unwrap->TryCompile(), "implicit null: body compiles")) {
+      return false;
+    }
+
+    int64_t object[2] = {0, 37};
+    PassedExecutionData data;
+    EnterFrame(data, int64_t{5}, static_cast<void*>(object));
+    passed = Expect(unwrap->Run(data).has_value() && !unwrap->TakeResumeIndex() && GetResult(data) == expected,
+                    "implicit null: field of the object is read") &&
+             passed;
+
+    PassedExecutionData null_data;
+    EnterFrame(null_data, int64_t{5}, static_cast<void*>(nullptr));
+    auto& stack = null_data.memory.machine_stack;
+    passed = Expect(unwrap->Run(null_data).has_value() && unwrap->TakeResumeIndex() == 2,
+                    "implicit null: interpreter resumes at the Unwrap") &&
+             passed;
+    passed = Expect(stack.size() == 2 && std::get<void*>(stack.top()) == nullptr, "implicit null: null is on top") &&
+             passed;
+    if (stack.size() == 2) {
+      stack.pop();
+      passed = Expect(std::get<int64_t>(stack.top()) == 5, "implicit null: value below the null is kept") && passed;
+    }
+  }
+  return passed;
+}
+
+// Code dropped after repeated null Unwraps is compiled again, null is reported by the new code itself
+bool TestUnwrapInvalidation() {
+  auto unwrap = CreateFunction(
+      "regression_unwrap_invalidation", {{"LoadLocal", {"1"}}, {"Unwrap", {}}, {"Pop", {}}, {"LoadLocal", {"0"}}}, 2);
+  if (!Expect(unwrap->TryCompile(), "unwrap invalidation: body compiles")) {
+    return false;
+  }
+
+  bool passed = true;
+  int resumed = 0;
+  for (int run = 0; run < kRepeatedFaults && passed; ++run) {
+    PassedExecutionData data;
+    EnterFrame(data, int64_t{41}, static_cast<void*>(nullptr));
+    const auto result = unwrap->Run(data);
+    const auto resume_index = unwrap->TakeResumeIndex();
+    resumed += resume_index ? 1 : 0;
+    passed = Expect(result.has_value() ? resume_index == 1 : !resume_index, "unwrap invalidation: resumed or reported");
+  }
+  passed = Expect(resumed > 0 && resumed < kRepeatedFaults, "unwrap invalidation: guard is dropped") && passed;
+
+  int64_t object = 0;
+  PassedExecutionData data;
+  EnterFrame(data, int64_t{41}, static_cast<void*>(&object));
+  return Expect(unwrap->Run(data).has_value() && GetResult(data) == 41, "unwrap invalidation: new code runs") &&
+         passed;
+}
+
+// Call results have no type the interpreter could be given, frames holding one report the error instead
+bool TestUntypedFrameErrors() {
+  auto callee = CreateFunction("regression_untyped_callee", PadBody({{"PushInt", {"7"}}}), 0);
+  auto divide = CreateFunction(
+      "regression_untyped_divide",
+      {{"Call", {"\"regression_untyped_callee\""}}, {"LoadLocal", {"0"}}, {"LoadLocal", {"1"}}, {"IntDivide", {}},
+       {"IntAdd", {}}},
+      2);
+  auto unwrap = CreateFunction(
+      "regression_untyped_unwrap",
+      {{"Call", {"\"regression_untyped_callee\""}}, {"LoadLocal", {"1"}}, {"Unwrap", {}}, {"Pop", {}}},
+      2);
+  if (!Expect(callee->TryCompile() && divide->TryCompile() && unwrap->TryCompile(), "untyped frame: bodies compile")) {
+    return false;
+  }
+
+  bool passed = Expect(ExpectResult(*divide, 42, 5, 15), "untyped frame: division result is 15");
+  for (int run = 0; run < kRepeatedFaults && passed; ++run) {
+    passed = Expect(ExpectDivisionError(*divide), "untyped frame: zero division is reported");
+  }
+
+  int64_t object = 0;
+  PassedExecutionData data;
+  EnterFrame(data, int64_t{0}, static_cast<void*>(&object));
+  passed = Expect(unwrap->Run(data).has_value() && !unwrap->TakeResumeIndex() && GetResult(data) == 7,
+                  "untyped frame: unwrap result is 7") &&
+           passed;
+  for (int run = 0; run < kRepeatedFaults && passed; ++run) {
+    PassedExecutionData null_data;
+    EnterFrame(null_data, int64_t{0}, static_cast<void*>(nullptr));
+    passed = Expect(!unwrap->Run(null_data) && !unwrap->TakeResumeIndex(), "untyped frame: null unwrap is reported");
+  }
+  return passed;
+}
+
+// Code entered in the middle of the body reports positions in the whole body when it leaves
+bool TestOsrEntryDeopt() {
+  auto osr = CreateFunction("regression_osr",
+                            {{"LoadLocal", {"0"}},
+                             {"LoadLocal", {"1"}},
+                             {"PushInt", {"1"}},
+                             {"IntAdd", {}},
+                             {"IntDivide", {}},
+                             {"PushInt", {"2"}},
+                             {"IntMultiply", {}}},
+                            2);
+
+  // The interpreter has run the two loads, their values are on its stack
+  const auto run_from_divisor = [&osr](int64_t divisor, PassedExecutionData& data) {
+    EnterFrame(data, int64_t{42}, divisor);
+    data.memory.machine_stack.push(int64_t{42});
+    data.memory.machine_stack.push(divisor);
+    return osr->RunFrom(data, 2);
+  };
+
+  PassedExecutionData data;
+  bool passed = Expect(run_from_divisor(6, data).has_value() && !osr->TakeResumeIndex() &&
+                           data.memory.machine_stack.size() == 1 && GetResult(data) == 12,
+                       "osr entry: result of the rest of the body");
+
+  PassedExecutionData zero_data;
+  passed = Expect(run_from_divisor(-1, zero_data).has_value() && osr->TakeResumeIndex() == 4,
+                  "osr entry: interpreter resumes at the division") &&
+           passed;
+  auto& stack = zero_data.memory.machine_stack;
+  passed = Expect(stack.size() == 2 && std::get<int64_t>(stack.top()) == 0, "osr entry: divisor is on top") && passed;
+  if (stack.size() == 2) {
+    stack.pop();
+    passed = Expect(std::get<int64_t>(stack.top()) == 42, "osr entry: dividend is below it") && passed;
+  }
+  return passed;
+}
+
+} // namespace
+
+int main() {
+  ovum::vm::jit::OilCommandAsmCompiler::InitializeStandardAssemblers(ovum::vm::jit::CpuFeatures::Detect());
+  ovum::vm::jit::CopyAndPatchCompiler::InitializeTemplates();
+
+  return ovum::vm::jit::tests::RunTests({{"two native calls", &TestTwoNativeCalls},
+                                         {"repeated zero divisions", &TestRepeatedZeroDivisions},
+                                         {"unwrap deopt", &TestUnwrapDeopt},
+                                         {"uncompilable virtual target", &TestUncompilableVirtualTarget},
+                                         {"osr entry deopt", &TestOsrEntryDeopt},
+                                         {"untyped frame errors", &TestUntypedFrameErrors},
+                                         {"unwrap invalidation", &TestUnwrapInvalidation},
+                                         {"implicit null faults", &TestImplicitNullFaults}});
+}
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <jit/AsmData.hpp>
+#include <jit/CpuFeatures.hpp>
+#include <jit/oil-to-asm-realisation/optimisers/InstructionScheduler.hpp>
+
+#include "TestSupport.hpp"
+
+// Dependences the instruction scheduler has to keep for every target: registers, flags, memory accesses and the
+// labels, branches and calls that split the runs. Instructions of a body are distinct, so each is found again.
+
+namespace {
+
+using ovum::vm::jit::addr;
+using ovum::vm::jit::AsmCommand;
+using ovum::vm::jit::AssemblyInstruction;
+using ovum::vm::jit::InstructionScheduler;
+using ovum::vm::jit::Microarchitecture;
+using ovum::vm::jit::Register;
+using ovum::vm::jit::tests::Expect;
+
+// Instruction at index before in the body has to stay in front of the one at index after
+struct Dependence {
+  size_t before;
+  size_t after;
+  std::string description;
+};
+
+size_t Find(const std::vector<AssemblyInstruction>& instructions, const AssemblyInstruction& instruction) {
+  return static_cast<size_t>(std::find(instructions.begin(), instructions.end(), instruction) - instructions.begin());
+}
+
+// Instructions at the indices of fixed keep their place
+bool ExpectScheduled(const std::string& name,
+                     const std::vector<AssemblyInstruction>& body,
+                     const std::vector<Dependence>& dependences,
+                     const std::vector<size_t>& fixed = {}) {
+  bool passed = true;
+  for (const Microarchitecture target :
+       {Microarchitecture::kGeneric, Microarchitecture::kIntelCore, Microarchitecture::kAmdZen}) {
+    const auto scheduled = InstructionScheduler::Schedule(body, target);
+    const std::string prefix = name + " on target " + std::to_string(static_cast<int>(target)) + ": ";
+    if (!Expect(std::is_permutation(body.begin(), body.end(), scheduled.begin(), scheduled.end()),
+                prefix + "the same instructions")) {
+      passed = false;
+      continue;
+    }
+
+    for (const Dependence& dependence : dependences) {
+      passed = Expect(Find(scheduled, body[dependence.before]) < Find(scheduled, body[dependence.after]),
+                      prefix + dependence.description) &&
+               passed;
+    }
+    for (const size_t index : fixed) {
+      passed = Expect(scheduled[index] == body[index], prefix + "instruction " + std::to_string(index) + " stays") &&
+               passed;
+      for (size_t i = 0; i < index; ++i) {
+        passed = Expect(Find(body, scheduled[i]) < index,
+                        prefix + "instruction " + std::to_string(i) + " stays before " + std::to_string(index)) &&
+                 passed;
+      }
+    }
+  }
+  return passed;
+}
+
+// Reads after writes, writes after reads and writes after writes of a register
+bool TestRegisterDependences() {
+  const std::vector<AssemblyInstruction> body = {{AsmCommand::MOV, {Register::RAX, addr(Register::RSP, 0)}},
+                                                 {AsmCommand::IMUL, {Register::RAX, Register::RBX}},
+                                                 {AsmCommand::MOV, {Register::RCX, Register::RAX}},
+                                                 {AsmCommand::MOV, {Register::RAX, int64_t{7}}},
+                                                 {AsmCommand::MOV, {Register::RDX, addr(Register::RSP, 8)}},
+                                                 {AsmCommand::ADD, {Register::RDX, int64_t{1}}}};
+  bool passed = ExpectScheduled("registers",
+                                body,
+                                {{0, 1, "multiplication reads the load"},
+                                 {1, 2, "move reads the product"},
+                                 {2, 3, "overwrite waits for the read"},
+                                 {1, 3, "overwrite waits for the earlier write"},
+                                 {4, 5, "addition reads the second load"}});
+
+  // The independent load fills the latency of the first one
+  bool reordered = false;
+  for (const Microarchitecture target :
+       {Microarchitecture::kGeneric, Microarchitecture::kIntelCore, Microarchitecture::kAmdZen}) {
+    reordered = reordered || InstructionScheduler::Schedule(body, target) != body;
+  }
+  return Expect(reordered, "registers: independent instructions are reordered") && passed;
+}
+
+// Flags are a register of their own, a partial register write depends on its full register
+bool TestFlagDependences() {
+  const std::vector<AssemblyInstruction> body = {{AsmCommand::CMP, {Register::RCX, Register::RDX}},
+                                                 {AsmCommand::MOV, {Register::RSI, addr(Register::RSP, 16)}},
+                                                 {AsmCommand::SETZ, {Register::AL}},
+                                                 {AsmCommand::ADD, {Register::RSI, Register::RDI}},
+                                                 {AsmCommand::MOVZX, {Register::RAX, Register::AL}},
+                                                 {AsmCommand::MOV, {Register::R8, Register::RAX}}};
+  return ExpectScheduled("flags",
+                         body,
+                         {{0, 2, "set reads the flags of the compare"},
+                          {2, 3, "addition overwrites the flags after they are read"},
+                          {0, 3, "flags are written in order"},
+                          {1, 3, "addition reads the load"},
+                          {2, 4, "extension reads the byte"},
+                          {4, 5, "move reads the extended register"}});
+}
+
+// Accesses through other registers than RSP may alias anything, RSP slots only the slots they overlap
+bool TestMemoryDependences() {
+  const std::vector<AssemblyInstruction> body = {{AsmCommand::MOV, {addr(Register::RBX, 0), Register::RAX}},
+                                                 {AsmCommand::MOV, {Register::RCX, addr(Register::RDX, 0)}},
+                                                 {AsmCommand::MOV, {addr(Register::RSP, 8), Register::RSI}},
+                                                 {AsmCommand::MOV, {Register::RDI, addr(Register::RSP, 8)}},
+                                                 {AsmCommand::MOV, {Register::R8, addr(Register::RSP, 16)}},
+                                                 {AsmCommand::MOV, {addr(Register::RBX, 8), Register::R9}},
+                                                 {AsmCommand::IMUL, {Register::R8, Register::R8}}};
+  return ExpectScheduled("memory",
+                         body,
+                         {{0, 1, "load may read the store before it"},
+                          {0, 2, "slot store may overwrite the pointed to memory"},
+                          {1, 2, "slot store may overwrite the loaded memory"},
+                          {2, 3, "slot load reads the slot store"},
+                          {1, 5, "store waits for the load it may overwrite"},
+                          {0, 5, "stores stay in order"},
+                          {4, 5, "store waits for the slot load it may overwrite"},
+                          {4, 6, "multiplication reads the slot load"}});
+}
+
+// Labels, the fault sites right after them, branches and calls keep their places, nothing moves across them
+bool TestBarriers() {
+  const std::string label = "scheduler_target";
+  const std::vector<AssemblyInstruction> body = {{AsmCommand::MOV, {Register::RAX, addr(Register::RSP, 0)}},
+                                                 {AsmCommand::IMUL, {Register::RAX, Register::RAX}},
+                                                 {AsmCommand::MOV, {Register::RCX, int64_t{5}}},
+                                                 {AsmCommand::LABEL, {label}},
+                                                 {AsmCommand::MOV, {Register::RDX, addr(Register::RSP, 8)}},
+                                                 {AsmCommand::IMUL, {Register::RDX, Register::RDX}},
+                                                 {AsmCommand::MOV, {Register::RSI, int64_t{6}}},
+                                                 {AsmCommand::CALL, {Register::R11}},
+                                                 {AsmCommand::MOV, {Register::RDI, addr(Register::RSP, 16)}},
+                                                 {AsmCommand::MOV, {Register::R8, int64_t{1}}},
+                                                 {AsmCommand::CMP, {Register::RDI, int64_t{0}}},
+                                                 {AsmCommand::JE, {label}},
+                                                 {AsmCommand::MOV, {Register::R9, int64_t{2}}}};
+  return ExpectScheduled("barriers", body, {{0, 1, "multiplication reads the load"}}, {3, 4, 7, 11, 12});
+}
+
+} // namespace
+
+int main() {
+  return ovum::vm::jit::tests::RunTests({{"register dependences", &TestRegisterDependences},
+                                         {"flag dependences", &TestFlagDependences},
+                                         {"memory dependences", &TestMemoryDependences},
+                                         {"barriers", &TestBarriers}});
+}
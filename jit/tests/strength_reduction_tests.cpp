@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <jit/CpuFeatures.hpp>
+#include <jit/JitExecutor.hpp>
+#include <jit/OilCommandAsmCompiler.hpp>
+
+#include "TestSupport.hpp"
+
+// Divisions and modulos by a pushed constant, reduced to multiplications by the reciprocal, shifts and masks,
+// compared with the C++ operators over dividends around the multiples of the divisor and the limits
+
+namespace {
+
+using ovum::vm::execution_tree::PassedExecutionData;
+using ovum::vm::jit::AsmCommand;
+using ovum::vm::jit::JitCompileTier;
+using ovum::vm::jit::JitExecutor;
+using ovum::vm::jit::OilCommandAsmCompiler;
+using ovum::vm::jit::PackedOilCommand;
+using ovum::vm::jit::tests::Expect;
+
+constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+
+// Runs past the tier-up threshold, the optimizing tier reduces the division
+constexpr int kTierUpRuns = 1100;
+
+// Divisors of every shift the magic numbers get, of both signs, with and without the multiplier correction
+const std::vector<int64_t> kDivisors = {2,
+                                        3,
+                                        5,
+                                        6,
+                                        7,
+                                        10,
+                                        12,
+                                        25,
+                                        100,
+                                        641,
+                                        -2,
+                                        -3,
+                                        -7,
+                                        -10,
+                                        -100,
+                                        1000000007,
+                                        0x123456789,
+                                        int64_t{1} << 31,
+                                        int64_t{1} << 40,
+                                        -(int64_t{1} << 40),
+                                        (int64_t{1} << 40) + 1,
+                                        3 * (int64_t{1} << 40),
+                                        kMax,
+                                        kMin + 1};
+
+// Dividends next to the limits and to the multiples of the divisor, where a wrong magic number is off by one
+std::vector<int64_t> GetDividends(int64_t divisor) {
+  std::vector<int64_t> dividends = {0, 1, -1, 2, -2, 12345, -12345, kMax, kMin};
+  // Products of the divisor and these fit into 64 bits
+  for (const int64_t multiple : {int64_t{1}, int64_t{-1}, kMax / divisor / 2, kMax / divisor, kMin / divisor}) {
+    const int64_t product = divisor * multiple;
+    for (const int64_t step : {int64_t{-1}, int64_t{0}, int64_t{1}}) {
+      if ((step < 0 && product == kMin) || (step > 0 && product == kMax)) {
+        continue;
+      }
+      dividends.push_back(product + step);
+    }
+  }
+  return dividends;
+}
+
+int64_t Run(JitExecutor& executor, int64_t dividend) {
+  PassedExecutionData data;
+  data.memory.stack_frames.emplace();
+  data.memory.stack_frames.top().local_variables.emplace_back(dividend);
+  if (!executor.Run(data) || executor.TakeResumeIndex()) {
+    return 0;
+  }
+  return static_cast<int64_t>(reinterpret_cast<intptr_t>(std::get<void*>(data.memory.machine_stack.top())));
+}
+
+bool TestOperation(const std::string& command_name) {
+  const bool is_modulo = command_name == "IntModulo";
+  bool passed = true;
+  for (const int64_t divisor : kDivisors) {
+    std::vector<PackedOilCommand> body = {
+        {"LoadLocal", {"0"}}, {"PushInt", {std::to_string(divisor)}}, {command_name, {}}};
+    const std::string description = command_name + " by " + std::to_string(divisor);
+
+    const auto code = OilCommandAsmCompiler::Compile(body, {});
+    const bool reduced = code && std::none_of(code->begin(), code->end(), [](const auto& instruction) {
+                           return instruction.command == AsmCommand::IDIV;
+                         });
+    passed = Expect(reduced, description + ": no IDIV is left") && passed;
+
+    JitExecutor executor(body, "strength_reduction_" + description, {});
+    if (!Expect(executor.TryCompile(), description + ": body compiles")) {
+      passed = false;
+      continue;
+    }
+    for (int run = 0; run < kTierUpRuns; ++run) {
+      (void)Run(executor, 1);
+    }
+    passed = Expect(executor.GetCompileTier() == JitCompileTier::kOptimizing, description + ": optimizing tier") &&
+             passed;
+
+    for (const int64_t dividend : GetDividends(divisor)) {
+      const int64_t expected = is_modulo ? dividend % divisor : dividend / divisor;
+      passed = Expect(Run(executor, dividend) == expected, description + " of " + std::to_string(dividend)) && passed;
+    }
+  }
+  return passed;
+}
+
+bool TestDivision() {
+  return TestOperation("IntDivide");
+}
+
+bool TestModulo() {
+  return TestOperation("IntModulo");
+}
+
+} // namespace
+
+int main() {
+  OilCommandAsmCompiler::InitializeStandardAssemblers(ovum::vm::jit::CpuFeatures::Detect());
+  return ovum::vm::jit::tests::RunTests(
+      {{"division by constants", &TestDivision}, {"modulo by constants", &TestModulo}});
+}